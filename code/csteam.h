@@ -39,7 +39,7 @@ typedef struct {
     int owner;
 } player_info_t;
 
-#define MPVERSION 90
+#define MPVERSION 91
     
 typedef struct {
     int version;
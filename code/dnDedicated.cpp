@@ -0,0 +1,268 @@
+//
+//  dnDedicated.cpp
+//  duke3d
+//
+//  Headless host for -net games: no window, sound or GUI
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "SDL.h"
+#include "dnAPI.h"
+
+extern "C" {
+#include "build.h"
+#include "osd.h"
+#include "duke3d.h"
+#include "mmulti.h"
+}
+
+#include "dnMulti.h"
+#include "dnDedicated.h"
+
+typedef struct {
+	long tics;
+	double simTime;		// ms spent in moveloop() on the tics above
+	double simMax;		// slowest single tic
+	double gapMax;		// longest wait between two moveloop() calls that ran tics
+	double lastTicTime;
+	int resyncs;
+} hostStats_t;
+
+typedef struct {
+	long lastFifoEnd;
+	long tics;			// inputs received
+	long lag;			// how many tics the host's input is ahead of this peer's
+	long maxLag;
+	int packets;
+	int bytes;
+} peerStats_t;
+
+static hostStats_t hostStats;
+static peerStats_t peerStats[MAXPLAYERS];
+static double statsStart;
+static char wasOutOfSync = 0;
+
+static
+void dnResetStats( void ) {
+	memset( &hostStats, 0, sizeof( hostStats ) );
+	for ( int i = 0; i < MAXPLAYERS; i++ ) {
+		memset( &peerStats[i], 0, sizeof( peerStats_t ) );
+		peerStats[i].lastFifoEnd = movefifoend[i];
+	}
+	statsStart = Sys_GetTicks();
+}
+
+static
+void dnLogStats( void ) {
+	double elapsed = ( Sys_GetTicks() - statsStart ) / 1000.0;
+
+	initprintf( "Host: %ld tics in %.1fs (%.1f/s), tic %.2f ms avg %.2f ms max, longest gap %.1f ms, %d resyncs\n",
+		hostStats.tics, elapsed, elapsed > 0.0 ? hostStats.tics / elapsed : 0.0,
+		hostStats.tics ? hostStats.simTime / hostStats.tics : 0.0, hostStats.simMax,
+		hostStats.gapMax, hostStats.resyncs );
+
+	dnIterClients( i ) {
+		peerStats_t *peer = &peerStats[i];
+		initprintf( "  %d %s: %ld tics, lag %ld (max %ld), min lag %ld, %d packets, %d bytes\n",
+			i, ud.user_name[i], peer->tics, peer->lag, peer->maxLag, myminlag[i], peer->packets, peer->bytes );
+	}
+
+	dnResetStats();
+}
+
+static
+void dnSamplePeers( void ) {
+	dnIterClients( i ) {
+		peerStats_t *peer = &peerStats[i];
+
+		// clearfifo() rewinds the fifos when a level starts
+		if ( movefifoend[i] > peer->lastFifoEnd ) {
+			peer->tics += movefifoend[i] - peer->lastFifoEnd;
+		}
+		peer->lastFifoEnd = movefifoend[i];
+
+		peer->lag = movefifoend[myconnectindex] - movefifoend[i];
+		peer->maxLag = max( peer->maxLag, peer->lag );
+	}
+}
+
+extern "C"
+void dnDedicatedNotePacket( int playerIndex, int size ) {
+	if ( playerIndex >= 0 && playerIndex < MAXPLAYERS ) {
+		peerStats[playerIndex].packets++;
+		peerStats[playerIndex].bytes += size;
+	}
+}
+
+static
+void dnTimedMoveLoop( void ) {
+	long before = movefifoplc;
+	double start = Sys_GetTicks();
+	double took;
+	long ran;
+
+	moveloop();
+
+	took = Sys_GetTicks() - start;
+	ran = movefifoplc - before;
+	if ( ran <= 0 ) {
+		return;
+	}
+
+	hostStats.tics += ran;
+	hostStats.simTime += took;
+	hostStats.simMax = max( hostStats.simMax, took / ran );
+	if ( hostStats.lastTicTime > 0.0 ) {
+		hostStats.gapMax = max( hostStats.gapMax, start - hostStats.lastTicTime );
+	}
+	hostStats.lastTicTime = start;
+}
+
+static
+void dnSleepUntilNextTic( void ) {
+	long clocks = ototalclock + TICSPERFRAME - totalclock;
+	long ms = clocks * 1000 / TICRATE;
+
+	SDL_Delay( (Uint32)min( max( ms, 1 ), DEDICATED_MAXSLEEP ) );
+}
+
+static
+void dnDedicatedStartGame( void ) {
+	char packet[11 + BMAX_PATH];
+	int size;
+
+	if ( boardfilename[0] ) {
+		ud.m_level_number = 7;
+		ud.m_volume_number = 0;
+	}
+
+	// every peer has to know the host sits out, so they all simulate the same players
+	dedicatedhost = 1;
+
+	packet[0] = boardfilename[0] ? 8 : 5;
+	packet[1] = ud.m_level_number;
+	packet[2] = ud.m_volume_number;
+	packet[3] = ud.m_player_skill;
+	packet[4] = ud.m_monsters_off;
+	packet[5] = ud.m_respawn_monsters;
+	packet[6] = ud.m_respawn_items;
+	packet[7] = ud.m_respawn_inventory;
+	packet[8] = ud.m_coop;
+	packet[9] = ud.m_marker;
+	if ( boardfilename[0] ) {
+		// the map name goes where ffire would, getpackets reads it from there
+		strcpy( &packet[10], boardfilename );
+		size = 10 + strlen( boardfilename ) + 1;
+		packet[size++] = 1;
+		initprintf( "Starting user map %s\n", boardfilename );
+	} else {
+		packet[10] = ud.m_ffire;
+		packet[11] = 1;
+		size = 12;
+		initprintf( "Starting E%dL%d, skill %d\n", ud.m_volume_number + 1, ud.m_level_number + 1, ud.m_player_skill );
+	}
+
+	dnIterClients( i ) {
+		sendpacket( i, packet, size );
+	}
+
+	dnIterPlayers( i ) {
+		resetweapons( i );
+		resetinventory( i );
+	}
+
+	newgame( ud.m_volume_number, ud.m_level_number, ud.m_player_skill );
+	ud.coop = ud.m_coop;
+
+	if ( enterlevel( MODE_GAME ) ) {
+		gameexit( "Could not load the level." );
+	}
+}
+
+static
+void dnDedicatedNextLevel( void ) {
+	if ( ps[myconnectindex].gm & MODE_EOL ) {
+		closedemowrite();
+
+		// the clients show the bonus screen, the host waits for them in enterlevel()
+		if ( ud.eog ) {
+			ud.eog = 0;
+			ud.m_level_number = ud.level_number = 0;
+		}
+		initprintf( "Level over, next E%dL%d\n", ud.volume_number + 1, ud.level_number + 1 );
+	}
+
+	ready2send = 0;
+	ps[myconnectindex].gm = MODE_GAME;
+	if ( enterlevel( MODE_GAME ) ) {
+		gameexit( "Could not load the level." );
+	}
+	dnResetStats();
+}
+
+static
+int dnNumClients( void ) {
+	int count = 0;
+	dnIterClients( i ) {
+		if ( playerquitflag[i] ) {
+			count++;
+		}
+	}
+	return count;
+}
+
+extern "C"
+void dnDedicatedRun( void ) {
+	if ( numplayers < 2 || myconnectindex != connecthead ) {
+		gameexit( "--dedicated needs -net, with this machine as the first player." );
+		return;
+	}
+
+	initprintf( "Dedicated host for %ld players\n", numplayers );
+
+	dnDedicatedStartGame();
+	dnResetStats();
+
+	while ( !( ps[myconnectindex].gm & MODE_END ) ) {
+		handleevents();
+		if ( quitevent ) {
+			break;
+		}
+		OSD_DispatchQueued();
+
+		if ( ps[myconnectindex].gm & MODE_GAME ) {
+			dnTimedMoveLoop();
+		}
+
+		if ( ps[myconnectindex].gm & ( MODE_EOL | MODE_RESTART ) ) {
+			dnDedicatedNextLevel();
+			continue;
+		}
+
+		checksync();
+		if ( ( syncstat || syncstate ) && !wasOutOfSync ) {
+			hostStats.resyncs++;
+		}
+		wasOutOfSync = syncstat || syncstate;
+
+		while ( ready2send && totalclock >= ototalclock + TICSPERFRAME ) {
+			faketimerhandler();
+		}
+
+		dnSamplePeers();
+
+		if ( dnNumClients() == 0 ) {
+			initprintf( "All players have left\n" );
+			break;
+		}
+
+		if ( Sys_GetTicks() - statsStart >= DEDICATED_STATSINTERVAL ) {
+			dnLogStats();
+		}
+
+		dnSleepUntilNextTic();
+	}
+
+	gameexit( " " );
+}
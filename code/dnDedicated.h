@@ -0,0 +1,52 @@
+//
+//  dnDedicated.h
+//  duke3d
+//
+//  Headless host for -net games: no window, sound or GUI
+//
+
+#ifndef DNDEDICATED_H
+#define DNDEDICATED_H
+
+/*
+
+ Started with --dedicated, the game sets up the engine, the CONs, the art headers and the network,
+ but never opens a video mode, starts sound or music, or brings up the GUI. SDL is pointed at its
+ dummy video and audio drivers so it runs on a machine without a display.
+
+ The host must be the first player of the -net list. It sends the other players the level given
+ on the command line (-v/-l/-s/-c/-t, or -map for a user map), enters it without drawing anything
+ and then only runs the game: the master side of faketimerhandler/getpackets, domovethings and the
+ snapshot serving in dnWaitForClients. It sleeps until the next tic instead of rendering frames.
+
+ The host still takes player slot 0, as master/slave needs it to, but the start packet tells every
+ peer it is a dedicated host (dedicatedhost in dnMulti.h). Its player gets no spawn point and a
+ hidden, non-blocking sprite that is never moved, hurt, targeted or counted: dnIterPlaying skips it
+ in the game logic, the frag bar and the scoreboard. When the level ends it goes straight on to the
+ next one, and it quits once every other player has left.
+
+ Only JF -net games are supported. The Megaton/Steam lobby (GUI::NewNetworkGame, dnWaitForClients)
+ starts its games from the GUI and can't be hosted this way; dnEnterMultiMode clears dedicatedhost.
+
+ Every DEDICATED_STATSINTERVAL ms it logs the tic rate, how long the tics took to simulate and,
+ for every peer, how far behind the host its input is.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEDICATED_STATSINTERVAL 10000	// ms
+#define DEDICATED_MAXSLEEP 4			// ms, so input that arrives between tics isn't kept waiting
+
+extern int dedicated;
+
+void dnDedicatedRun( void );
+void dnDedicatedNotePacket( int playerIndex, int size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNDEDICATED_H */
@@ -0,0 +1,523 @@
+//
+//  dnDemo.cpp
+//  duke3d
+//
+//  Seekable demos: keyframe snapshots and a tic index around the recorded input
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dnAPI.h"
+
+extern "C" {
+#include "build.h"
+#include "duke3d.h"
+#include "crc32.h"
+#include "workers.h"
+#include "lz4.h"
+#include "osd.h"
+}
+
+#include "dnMulti.h"
+#include "dnSnapshot.h"
+#include "dnDemo.h"
+
+#define TICSPERSECOND ( TICRATE / TICSPERFRAME )
+
+typedef struct {
+	int tic;
+	int offset;
+} keyframeEntry_t;
+
+static int keyframeSecs = DEMO_DEFAULTKEYFRAMESECS;
+static int verify = 1;
+
+static keyframeEntry_t *keyframes = NULL;
+static int keyframeCount, keyframeAlloc;
+static snapshot_t *scratch = NULL;
+
+// recording
+static int writeInterval;
+static long lastKeyframeTic;
+
+// playback
+static bool seekable = false;
+static bool indexLoaded;
+static long totalRecords, indexOffset, blocksStart, walkedRecords;
+static long fastForwardTo = -1;
+static int desyncs;
+static bool seekPending = false;
+static long seekMs;
+static int seekRelative;
+
+static
+snapshot_t *dnScratchSnapshot( void ) {
+	if ( !scratch ) {
+		scratch = (snapshot_t*)calloc( 1, sizeof( snapshot_t ) );
+	}
+	return scratch;
+}
+
+static
+unsigned int dnStateHash( void ) {
+	snapshot_t *snapshot = dnScratchSnapshot();
+	dnTakeSnapshot( snapshot );
+	return (unsigned int)crc32once( (unsigned char*)snapshot, sizeof( snapshot_t ) );
+}
+
+static
+void dnAddKeyframe( long tic, long offset ) {
+	if ( keyframeCount == keyframeAlloc ) {
+		keyframeAlloc = keyframeAlloc ? keyframeAlloc * 2 : 64;
+		keyframes = (keyframeEntry_t*)realloc( keyframes, keyframeAlloc * sizeof( keyframeEntry_t ) );
+	}
+	keyframes[keyframeCount].tic = tic;
+	keyframes[keyframeCount].offset = offset;
+	keyframeCount++;
+}
+
+static
+long dnCurrentTic( void ) {
+	return ud.multimode > 0 ? ( totalRecords - ud.reccnt ) / ud.multimode : 0;
+}
+
+static
+long dnTotalTics( void ) {
+	return ud.multimode > 0 ? totalRecords / ud.multimode : 0;
+}
+
+extern "C"
+void dnDemoSetKeyframeInterval( int seconds ) {
+	keyframeSecs = max( seconds, 0 );
+}
+
+extern "C"
+int dnDemoGetKeyframeInterval( void ) {
+	return keyframeSecs;
+}
+
+extern "C"
+void dnDemoSetVerify( int on ) {
+	verify = on != 0;
+}
+
+extern "C"
+int dnDemoGetVerify( void ) {
+	return verify;
+}
+
+extern "C"
+void dnDemoWriteHeader( BFILE *fil ) {
+	int header[4];
+
+	writeInterval = keyframeSecs * TICSPERSECOND;
+	lastKeyframeTic = -1;
+	keyframeCount = 0;
+
+	header[0] = DEMO_MAGIC;
+	header[1] = 0;				// record count and index offset, filled in by dnDemoFinishWrite
+	header[2] = 0;
+	header[3] = writeInterval | ( dedicatedhost ? DEMO_DEDICATEDHOST : 0 );
+	fwrite( header, sizeof( header ), 1, fil );
+}
+
+extern "C"
+int dnDemoKeyframeDue( long tic ) {
+	return writeInterval > 0 && tic % writeInterval == 0 && tic != lastKeyframeTic;
+}
+
+// the jobs below run on the background thread, in the order they were queued, and the file
+// and the keyframe index are theirs until the demo has been closed
+typedef struct {
+	BFILE *fil;
+	long tic;
+	long tics, recordSize;
+	long records;
+	void *data;
+} demoJob_t;
+
+static
+demoJob_t *dnNewJob( BFILE *fil, void *data ) {
+	demoJob_t *job = (demoJob_t*)calloc( 1, sizeof( demoJob_t ) );
+	job->fil = fil;
+	job->data = data;
+	return job;
+}
+
+static
+void dnWriteInputsJob( void *arg ) {
+	demoJob_t *job = (demoJob_t*)arg;
+	long size = job->tics * job->recordSize;
+	char *packed = (char*)malloc( LZ4_compressBound( size ) );
+	char tag = DEMO_BLOCK_LZ4INPUT;
+	int block[2];
+
+	block[0] = job->tics;
+	block[1] = LZ4_compress( (char*)job->data, packed, size );
+	fwrite( &tag, 1, 1, job->fil );
+	fwrite( block, sizeof( block ), 1, job->fil );
+	fwrite( packed, 1, block[1], job->fil );
+
+	free( packed );
+	free( job->data );
+	free( job );
+}
+
+static
+void dnWriteKeyframeJob( void *arg ) {
+	demoJob_t *job = (demoJob_t*)arg;
+	const snapshot_t *snapshot = (const snapshot_t*)job->data;
+	compressedSnapshot_t *compressed = dnCompressSnapshot( snapshot );
+	char tag = DEMO_BLOCK_KEYFRAME;
+	int block[3];
+
+	block[0] = job->tic;
+	block[1] = crc32once( (unsigned char*)snapshot, sizeof( snapshot_t ) );
+	block[2] = compressed->size;
+
+	dnAddKeyframe( job->tic, ftell( job->fil ) );
+	fwrite( &tag, 1, 1, job->fil );
+	fwrite( block, sizeof( block ), 1, job->fil );
+	fwrite( &compressed->data[0], 1, compressed->size, job->fil );
+
+	free( compressed );
+	free( job->data );
+	free( job );
+}
+
+static
+void dnFinishWriteJob( void *arg ) {
+	demoJob_t *job = (demoJob_t*)arg;
+	int header[2];
+
+	header[0] = job->records;
+	header[1] = ftell( job->fil );
+	fwrite( &keyframeCount, sizeof( int ), 1, job->fil );
+	fwrite( keyframes, sizeof( keyframeEntry_t ), keyframeCount, job->fil );
+
+	fseek( job->fil, sizeof( int ), SEEK_SET );
+	fwrite( header, sizeof( header ), 1, job->fil );
+	fclose( job->fil );
+	keyframeCount = 0;
+	free( job );
+}
+
+extern "C"
+void dnDemoWriteInputs( BFILE *fil, void *records, long tics, long recordSize ) {
+	demoJob_t *job;
+
+	if ( tics <= 0 ) {
+		return;
+	}
+
+	job = dnNewJob( fil, malloc( tics * recordSize ) );
+	job->tics = tics;
+	job->recordSize = recordSize;
+	memcpy( job->data, records, tics * recordSize );
+	runbackground( dnWriteInputsJob, job );
+}
+
+extern "C"
+void dnDemoWriteKeyframe( BFILE *fil, long tic ) {
+	demoJob_t *job = dnNewJob( fil, calloc( 1, sizeof( snapshot_t ) ) );
+
+	job->tic = tic;
+	dnTakeSnapshot( (snapshot_t*)job->data );
+	runbackground( dnWriteKeyframeJob, job );
+	lastKeyframeTic = tic;
+}
+
+extern "C"
+void dnDemoFinishWrite( BFILE *fil, long records ) {
+	demoJob_t *job = dnNewJob( fil, NULL );
+
+	job->records = records;
+	runbackground( dnFinishWriteJob, job );
+}
+
+extern "C"
+int dnDemoReadHeader( long fil, long *records ) {
+	int header[3];
+
+	if ( kread( fil, header, sizeof( header ) ) != sizeof( header ) || header[0] < 0 ) {
+		return 0;
+	}
+	*records = totalRecords = header[0];
+	indexOffset = header[1];
+	dedicatedhost = ( header[2] & DEMO_DEDICATEDHOST ) != 0;
+	indexLoaded = false;
+	keyframeCount = 0;
+	fastForwardTo = -1;
+	seekPending = false;
+	desyncs = 0;
+	seekable = true;
+	return 1;
+}
+
+// closed demos carry the index, the others are walked block by block
+static
+bool dnLoadIndex( long fil ) {
+	long resume = ktell( fil );
+	char tag;
+	int block[3], count;
+
+	walkedRecords = 0;
+	if ( indexLoaded ) {
+		return true;
+	}
+	keyframeCount = 0;
+
+	if ( indexOffset > 0 ) {
+		klseek( fil, indexOffset, SEEK_SET );
+		if ( kread( fil, &count, sizeof( int ) ) == sizeof( int ) && count >= 0 ) {
+			for ( int i = 0; i < count; i++ ) {
+				if ( kread( fil, block, 2 * sizeof( int ) ) != 2 * sizeof( int ) ) {
+					break;
+				}
+				dnAddKeyframe( block[0], block[1] );
+			}
+		}
+	} else {
+		klseek( fil, blocksStart, SEEK_SET );
+		for ( ;; ) {
+			long offset = ktell( fil );
+
+			if ( kread( fil, &tag, 1 ) != 1 ) {
+				break;
+			}
+			if ( tag == DEMO_BLOCK_KEYFRAME ) {
+				if ( kread( fil, block, 3 * sizeof( int ) ) != 3 * sizeof( int ) ) {
+					break;
+				}
+				dnAddKeyframe( block[0], offset );
+				klseek( fil, block[2], SEEK_CUR );
+			} else if ( tag == DEMO_BLOCK_INPUT || tag == DEMO_BLOCK_LZ4INPUT ) {
+				if ( kread( fil, block, 2 * sizeof( int ) ) != 2 * sizeof( int ) ) {
+					break;
+				}
+				klseek( fil, block[1], SEEK_CUR );
+				walkedRecords += block[0] * ud.multimode;
+			} else {
+				break;
+			}
+		}
+	}
+
+	klseek( fil, resume, SEEK_SET );
+	indexLoaded = true;
+	Sys_DPrintf( "[DUKEMP] dnLoadIndex: %d keyframes\n", keyframeCount );
+	return true;
+}
+
+extern "C"
+void dnDemoBeginRead( long fil, long *records ) {
+	if ( !seekable ) {
+		return;
+	}
+	blocksStart = ktell( fil );
+
+	// a demo that was never closed has neither its length nor the index in the header
+	if ( indexOffset <= 0 ) {
+		dnLoadIndex( fil );
+		*records = totalRecords = walkedRecords;
+		OSD_Printf( "Demo was not closed, %ld tics recovered\n", dnTotalTics() );
+	}
+}
+
+extern "C"
+int dnDemoSeekable( void ) {
+	return seekable;
+}
+
+// the keyframe ahead is the state before the tic the following input starts at, which is where
+// playback stands whenever it reads another block
+static
+void dnVerifyKeyframe( long tic, unsigned int hash ) {
+	if ( !verify || fastForwardTo >= 0 || tic != dnCurrentTic() ) {
+		return;
+	}
+	if ( dnStateHash() != hash ) {
+		desyncs++;
+		OSD_Printf( "Demo desynced at tic %ld (%ld:%02ld)\n", tic, tic / TICSPERSECOND / 60, tic / TICSPERSECOND % 60 );
+	}
+}
+
+static
+long dnReadLZ4Inputs( long fil, void *records, long maxTics, long recordSize ) {
+	int block[2];
+	char *packed;
+	bool ok;
+
+	if ( kread( fil, block, sizeof( block ) ) != sizeof( block ) || block[0] <= 0 || block[0] > maxTics ||
+		block[1] <= 0 || block[1] > LZ4_compressBound( maxTics * recordSize ) ) {
+		return -1;
+	}
+
+	packed = (char*)malloc( block[1] );
+	ok = kread( fil, packed, block[1] ) == block[1] &&
+		LZ4_decompress_safe( packed, (char*)records, block[1], maxTics * recordSize ) == block[0] * recordSize;
+	free( packed );
+	return ok ? block[0] : -1;
+}
+
+extern "C"
+long dnDemoReadInputs( long fil, void *records, long maxTics, long recordSize ) {
+	char tag;
+	int block[3];
+
+	for ( ;; ) {
+		if ( kread( fil, &tag, 1 ) != 1 ) {
+			return -1;
+		}
+		if ( tag == DEMO_BLOCK_KEYFRAME ) {
+			if ( kread( fil, block, 3 * sizeof( int ) ) != 3 * sizeof( int ) || block[2] < 0 ) {
+				return -1;
+			}
+			dnVerifyKeyframe( block[0], (unsigned int)block[1] );
+			klseek( fil, block[2], SEEK_CUR );
+			continue;
+		}
+		if ( tag == DEMO_BLOCK_LZ4INPUT ) {
+			return dnReadLZ4Inputs( fil, records, maxTics, recordSize );
+		}
+		if ( tag != DEMO_BLOCK_INPUT ) {
+			return -1;
+		}
+
+		// a block was written by one dfwrite and has to be read back by one kdfread
+		if ( kread( fil, block, 2 * sizeof( int ) ) != 2 * sizeof( int ) || block[0] <= 0 || block[0] > maxTics ) {
+			return -1;
+		}
+		if ( kdfread( records, recordSize, block[0], fil ) != block[0] ) {
+			return -1;
+		}
+		return block[0];
+	}
+}
+
+extern "C"
+void dnDemoEndRead( void ) {
+	seekable = false;
+	seekPending = false;
+	fastForwardTo = -1;
+	keyframeCount = 0;
+}
+
+static
+bool dnLoadKeyframe( long fil, const keyframeEntry_t *keyframe ) {
+	snapshot_t *snapshot = dnScratchSnapshot();
+	char tag;
+	int block[3];
+	char *data;
+	bool ok;
+
+	klseek( fil, keyframe->offset, SEEK_SET );
+	if ( kread( fil, &tag, 1 ) != 1 || tag != DEMO_BLOCK_KEYFRAME ||
+		kread( fil, block, sizeof( block ) ) != sizeof( block ) || block[0] != keyframe->tic || block[2] <= 0 ) {
+		return false;
+	}
+
+	data = (char*)malloc( block[2] );
+	ok = kread( fil, data, block[2] ) == block[2];
+	if ( ok ) {
+		dnDecompressSnapshotRAW( data, block[2], snapshot );
+		ok = crc32once( (unsigned char*)snapshot, sizeof( snapshot_t ) ) == (unsigned int)block[1];
+	}
+	free( data );
+	if ( !ok ) {
+		return false;
+	}
+
+	dnRestoreSnapshot( snapshot );
+	resetinterpolations();
+	totalclock = ototalclock = lockclock;	// the tics up to the target are run by dnDemoFastForwarding alone
+	return true;
+}
+
+extern "C"
+void dnDemoRequestSeek( long ms, int relative ) {
+	seekMs = ms;
+	seekRelative = relative;
+	seekPending = true;
+}
+
+extern "C"
+int dnDemoSeekPending( void ) {
+	return seekPending;
+}
+
+extern "C"
+int dnDemoPerformSeek( long fil ) {
+	long tic = dnCurrentTic();
+	long target = seekMs * TICSPERSECOND / 1000;
+	long resume = ktell( fil );
+	int k;
+
+	seekPending = false;
+	if ( !seekable ) {
+		OSD_Printf( "This demo was recorded without keyframes and can't seek\n" );
+		return 0;
+	}
+
+	if ( seekRelative ) {
+		target += tic;
+	}
+	target = max( 0, min( target, dnTotalTics() - 1 ) );
+	dnLoadIndex( fil );
+
+	for ( k = keyframeCount - 1; k >= 0 && keyframes[k].tic > target; k-- ) {
+	}
+
+	// nothing closer to start from than where playback already is
+	if ( target >= tic && ( k < 0 || keyframes[k].tic <= tic ) ) {
+		fastForwardTo = target;
+		return 0;
+	}
+	if ( k < 0 ) {
+		OSD_Printf( "No keyframe before %ld:%02ld\n", target / TICSPERSECOND / 60, target / TICSPERSECOND % 60 );
+		return 0;
+	}
+	if ( !dnLoadKeyframe( fil, &keyframes[k] ) ) {
+		OSD_Printf( "The keyframe at tic %d is damaged\n", keyframes[k].tic );
+		klseek( fil, resume, SEEK_SET );
+		return 0;
+	}
+
+	ud.reccnt = totalRecords - keyframes[k].tic * ud.multimode;
+	fastForwardTo = target;
+	return 1;
+}
+
+extern "C"
+int dnDemoFastForwarding( void ) {
+	if ( fastForwardTo < 0 ) {
+		return 0;
+	}
+	if ( dnCurrentTic() < fastForwardTo && ud.reccnt > 0 ) {
+		return 1;
+	}
+
+	// arrived: the clock picks up from here instead of racing to catch up
+	fastForwardTo = -1;
+	totalclock = ototalclock = lockclock;
+	return 0;
+}
+
+extern "C"
+int dnDemoFilterSound( void ) {
+	return fastForwardTo >= 0;
+}
+
+extern "C"
+void dnDemoPrintStatus( void ) {
+	long tic = dnCurrentTic(), total = dnTotalTics();
+
+	OSD_Printf( "Demo at %ld:%02ld of %ld:%02ld", tic / TICSPERSECOND / 60, tic / TICSPERSECOND % 60,
+		total / TICSPERSECOND / 60, total / TICSPERSECOND % 60 );
+	if ( seekable ) {
+		OSD_Printf( ", %s, %d desyncs\n", indexLoaded ? "indexed" : "not indexed yet", desyncs );
+	} else {
+		OSD_Printf( ", old format, no seeking\n" );
+	}
+}
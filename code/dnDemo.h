@@ -0,0 +1,83 @@
+//
+//  dnDemo.h
+//  duke3d
+//
+//  Seekable demos: keyframe snapshots and a tic index around the recorded input
+//
+
+#ifndef DNDEMO_H
+#define DNDEMO_H
+
+/*
+
+ A demo written by record() starts with DEMO_MAGIC where the old format had its record count,
+ then the record count, the offset of the tic index and the keyframe interval (with
+ DEMO_DEDICATEDHOST or'd in if the game had one), then the usual
+ header fields. After that come blocks:
+
+	'L' tics bytes <LZ4 data>		input for the next tics, all players per tic
+	'I' tics bytes <dfwrite data>		the same, as the first seekable demos wrote it
+	'K' tic hash bytes <LZ4 data>		the state before the tic runs, as a dnSnapshot
+
+ and at the index offset the count and (tic, offset) of every keyframe. The sizes are there so
+ the blocks can be walked without unpacking them. A demo that was never closed has no index,
+ so it is rebuilt that way when the demo is opened. Demos in the old format still play but
+ cannot seek.
+
+ Recording only copies the input and the snapshots: packing and writing them, and finishing the
+ file, happens in order on the background thread (runbackground), so the game doesn't stop for it.
+
+ A keyframe is taken every demo_keyframes seconds of game time. On playback its hash is checked
+ against the state the demo has reached, and a mismatch is reported with the tic it happened at.
+ demo_seek jumps to a time: the nearest keyframe before it is loaded and the rest is run without
+ drawing or sounds. Going forward from a point after the last keyframe only runs the tics.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "compat.h"
+
+#define DEMO_MAGIC 0x58444E44			// "DNDX"
+#define DEMO_DEFAULTKEYFRAMESECS 10
+#define DEMO_DEDICATEDHOST 0x40000000	// set in the keyframe interval when player 0 was a dedicated host
+
+enum {
+	DEMO_BLOCK_INPUT = 'I',
+	DEMO_BLOCK_LZ4INPUT = 'L',
+	DEMO_BLOCK_KEYFRAME = 'K',
+};
+
+void dnDemoSetKeyframeInterval( int seconds );	// 0 turns keyframes off
+int  dnDemoGetKeyframeInterval( void );
+void dnDemoSetVerify( int on );
+int  dnDemoGetVerify( void );
+
+// recording
+void dnDemoWriteHeader( BFILE *fil );
+int  dnDemoKeyframeDue( long tic );
+void dnDemoWriteInputs( BFILE *fil, void *records, long tics, long recordSize );
+void dnDemoWriteKeyframe( BFILE *fil, long tic );
+void dnDemoFinishWrite( BFILE *fil, long totalRecords );	// closes fil once everything is written
+
+// playback
+int  dnDemoReadHeader( long fil, long *totalRecords );	// after DEMO_MAGIC, 0 if it is corrupt
+void dnDemoBeginRead( long fil, long *totalRecords );	// after the usual header fields
+int  dnDemoSeekable( void );
+long dnDemoReadInputs( long fil, void *records, long maxTics, long recordSize );	// tics read, -1 if corrupt
+void dnDemoEndRead( void );
+
+void dnDemoRequestSeek( long ms, int relative );
+int  dnDemoSeekPending( void );
+int  dnDemoPerformSeek( long fil );		// 1 if the file was moved and ud.reccnt set to match
+int  dnDemoFastForwarding( void );		// run the next tic without waiting for the clock
+int  dnDemoFilterSound( void );
+void dnDemoPrintStatus( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNDEMO_H */
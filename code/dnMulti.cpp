@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include "csteam.h"
 #include "dnAPI.h"
+#include "SDL.h"
 
 extern "C" {
 #include "types.h"
@@ -27,11 +28,20 @@ extern "C" {
 
 #include "dnMulti.h"
 #include "dnSnapshot.h"
+#include "dnTransport.h"
+#include "dnDedicated.h"
+#include "dnTelemetry.h"
 
 #define MAX_PACKET_SIZE (1024*1024)
 #define MAX_BLOCK_SIZE (5*1024*1024)
-#define BLOCK_CHUNK_SIZE (MAX_PACKET_SIZE - 5*1024)
-#define CHUNKS_AT_TIME (1)
+#define BLOCK_CHUNK_SIZE (1100)		// a chunk and its header fit one unfragmented datagram
+#define MAX_BLOCK_CHUNKS ((MAX_BLOCK_SIZE + BLOCK_CHUNK_SIZE - 1) / BLOCK_CHUNK_SIZE)
+#define BLOCK_MIN_WINDOW (4.0)
+#define BLOCK_INITIAL_WINDOW (16.0)
+#define BLOCK_REORDER_CHUNKS (3)		// acks past a hole before the chunk in it counts as lost
+#define BLOCK_INITIAL_RTT (100.0)
+#define BLOCK_MIN_RTO (200.0)
+#define BLOCK_CONGESTED_LOSS (0.05)		// share of a round's chunks lost that means the link is full
 
 #define READY_RESEND_DELAY (1000.0)
 #define PREMATCH_STATUS_RESEND_DELAY (2000.0)
@@ -53,11 +63,46 @@ static int timeToStart;
 static struct {
 	unsigned char buffer[MAX_BLOCK_SIZE];
 	unsigned int size;
-	unsigned int chunkMask;
+	unsigned int id;
+	unsigned int numChunks;
+	unsigned int numReceived;
+	unsigned int firstMissing;
+	unsigned char received[( MAX_BLOCK_CHUNKS + 7 ) / 8];
+	double uploadStart;
 	int transmissionInProgress;
 } block = { 0 };
 
-static blockDownloadStatus_t clientBlockStatus[MAXPLAYERS];
+static unsigned int nextBlockID = 1;
+
+/* server side state of one client's download: a selective-repeat window, paced over the measured
+   round trip. The window grows in slow start and then linearly while the round trip stays near its
+   minimum, and is halved after a round that lost more than a few percent, or lost anything while
+   the round trip was inflated. Scattered losses on an otherwise idle link just get resent. */
+typedef struct {
+	bool active;
+	unsigned int firstMissing;		// lowest chunk the client hasn't acknowledged
+	unsigned int nextNew;			// lowest chunk not sent yet
+	unsigned int highestAcked;
+	unsigned int resendFrom;		// lost chunks are all at or above this one
+	unsigned int inFlight;
+	double window, threshold;
+	double rtt, minRtt;
+	double tokens;
+	double lastPump, lastAck, roundEnd;
+	unsigned int roundAcked, roundLost;
+	unsigned char acked[( MAX_BLOCK_CHUNKS + 7 ) / 8];
+	float sentAt[MAX_BLOCK_CHUNKS];	// ms since the upload began, negative when not in flight
+} blockUpload_t;
+
+static blockUpload_t clientUploads[MAXPLAYERS];
+
+static union {
+	blockChunk_t chunk;
+	unsigned char raw[sizeof( blockChunk_t ) + BLOCK_CHUNK_SIZE];
+} chunkPacket;
+
+#define BIT_TEST( bits, i ) ( ( bits )[( i ) >> 3] & ( 1 << ( ( i ) & 7 ) ) )
+#define BIT_SET( bits, i ) ( ( bits )[( i ) >> 3] |= ( 1 << ( ( i ) & 7 ) ) )
 
 static snapshot_t snapshot;
 static bool doLoadSnapshot;
@@ -104,7 +149,7 @@ void dnSendQuit( int playerIndex, quitReason_t quitReason ) {
 		quitPacket.header.tag = TAG_QUIT;
 		quitPacket.reason = quitReason;
 		
-		CSTEAM_SendPacket( playerIDs[playerIndex], &quitPacket, sizeof( quitPacket_t ), 1, CHAN_SYNC );
+		dnNetSend( playerIDs[playerIndex], &quitPacket, sizeof( quitPacket_t ), 1, CHAN_SYNC );
 	}
 }
 
@@ -171,7 +216,11 @@ void dnDoGameLoop( void ) {
 	resettimeout();
 	handleevents();
 	getpackets();
-	dnDrawLoadingScreen( *waitStatus ? waitStatus : NULL );
+	if ( dedicated ) {
+		SDL_Delay( 1 );
+	} else {
+		dnDrawLoadingScreen( *waitStatus ? waitStatus : NULL );
+	}
 }
 
 static
@@ -204,23 +253,20 @@ void dnApplyPlayerPrefs( ) {
 }
 
 static
-void dnBeginBlockDownload( void ) {
-	block.chunkMask = 0;
-	block.size = 0;
-	block.transmissionInProgress = 1;
+unsigned int dnGetNumChunks( unsigned int size ) {
+	// an empty block still goes out as one empty chunk
+	return size > 0 ? ( size + BLOCK_CHUNK_SIZE - 1 ) / BLOCK_CHUNK_SIZE : 1;
 }
 
 static
-int dnGetNumChunks( ) {
-	int numChunks;
-	
-	if ( block.size % BLOCK_CHUNK_SIZE == 0 ) {
-		numChunks = block.size / BLOCK_CHUNK_SIZE;
-	} else {
-		numChunks = block.size / BLOCK_CHUNK_SIZE + 1;
-	}
-	
-	return numChunks;
+void dnBeginBlockDownload( void ) {
+	block.size = 0;
+	block.id = 0;
+	block.numChunks = 0;
+	block.numReceived = 0;
+	block.firstMissing = 0;
+	memset( block.received, 0, sizeof( block.received ) );
+	block.transmissionInProgress = 1;
 }
 
 static
@@ -228,10 +274,12 @@ void dnBeginBlockUpload( const void *data, unsigned int size ) {
 	if ( size <= sizeof( block.buffer ) ) {
 		memcpy( (void*)&block.buffer[0], data, size );
 		block.size = size;
+		block.id = nextBlockID++;
+		block.numChunks = dnGetNumChunks( size );
+		block.uploadStart = Sys_GetTicks();
 		block.transmissionInProgress = 1;
-		block.chunkMask = 0;
-		for ( int i = 0, numChunks = dnGetNumChunks(); i < numChunks; i++ ) {
-			block.chunkMask |= ( 1 << i );
+		for ( int i = 0; i < MAXPLAYERS; i++ ) {
+			clientUploads[i].active = false;
 		}
 	} else {
 		Sys_DPrintf( "[DUKEMP] dnBeginBlockUpload: data is too big\n" );
@@ -244,69 +292,273 @@ int dnIsBlockTransmissionFinished( void ) {
 }
 
 static
-void dnGetChunkBounds( unsigned int chunkIndex, unsigned int *offset, unsigned int *size ) {
-	int numChunks = dnGetNumChunks();
+void dnStartClientUpload( blockUpload_t *up ) {
+	double now = Sys_GetTicks();
 	
-	if ( chunkIndex < numChunks ) {
-		*offset = chunkIndex * BLOCK_CHUNK_SIZE;
-		if ( chunkIndex + 1 == dnGetNumChunks() ) {
-			*size = block.size - *offset;
-		} else {
-			*size = BLOCK_CHUNK_SIZE;
-		}
-	} else {
-		Sys_DPrintf( "[DUKEMP] dnGetChunkBounds: wrong chunk index\n" );
+	up->active = true;
+	up->firstMissing = 0;
+	up->nextNew = 0;
+	up->highestAcked = 0;
+	up->resendFrom = 0;
+	up->inFlight = 0;
+	up->window = BLOCK_INITIAL_WINDOW;
+	up->threshold = BLOCK_SACK_CHUNKS;
+	up->rtt = BLOCK_INITIAL_RTT;
+	up->minRtt = 0;
+	up->tokens = BLOCK_INITIAL_WINDOW;
+	up->lastPump = now;
+	up->lastAck = now;
+	up->roundEnd = now + BLOCK_INITIAL_RTT;
+	up->roundAcked = 0;
+	up->roundLost = 0;
+	memset( up->acked, 0, sizeof( up->acked ) );
+	for ( unsigned int i = 0; i < block.numChunks; i++ ) {
+		up->sentAt[i] = -1.0f;
 	}
+}
+
+// chunk timestamps go over the wire as 32-bit milliseconds; they wrap every 49 days, so only
+// differences taken in unsigned arithmetic mean anything
+static
+unsigned int dnChunkStamp( void ) {
+	return (unsigned int)(unsigned long long)Sys_GetTicks();
+}
+
+static
+void dnSendChunk( int playerIndex, unsigned int chunkIndex ) {
+	unsigned int offset = chunkIndex * BLOCK_CHUNK_SIZE;
+	unsigned int size = block.size - offset;
+	
+	if ( size > BLOCK_CHUNK_SIZE ) {
+		size = BLOCK_CHUNK_SIZE;
+	}
+	chunkPacket.chunk.header.sessionToken = sessionToken;
+	chunkPacket.chunk.header.tag = TAG_BLOCK_CHUNK;
+	chunkPacket.chunk.blockID = block.id;
+	chunkPacket.chunk.blockSize = block.size;
+	chunkPacket.chunk.chunkIndex = chunkIndex;
+	chunkPacket.chunk.sendTime = dnChunkStamp();
+	chunkPacket.chunk.chunkSize = (unsigned short)size;
+	memcpy( (void*)&chunkPacket.chunk.chunkData[0], (void*)&block.buffer[offset], size );
 	
+	// the window does the retransmitting, so chunks don't need the transport's reliable mode
+	dnNetSend( playerIDs[playerIndex], (void*)&chunkPacket, sizeof( blockChunk_t ) - 1 + size, 0, CHAN_SYNC );
 }
 
 static
 void dnSendNextChunk( int playerIndex ) {
-	blockDownloadStatus_t *bds = &clientBlockStatus[playerIndex];
-	int numChunks = dnGetNumChunks();
-	blockChunk_t *blockChunk;
-	unsigned int offset, size;
-	int chunksSent;
-	
-	chunksSent = 0;
-	for ( int i = 0; i < numChunks; i++ ) {
-		if ( ( bds->chunkMask & ( 1 << i ) ) == 0 ) {
-			Sys_DPrintf( "[DUKEMP] dnSendNextChunk: sending chunk %d of %d\n", i + 1, numChunks );
-			
-			dnGetChunkBounds( i, &offset, &size );
-			blockChunk = (blockChunk_t*)malloc( sizeof( blockChunk_t ) + size );
-			blockChunk->header.sessionToken = sessionToken;
-			blockChunk->header.tag = TAG_BLOCK_CHUNK;
-			blockChunk->chunkIndex = i;
-			blockChunk->allBlockChunks = block.chunkMask;
-			blockChunk->chunkMask = bds->chunkMask | ( 1 << i );
-			blockChunk->chunkOffset = offset;
-			blockChunk->chunkSize = size;
-			blockChunk->blockSize = block.size;
-			memcpy( (void*)&blockChunk->chunkData[0], (void*)&block.buffer[offset], size );
-			chunksSent += CSTEAM_SendPacket( playerIDs[playerIndex], (void*)blockChunk, sizeof( blockChunk_t ) + size, 1, CHAN_SYNC );
-			
-			Sys_DPrintf( "[DUKEMP] crc32 = %u\n", crc32once( &blockChunk->chunkData[0], blockChunk->chunkSize ) );
-		}
-		if ( chunksSent >= CHUNKS_AT_TIME ) {
-			break;
+	blockUpload_t *up = &clientUploads[playerIndex];
+	double now = Sys_GetTicks();
+	
+	if ( !up->active || up->firstMissing >= block.numChunks ) {
+		return;
+	}
+	
+	// nothing heard for a while: assume everything outstanding is gone and start over slowly
+	if ( up->inFlight > 0 && now - up->lastAck > max( BLOCK_MIN_RTO, 4.0 * up->rtt ) ) {
+		Sys_DPrintf( "[DUKEMP] dnSendNextChunk: timeout, %u chunks in flight\n", up->inFlight );
+		for ( unsigned int i = up->firstMissing; i < up->nextNew; i++ ) {
+			up->sentAt[i] = -1.0f;
 		}
+		up->inFlight = 0;
+		up->resendFrom = up->firstMissing;
+		up->threshold = max( up->window / 2.0, BLOCK_MIN_WINDOW );
+		up->window = BLOCK_MIN_WINDOW;
+		up->lastAck = now;
+	}
+	
+	up->tokens += ( now - up->lastPump ) * up->window / max( up->rtt, 1.0 );
+	if ( up->tokens > up->window ) {
+		up->tokens = up->window;
 	}
+	up->lastPump = now;
 	
-	if ( chunksSent == 0 ) {
-		Sys_DPrintf( "[DUKEMP] dnSendNextChunk: all chunks sent\n" );
+	while ( up->tokens >= 1.0 && up->inFlight < up->window ) {
+		unsigned int limit = min( up->nextNew, up->firstMissing + BLOCK_SACK_CHUNKS );
+		unsigned int chunkIndex;
 		
-		blockChunk = (blockChunk_t*)malloc( sizeof( blockChunk_t ) );
-		blockChunk->header.sessionToken = sessionToken;
-		blockChunk->header.tag = TAG_BLOCK_CHUNK;
-		blockChunk->chunkIndex = 0xFFFFFFFF;
-		blockChunk->allBlockChunks = block.chunkMask;
-		blockChunk->chunkMask = bds->chunkMask;
-		blockChunk->chunkOffset = 0;
-		blockChunk->chunkSize = 0;
-		blockChunk->blockSize = block.size;
+		while ( up->resendFrom < limit && ( BIT_TEST( up->acked, up->resendFrom ) || up->sentAt[up->resendFrom] >= 0.0f ) ) {
+			up->resendFrom++;
+		}
+		if ( up->resendFrom < limit ) {
+			chunkIndex = up->resendFrom++;
+		} else if ( up->nextNew < block.numChunks && up->nextNew < up->firstMissing + BLOCK_SACK_CHUNKS ) {
+			chunkIndex = up->nextNew++;
+		} else {
+			break;
+		}
 		
-		CSTEAM_SendPacket( playerIDs[playerIndex], (void*)blockChunk, sizeof( blockChunk_t ), 1, CHAN_SYNC );
+		dnSendChunk( playerIndex, chunkIndex );
+		up->sentAt[chunkIndex] = (float)( now - block.uploadStart );
+		up->inFlight++;
+		up->tokens -= 1.0;
+	}
+}
+
+static
+void dnPumpBlockUploads( void ) {
+	if ( block.transmissionInProgress ) {
+		dnIterPlayers( i ) {
+			dnSendNextChunk( i );
+		}
+	}
+}
+
+static
+void dnAckChunk( blockUpload_t *up, unsigned int chunkIndex, unsigned int *newlyAcked ) {
+	if ( chunkIndex < block.numChunks && !BIT_TEST( up->acked, chunkIndex ) ) {
+		BIT_SET( up->acked, chunkIndex );
+		if ( up->sentAt[chunkIndex] >= 0.0f ) {
+			up->sentAt[chunkIndex] = -1.0f;
+			up->inFlight--;
+		}
+		if ( chunkIndex > up->highestAcked ) {
+			up->highestAcked = chunkIndex;
+		}
+		( *newlyAcked )++;
+	}
+}
+
+static
+void dnProcessBlockStatus( int playerIndex, const blockDownloadStatus_t *bds ) {
+	blockUpload_t *up = &clientUploads[playerIndex];
+	double now = Sys_GetTicks();
+	unsigned int newlyAcked = 0, lost = 0;
+	bool queueing;
+	
+	if ( bds->blockID != 0 && bds->blockID != block.id ) {
+		return;
+	}
+	if ( !up->active ) {
+		Sys_DPrintf( "[DUKEMP] dnProcessBlockStatus: player %d starts downloading %u chunks\n", playerIndex, block.numChunks );
+		dnStartClientUpload( up );
+	}
+	
+	int elapsed = (int)( dnChunkStamp() - bds->echoTime );
+	if ( bds->echoTime != 0 && elapsed >= 0 ) {
+		double sample = elapsed;
+		up->rtt = up->rtt * 0.875 + sample * 0.125;
+		if ( up->minRtt == 0 || sample < up->minRtt ) {
+			up->minRtt = sample;
+		}
+	}
+	up->lastAck = now;
+	
+	for ( unsigned int i = up->firstMissing; i < bds->firstMissing && i < block.numChunks; i++ ) {
+		dnAckChunk( up, i, &newlyAcked );
+	}
+	for ( unsigned int i = 0; i < BLOCK_SACK_CHUNKS; i++ ) {
+		if ( BIT_TEST( bds->sack, i ) ) {
+			dnAckChunk( up, bds->firstMissing + 1 + i, &newlyAcked );
+		}
+	}
+	while ( up->firstMissing < block.numChunks && BIT_TEST( up->acked, up->firstMissing ) ) {
+		up->firstMissing++;
+	}
+	if ( up->resendFrom < up->firstMissing ) {
+		up->resendFrom = up->firstMissing;
+	}
+	
+	// a hole that later chunks have overtaken, sent well over a round trip ago, won't be filled any more
+	for ( unsigned int i = up->firstMissing; i + BLOCK_REORDER_CHUNKS < up->highestAcked; i++ ) {
+		if ( !BIT_TEST( up->acked, i ) && up->sentAt[i] >= 0.0f && now - block.uploadStart - up->sentAt[i] > up->rtt * 1.25 ) {
+			up->sentAt[i] = -1.0f;
+			up->inFlight--;
+			if ( i < up->resendFrom ) {
+				up->resendFrom = i;
+			}
+			lost++;
+		}
+	}
+	up->roundAcked += newlyAcked;
+	up->roundLost += lost;
+	
+	queueing = up->rtt > up->minRtt * 1.5 + 10.0;
+	if ( !queueing ) {
+		for ( unsigned int i = 0; i < newlyAcked; i++ ) {
+			up->window += up->window < up->threshold ? 1.0 : 1.0 / up->window;
+		}
+		if ( up->window > BLOCK_SACK_CHUNKS ) {
+			up->window = BLOCK_SACK_CHUNKS;
+		}
+	}
+	
+	if ( now >= up->roundEnd ) {
+		if ( up->roundLost > ( up->roundAcked + up->roundLost ) * BLOCK_CONGESTED_LOSS || ( up->roundLost > 0 && queueing ) ) {
+			up->threshold = max( up->window / 2.0, BLOCK_MIN_WINDOW );
+			up->window = up->threshold;
+		}
+		up->roundAcked = 0;
+		up->roundLost = 0;
+		up->roundEnd = now + up->rtt;
+	}
+	
+	if ( up->firstMissing >= block.numChunks ) {
+		Sys_DPrintf( "[DUKEMP] dnProcessBlockStatus: player %d has the whole block, %.1f ms round trip\n", playerIndex, up->rtt );
+	} else {
+		dnSendNextChunk( playerIndex );
+	}
+}
+
+static
+void dnFillBlockStatus( blockDownloadStatus_t *bds, unsigned int echoTime ) {
+	memset( bds, 0, sizeof( blockDownloadStatus_t ) );
+	bds->header.sessionToken = sessionToken;
+	bds->header.tag = TAG_BLOCK_STATUS;
+	bds->blockID = block.id;
+	bds->firstMissing = block.firstMissing;
+	bds->echoTime = echoTime;
+	for ( unsigned int i = 0; i < BLOCK_SACK_CHUNKS; i++ ) {
+		unsigned int chunkIndex = block.firstMissing + 1 + i;
+		if ( chunkIndex >= block.numChunks ) {
+			break;
+		}
+		if ( BIT_TEST( block.received, chunkIndex ) ) {
+			BIT_SET( bds->sack, i );
+		}
+	}
+}
+
+static
+void dnReceiveChunk( const blockChunk_t *blockChunk, unsigned int msgSize ) {
+	blockDownloadStatus_t bds;
+	unsigned int chunkIndex = blockChunk->chunkIndex;
+	
+	if ( msgSize < sizeof( blockChunk_t ) - 1 || msgSize < sizeof( blockChunk_t ) - 1 + blockChunk->chunkSize ) {
+		Sys_DPrintf( "[DUKEMP] dnReceiveChunk: truncated chunk\n" );
+		return;
+	}
+	if ( block.id == 0 ) {
+		if ( !block.transmissionInProgress || blockChunk->blockSize > sizeof( block.buffer ) ) {
+			return;
+		}
+		block.id = blockChunk->blockID;
+		block.size = blockChunk->blockSize;
+		block.numChunks = dnGetNumChunks( block.size );
+	}
+	if ( blockChunk->blockID != block.id || chunkIndex >= block.numChunks ||
+		chunkIndex * BLOCK_CHUNK_SIZE + blockChunk->chunkSize != min( ( chunkIndex + 1 ) * BLOCK_CHUNK_SIZE, block.size ) ) {
+		Sys_DPrintf( "[DUKEMP] dnReceiveChunk: chunk %u doesn't belong to block %u\n", chunkIndex, block.id );
+		return;
+	}
+	
+	if ( !BIT_TEST( block.received, chunkIndex ) ) {
+		memcpy( (void*)&block.buffer[chunkIndex * BLOCK_CHUNK_SIZE], (void*)&blockChunk->chunkData[0], blockChunk->chunkSize );
+		BIT_SET( block.received, chunkIndex );
+		block.numReceived++;
+		while ( block.firstMissing < block.numChunks && BIT_TEST( block.received, block.firstMissing ) ) {
+			block.firstMissing++;
+		}
+	}
+	
+	// chunks are acked even after the download is over, in case the last status went missing
+	dnFillBlockStatus( &bds, blockChunk->sendTime );
+	if ( block.transmissionInProgress && block.numReceived == block.numChunks ) {
+		Sys_DPrintf( "[DUKEMP] dnReceiveChunk: all %u chunks downloaded\n", block.numChunks );
+		block.transmissionInProgress = 0;
+		dnNetSend( playerIDs[0], (void*)&bds, sizeof( blockDownloadStatus_t ), 1, CHAN_SYNC );
+	} else {
+		dnNetSend( playerIDs[0], (void*)&bds, sizeof( blockDownloadStatus_t ), 0, CHAN_SYNC );
 	}
 }
 
@@ -318,21 +570,22 @@ void dnReceiveBlock( void ) {
 	
 	Sys_DPrintf( "[DUKEMP] dnReceiveBlock: starting block downloading\n" );
 	
-	bds.header.sessionToken = sessionToken;
-	bds.header.tag = TAG_BLOCK_STATUS;
-	bds.chunkMask = block.chunkMask;
-	
 	lastStatusSent = -999999.0;
 	
 	do {
+		if ( block.numChunks > 0 ) {
+			sprintf( waitStatus, "Downloading: %d%%", (int)( 100.0 * block.numReceived / block.numChunks ) );
+		}
+		
 		dnDoGameLoop();
 
 		now = Sys_GetTicks();
 		
+		// asks for the block until it starts arriving, then keeps the server's window from stalling
 		if ( lastStatusSent + BLOCK_REQUEST_DELAY < now ) {
-			bds.chunkMask = block.chunkMask;
-			Sys_DPrintf( "[DUKEMP] dnReceiveBlock: request with mask %d\n", bds.chunkMask );
-			CSTEAM_SendPacket( playerIDs[0], (void*)&bds, sizeof( blockDownloadStatus_t ), 1, CHAN_SYNC );
+			dnFillBlockStatus( &bds, 0 );
+			Sys_DPrintf( "[DUKEMP] dnReceiveBlock: status, %u of %u chunks\n", block.numReceived, block.numChunks );
+			dnNetSend( playerIDs[0], (void*)&bds, sizeof( blockDownloadStatus_t ), 1, CHAN_SYNC );
 			lastStatusSent = Sys_GetTicks();
 		}
 		
@@ -392,6 +645,7 @@ void dnWaitForClients( blockKind_t blockKind ) {
 		sprintf( waitStatus, "Waiting for players: %d of %d", dnNumBitsSet( readyPlayers ), numPlayers - 1 );
 		
 		dnDoGameLoop();
+		dnPumpBlockUploads();
 		
 		now = Sys_GetTicks();
 		
@@ -401,7 +655,7 @@ void dnWaitForClients( blockKind_t blockKind ) {
 			dnFillPrematchStatusPacket( &psp );
 			
 			dnIterPlayers( i ) {
-				CSTEAM_SendPacket( playerIDs[i], (void*)&psp, sizeof( prematchStatusPacket_t ), 1, CHAN_SYNC );
+				dnNetSend( playerIDs[i], (void*)&psp, sizeof( prematchStatusPacket_t ), 1, CHAN_SYNC );
 				delaySum[i] += Sys_GetTicks() - now;
 				numUpdates[i] ++;
 			}
@@ -434,7 +688,7 @@ void dnWaitForClients( blockKind_t blockKind ) {
 			if ( psp.timeToStart < 0 ) {
 				psp.timeToStart = 0;
 			}
-			CSTEAM_SendPacket( playerIDs[i], (void*)&psp, sizeof( prematchStatusPacket_t ), 1, CHAN_SYNC );
+			dnNetSend( playerIDs[i], (void*)&psp, sizeof( prematchStatusPacket_t ), 1, CHAN_SYNC );
 			dnDoGameLoop();
 		}
 		
@@ -470,7 +724,7 @@ void dnSendReady( void ) {
 	for ( int i = 0; i < MAX_WEAPONS; i++ ) {
 		readyPacket.playerPrefs.wchoice[i] = ud.wchoice[myConnectIndex][i] & 0xFF;
 	}
-	CSTEAM_SendPacket( playerIDs[0], &readyPacket, sizeof( readyPacket_t ), 1, CHAN_SYNC );
+	dnNetSend( playerIDs[0], &readyPacket, sizeof( readyPacket_t ), 1, CHAN_SYNC );
 }
 
 static
@@ -559,6 +813,7 @@ void dnProcessNotification( int senderIndex, notificationPacket_t *notificationP
 		case NOTIFICATION_OUT_OF_SYNC: {
 			Sys_DPrintf( "[DUKEMP] dnProcessNotification: got out-of-sync from %d\n", senderIndex );
 			if ( !awaitingResync ) {
+				dnTelemetryNoteResync( senderIndex );
 				dnTakeSnapshot( &snapshot );
 				awaitingResync = true;
 				dnIterPlayers( i ) {
@@ -598,12 +853,12 @@ void dnProcessPacket( steam_id_t sender, const void *packetData, unsigned int ms
 	
 	switch ( packetHeader->tag ) {
 		case TAG_PING: {
-			Sys_DPrintf( "[DUKEMP] dnProcessPacket: ping request from %s\n", CSTEAM_FormatId( sender ) );
-			CSTEAM_SendPacket( sender, packetData, msgSize, 0, CHAN_PONG );
+			Sys_DPrintf( "[DUKEMP] dnProcessPacket: ping request from %s\n", dnNetFormatID( sender ) );
+			dnNetSend( sender, packetData, msgSize, 0, CHAN_PONG );
 			break;
 		}
 		case TAG_READY: {
-			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got ready packet from %s\n", CSTEAM_FormatId( sender ) );
+			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got ready packet from %s\n", dnNetFormatID( sender ) );
 			int playerIndex = dnPlayerIndex( sender );
 			if ( playerIndex > 0 ) {
 				memcpy( &playerPrefs[playerIndex], &readyPacket->playerPrefs, sizeof( playerPrefs_t ) );
@@ -614,7 +869,7 @@ void dnProcessPacket( steam_id_t sender, const void *packetData, unsigned int ms
 			break;
 		}
 		case TAG_PREMATCH: {
-			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got prematch status packet from %s\n", CSTEAM_FormatId(( sender ) ) );
+			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got prematch status packet from %s\n", dnNetFormatID(( sender ) ) );
 			if ( wfeState == STATE_PREMATCH ) {
 				int playerIndex = dnPlayerIndex( sender );
 				if ( playerIndex == 0 ) {
@@ -630,12 +885,10 @@ void dnProcessPacket( steam_id_t sender, const void *packetData, unsigned int ms
 			break;
 		}
 		case TAG_BLOCK_STATUS: {
-			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got block status from %s\n", CSTEAM_FormatId( sender ) );
 			int playerIndex = dnPlayerIndex( sender );
 			if  ( playerIndex > 0 ) {
 				if ( block.transmissionInProgress ) {
-					memcpy( &clientBlockStatus[playerIndex], blockDownloadStatus, sizeof( blockDownloadStatus_t ) );
-					dnSendNextChunk( playerIndex );
+					dnProcessBlockStatus( playerIndex, blockDownloadStatus );
 				} else {
 					Sys_DPrintf( "[DUKEMP] dnProcessPacket: no transmission in progress\n" );
 				}
@@ -645,30 +898,16 @@ void dnProcessPacket( steam_id_t sender, const void *packetData, unsigned int ms
 			break;
 		}
 		case TAG_BLOCK_CHUNK: {
-			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got block chunk from %s\n", CSTEAM_FormatId( sender ) );
 			int playerIndex = dnPlayerIndex( sender );
 			if ( playerIndex == 0 ) {
-				if ( blockChunk->chunkIndex != 0xFFFFFFFF ) {
-					Sys_DPrintf( "[DUKEMP] dnProcessPacket: merging chunk %d\n", blockChunk->chunkIndex + 1 );
-					memcpy( (void*)&block.buffer[blockChunk->chunkOffset], (void*)&blockChunk->chunkData[0], blockChunk->chunkSize );	
-					block.chunkMask |= ( 1 << blockChunk->chunkIndex );
-					block.size = blockChunk->blockSize;
-					Sys_DPrintf( "[DUKEMP] crc32 = %u\n", crc32once( &blockChunk->chunkData[0], blockChunk->chunkSize ) );
-					if ( block.chunkMask == blockChunk->allBlockChunks ) {
-						Sys_DPrintf( "[DUKEMP] dnProcessPacket: all chunks downloaded\n" );
-						block.transmissionInProgress = 0;
-					}
-				} else {
-					Sys_DPrintf( "[DUKEMP] dnProcessPacket: transmission is over\n" );
-					block.transmissionInProgress = 0;
-				}
+				dnReceiveChunk( blockChunk, msgSize );
 			} else {
 				Sys_DPrintf( "[DUKEMP] dnProcessPacket: got block chunk packet from non-server\n" );
 			}
 			break;
 		}
 		case TAG_NOTIFICATION: {
-			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got notification from %s\n", CSTEAM_FormatId( sender ) );
+			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got notification from %s\n", dnNetFormatID( sender ) );
 			int playerIndex = dnPlayerIndex( sender );
 			if ( dnIsPlayerIndexValid( playerIndex ) ) {
 				dnProcessNotification( playerIndex, notificationPacket );
@@ -678,7 +917,7 @@ void dnProcessPacket( steam_id_t sender, const void *packetData, unsigned int ms
 			break;
 		}
 		case TAG_QUIT: {
-			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got quit packet from %s\n", CSTEAM_FormatId( sender ) );
+			Sys_DPrintf( "[DUKEMP] dnProcessPacket: got quit packet from %s\n", dnNetFormatID( sender ) );
 			int playerIndex = dnPlayerIndex( sender );
 			if ( dnIsPlayerIndexValid( playerIndex ) ) {
 				
@@ -688,7 +927,7 @@ void dnProcessPacket( steam_id_t sender, const void *packetData, unsigned int ms
 			break;
 		}
 		default: {
-			Sys_DPrintf( "[DUKEMP] got packet with unknown tag %d from %s\n", packetHeader->tag, CSTEAM_FormatId( sender ) );
+			Sys_DPrintf( "[DUKEMP] got packet with unknown tag %d from %s\n", packetHeader->tag, dnNetFormatID( sender ) );
 		}
 	}
 }
@@ -699,13 +938,13 @@ void dnGetPackets( void ) {
 	steam_id_t sender;
 	packetHeader_t *packetHeader;
 	
-	while ( CSTEAM_IsPacketAvailable( &msgSize, CHAN_SYNC ) ) {
-		if ( CSTEAM_ReadPacket( (void*)packetBuffer, MAX_PACKET_SIZE, &msgSize, &sender, CHAN_SYNC ) ) {
+	while ( dnNetIsPacketAvailable( &msgSize, CHAN_SYNC ) ) {
+		if ( dnNetReadPacket( (void*)packetBuffer, MAX_PACKET_SIZE, &msgSize, &sender, CHAN_SYNC ) ) {
 			packetHeader = (packetHeader_t*)&packetBuffer[0];
 			if ( packetHeader->sessionToken == sessionToken || packetHeader->sessionToken == 0xDEADBEEF ) {
 				dnProcessPacket( sender, (void*)&packetBuffer[0], msgSize );
 			} else {
-				Sys_DPrintf( "[DUKEMP] dnGetPackets: got packet with incorrect session token from %s\n", CSTEAM_FormatId( sender ) );
+				Sys_DPrintf( "[DUKEMP] dnGetPackets: got packet with incorrect session token from %s\n", dnNetFormatID( sender ) );
 			}
 		} else {
 			Sys_DPrintf( "[DUKEMP] dnGetPackets: error reading packet\n" );
@@ -719,10 +958,50 @@ int dnPing( steam_id_t remote ) {
 	pingPacket.header.sessionToken = 0xDEADBEEF;
 	pingPacket.header.tag = TAG_PING;
 	pingPacket.value = rand();
-	CSTEAM_SendPacket( remote, (void*)&pingPacket, sizeof( pingPacket_t ), 0, CHAN_SYNC );
+	dnNetSend( remote, (void*)&pingPacket, sizeof( pingPacket_t ), 0, CHAN_SYNC );
 	return pingPacket.value;
 }
 
+extern "C"
+void dnPingPlayer( int playerIndex, int value ) {
+	pingPacket_t pingPacket;
+	if ( dnIsPlayerIndexValid( playerIndex ) ) {
+		pingPacket.header.sessionToken = 0xDEADBEEF;
+		pingPacket.header.tag = TAG_PING;
+		pingPacket.value = value;
+		dnNetSend( playerIDs[playerIndex], (void*)&pingPacket, sizeof( pingPacket_t ), 0, CHAN_SYNC );
+	}
+}
+
+extern "C"
+int dnGetPong( int *playerIndex, int *value ) {
+	unsigned int msgSize;
+	steam_id_t sender;
+	pingPacket_t *pingPacket;
+	
+	while ( dnNetIsPacketAvailable( &msgSize, CHAN_PONG ) ) {
+		if ( dnNetReadPacket( (void*)packetBuffer, MAX_PACKET_SIZE, &msgSize, &sender, CHAN_PONG ) ) {
+			pingPacket = (pingPacket_t*)&packetBuffer[0];
+			if ( msgSize >= sizeof( pingPacket_t ) && pingPacket->header.tag == TAG_PING ) {
+				*playerIndex = dnPlayerIndex( sender );
+				*value = pingPacket->value;
+				return 1;
+			}
+		}
+	}
+	
+	return 0;
+}
+
+extern "C"
+void dnGetPlayerTraffic( int playerIndex, netTraffic_t *traffic ) {
+	if ( dnIsPlayerIndexValid( playerIndex ) ) {
+		dnNetGetTraffic( playerIDs[playerIndex], traffic );
+	} else {
+		memset( traffic, 0, sizeof( netTraffic_t ) );
+	}
+}
+
 extern "C"
 int  dnCheckPong( steam_id_t remote, int value ) {
 	unsigned int msgSize;
@@ -730,15 +1009,15 @@ int  dnCheckPong( steam_id_t remote, int value ) {
 	pingPacket_t *pingPacket;
 	int retval = 0;
 	
-	while ( CSTEAM_IsPacketAvailable( &msgSize, CHAN_PONG ) ) {
-		if ( CSTEAM_ReadPacket( (void*)packetBuffer, MAX_PACKET_SIZE, &msgSize, &sender, CHAN_PONG ) ) {
+	while ( dnNetIsPacketAvailable( &msgSize, CHAN_PONG ) ) {
+		if ( dnNetReadPacket( (void*)packetBuffer, MAX_PACKET_SIZE, &msgSize, &sender, CHAN_PONG ) ) {
 			pingPacket = (pingPacket_t*)&packetBuffer[0];
 			if ( pingPacket->header.tag == TAG_PING ) {
-				Sys_DPrintf( "[DUKEMP] dnCheckPong: got pong from %s\n", CSTEAM_FormatId( sender ) );
+				Sys_DPrintf( "[DUKEMP] dnCheckPong: got pong from %s\n", dnNetFormatID( sender ) );
 				retval = 1;
 				break;
 			} else {
-				Sys_DPrintf( "[DUKEMP] dnCheckPong: got junk over PONG channel from %s\n", CSTEAM_FormatId( sender ) );
+				Sys_DPrintf( "[DUKEMP] dnCheckPong: got junk over PONG channel from %s\n", dnNetFormatID( sender ) );
 			}
 		} else {
 			Sys_DPrintf( "[DUKEMP] dnCheckPong: error reading packet\n" );
@@ -758,6 +1037,7 @@ int  dnEnterMultiMode( const lobby_info_t *lobbyInfo ) {
 	numPlayers = lobbyInfo->num_players;
 	numActivePlayers = numPlayers;
 	doLoadSnapshot = false;
+	dedicatedhost = 0;		// lobby games are never run by a --dedicated host
 	
 	myConnectIndex = -1;
 	for ( int i = 0; i < numPlayers; i++ ) {
@@ -766,7 +1046,7 @@ int  dnEnterMultiMode( const lobby_info_t *lobbyInfo ) {
 		memset( &ud.user_name[i][0], 0, sizeof( ud.user_name[i] ) );
 		strncpy( &ud.user_name[i][0], dnFilterUsername( lobbyInfo->players[i].name ), sizeof( ud.user_name[i] ) - 1 );
 #endif
-		if ( playerIDs[i] == CSTEAM_MyID() ) {
+		if ( playerIDs[i] == dnNetMyID() ) {
 			myConnectIndex = i;
 		}
 	}
@@ -829,7 +1109,7 @@ void dnNotifyPlayer( int playerIndex, notification_t notification ) {
 		np.header.sessionToken = sessionToken;
 		np.header.tag = TAG_NOTIFICATION;
 		np.notification = notification;
-		CSTEAM_SendPacket( playerIDs[playerIndex], (void*)&np, sizeof( notificationPacket_t ), 1, CHAN_SYNC );
+		dnNetSend( playerIDs[playerIndex], (void*)&np, sizeof( notificationPacket_t ), 1, CHAN_SYNC );
 	}
 }
 
@@ -837,7 +1117,7 @@ extern "C"
 int  dnSendPacket( int playerIndex, const void *bufptr, int size ) {
 	int retval = 0;
 	if ( dnIsPlayerIndexValid( playerIndex ) ) {
-		retval = CSTEAM_SendPacket( playerIDs[playerIndex], bufptr, size, NET_RELIABLE, CHAN_LEGACY );
+		retval = dnNetSend( playerIDs[playerIndex], bufptr, size, NET_RELIABLE, CHAN_LEGACY );
 	}
 	return retval;
 }
@@ -848,10 +1128,37 @@ int dnGetPacket( int *playerIndex, void *bufptr, int size ) {
 	unsigned int bufsize = 0;
 	
 	*playerIndex = -1;
-	if ( CSTEAM_IsPacketAvailable( &bufsize, CHAN_LEGACY ) ) {
+	if ( dnNetIsPacketAvailable( &bufsize, CHAN_LEGACY ) ) {
+		steam_id_t remote;
+		unsigned int msgsize;
+		if ( dnNetReadPacket( bufptr, size, &msgsize, &remote, CHAN_LEGACY ) ) {
+			result = (int)msgsize;
+			*playerIndex = dnPlayerIndex( remote );
+		}
+	}
+	
+	return result;
+}
+
+extern "C"
+int dnSendInputPacket( int playerIndex, const void *bufptr, int size ) {
+	int retval = 0;
+	if ( dnIsPlayerIndexValid( playerIndex ) ) {
+		retval = dnNetSend( playerIDs[playerIndex], bufptr, size, 0, CHAN_INPUT );
+	}
+	return retval;
+}
+
+extern "C"
+int dnGetInputPacket( int *playerIndex, void *bufptr, int size ) {
+	int result = 0;
+	unsigned int bufsize = 0;
+	
+	*playerIndex = -1;
+	if ( dnNetIsPacketAvailable( &bufsize, CHAN_INPUT ) ) {
 		steam_id_t remote;
 		unsigned int msgsize;
-		if ( CSTEAM_ReadPacket( bufptr, size, &msgsize, &remote, CHAN_LEGACY ) ) {
+		if ( dnNetReadPacket( bufptr, size, &msgsize, &remote, CHAN_INPUT ) ) {
 			result = (int)msgsize;
 			*playerIndex = dnPlayerIndex( remote );
 		}
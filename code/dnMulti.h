@@ -18,6 +18,7 @@
 	Channel 0: legacy DN3D network communications
 	Channel 1: pong response
 	Channel 2: ping request, client-server synchronizations, snapshot transmission, etc.
+	Channel 3: redundant input packets (see dnNetInput.h)
  
  */
 
@@ -27,6 +28,7 @@ extern "C" {
 	
 #include "duke3d.h"
 #include "csteam.h"
+#include "dnTransport.h"
 
 #pragma pack(push,1)
 	
@@ -36,6 +38,7 @@ enum {
 	CHAN_LEGACY = 0,
 	CHAN_PONG = 1,
 	CHAN_SYNC = 2,
+	CHAN_INPUT = 3,
 };
 	
 enum {
@@ -91,20 +94,24 @@ typedef struct {
 	playerPrefs_t playerPrefs[MAXPLAYERS];
 } prematchStatusPacket_t;
 	
+#define BLOCK_SACK_CHUNKS 512
+	
 typedef struct {
 	packetHeader_t header;
+	unsigned int blockID;
 	unsigned int blockSize;
-	unsigned int allBlockChunks;
-	unsigned int chunkMask;
 	unsigned int chunkIndex;
-	unsigned int chunkOffset, chunkSize;
+	unsigned int sendTime;			// Sys_GetTicks() in whole milliseconds, echoed back in the status so the server can time the round trip
+	unsigned short chunkSize;
 	unsigned char chunkData[1];
 } blockChunk_t;
 	
 typedef struct {
 	packetHeader_t header;
-	unsigned int blockID;
-	unsigned int chunkMask;
+	unsigned int blockID;			// 0 until the first chunk has arrived
+	unsigned int firstMissing;		// every chunk below this one has arrived
+	unsigned int echoTime;			// sendTime of the chunk this answers, 0 for none
+	unsigned char sack[BLOCK_SACK_CHUNKS / 8];	// bit n: chunk firstMissing + 1 + n has arrived
 } blockDownloadStatus_t;
 	
 typedef struct {
@@ -123,6 +130,9 @@ void dnGetPackets( void );
 void dnWaitForEverybody( blockKind_t blockKind );
 int  dnPing( steam_id_t remote );
 int  dnCheckPong( steam_id_t remote, int value );
+void dnPingPlayer( int playerIndex, int value );
+int  dnGetPong( int *playerIndex, int *value );
+void dnGetPlayerTraffic( int playerIndex, netTraffic_t *traffic );
 
 int  dnEnterMultiMode( const lobby_info_t *lobbyInfo );
 void dnExitMultiMode( void );
@@ -134,11 +144,17 @@ void dnNotifyPlayer( int playerIndex, notification_t notification );
 	
 int dnSendPacket( int playerIndex, const void *bufptr, int size );
 int dnGetPacket( int *playerIndex, void *bufptr, int size );
+int dnSendInputPacket( int playerIndex, const void *bufptr, int size );
+int dnGetInputPacket( int *playerIndex, void *bufptr, int size );
 	
 void dnResyncIfNeeded( void );
 	
 int  dnIsPlayerIndexValid( int playerIndex );
 int  dnGetNextPlayer( int playerIndex );
+
+extern int dedicatedhost;		// player 0 is a --dedicated host: it runs the game but takes no part in it
+
+#define dnIsDedicatedHost(playerIndex) ( dedicatedhost && (playerIndex) == 0 )
 	
 	
 #ifdef __cplusplus
@@ -149,11 +165,13 @@ int  dnGetNextPlayer( int playerIndex );
 
 #define dnIterClients(varname) for ( int varname = dnGetNextPlayer(0); varname >= 0; varname = dnGetNextPlayer( varname ) )
 #define dnIterPlayers(varname) for ( int varname = 0; varname >= 0; varname = dnGetNextPlayer( varname ) )
+#define dnIterPlaying(varname) for ( int varname = dedicatedhost ? dnGetNextPlayer(0) : 0; varname >= 0; varname = dnGetNextPlayer( varname ) )
 
 #else
 
 #define dnIterClients(varname) for ( varname = dnGetNextPlayer(0); varname >= 0; varname = dnGetNextPlayer( varname ) )
 #define dnIterPlayers(varname) for ( varname = 0; varname >= 0; varname = dnGetNextPlayer( varname ) )
+#define dnIterPlaying(varname) for ( varname = dedicatedhost ? dnGetNextPlayer(0) : 0; varname >= 0; varname = dnGetNextPlayer( varname ) )
 
 #endif
 
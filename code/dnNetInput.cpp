@@ -0,0 +1,666 @@
+//
+//  dnNetInput.cpp
+//  duke3d
+//
+//  Redundant, bit-packed input packets for master/slave games
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "dnAPI.h"
+
+extern "C" {
+#include "build.h"
+#include "duke3d.h"
+#include "mmulti.h"
+}
+
+#include "dnMulti.h"
+#include "dnNetInput.h"
+#include "dnDedicated.h"
+
+#define QUIT_BIT (1<<26)
+#define INPUT_MAXHEADER ( 5 + 6 * 5 + INPUT_MAXSYNC )	// kind, stream ids, six varints, sync values
+
+enum {
+	PACKET_MOVES = 1,		// slave -> master
+	PACKET_TICS = 2,		// master -> slave
+};
+
+enum {
+	FIELD_FVEL = 1,
+	FIELD_SVEL = 2,
+	FIELD_AVEL = 4,
+	FIELD_HORZ = 8,
+	FIELD_BITS = 16,
+	FIELD_COUNT = 5,
+};
+
+typedef struct {
+	unsigned char *data;
+	int size;
+	int bit;
+	bool overflow;
+} bitStream_t;
+
+// what the master keeps of a tic besides the moves, which stay in inputfifo
+typedef struct {
+	unsigned short mask;			// players in the game
+	bool timerUpdate;
+	signed char lag[MAXPLAYERS];	// each client's myminlag, sent on timer updates
+} inputTic_t;
+
+static int enabled = 1;
+static bool active = false;
+static int maxMoves = INPUT_DEFAULTMOVES;
+static inputStats_t stats;
+
+static unsigned short myStream;
+static unsigned short peerStream[MAXPLAYERS];	// 0 until the peer's current stream is heard
+static long ackedMoves[MAXPLAYERS];				// how much of ours each peer has
+static long ackedSync[MAXPLAYERS];
+static double lastSend[MAXPLAYERS];
+static bool ackOwed[MAXPLAYERS];
+
+static inputTic_t masterTics[MOVEFIFOSIZ];
+static long numTics;
+
+static unsigned char packet[INPUT_MAXPACKET];
+static unsigned char bitBuffer[INPUT_MAXPACKET - INPUT_MAXHEADER];
+
+static input decodedMoves[INPUT_MAXMOVES][MAXPLAYERS];
+static inputTic_t decodedTics[INPUT_MAXMOVES];
+
+static
+void dnOpenStream( bitStream_t *s, unsigned char *data, int size ) {
+	s->data = data;
+	s->size = size;
+	s->bit = 0;
+	s->overflow = false;
+}
+
+static
+void dnPutBits( bitStream_t *s, unsigned int value, int count ) {
+	for ( int i = 0; i < count; i++, s->bit++ ) {
+		if ( ( s->bit >> 3 ) >= s->size ) {
+			s->overflow = true;
+			return;
+		}
+		if ( value & ( 1u << i ) ) {
+			s->data[s->bit >> 3] |= 1 << ( s->bit & 7 );
+		} else {
+			s->data[s->bit >> 3] &= ~( 1 << ( s->bit & 7 ) );
+		}
+	}
+}
+
+static
+unsigned int dnGetBits( bitStream_t *s, int count ) {
+	unsigned int value = 0;
+	for ( int i = 0; i < count; i++, s->bit++ ) {
+		if ( ( s->bit >> 3 ) >= s->size ) {
+			s->overflow = true;
+			return 0;
+		}
+		if ( s->data[s->bit >> 3] & ( 1 << ( s->bit & 7 ) ) ) {
+			value |= 1u << i;
+		}
+	}
+	return value;
+}
+
+// a non-zero difference: its bit length, then the bits below the top one
+static
+void dnPutDelta( bitStream_t *s, int delta, int lengthBits ) {
+	unsigned int zigzag = ( (unsigned int)delta << 1 ) ^ (unsigned int)( delta >> 31 );
+	int length = 0;
+
+	while ( length < 32 && ( zigzag >> length ) ) {
+		length++;
+	}
+	dnPutBits( s, length, lengthBits );
+	dnPutBits( s, zigzag, length - 1 );
+}
+
+static
+int dnGetDelta( bitStream_t *s, int lengthBits ) {
+	int length = dnGetBits( s, lengthBits );
+	unsigned int zigzag;
+
+	if ( length == 0 ) {
+		s->overflow = true;
+		return 0;
+	}
+	zigzag = dnGetBits( s, length - 1 ) | ( 1u << ( length - 1 ) );
+	return (int)( zigzag >> 1 ) ^ -(int)( zigzag & 1 );
+}
+
+// the button bits flip a few at a time: list the positions, or the changed bytes when shorter
+static
+void dnPutButtons( bitStream_t *s, unsigned int before, unsigned int after ) {
+	unsigned int flipped = before ^ after;
+	int count = 0, bytes = 0;
+
+	for ( int i = 0; i < 32; i++ ) {
+		count += ( flipped >> i ) & 1;
+	}
+	for ( int i = 0; i < 4; i++ ) {
+		bytes += ( ( flipped >> ( i << 3 ) ) & 255 ) != 0;
+	}
+
+	if ( count <= 4 && 3 + 5 * count <= 5 + 8 * bytes ) {
+		dnPutBits( s, 0, 1 );
+		dnPutBits( s, count - 1, 2 );
+		for ( int i = 0; i < 32; i++ ) {
+			if ( ( flipped >> i ) & 1 ) {
+				dnPutBits( s, i, 5 );
+			}
+		}
+	} else {
+		dnPutBits( s, 1, 1 );
+		for ( int i = 0; i < 4; i++ ) {
+			dnPutBits( s, ( ( flipped >> ( i << 3 ) ) & 255 ) != 0, 1 );
+		}
+		for ( int i = 0; i < 4; i++ ) {
+			if ( ( flipped >> ( i << 3 ) ) & 255 ) {
+				dnPutBits( s, ( after >> ( i << 3 ) ) & 255, 8 );
+			}
+		}
+	}
+}
+
+static
+unsigned int dnGetButtons( bitStream_t *s, unsigned int before ) {
+	unsigned int after = before;
+
+	if ( !dnGetBits( s, 1 ) ) {
+		int count = dnGetBits( s, 2 ) + 1;
+		for ( int i = 0; i < count; i++ ) {
+			after ^= 1u << dnGetBits( s, 5 );
+		}
+	} else {
+		int changed = dnGetBits( s, 4 );
+		for ( int i = 0; i < 4; i++ ) {
+			if ( changed & ( 1 << i ) ) {
+				after = ( after & ~( 255u << ( i << 3 ) ) ) | ( dnGetBits( s, 8 ) << ( i << 3 ) );
+			}
+		}
+	}
+	return after;
+}
+
+static
+void dnPutMove( bitStream_t *s, const input *before, const input *after ) {
+	int fields = 0;
+
+	if ( after->fvel != before->fvel ) fields |= FIELD_FVEL;
+	if ( after->svel != before->svel ) fields |= FIELD_SVEL;
+	if ( after->avel != before->avel ) fields |= FIELD_AVEL;
+	if ( after->horz != before->horz ) fields |= FIELD_HORZ;
+	if ( (unsigned int)after->bits != (unsigned int)before->bits ) fields |= FIELD_BITS;
+
+	dnPutBits( s, fields != 0, 1 );
+	if ( !fields ) {
+		return;
+	}
+	dnPutBits( s, fields, FIELD_COUNT );
+
+	if ( fields & FIELD_FVEL ) dnPutDelta( s, after->fvel - before->fvel, 5 );
+	if ( fields & FIELD_SVEL ) dnPutDelta( s, after->svel - before->svel, 5 );
+	if ( fields & FIELD_AVEL ) dnPutDelta( s, after->avel - before->avel, 4 );
+	if ( fields & FIELD_HORZ ) dnPutDelta( s, after->horz - before->horz, 4 );
+	if ( fields & FIELD_BITS ) dnPutButtons( s, (unsigned int)before->bits, (unsigned int)after->bits );
+}
+
+static
+void dnGetMove( bitStream_t *s, const input *before, input *after ) {
+	int fields;
+
+	*after = *before;
+	if ( !dnGetBits( s, 1 ) ) {
+		return;
+	}
+	fields = dnGetBits( s, FIELD_COUNT );
+
+	if ( fields & FIELD_FVEL ) after->fvel = (short)( before->fvel + dnGetDelta( s, 5 ) );
+	if ( fields & FIELD_SVEL ) after->svel = (short)( before->svel + dnGetDelta( s, 5 ) );
+	if ( fields & FIELD_AVEL ) after->avel = (signed char)( before->avel + dnGetDelta( s, 4 ) );
+	if ( fields & FIELD_HORZ ) after->horz = (signed char)( before->horz + dnGetDelta( s, 4 ) );
+	if ( fields & FIELD_BITS ) after->bits = dnGetButtons( s, (unsigned int)before->bits );
+}
+
+static
+unsigned char *dnPutVarint( unsigned char *p, unsigned long value ) {
+	while ( value >= 128 ) {
+		*p++ = (unsigned char)( value | 128 );
+		value >>= 7;
+	}
+	*p++ = (unsigned char)value;
+	return p;
+}
+
+static
+const unsigned char *dnGetVarint( const unsigned char *p, const unsigned char *end, long *value ) {
+	unsigned long result = 0;
+
+	for ( int shift = 0; shift < 32; shift += 7 ) {
+		if ( p >= end ) {
+			return NULL;
+		}
+		result |= (unsigned long)( *p & 127 ) << shift;
+		if ( !( *p++ & 128 ) ) {
+			*value = (long)result;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static
+long dnProducedMoves( void ) {
+	if ( myconnectindex == connecthead ) {
+		return numTics;
+	}
+	return ( movefifoend[myconnectindex] + movesperpacket - 1 ) / movesperpacket;
+}
+
+// a slave's own moves, oldest unacknowledged first
+static
+long dnPutMoves( bitStream_t *s, long base, long count ) {
+	input previous;
+	long m;
+
+	memset( &previous, 0, sizeof( previous ) );
+	for ( m = 0; m < count; m++ ) {
+		const input *move = &inputfifo[( ( base + m ) * movesperpacket ) & ( MOVEFIFOSIZ - 1 )][myconnectindex];
+		int mark = s->bit;
+
+		dnPutMove( s, &previous, move );
+		if ( s->overflow ) {
+			s->bit = mark;
+			s->overflow = false;
+			break;
+		}
+		previous = *move;
+	}
+	return m;
+}
+
+// every player's move of the master's tics, and the client's lag where the timers are updated
+static
+long dnPutTics( bitStream_t *s, int client, long base, long count ) {
+	input previous[MAXPLAYERS];
+	long m;
+
+	memset( previous, 0, sizeof( previous ) );
+	for ( m = 0; m < count; m++ ) {
+		const inputTic_t *tic = &masterTics[( base + m ) & ( MOVEFIFOSIZ - 1 )];
+		const input *moves = &inputfifo[( ( base + m ) * movesperpacket ) & ( MOVEFIFOSIZ - 1 )][0];
+		unsigned short previousMask = masterTics[( base + m - 1 ) & ( MOVEFIFOSIZ - 1 )].mask;
+		int mark = s->bit;
+
+		if ( m > 0 ) {
+			dnPutBits( s, tic->mask == previousMask, 1 );
+		}
+		if ( m == 0 || tic->mask != previousMask ) {
+			dnPutBits( s, tic->mask, numplayers );
+		}
+		dnPutBits( s, tic->timerUpdate, 1 );
+		if ( tic->timerUpdate ) {
+			dnPutBits( s, (unsigned char)tic->lag[client], 8 );
+		}
+		for ( int i = 0; i < numplayers; i++ ) {
+			if ( tic->mask & ( 1 << i ) ) {
+				dnPutMove( s, &previous[i], &moves[i] );
+			}
+		}
+		if ( s->overflow ) {
+			s->bit = mark;
+			s->overflow = false;
+			break;
+		}
+		for ( int i = 0; i < numplayers; i++ ) {
+			if ( tic->mask & ( 1 << i ) ) {
+				previous[i] = moves[i];
+			}
+		}
+	}
+	return m;
+}
+
+static
+void dnSendTo( int peer ) {
+	unsigned char *p = packet;
+	bitStream_t s;
+	long base = 0, count = 0, syncBase = 0, syncCount = 0;
+	int size, bytes;
+
+	dnOpenStream( &s, bitBuffer, INPUT_MAXPACKET - INPUT_MAXHEADER );
+
+	// a machine that sends the legacy packets still acknowledges what it gets this way
+	if ( active ) {
+		long produced = dnProducedMoves();
+
+		base = min( ackedMoves[peer], produced );
+		count = min( produced - base, (long)maxMoves );
+		if ( myconnectindex == connecthead ) {
+			count = dnPutTics( &s, peer, base, count );
+		} else {
+			count = dnPutMoves( &s, base, count );
+		}
+
+		syncBase = min( ackedSync[peer], syncvalhead[myconnectindex] );
+		syncCount = min( syncvalhead[myconnectindex] - syncBase, (long)INPUT_MAXSYNC );
+	}
+
+	*p++ = myconnectindex == connecthead ? PACKET_TICS : PACKET_MOVES;
+	*p++ = myStream & 255;
+	*p++ = myStream >> 8;
+	*p++ = peerStream[peer] & 255;
+	*p++ = peerStream[peer] >> 8;
+	p = dnPutVarint( p, movefifoend[peer] / movesperpacket );
+	p = dnPutVarint( p, syncvalhead[peer] );
+	p = dnPutVarint( p, base );
+	p = dnPutVarint( p, count );
+	p = dnPutVarint( p, syncBase );
+	p = dnPutVarint( p, syncCount );
+	for ( long k = 0; k < syncCount; k++ ) {
+		*p++ = syncval[myconnectindex][( syncBase + k ) & ( MOVEFIFOSIZ - 1 )];
+	}
+
+	bytes = ( s.bit + 7 ) >> 3;
+	memcpy( p, bitBuffer, bytes );
+	size = (int)( p - packet ) + bytes;
+
+	dnSendInputPacket( peer, packet, size );
+	stats.packetsSent++;
+	stats.bytesSent += size;
+	lastSend[peer] = Sys_GetTicks();
+	ackOwed[peer] = false;
+}
+
+static
+bool dnIsOverdue( int peer, double now ) {
+	if ( now - lastSend[peer] < INPUT_RESENDMS ) {
+		return false;
+	}
+	if ( ackOwed[peer] ) {
+		return true;
+	}
+	return active && ( ackedMoves[peer] < dnProducedMoves() || ackedSync[peer] < syncvalhead[myconnectindex] );
+}
+
+static
+void dnPushSyncVal( int peer, char value ) {
+	if ( myconnectindex == connecthead ) {
+		syncval[peer][syncvalhead[peer] & ( MOVEFIFOSIZ - 1 )] = value;
+		syncvalhead[peer]++;
+		return;
+	}
+
+	// the master's values stand for everybody else's, as in packet 0
+	dnIterPlayers( i ) {
+		if ( i != myconnectindex ) {
+			syncval[i][syncvalhead[i] & ( MOVEFIFOSIZ - 1 )] = value;
+			syncvalhead[i]++;
+		}
+	}
+}
+
+// a slave's move on the master, as packet 1
+static
+void dnApplyMove( int peer, const input *move ) {
+	for ( int k = 0; k < movesperpacket; k++ ) {
+		copybufbyte( (void*)move, &inputfifo[movefifoend[peer] & ( MOVEFIFOSIZ - 1 )][peer], sizeof( input ) );
+		movefifoend[peer]++;
+	}
+	if ( move->bits & QUIT_BIT ) {
+		Sys_DPrintf( "[DUKEMP] Player quit\n" );
+	}
+}
+
+// a master's tic on a slave, as packet 0
+static
+void dnApplyTic( const inputTic_t *tic, const input *moves ) {
+	if ( tic->timerUpdate ) {
+		otherminlag = tic->lag[myconnectindex];
+	}
+
+	for ( int i = 0; i < numplayers; i++ ) {
+		if ( !( tic->mask & ( 1 << i ) ) || i == myconnectindex ) {
+			continue;
+		}
+		for ( int k = 0; k < movesperpacket; k++ ) {
+			copybufbyte( (void*)&moves[i], &inputfifo[movefifoend[i] & ( MOVEFIFOSIZ - 1 )][i], sizeof( input ) );
+			movefifoend[i]++;
+		}
+		if ( moves[i].bits & QUIT_BIT ) {
+			playerquitflag[i] = 0;
+		}
+	}
+
+	movefifosendplc += movesperpacket;
+}
+
+static
+bool dnDecodeMoves( bitStream_t *s, long count ) {
+	input empty;
+
+	memset( &empty, 0, sizeof( empty ) );
+	for ( long m = 0; m < count && !s->overflow; m++ ) {
+		dnGetMove( s, m ? &decodedMoves[m - 1][0] : &empty, &decodedMoves[m][0] );
+	}
+	return !s->overflow;
+}
+
+static
+bool dnDecodeTics( bitStream_t *s, long count ) {
+	input previous[MAXPLAYERS];
+	unsigned short mask = 0;
+
+	memset( previous, 0, sizeof( previous ) );
+	for ( long m = 0; m < count && !s->overflow; m++ ) {
+		inputTic_t *tic = &decodedTics[m];
+
+		if ( m == 0 || !dnGetBits( s, 1 ) ) {
+			mask = dnGetBits( s, numplayers );
+		}
+		tic->mask = mask;
+		tic->timerUpdate = dnGetBits( s, 1 ) != 0;
+		tic->lag[myconnectindex] = tic->timerUpdate ? (signed char)dnGetBits( s, 8 ) : 0;
+
+		for ( int i = 0; i < numplayers; i++ ) {
+			if ( mask & ( 1 << i ) ) {
+				dnGetMove( s, &previous[i], &decodedMoves[m][i] );
+				previous[i] = decodedMoves[m][i];
+			}
+		}
+	}
+	return !s->overflow;
+}
+
+static
+void dnReadPacket( int peer, unsigned char *data, int size ) {
+	const unsigned char *p = data + 5, *end = data + size;
+	long ackMoves, ackSync, base, count, syncBase, syncCount;
+	long expected, first;
+	unsigned short stream, ackStream;
+	bitStream_t s;
+	bool fromMaster = peer == connecthead;
+
+	if ( size < 5 || data[0] != ( fromMaster ? PACKET_TICS : PACKET_MOVES ) || fromMaster == ( myconnectindex == connecthead ) ) {
+		stats.dropped++;
+		return;
+	}
+	stream = data[1] | ( data[2] << 8 );
+	ackStream = data[3] | ( data[4] << 8 );
+
+	if ( !( p = dnGetVarint( p, end, &ackMoves ) ) || !( p = dnGetVarint( p, end, &ackSync ) ) ||
+		 !( p = dnGetVarint( p, end, &base ) ) || !( p = dnGetVarint( p, end, &count ) ) ||
+		 !( p = dnGetVarint( p, end, &syncBase ) ) || !( p = dnGetVarint( p, end, &syncCount ) ) ||
+		 count < 0 || count > INPUT_MAXMOVES || syncCount < 0 || syncCount > INPUT_MAXSYNC || end - p < syncCount ) {
+		stats.dropped++;
+		return;
+	}
+
+	// acknowledgements only count for what this machine sent since its last reset
+	if ( ackStream == myStream ) {
+		ackedMoves[peer] = max( ackedMoves[peer], min( ackMoves, dnProducedMoves() ) );
+		ackedSync[peer] = max( ackedSync[peer], min( ackSync, syncvalhead[myconnectindex] ) );
+	}
+
+	expected = movefifoend[peer] / movesperpacket;
+	if ( stream != peerStream[peer] ) {
+		// a new stream starts from nothing, on both sides; anything else is left over from before
+		if ( base != 0 || expected != 0 || syncvalhead[peer] != 0 || ( ackStream != 0 && ackStream != myStream ) ) {
+			stats.dropped++;
+			return;
+		}
+		peerStream[peer] = stream;
+	}
+
+	if ( count == 0 && syncCount == 0 ) {
+		return;
+	}
+	ackOwed[peer] = true;
+
+	dnOpenStream( &s, (unsigned char*)p + syncCount, (int)( end - p - syncCount ) );
+	if ( !( fromMaster ? dnDecodeTics( &s, count ) : dnDecodeMoves( &s, count ) ) ) {
+		stats.dropped++;
+		return;
+	}
+
+	if ( base > expected ) {
+		stats.gaps++;
+	} else if ( count > 0 ) {
+		first = expected - base;
+		stats.movesRepeated += min( first, count );
+		for ( long m = first; m < count; m++ ) {
+			if ( fromMaster ) {
+				dnApplyTic( &decodedTics[m], &decodedMoves[m][0] );
+			} else {
+				dnApplyMove( peer, &decodedMoves[m][0] );
+			}
+			stats.movesApplied++;
+		}
+	}
+
+	if ( syncBase <= syncvalhead[peer] ) {
+		for ( long k = syncvalhead[peer] - syncBase; k < syncCount; k++ ) {
+			dnPushSyncVal( peer, p[k] );
+		}
+	}
+}
+
+extern "C"
+void dnInputSetEnabled( int on ) {
+	enabled = on != 0;
+}
+
+extern "C"
+int dnInputEnabled( void ) {
+	return enabled;
+}
+
+extern "C"
+int dnInputActive( void ) {
+	return active && numplayers > 1 && networkmode == 0;
+}
+
+extern "C"
+void dnInputSetMaxMoves( int moves ) {
+	maxMoves = max( 1, min( moves, INPUT_MAXMOVES ) );
+}
+
+extern "C"
+int dnInputGetMaxMoves( void ) {
+	return maxMoves;
+}
+
+extern "C"
+void dnInputGetStats( inputStats_t *out ) {
+	*out = stats;
+}
+
+extern "C"
+void dnInputReset( void ) {
+	unsigned short previous = myStream;
+
+	do {
+		myStream = (unsigned short)( rand() ^ (int)Sys_GetTicks() );
+	} while ( myStream == 0 || myStream == previous );
+
+	active = enabled != 0;
+	numTics = 0;
+	memset( peerStream, 0, sizeof( peerStream ) );
+	memset( ackedMoves, 0, sizeof( ackedMoves ) );
+	memset( ackedSync, 0, sizeof( ackedSync ) );
+	memset( lastSend, 0, sizeof( lastSend ) );
+	memset( ackOwed, 0, sizeof( ackOwed ) );
+}
+
+extern "C"
+void dnInputGetPackets( void ) {
+	int peer, size;
+	double now;
+
+	if ( numplayers < 2 || networkmode != 0 ) {
+		return;
+	}
+
+	while ( ( size = dnGetInputPacket( &peer, packet, sizeof( packet ) ) ) > 0 ) {
+		if ( !dnIsPlayerIndexValid( peer ) || peer == myconnectindex ) {
+			continue;
+		}
+		keepalive( peer );
+		if ( dedicated ) {
+			dnDedicatedNotePacket( peer, size );
+		}
+		stats.packetsReceived++;
+		stats.bytesReceived += size;
+		dnReadPacket( peer, packet, size );
+	}
+
+	now = Sys_GetTicks();
+	if ( myconnectindex == connecthead ) {
+		dnIterClients( i ) {
+			if ( playerquitflag[i] && dnIsOverdue( i, now ) ) {
+				dnSendTo( i );
+			}
+		}
+	} else if ( dnIsOverdue( connecthead, now ) ) {
+		dnSendTo( connecthead );
+	}
+}
+
+extern "C"
+void dnInputSendMoves( void ) {
+	dnSendTo( connecthead );
+}
+
+extern "C"
+void dnInputRecordTic( long fifoIndex, int timerUpdate ) {
+	long m = fifoIndex / movesperpacket;
+	inputTic_t *tic = &masterTics[m & ( MOVEFIFOSIZ - 1 )];
+
+	tic->mask = 0;
+	dnIterPlayers( i ) {
+		if ( playerquitflag[i] ) {
+			tic->mask |= 1 << i;
+		}
+	}
+	tic->timerUpdate = timerUpdate != 0;
+	dnIterClients( i ) {
+		tic->lag[i] = (signed char)min( max( myminlag[i], -128 ), 127 );
+	}
+	numTics = m + 1;
+}
+
+extern "C"
+void dnInputSendTics( void ) {
+	dnIterClients( i ) {
+		if ( playerquitflag[i] ) {
+			dnSendTo( i );
+		}
+	}
+}
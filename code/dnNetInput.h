@@ -0,0 +1,78 @@
+//
+//  dnNetInput.h
+//  duke3d
+//
+//  Redundant, bit-packed input packets for master/slave games
+//
+
+#ifndef DNNETINPUT_H
+#define DNNETINPUT_H
+
+/*
+
+ The legacy sync packets (0 from the master, 1 from a slave) carry one tic each and go through
+ mmulti's ordered resend loop, so a single lost datagram holds every later tic back until
+ dosendpackets tries it again. These packets go over their own unreliable channel instead, and
+ every one of them repeats everything the other side hasn't acknowledged yet: a lost packet is
+ made good by the next one, which leaves on the next tic anyway.
+
+ Each packet acknowledges what its sender has received so far. Moves are bit-packed: a move that
+ repeats the previous one costs a single bit, otherwise a field mask follows, the speeds and angles
+ are sent as the difference to the previous move with a length prefix, and the button bits as the
+ positions that flipped (or the bytes that changed, when that is shorter). The first move of every
+ packet is coded against an empty input, so a packet never depends on another one having arrived.
+
+ The master sends each client, per tic, which players are in, their moves and that client's lag
+ byte at timer updates. A slave sends the master its own moves. Both add their unacknowledged sync
+ values. What a packet brings is applied exactly as packets 0 and 1 are, and only once it follows
+ on from what is already in: anything older is skipped, anything after a gap waits for a resend.
+ When nothing new has been sent for INPUT_RESENDMS while something is still unacknowledged, it is
+ sent again.
+
+ Every machine picks a new stream id whenever the fifos are cleared and packets carry it, so what
+ is still in flight from before a level change or a resync is recognised and dropped. Receiving
+ is always on; net_inputcodec only decides how this machine sends, from the next level on, so it
+ can be set differently on every machine. Peer-to-peer games keep the legacy packets.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INPUT_MAXMOVES 64			// most tics one packet repeats
+#define INPUT_DEFAULTMOVES 32
+#define INPUT_MAXSYNC 64			// most sync values one packet repeats
+#define INPUT_MAXPACKET 4096
+#define INPUT_RESENDMS 40
+
+typedef struct {
+	int packetsSent;
+	int bytesSent;
+	int packetsReceived;
+	int bytesReceived;
+	int movesApplied;		// tics that reached the fifos through these packets
+	int movesRepeated;		// tics that came again after they were already in
+	int gaps;				// packets that had to wait for an earlier tic
+	int dropped;			// stale or malformed packets
+} inputStats_t;
+
+void dnInputSetEnabled( int enabled );
+int  dnInputEnabled( void );
+int  dnInputActive( void );			// this machine sends its input this way in the current game
+void dnInputSetMaxMoves( int moves );
+int  dnInputGetMaxMoves( void );
+void dnInputGetStats( inputStats_t *stats );
+
+void dnInputReset( void );			// the fifos have been cleared
+void dnInputGetPackets( void );		// apply what has arrived and resend what is overdue
+
+void dnInputSendMoves( void );		// slave: the moves the master hasn't acknowledged
+void dnInputRecordTic( long fifoIndex, int timerUpdate );	// master: a tic is complete
+void dnInputSendTics( void );		// master: the tics each client hasn't acknowledged
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNNETINPUT_H */
@@ -0,0 +1,275 @@
+//
+//  dnRewind.cpp
+//  duke3d
+//
+//  Rewind: the last seconds of a single player game kept in memory and restored at once
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "dnAPI.h"
+
+extern "C" {
+#include "build.h"
+#include "duke3d.h"
+#include "osd.h"
+}
+
+#include "dnSnapshot.h"
+#include "dnRewind.h"
+
+#define TICSPERSECOND ( TICRATE / TICSPERFRAME )
+#define REWIND_MERGEGAP 8		// equal bytes a run carries along rather than start another one
+
+/*
+ An entry is a list of runs, each an offset and a length followed by the bytes, which copied over
+ the state after it give back the state the entry was taken at.
+ */
+typedef struct {
+	long tic;
+	unsigned char *data;
+	unsigned int size;
+} rewindEntry_t;
+
+static int history = REWIND_DEFAULTHISTORY;
+static int interval = REWIND_DEFAULTINTERVAL;
+static int key = sc_BackSpace;
+static rewindStats_t stats;
+
+static rewindEntry_t ring[REWIND_MAXENTRIES];
+static int first, count;
+static long bytes;
+
+static snapshot_t *head = NULL, *spare = NULL;	// the newest state, and room for the one after it
+static bool haveHead = false;
+static long headTic;
+static long tic;
+
+static std::vector<unsigned char> runs;
+
+static
+bool dnRewindWanted( void ) {
+	return history > 0 && numplayers < 2 && ud.multimode < 2 && ud.recstat == 0 && ( ps[myconnectindex].gm & MODE_GAME );
+}
+
+static
+int dnCapacity( void ) {
+	return max( 1, min( history * TICSPERSECOND / interval, REWIND_MAXENTRIES ) );
+}
+
+static
+void dnDropOldest( void ) {
+	rewindEntry_t *entry = &ring[first];
+
+	bytes -= entry->size;
+	free( entry->data );
+	entry->data = NULL;
+	first = ( first + 1 ) % REWIND_MAXENTRIES;
+	count--;
+}
+
+static
+void dnDropNewest( void ) {
+	rewindEntry_t *entry = &ring[( first + count - 1 ) % REWIND_MAXENTRIES];
+
+	bytes -= entry->size;
+	free( entry->data );
+	entry->data = NULL;
+	count--;
+}
+
+static
+void dnAppendRun( const unsigned char *state, unsigned int offset, unsigned int length ) {
+	size_t at = runs.size();
+
+	runs.resize( at + 2 * sizeof( unsigned int ) + length );
+	memcpy( &runs[at], &offset, sizeof( unsigned int ) );
+	memcpy( &runs[at + sizeof( unsigned int )], &length, sizeof( unsigned int ) );
+	memcpy( &runs[at + 2 * sizeof( unsigned int )], state + offset, length );
+}
+
+// the runs that turn from into to
+static
+void dnCalcRuns( const snapshot_t *fromState, const snapshot_t *toState, rewindEntry_t *entry ) {
+	const unsigned char *from = (const unsigned char*)fromState;
+	const unsigned char *to = (const unsigned char*)toState;
+	const unsigned int size = sizeof( snapshot_t );
+	unsigned int i = 0, start, end;
+
+	runs.clear();
+	while ( i < size ) {
+		if ( from[i] == to[i] ) {
+			// most of the state doesn't change from one second to the next
+			if ( ( i & 63 ) == 0 && i + 64 <= size && !memcmp( from + i, to + i, 64 ) ) {
+				i += 64;
+			} else {
+				i++;
+			}
+			continue;
+		}
+
+		start = i;
+		end = i + 1;
+		for ( i = end; i < size; i++ ) {
+			if ( from[i] != to[i] ) {
+				end = i + 1;
+			} else if ( i - end >= REWIND_MERGEGAP ) {
+				break;
+			}
+		}
+		dnAppendRun( to, start, end - start );
+		i = end;
+	}
+
+	entry->size = runs.size();
+	entry->data = (unsigned char*)malloc( max( entry->size, 1u ) );
+	if ( entry->size ) {
+		memcpy( entry->data, &runs[0], entry->size );
+	}
+}
+
+static
+void dnApplyRuns( snapshot_t *state, const rewindEntry_t *entry ) {
+	unsigned char *base = (unsigned char*)state;
+	const unsigned char *p = entry->data, *end = entry->data + entry->size;
+	unsigned int offset, length;
+
+	while ( p < end ) {
+		memcpy( &offset, p, sizeof( unsigned int ) );
+		memcpy( &length, p + sizeof( unsigned int ), sizeof( unsigned int ) );
+		p += 2 * sizeof( unsigned int );
+		memcpy( base + offset, p, length );
+		p += length;
+	}
+}
+
+static
+void dnTake( void ) {
+	rewindEntry_t *entry;
+	snapshot_t *swap;
+
+	if ( !head ) {
+		head = (snapshot_t*)calloc( 1, sizeof( snapshot_t ) );
+		spare = (snapshot_t*)calloc( 1, sizeof( snapshot_t ) );
+	}
+
+	if ( !haveHead ) {
+		dnTakeSnapshot( head );
+		headTic = tic;
+		haveHead = true;
+		return;
+	}
+
+	while ( count >= dnCapacity() ) {
+		dnDropOldest();
+	}
+
+	dnTakeSnapshot( spare );
+	entry = &ring[( first + count ) % REWIND_MAXENTRIES];
+	entry->tic = headTic;
+	dnCalcRuns( spare, head, entry );
+	bytes += entry->size;
+	count++;
+
+	swap = head;
+	head = spare;
+	spare = swap;
+	headTic = tic;
+}
+
+extern "C"
+void dnRewindSetHistory( int seconds ) {
+	history = max( seconds, 0 );
+	if ( !history ) {
+		dnRewindReset();
+	}
+}
+
+extern "C"
+int dnRewindGetHistory( void ) {
+	return history;
+}
+
+extern "C"
+void dnRewindSetInterval( int tics ) {
+	interval = max( 1, min( tics, TICSPERSECOND * 60 ) );
+}
+
+extern "C"
+int dnRewindGetInterval( void ) {
+	return interval;
+}
+
+extern "C"
+void dnRewindSetKey( int scancode ) {
+	key = scancode;
+}
+
+extern "C"
+int dnRewindGetKey( void ) {
+	return key;
+}
+
+extern "C"
+void dnRewindGetStats( rewindStats_t *out ) {
+	long oldest = count ? ring[first].tic : headTic;
+
+	*out = stats;
+	out->entries = count;
+	out->seconds = haveHead ? ( tic - oldest ) / TICSPERSECOND : 0;
+	out->bytes = bytes;
+}
+
+extern "C"
+void dnRewindReset( void ) {
+	while ( count ) {
+		dnDropOldest();
+	}
+	first = 0;
+	haveHead = false;
+	tic = 0;
+}
+
+extern "C"
+void dnRewindCapture( void ) {
+	if ( !dnRewindWanted() ) {
+		return;
+	}
+	// a state just rewound to is the head already
+	if ( tic % interval == 0 && !( haveHead && headTic == tic ) ) {
+		dnTake();
+	}
+	tic++;
+}
+
+extern "C"
+int dnRewind( long seconds ) {
+	long target = tic - max( seconds, 0L ) * TICSPERSECOND;
+
+	if ( !dnRewindWanted() || !haveHead ) {
+		return 0;
+	}
+
+	// newest state at least that far back, or the oldest there is
+	while ( headTic > target && count ) {
+		rewindEntry_t *entry = &ring[( first + count - 1 ) % REWIND_MAXENTRIES];
+		dnApplyRuns( head, entry );
+		headTic = entry->tic;
+		dnDropNewest();
+	}
+	if ( headTic == tic ) {
+		return 0;
+	}
+
+	FX_StopAllSounds();
+	clearsoundlocks();
+	dnRestoreSnapshot( head );
+	resetinterpolations();
+	totalclock = ototalclock = lockclock;
+
+	Sys_DPrintf( "[DUKEMP] dnRewind: back %ld tics, %d entries left\n", tic - headTic, count );
+	tic = headTic;
+	stats.restores++;
+	return 1;
+}
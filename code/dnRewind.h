@@ -0,0 +1,58 @@
+//
+//  dnRewind.h
+//  duke3d
+//
+//  Rewind: the last seconds of a single player game kept in memory and restored at once
+//
+
+#ifndef DNREWIND_H
+#define DNREWIND_H
+
+/*
+
+ Every rewind_interval tics a single player game takes a dnSnapshot. Only the newest is kept
+ whole; for every older one the ring keeps what turns its successor back into it, as runs of
+ changed bytes: between states a second apart that is a few kilobytes against the megabytes of
+ snapshot_t. Entries older than rewind_history seconds are dropped.
+
+ rewind <seconds>, or the rewind_key, goes back to the newest state at least that far behind the
+ current tic: the runs of every newer entry are copied over the newest snapshot, so the cost
+ depends on what changed and not on the size of the state. What came after is forgotten. The
+ ring starts over whenever the fifos are cleared, and nothing is kept in multiplayer games or
+ while a demo records or plays, where the other side or the file would no longer match.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REWIND_MAXENTRIES 512
+#define REWIND_DEFAULTHISTORY 60		// seconds
+#define REWIND_DEFAULTINTERVAL 30		// tics
+#define REWIND_KEYSECONDS 3
+
+typedef struct {
+	int entries;
+	long seconds;				// how far back the oldest entry is
+	long bytes;					// held by the entries, without the two whole snapshots
+	int restores;
+} rewindStats_t;
+
+void dnRewindSetHistory( int seconds );		// 0 turns rewinding off
+int  dnRewindGetHistory( void );
+void dnRewindSetInterval( int tics );
+int  dnRewindGetInterval( void );
+void dnRewindSetKey( int scancode );		// 0 for none
+int  dnRewindGetKey( void );
+void dnRewindGetStats( rewindStats_t *stats );
+
+void dnRewindReset( void );			// the fifos have been cleared
+void dnRewindCapture( void );		// at the start of every tic
+int  dnRewind( long seconds );		// 0 if there is nothing to go back to
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNREWIND_H */
@@ -0,0 +1,470 @@
+//
+//  dnRollback.cpp
+//  duke3d
+//
+//  Rollback netcode: predict remote input, rewind and re-simulate on a miss
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "dnAPI.h"
+
+extern "C" {
+#include "build.h"
+#include "duke3d.h"
+}
+
+#include "dnMulti.h"
+#include "dnRollback.h"
+#include "dnDedicated.h"
+
+#define ROLLBACK_MAXSOUNDS 16
+#define QUIT_BIT (1<<26)
+
+/*
+ The state before a speculative tic. It is only ever loaded back into the same process, so unlike
+ snapshot_t nothing is relocated: script pointers in hittype and animateptr are kept as they are,
+ the script itself is left out since nothing changes it during play, and only the walls, sectors
+ and sprites the level actually uses are copied. The sprite lists are copied whole, the free list
+ threads through sprites above the last one in use.
+ */
+typedef struct {
+	short num, i;
+} rollbackSound_t;
+
+typedef struct {
+	long tic;
+	input used[MAXPLAYERS];		// what the tic ran on, predicted or not
+	int syncval;				// -1 when the tic didn't produce one
+	int numsounds;
+	rollbackSound_t sounds[ROLLBACK_MAXSOUNDS];
+	unsigned char *data;
+	unsigned int size, alloc;
+} rollbackSlot_t;
+
+enum {
+	XFER_MEASURE,
+	XFER_SAVE,
+	XFER_LOAD,
+};
+
+static int enabled = 0;
+static int budget = ROLLBACK_DEFAULTBUDGET;
+static rollbackStats_t stats;
+
+static rollbackSlot_t slots[ROLLBACK_MAXTICS];
+static bool valid = false;
+static long confirmedTic;	// tics before this ran on real input only and are final
+static long shownTic;		// tics before this have been simulated at least once
+
+static rollbackSlot_t *speculating = NULL;		// slot of the tic being run on predicted input
+static bool replaying = false;
+static int numheard;
+static rollbackSound_t heard[ROLLBACK_MAXSOUNDS];	// what the tic played last time it ran
+
+static int xferMode;
+static unsigned char *xferData;
+static unsigned int xferSize;
+static long spriteCount;
+
+static
+void dnXfer( void *p, unsigned int size ) {
+	if ( xferMode == XFER_SAVE ) {
+		memcpy( xferData + xferSize, p, size );
+	} else if ( xferMode == XFER_LOAD ) {
+		memcpy( p, xferData + xferSize, size );
+	}
+	xferSize += size;
+}
+
+#define xferval(x) dnXfer( &(x), sizeof( x ) )
+#define xferarr(x,n) dnXfer( &(x)[0], sizeof( (x)[0] ) * (n) )
+
+static
+long dnCountSprites( void ) {
+	long count = 0;
+
+	for ( int s = 0; s < MAXSTATUS; s++ ) {
+		for ( int i = headspritestat[s]; i >= 0; i = nextspritestat[i] ) {
+			if ( i >= count ) {
+				count = i+1;
+			}
+		}
+	}
+	return count;
+}
+
+// one list for all three directions so the layout can't drift apart
+static
+void dnXferState( void ) {
+	xferval( spriteCount );
+	xferval( numwalls );
+	xferarr( wall, numwalls );
+	xferval( numsectors );
+	xferarr( sector, numsectors );
+	xferarr( sprite, spriteCount );
+	xferarr( spriteext, spriteCount );
+	xferarr( hittype, spriteCount );
+	xferarr( headspritesect, MAXSECTORS+1 );
+	xferarr( prevspritesect, MAXSPRITES );
+	xferarr( nextspritesect, MAXSPRITES );
+	xferarr( headspritestat, MAXSTATUS+1 );
+	xferarr( prevspritestat, MAXSPRITES );
+	xferarr( nextspritestat, MAXSPRITES );
+	xferval( numcyclers );
+	xferarr( cyclers, numcyclers );
+	xferarr( ps, MAXPLAYERS );
+	xferval( numanimwalls );
+	xferarr( animwall, numanimwalls );
+	xferarr( msx, 2048 );
+	xferarr( msy, 2048 );
+	xferval( spriteqloc );
+	xferval( spriteqamount );
+	xferarr( spriteq, 1024 );
+	xferval( lockclock );
+	xferval( animatecnt );
+	xferarr( animatesect, MAXANIMATES );
+	xferarr( animateptr, MAXANIMATES );
+	xferarr( animategoal, MAXANIMATES );
+	xferarr( animatevel, MAXANIMATES );
+	xferval( earthquaketime );
+	xferval( fricxv );
+	xferval( fricyv );
+	xferval( rtsplaying );
+	xferval( everyothertime );
+	xferval( camsprite );
+	xferval( ud.camerasprite );
+	xferval( ud.pause_on );
+	xferval( ud.from_bonus );
+	xferval( ud.secretlevel );
+	xferval( ud.eog );
+	xferval( ud.level_number );
+	xferval( ud.m_level_number );
+	xferval( numplayersprites );
+	xferarr( frags, MAXPLAYERS );
+	xferval( randomseed );
+	xferval( global_random );
+	xferval( numinterpolations );
+	xferval( startofdynamicinterpolations );
+	xferarr( curipos, numinterpolations );
+	xferarr( oldipos, numinterpolations );
+}
+
+static
+void dnSaveState( rollbackSlot_t *slot ) {
+	spriteCount = dnCountSprites();
+
+	xferMode = XFER_MEASURE;
+	xferSize = 0;
+	dnXferState();
+
+	if ( xferSize > slot->alloc ) {
+		free( slot->data );
+		slot->alloc = xferSize + xferSize/4;
+		slot->data = (unsigned char*)malloc( slot->alloc );
+		if ( !slot->data ) {
+			gameexit( "Out of memory for rollback." );
+		}
+	}
+
+	xferMode = XFER_SAVE;
+	xferData = slot->data;
+	xferSize = 0;
+	dnXferState();
+	slot->size = xferSize;
+}
+
+static
+void dnLoadState( const rollbackSlot_t *slot ) {
+	char *palette[MAXPLAYERS];
+	char gm[MAXPLAYERS];
+	long count, i;
+
+	count = dnCountSprites();
+
+	for ( i = 0; i < MAXPLAYERS; i++ ) {
+		palette[i] = ps[i].palette;
+		gm[i] = ps[i].gm;
+	}
+
+	xferMode = XFER_LOAD;
+	xferData = slot->data;
+	xferSize = 0;
+	dnXferState();
+
+	for ( i = 0; i < MAXPLAYERS; i++ ) {
+		ps[i].palette = palette[i];
+		ps[i].gm = gm[i];
+	}
+
+	// sprites spawned since the save are back on the free list
+	for ( i = spriteCount; i < count; i++ ) {
+		sprite[i].sectnum = MAXSECTORS;
+		sprite[i].statnum = MAXSTATUS;
+	}
+	relinkinterpolations();
+}
+
+static
+long dnConfirmedTic( long head ) {
+	long confirmed = head;
+
+	dnIterPlayers( i ) {
+		if ( playerquitflag[i] && movefifoend[i] < confirmed ) {
+			confirmed = movefifoend[i];
+		}
+	}
+	return confirmed;
+}
+
+static
+bool dnSameInput( const input *a, const input *b ) {
+	return a->avel == b->avel && a->horz == b->horz &&
+		a->fvel == b->fvel && a->svel == b->svel && a->bits == b->bits;
+}
+
+// fills in the inputs that haven't arrived for tic t, false if t must wait for real input
+static
+bool dnPredictInputs( long t ) {
+	input *in = &inputfifo[t&(MOVEFIFOSIZ-1)][0];
+
+	dnIterPlayers( i ) {
+		if ( !playerquitflag[i] ) {
+			continue;
+		}
+		if ( movefifoend[i] > t ) {
+			if ( in[i].bits & QUIT_BIT ) {
+				return false;
+			}
+			continue;
+		}
+		in[i] = inputfifo[(movefifoend[i]-1)&(MOVEFIFOSIZ-1)][i];
+		in[i].bits &= ~QUIT_BIT;
+	}
+	return true;
+}
+
+static
+bool dnPredictionHeld( const rollbackSlot_t *slot ) {
+	const input *in = &inputfifo[slot->tic&(MOVEFIFOSIZ-1)][0];
+
+	dnIterPlayers( i ) {
+		if ( !dnSameInput( &slot->used[i], &in[i] ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static
+void dnPushSyncVal( int val ) {
+	syncval[myconnectindex][syncvalhead[myconnectindex]&(MOVEFIFOSIZ-1)] = (char)val;
+	syncvalhead[myconnectindex]++;
+}
+
+static
+void dnRewind( rollbackSlot_t *slot ) {
+	long depth = movefifoplc - slot->tic;
+
+	dnLoadState( slot );
+	movefifoplc = slot->tic;
+
+	stats.rollbacks++;
+	if ( depth > stats.maxdepth ) {
+		stats.maxdepth = depth;
+	}
+}
+
+// a tic that already ran once plays only the sounds it didn't play then
+static
+void dnListenForReplay( long t ) {
+	const rollbackSlot_t *slot = &slots[t % ROLLBACK_MAXTICS];
+
+	replaying = ( t < shownTic );
+	numheard = 0;
+	if ( replaying && slot->tic == t ) {
+		numheard = slot->numsounds;
+		memcpy( heard, slot->sounds, sizeof( heard[0] ) * numheard );
+	}
+}
+
+// a speculative tic: save the state before it, then run it on predicted input
+static
+bool dnRunSpeculative( long t ) {
+	rollbackSlot_t *slot = &slots[t % ROLLBACK_MAXTICS];
+	char gm[MAXPLAYERS];
+
+	if ( !dnPredictInputs( t ) ) {
+		return false;
+	}
+
+	dnSaveState( slot );
+	slot->tic = t;
+	slot->syncval = -1;
+	slot->numsounds = 0;
+	memcpy( slot->used, &inputfifo[t&(MOVEFIFOSIZ-1)][0], sizeof( slot->used ) );
+
+	for ( int i = 0; i < MAXPLAYERS; i++ ) {
+		gm[i] = ps[i].gm;
+	}
+
+	speculating = slot;
+	incrementEndLevelsVars();
+	domovethings();
+	speculating = NULL;
+
+	// the level only ends on confirmed input, the main loop would act on it straight away
+	if ( ( ps[myconnectindex].gm & (MODE_EOL|MODE_RESTART) ) && !( gm[myconnectindex] & (MODE_EOL|MODE_RESTART) ) ) {
+		dnLoadState( slot );
+		movefifoplc = t;
+		for ( int i = 0; i < MAXPLAYERS; i++ ) {
+			ps[i].gm = gm[i];
+		}
+		return false;
+	}
+	return true;
+}
+
+extern "C"
+void dnRollbackSetEnabled( int on ) {
+	if ( !on && valid && movefifoplc > confirmedTic && slots[confirmedTic % ROLLBACK_MAXTICS].tic == confirmedTic ) {
+		// leave the game the way lockstep expects to find it
+		dnLoadState( &slots[confirmedTic % ROLLBACK_MAXTICS] );
+		movefifoplc = confirmedTic;
+		fakedomovethingsresync();
+	}
+	dnRollbackReset();
+	enabled = on ? 1 : 0;
+}
+
+extern "C"
+int dnRollbackEnabled( void ) {
+	return enabled;
+}
+
+extern "C"
+int dnRollbackActive( void ) {
+	// nobody watches a dedicated host, so it has nothing to predict for
+	return enabled && numplayers > 1 && ud.recstat != 1 && !dedicated;
+}
+
+extern "C"
+void dnRollbackSetBudget( int tics ) {
+	budget = max( 1, min( tics, ROLLBACK_MAXTICS ) );
+}
+
+extern "C"
+int dnRollbackGetBudget( void ) {
+	return budget;
+}
+
+extern "C"
+void dnRollbackGetStats( rollbackStats_t *out ) {
+	*out = stats;
+}
+
+extern "C"
+void dnRollbackReset( void ) {
+	valid = false;
+	speculating = NULL;
+	replaying = false;
+	for ( int i = 0; i < ROLLBACK_MAXTICS; i++ ) {
+		slots[i].tic = -1;
+	}
+}
+
+extern "C"
+char dnRollbackMoveLoop( void ) {
+	long head, confirmed, t;
+	int resimulated = 0;
+
+	getpackets();
+
+	if ( !valid || movefifoplc < confirmedTic ) {
+		dnRollbackReset();
+		confirmedTic = shownTic = movefifoplc;
+		valid = true;
+	}
+
+	head = movefifoend[myconnectindex];
+	confirmed = dnConfirmedTic( head );
+
+	// speculative tics whose input has all arrived since
+	for ( t = confirmedTic; t < confirmed && t < movefifoplc; t++ ) {
+		rollbackSlot_t *slot = &slots[t % ROLLBACK_MAXTICS];
+
+		if ( !dnPredictionHeld( slot ) ) {
+			dnRewind( slot );
+			break;
+		}
+		if ( slot->syncval >= 0 ) {
+			dnPushSyncVal( slot->syncval );
+		}
+		confirmedTic = t+1;
+	}
+
+	while ( movefifoplc < head ) {
+		t = movefifoplc;
+		if ( t < shownTic && resimulated++ >= budget ) {
+			break;
+		}
+		dnListenForReplay( t );
+
+		if ( t < confirmed ) {
+			incrementEndLevelsVars();
+			if ( domovethings() ) {
+				replaying = false;
+				return 1;
+			}
+			confirmedTic = t+1;
+		} else {
+			if ( t - confirmedTic >= ROLLBACK_MAXTICS ) {
+				stats.stalls++;
+				break;
+			}
+			if ( !dnRunSpeculative( t ) ) {
+				break;
+			}
+		}
+
+		if ( replaying ) {
+			stats.resimulated++;
+		}
+		if ( movefifoplc > shownTic ) {
+			shownTic = movefifoplc;
+		}
+	}
+	replaying = false;
+
+	// local prediction covers whatever the ring had no room for
+	fakedomovethingsresync();
+	return 0;
+}
+
+extern "C"
+int dnRollbackDeferSyncVal( char val ) {
+	if ( !speculating ) {
+		return 0;
+	}
+	speculating->syncval = (unsigned char)val;
+	return 1;
+}
+
+extern "C"
+int dnRollbackFilterSound( short num, short i ) {
+	if ( speculating && speculating->numsounds < ROLLBACK_MAXSOUNDS ) {
+		speculating->sounds[speculating->numsounds].num = num;
+		speculating->sounds[speculating->numsounds].i = i;
+		speculating->numsounds++;
+	}
+	if ( !replaying ) {
+		return 0;
+	}
+	for ( int k = 0; k < numheard; k++ ) {
+		if ( heard[k].num == num && heard[k].i == i ) {
+			heard[k] = heard[--numheard];
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,61 @@
+//
+//  dnRollback.h
+//  duke3d
+//
+//  Rollback netcode: predict remote input, rewind and re-simulate on a miss
+//
+
+#ifndef DNROLLBACK_H
+#define DNROLLBACK_H
+
+/*
+
+ In lockstep play a tic only runs once every player's input for it is in, so everybody feels the
+ slowest link. With rollback on, tics run as soon as the local input exists: a remote player whose
+ input hasn't arrived is assumed to repeat the last input that did, and the game state before
+ each such speculative tic is kept in a ring. When the real input turns up and differs from
+ the guess, the state is put back to that tic and everything from there is simulated again.
+
+ Tics whose inputs are all real are final and run exactly as lockstep would, so peers stay in sync
+ whether or not they use rollback themselves; it only changes what this machine shows in the
+ meantime.
+
+ Speculation stops ROLLBACK_MAXTICS ahead of the last confirmed tic, before a tic carrying a real
+ quit, and before a tic that would end the level. Re-simulating tics that were already shown is
+ limited to a budget per frame; what is left over is finished on the next frames. Sounds a
+ re-simulated tic already played the first time round are not played again.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROLLBACK_MAXTICS 32
+#define ROLLBACK_DEFAULTBUDGET 12
+
+typedef struct {
+	int rollbacks;		// mispredictions that rewound the game
+	int resimulated;	// tics simulated a second time
+	int maxdepth;		// deepest rewind, in tics
+	int stalls;			// frames that ran out of room to predict
+} rollbackStats_t;
+
+void dnRollbackSetEnabled( int enabled );
+int  dnRollbackEnabled( void );
+int  dnRollbackActive( void );		// enabled and in a game it applies to
+void dnRollbackSetBudget( int tics );
+int  dnRollbackGetBudget( void );
+void dnRollbackGetStats( rollbackStats_t *stats );
+
+void dnRollbackReset( void );		// forget the ring, the fifos have been cleared
+char dnRollbackMoveLoop( void );	// moveloop() while dnRollbackActive()
+
+int  dnRollbackDeferSyncVal( char val );
+int  dnRollbackFilterSound( short num, short i );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNROLLBACK_H */
@@ -0,0 +1,230 @@
+//
+//  dnSaveFile.cpp
+//  duke3d
+//
+//  Saved games gathered in memory and LZ4-packed and written on the background thread
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csteam.h"
+#include "dnAPI.h"
+
+extern "C" {
+#include "build.h"
+#include "duke3d.h"
+#include "workers.h"
+#include "lz4.h"
+}
+
+#include "dnSaveFile.h"
+
+#define SAVE_INITIALSIZE ( 4 << 20 )
+
+struct saveFile_s {
+	// writing
+	FILE *out;						// the temp file, renamed over the slot once it's all written
+	char *data;
+	long size, alloc;
+	bool failed;					// ran out of memory, the save is thrown away on close
+	char fileName[BMAX_PATH];
+	char tempName[BMAX_PATH];
+	bool cloud;						// goes to the cloud once written
+
+	// reading
+	long fil;
+	bool lz4;
+	char *chunk;
+	long chunkSize, chunkPos;
+};
+
+static
+void dnSaveFree( saveFile_t *save ) {
+	free( save->data );
+	free( save );
+}
+
+static
+void dnSaveDiscard( saveFile_t *save ) {
+	if ( save->out ) {
+		fclose( save->out );
+	}
+	remove( save->tempName );
+	dnSaveFree( save );
+}
+
+static
+void dnSaveWriteJob( void *arg ) {
+	saveFile_t *save = (saveFile_t*)arg;
+	char *packed = (char*)malloc( LZ4_compressBound( SAVE_CHUNKSIZE ) );
+	int header[2];
+	bool ok = packed != NULL;
+
+	header[0] = SAVE_MAGIC;
+	ok = ok && fwrite( &header[0], sizeof( int ), 1, save->out ) == 1;
+
+	for ( long pos = 0; ok && pos < save->size; pos += header[0] ) {
+		header[0] = min( save->size - pos, SAVE_CHUNKSIZE );
+		header[1] = LZ4_compress( save->data + pos, packed, header[0] );
+		ok = header[1] > 0 &&
+			fwrite( header, sizeof( header ), 1, save->out ) == 1 &&
+			fwrite( packed, 1, header[1], save->out ) == (size_t)header[1];
+	}
+	header[0] = 0;
+	ok = ok && fwrite( &header[0], sizeof( int ), 1, save->out ) == 1;
+	free( packed );
+
+	ok = fclose( save->out ) == 0 && ok;
+	save->out = NULL;
+	if ( ok ) {
+#ifdef _WIN32
+		// rename won't replace an existing file here
+		remove( save->fileName );
+#endif
+		ok = rename( save->tempName, save->fileName ) == 0;
+	}
+	if ( !ok ) {
+		Sys_DPrintf( "[DUKEMP] dnSaveWriteJob: could not write %s, the slot is left as it was\n", save->fileName );
+		dnSaveDiscard( save );
+		return;
+	}
+
+	if ( save->cloud ) {
+		CSTEAM_UploadFile( save->fileName );
+	}
+	dnSaveFree( save );
+}
+
+extern "C"
+saveFile_t *dnSaveCreate( const char *filename, int cloud ) {
+	saveFile_t *save;
+
+	// the same slot may still be on its way out
+	dnSaveFlush();
+
+	if ( ( save = (saveFile_t*)calloc( 1, sizeof( saveFile_t ) ) ) == NULL ) {
+		return NULL;
+	}
+	Bstrncpy( save->fileName, filename, sizeof( save->fileName ) - 1 );
+	Bsnprintf( save->tempName, sizeof( save->tempName ) - 1, "%s.tmp", filename );
+	save->cloud = cloud != 0;
+	save->alloc = SAVE_INITIALSIZE;
+	save->data = (char*)malloc( save->alloc );
+
+	if ( save->data == NULL || ( save->out = fopen( save->tempName, "wb" ) ) == NULL ) {
+		dnSaveFree( save );
+		return NULL;
+	}
+	return save;
+}
+
+extern "C"
+void dnSaveWrite( const void *buffer, long dasizeof, long count, saveFile_t *save ) {
+	long bytes = dasizeof * count;
+	char *data;
+
+	if ( save->failed ) {
+		return;
+	}
+	if ( save->size + bytes > save->alloc ) {
+		while ( save->size + bytes > save->alloc ) {
+			save->alloc *= 2;
+		}
+		if ( ( data = (char*)realloc( save->data, save->alloc ) ) == NULL ) {
+			save->failed = true;
+			return;
+		}
+		save->data = data;
+	}
+	memcpy( save->data + save->size, buffer, bytes );
+	save->size += bytes;
+}
+
+extern "C"
+void dnSaveClose( saveFile_t *save ) {
+	if ( save->failed ) {
+		Sys_DPrintf( "[DUKEMP] dnSaveClose: out of memory, %s not saved\n", save->fileName );
+		dnSaveDiscard( save );
+		return;
+	}
+	Sys_DPrintf( "[DUKEMP] dnSaveClose: %ld bytes queued\n", save->size );
+	runbackground( dnSaveWriteJob, save );
+}
+
+extern "C"
+saveFile_t *dnSaveOpen( const char *filename ) {
+	saveFile_t *save;
+	long fil;
+	int magic;
+
+	dnSaveFlush();
+	if ( ( fil = kopen4load( (char*)filename, 0 ) ) == -1 ) {
+		return NULL;
+	}
+
+	save = (saveFile_t*)calloc( 1, sizeof( saveFile_t ) );
+	save->fil = fil;
+	if ( kread( fil, &magic, sizeof( int ) ) == sizeof( int ) && magic == SAVE_MAGIC ) {
+		save->lz4 = true;
+		save->chunk = (char*)malloc( SAVE_CHUNKSIZE );
+	} else {
+		klseek( fil, 0, SEEK_SET );
+	}
+	return save;
+}
+
+static
+bool dnSaveNextChunk( saveFile_t *save ) {
+	int header[2];
+	char *packed;
+	bool ok;
+
+	if ( kread( save->fil, &header[0], sizeof( int ) ) != sizeof( int ) || header[0] <= 0 || header[0] > SAVE_CHUNKSIZE ||
+		kread( save->fil, &header[1], sizeof( int ) ) != sizeof( int ) || header[1] <= 0 || header[1] > LZ4_compressBound( SAVE_CHUNKSIZE ) ) {
+		return false;
+	}
+
+	packed = (char*)malloc( header[1] );
+	ok = kread( save->fil, packed, header[1] ) == header[1] &&
+		LZ4_decompress_safe( packed, save->chunk, header[1], SAVE_CHUNKSIZE ) == header[0];
+	free( packed );
+
+	save->chunkSize = ok ? header[0] : 0;
+	save->chunkPos = 0;
+	return ok;
+}
+
+extern "C"
+int dnSaveRead( void *buffer, long dasizeof, long count, saveFile_t *save ) {
+	char *ptr = (char*)buffer;
+	long left = dasizeof * count;
+
+	if ( !save->lz4 ) {
+		return kdfread( buffer, dasizeof, count, save->fil );
+	}
+
+	while ( left > 0 ) {
+		if ( save->chunkPos == save->chunkSize && !dnSaveNextChunk( save ) ) {
+			return -1;
+		}
+		long n = min( left, save->chunkSize - save->chunkPos );
+		memcpy( ptr, save->chunk + save->chunkPos, n );
+		save->chunkPos += n;
+		ptr += n;
+		left -= n;
+	}
+	return count;
+}
+
+extern "C"
+void dnSaveEnd( saveFile_t *save ) {
+	kclose( save->fil );
+	free( save->chunk );
+	free( save );
+}
+
+extern "C"
+void dnSaveFlush( void ) {
+	finishbackground();
+}
@@ -0,0 +1,54 @@
+//
+//  dnSaveFile.h
+//  duke3d
+//
+//  Saved games gathered in memory and LZ4-packed and written on the background thread
+//
+
+#ifndef DNSAVEFILE_H
+#define DNSAVEFILE_H
+
+/*
+
+ saveplayer used to dfwrite every array straight to the file, which runs Ken's LZW over several
+ megabytes on the game thread while the game stands still. Now each write is only copied into a
+ buffer, and dnSaveClose queues the buffer for the background thread to pack with LZ4 and write:
+
+	SAVE_MAGIC, then chunks of	rawSize packedSize <LZ4 data>	up to a 0 rawSize
+
+ A chunk holds at most SAVE_CHUNKSIZE bytes, so the slot previews only unpack what they read.
+ Reading finds out from the first four bytes which kind of file it has: an LZW file starts with
+ the length of its first block, which is never as large as SAVE_MAGIC's low half, and is read
+ with kdfread as before.
+
+ The packed file goes to <slot>.tmp first and is renamed over the slot only when every write
+ went through, so a full disk leaves the old save as it was. A file saved with cloud set is
+ uploaded by the background thread once it has been written.
+ Saving again, loading or removing a file waits for whatever is still being written.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SAVE_MAGIC 0x5A534E44			// "DNSZ"
+#define SAVE_CHUNKSIZE ( 1 << 17 )
+
+typedef struct saveFile_s saveFile_t;
+
+saveFile_t *dnSaveCreate( const char *filename, int cloud );	// NULL if it can't be created
+void dnSaveWrite( const void *buffer, long dasizeof, long count, saveFile_t *save );
+void dnSaveClose( saveFile_t *save );			// packs and writes it in the background
+
+saveFile_t *dnSaveOpen( const char *filename );		// NULL if there is no such file
+int  dnSaveRead( void *buffer, long dasizeof, long count, saveFile_t *save );	// count, -1 past the end
+void dnSaveEnd( saveFile_t *save );
+
+void dnSaveFlush( void );				// wait until every save is on disk
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNSAVEFILE_H */
@@ -0,0 +1,333 @@
+//
+//  dnTelemetry.cpp
+//  duke3d
+//
+//  Per-peer network telemetry: round trip, jitter, loss, traffic, fifo lag, resyncs
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "dnAPI.h"
+
+extern "C" {
+#include "build.h"
+#include "duke3d.h"
+#include "mmulti.h"
+}
+
+#include "dnMulti.h"
+#include "dnTelemetry.h"
+
+#define PING_MAGIC 0x7E510000		// tells our pongs from the server browser's
+#define PING_SEQMASK 0xFFFF
+
+typedef struct {
+	double sentAt[TELEMETRY_PINGWINDOW];	// 0 for a slot never used
+	int seq[TELEMETRY_PINGWINDOW];
+	bool answered[TELEMETRY_PINGWINDOW];
+	int nextSeq;
+	bool haveRtt;
+	netTraffic_t lastTraffic;
+	peerTelemetry_t current;
+} peerState_t;
+
+static const char *channelNames[NET_MAX_CHANNELS] = { "legacy", "pong", "sync", "input" };
+
+static int overlay = 0;
+static FILE *logFile = NULL;
+static bool logJSON;
+static char logName[BMAX_PATH];
+
+static peerState_t peers[MAXPLAYERS];
+static localTelemetry_t local;
+static double lastPing, lastSample, started;
+static bool wasOutOfSync = false;
+
+static
+bool dnTelemetryWanted( void ) {
+	return ( overlay || logFile ) && numplayers > 1 && ( ps[myconnectindex].gm & MODE_GAME );
+}
+
+static
+void dnReadPongs( double now ) {
+	int playerIndex, value;
+
+	while ( dnGetPong( &playerIndex, &value ) ) {
+		if ( ( value & ~PING_SEQMASK ) != PING_MAGIC || playerIndex < 0 || playerIndex >= MAXPLAYERS ) {
+			continue;
+		}
+
+		peerState_t *peer = &peers[playerIndex];
+		int seq = value & PING_SEQMASK;
+		int slot = seq % TELEMETRY_PINGWINDOW;
+		if ( peer->sentAt[slot] == 0.0 || peer->seq[slot] != seq || peer->answered[slot] ) {
+			continue;
+		}
+		peer->answered[slot] = true;
+
+		float rtt = (float)( now - peer->sentAt[slot] );
+		if ( peer->haveRtt ) {
+			float change = rtt > peer->current.rtt ? rtt - peer->current.rtt : peer->current.rtt - rtt;
+			peer->current.jitter += ( change - peer->current.jitter ) / 16.0f;
+		}
+		peer->current.rtt = rtt;
+		peer->haveRtt = true;
+	}
+}
+
+static
+void dnSendPings( double now ) {
+	dnIterPlayers( i ) {
+		if ( i == myconnectindex ) {
+			continue;
+		}
+		peerState_t *peer = &peers[i];
+		int seq = peer->nextSeq;
+		int slot = seq % TELEMETRY_PINGWINDOW;
+
+		peer->nextSeq = ( seq + 1 ) & PING_SEQMASK;
+		peer->sentAt[slot] = now;
+		peer->seq[slot] = seq;
+		peer->answered[slot] = false;
+		dnPingPlayer( i, PING_MAGIC | seq );
+	}
+}
+
+static
+float dnPingLoss( const peerState_t *peer, double now ) {
+	int counted = 0, lost = 0;
+
+	for ( int slot = 0; slot < TELEMETRY_PINGWINDOW; slot++ ) {
+		if ( peer->sentAt[slot] == 0.0 ) {
+			continue;
+		}
+		if ( peer->answered[slot] ) {
+			counted++;
+		} else if ( now - peer->sentAt[slot] > TELEMETRY_PINGTIMEOUT ) {
+			counted++;
+			lost++;
+		}
+	}
+	return counted ? lost * 100.0f / counted : 0.0f;
+}
+
+// names go into the log as they are, save what would break a CSV field or a JSON string
+static
+const char *dnLogName( int playerIndex ) {
+	static char name[32];
+	int i;
+
+	for ( i = 0; i < (int)sizeof( name ) - 1 && ud.user_name[playerIndex][i]; i++ ) {
+		char c = ud.user_name[playerIndex][i];
+		name[i] = ( c == '"' || c == '\\' || c == ',' || (unsigned char)c < 32 ) ? '_' : c;
+	}
+	name[i] = 0;
+	return name;
+}
+
+static
+void dnLogSample( double now ) {
+	dnIterPlayers( i ) {
+		if ( i == myconnectindex ) {
+			continue;
+		}
+		const peerTelemetry_t *peer = &peers[i].current;
+		double t = now - started;
+
+		if ( logJSON ) {
+			fprintf( logFile, "{\"t\":%.0f,\"player\":%d,\"name\":\"%s\",\"rtt\":%.1f,\"jitter\":%.1f,\"loss\":%.1f,"
+				"\"lag\":%ld,\"minlag\":%ld,\"resyncs\":%d,\"fifo\":%ld,\"bufferjitter\":%ld,\"movesperpacket\":%d,\"localresyncs\":%d",
+				t, i, dnLogName( i ), peer->rtt, peer->jitter, peer->loss, peer->fifoLag, peer->minLag, peer->resyncs,
+				local.fifoDepth, local.bufferJitter, local.movesPerPacket, local.resyncs );
+			for ( int c = 0; c < NET_MAX_CHANNELS; c++ ) {
+				fprintf( logFile, ",\"in_%s\":%.0f,\"out_%s\":%.0f", channelNames[c], peer->bytesIn[c], channelNames[c], peer->bytesOut[c] );
+			}
+			fprintf( logFile, "}\n" );
+		} else {
+			fprintf( logFile, "%.0f,%d,%s,%.1f,%.1f,%.1f,%ld,%ld,%d,%ld,%ld,%d,%d",
+				t, i, dnLogName( i ), peer->rtt, peer->jitter, peer->loss, peer->fifoLag, peer->minLag, peer->resyncs,
+				local.fifoDepth, local.bufferJitter, local.movesPerPacket, local.resyncs );
+			for ( int c = 0; c < NET_MAX_CHANNELS; c++ ) {
+				fprintf( logFile, ",%.0f,%.0f", peer->bytesIn[c], peer->bytesOut[c] );
+			}
+			fprintf( logFile, "\n" );
+		}
+	}
+	fflush( logFile );
+}
+
+static
+void dnSample( double now ) {
+	double elapsed = ( now - lastSample ) / 1000.0;
+
+	local.fifoDepth = movefifoend[myconnectindex] - movefifoplc;
+	local.bufferJitter = bufferjitter;
+	local.movesPerPacket = movesperpacket;
+
+	dnIterPlayers( i ) {
+		if ( i == myconnectindex ) {
+			continue;
+		}
+		peerState_t *peer = &peers[i];
+		netTraffic_t traffic;
+
+		dnGetPlayerTraffic( i, &traffic );
+		for ( int c = 0; c < NET_MAX_CHANNELS; c++ ) {
+			peer->current.bytesIn[c] = (float)( ( traffic.bytesIn[c] - peer->lastTraffic.bytesIn[c] ) / elapsed );
+			peer->current.bytesOut[c] = (float)( ( traffic.bytesOut[c] - peer->lastTraffic.bytesOut[c] ) / elapsed );
+		}
+		peer->lastTraffic = traffic;
+
+		peer->current.loss = dnPingLoss( peer, now );
+		peer->current.fifoLag = movefifoend[myconnectindex] - movefifoend[i];
+		peer->current.minLag = myminlag[i] == 0x7fffffff ? 0 : myminlag[i];
+		peer->current.valid = 1;
+	}
+
+	if ( logFile ) {
+		dnLogSample( now );
+	}
+	lastSample = now;
+}
+
+// a game that starts is measured from scratch
+static
+void dnTelemetryStart( double now ) {
+	memset( peers, 0, sizeof( peers ) );
+	memset( &local, 0, sizeof( local ) );
+	dnIterPlayers( i ) {
+		dnGetPlayerTraffic( i, &peers[i].lastTraffic );
+	}
+	started = lastSample = lastPing = now;
+	wasOutOfSync = false;
+}
+
+extern "C"
+void dnTelemetrySetOverlay( int on ) {
+	overlay = on != 0;
+}
+
+extern "C"
+int dnTelemetryOverlay( void ) {
+	return overlay;
+}
+
+extern "C"
+int dnTelemetryOpenLog( const char *filename ) {
+	const char *dot = strrchr( filename, '.' );
+
+	dnTelemetryCloseLog();
+	logFile = fopen( filename, "w" );
+	if ( !logFile ) {
+		return 0;
+	}
+	Bstrncpy( logName, filename, sizeof( logName ) - 1 );
+	logName[sizeof( logName ) - 1] = 0;
+	logJSON = dot && !Bstrcasecmp( dot, ".json" );
+
+	if ( !logJSON ) {
+		fprintf( logFile, "t,player,name,rtt,jitter,loss,lag,minlag,resyncs,fifo,bufferjitter,movesperpacket,localresyncs" );
+		for ( int c = 0; c < NET_MAX_CHANNELS; c++ ) {
+			fprintf( logFile, ",in_%s,out_%s", channelNames[c], channelNames[c] );
+		}
+		fprintf( logFile, "\n" );
+	}
+	return 1;
+}
+
+extern "C"
+void dnTelemetryCloseLog( void ) {
+	if ( logFile ) {
+		fclose( logFile );
+		logFile = NULL;
+	}
+}
+
+extern "C"
+const char *dnTelemetryLogName( void ) {
+	return logFile ? logName : NULL;
+}
+
+extern "C"
+void dnTelemetryGetPeer( int playerIndex, peerTelemetry_t *peer ) {
+	if ( playerIndex >= 0 && playerIndex < MAXPLAYERS ) {
+		*peer = peers[playerIndex].current;
+	} else {
+		memset( peer, 0, sizeof( peerTelemetry_t ) );
+	}
+}
+
+extern "C"
+void dnTelemetryGetLocal( localTelemetry_t *out ) {
+	*out = local;
+}
+
+extern "C"
+void dnTelemetryNoteResync( int playerIndex ) {
+	if ( playerIndex >= 0 && playerIndex < MAXPLAYERS ) {
+		peers[playerIndex].current.resyncs++;
+	}
+}
+
+extern "C"
+void dnTelemetryUpdate( void ) {
+	double now;
+	bool outOfSync;
+
+	if ( !dnTelemetryWanted() ) {
+		started = 0.0;
+		return;
+	}
+
+	now = Sys_GetTicks();
+	if ( started == 0.0 ) {
+		dnTelemetryStart( now );
+	}
+
+	dnReadPongs( now );
+
+	outOfSync = syncstat || syncstate;
+	if ( outOfSync && !wasOutOfSync ) {
+		local.resyncs++;
+	}
+	wasOutOfSync = outOfSync;
+
+	if ( now - lastPing >= TELEMETRY_PINGMS ) {
+		dnSendPings( now );
+		lastPing = now;
+	}
+	if ( now - lastSample >= TELEMETRY_SAMPLEMS ) {
+		dnSample( now );
+	}
+}
+
+extern "C"
+void dnTelemetryDraw( void ) {
+	char line[128];
+	long x = windowx1 + 4, y = windowy1 + 8;
+
+	if ( !overlay || started == 0.0 ) {
+		return;
+	}
+
+	sprintf( line, "fifo %ld  jitter %ld  mpp %d  oos %d", local.fifoDepth, local.bufferJitter, local.movesPerPacket, local.resyncs );
+	printext256( x, y, 31, -1, line, 1 );
+	y += 7;
+
+	dnIterPlayers( i ) {
+		if ( i == myconnectindex || !peers[i].current.valid ) {
+			continue;
+		}
+		const peerTelemetry_t *peer = &peers[i].current;
+
+		sprintf( line, "%d %.10s  rtt %.0f  jit %.0f  loss %.0f%%  lag %ld/%ld  rs %d",
+			i, ud.user_name[i], peer->rtt, peer->jitter, peer->loss, peer->fifoLag, peer->minLag, peer->resyncs );
+		printext256( x, y, 31, -1, line, 1 );
+		y += 7;
+
+		sprintf( line, "  B/s in/out  leg %.0f/%.0f  sync %.0f/%.0f  inp %.0f/%.0f",
+			peer->bytesIn[0], peer->bytesOut[0], peer->bytesIn[2], peer->bytesOut[2], peer->bytesIn[3], peer->bytesOut[3] );
+		printext256( x, y, 31, -1, line, 1 );
+		y += 7;
+	}
+}
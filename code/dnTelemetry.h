@@ -0,0 +1,77 @@
+//
+//  dnTelemetry.h
+//  duke3d
+//
+//  Per-peer network telemetry: round trip, jitter, loss, traffic, fifo lag, resyncs
+//
+
+#ifndef DNTELEMETRY_H
+#define DNTELEMETRY_H
+
+/*
+
+ While net_stats is on or net_statslog names a file, every peer is pinged each TELEMETRY_PINGMS
+ over the sync channel. The pong comes back on the pong channel, which nothing else reads during
+ a game. Round trip is taken from the pongs, jitter is smoothed over the change between
+ consecutive round trips as in RFC 3550, and loss is the share of the last TELEMETRY_PINGWINDOW
+ pings that got no answer within TELEMETRY_PINGTIMEOUT.
+
+ Every TELEMETRY_SAMPLEMS the transport's counters give the bytes per second on each channel,
+ and the fifos give how many tics behind this machine each peer's input is (movefifoend),
+ the smallest lag of the last timer update (myminlag) and the local fifo depth, bufferjitter
+ and movesperpacket to tune against. Resyncs count this machine going out of sync, and on the
+ host the out-of-sync reports that made it take a snapshot, per peer.
+
+ net_stats draws the last sample in the top left corner. net_statslog writes one row per peer
+ and sample, as JSON lines when the file name ends in .json and as CSV otherwise.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dnTransport.h"
+
+#define TELEMETRY_PINGMS 250
+#define TELEMETRY_SAMPLEMS 1000
+#define TELEMETRY_PINGWINDOW 32
+#define TELEMETRY_PINGTIMEOUT 2000
+
+typedef struct {
+	int valid;
+	float rtt;						// ms, last pong
+	float jitter;					// ms
+	float loss;						// percent
+	float bytesIn[NET_MAX_CHANNELS];	// per second
+	float bytesOut[NET_MAX_CHANNELS];
+	long fifoLag;					// tics this peer's input is behind ours
+	long minLag;
+	int resyncs;
+} peerTelemetry_t;
+
+typedef struct {
+	long fifoDepth;					// tics received but not yet run
+	long bufferJitter;
+	int movesPerPacket;
+	int resyncs;
+} localTelemetry_t;
+
+void dnTelemetrySetOverlay( int on );
+int  dnTelemetryOverlay( void );
+int  dnTelemetryOpenLog( const char *filename );	// 0 if it can't be created
+void dnTelemetryCloseLog( void );
+const char *dnTelemetryLogName( void );			// NULL when not logging
+
+void dnTelemetryGetPeer( int playerIndex, peerTelemetry_t *peer );
+void dnTelemetryGetLocal( localTelemetry_t *local );
+
+void dnTelemetryUpdate( void );				// ping, read pongs and sample when due
+void dnTelemetryDraw( void );
+void dnTelemetryNoteResync( int playerIndex );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DNTELEMETRY_H */
@@ -0,0 +1,1337 @@
+//
+//  dnTransport.cpp
+//  duke3d
+//
+//  Network transports behind dnMulti and mmulti_steam
+//
+
+#ifdef _WIN32
+#include <winsock2.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+typedef int socklen_t;
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csteam.h"
+#include "dnAPI.h"
+
+#include "dnTransport.h"
+
+#define NETID_KIND_MASK 0xFF00000000000000ULL
+#define NETID_UDP 0x7E00000000000000ULL
+#define NETID_LOOPBACK 0x7F00000000000000ULL
+
+#define MAX_CHANNELS NET_MAX_CHANNELS
+
+#define UDP_FRAGMENT_SIZE 1200
+#define UDP_MAX_MESSAGE (1024*1024)
+#define UDP_MAX_FRAGMENTS ( ( UDP_MAX_MESSAGE + UDP_FRAGMENT_SIZE - 1 ) / UDP_FRAGMENT_SIZE )
+#define UDP_MAX_REASSEMBLY 8
+#define UDP_REASSEMBLY_TIMEOUT (5000.0)
+#define UDP_SEND_RATE (4*1024*1024)		// bytes per second the fragment queues are paced to
+#define UDP_SEND_BURST (128*1024)		// stays under a default socket receive buffer
+#define UDP_SOCKET_BUFFER (1024*1024)
+#define UDP_MAGIC 0xD4
+#define UDP_MAX_PEERS 32
+#define UDP_MAX_HELD 64				// reliable messages held back per channel waiting for an earlier one
+#define UDP_RTO_MIN (200.0)
+#define UDP_RTO_MAX (1000.0)
+#define UDP_RELIABLE_GIVEUP (30000.0)
+
+#define SIM_MAX_LINKS 32
+#define TRAFFIC_MAX_PEERS 32
+
+typedef struct {
+	const char *name;
+	int  (*open)( void );
+	void (*close)( void );
+	steam_id_t (*myID)( void );
+	int  (*send)( steam_id_t peer, const void *buffer, unsigned int bufsize, int reliable, int channel );
+	int  (*isPacketAvailable)( unsigned int *bufsize, int channel );
+	int  (*readPacket)( void *buffer, unsigned int bufsize, unsigned int *msgsize, steam_id_t *remote, int channel );
+	void (*closePeer)( steam_id_t peer );
+	void (*drain)( void );
+	const char *(*formatID)( steam_id_t id );
+} netTransport_t;
+
+typedef struct netMessage_s {
+	struct netMessage_s *next;
+	steam_id_t remote;
+	unsigned int size;
+	unsigned char data[1];
+} netMessage_t;
+
+typedef struct {
+	netMessage_t *head, *tail;
+} netQueue_t;
+
+static
+netMessage_t *dnNetAllocMessage( steam_id_t remote, const void *data, unsigned int size ) {
+	netMessage_t *msg = (netMessage_t*)malloc( sizeof( netMessage_t ) + size );
+	if ( msg != NULL ) {
+		msg->next = NULL;
+		msg->remote = remote;
+		msg->size = size;
+		if ( data != NULL ) {
+			memcpy( msg->data, data, size );
+		}
+	}
+	return msg;
+}
+
+static
+void dnNetQueuePush( netQueue_t *q, netMessage_t *msg ) {
+	msg->next = NULL;
+	if ( q->tail != NULL ) {
+		q->tail->next = msg;
+	} else {
+		q->head = msg;
+	}
+	q->tail = msg;
+}
+
+static
+netMessage_t *dnNetQueuePop( netQueue_t *q ) {
+	netMessage_t *msg = q->head;
+	if ( msg != NULL ) {
+		q->head = msg->next;
+		if ( q->head == NULL ) {
+			q->tail = NULL;
+		}
+	}
+	return msg;
+}
+
+static
+void dnNetQueueClear( netQueue_t *q ) {
+	netMessage_t *msg;
+	while ( ( msg = dnNetQueuePop( q ) ) != NULL ) {
+		free( msg );
+	}
+}
+
+static
+void dnNetQueueDropFrom( netQueue_t *q, steam_id_t remote ) {
+	netQueue_t keep = { NULL, NULL };
+	netMessage_t *msg;
+	while ( ( msg = dnNetQueuePop( q ) ) != NULL ) {
+		if ( msg->remote == remote ) {
+			free( msg );
+		} else {
+			dnNetQueuePush( &keep, msg );
+		}
+	}
+	*q = keep;
+}
+
+static
+int dnNetQueueRead( netQueue_t *q, void *buffer, unsigned int bufsize, unsigned int *msgsize, steam_id_t *remote ) {
+	netMessage_t *msg = dnNetQueuePop( q );
+	int result = 0;
+
+	if ( msg == NULL ) {
+		return 0;
+	}
+	// a message that doesn't fit is thrown away rather than left to block the queue
+	if ( msg->size <= bufsize ) {
+		memcpy( buffer, msg->data, msg->size );
+		result = 1;
+	}
+	*msgsize = msg->size;
+	*remote = msg->remote;
+	free( msg );
+	return result;
+}
+
+static
+const char *dnNetIDBuffer( void ) {
+	static char buffers[4][32];
+	static int next = 0;
+	next = ( next + 1 ) & 3;
+	return buffers[next];
+}
+
+//
+// Steam
+//
+
+static
+int dnSteamOpen( void ) {
+	return 1;
+}
+
+static
+void dnSteamClose( void ) {
+}
+
+static
+const char *dnSteamFormatID( steam_id_t id ) {
+	const char *s = CSTEAM_FormatId( id );
+	if ( s == NULL ) {
+		char *buf = (char*)dnNetIDBuffer();
+		snprintf( buf, 32, "%llu", id );
+		s = buf;
+	}
+	return s;
+}
+
+static const netTransport_t steamTransport = {
+	"steam",
+	dnSteamOpen,
+	dnSteamClose,
+	CSTEAM_MyID,
+	CSTEAM_SendPacket,
+	CSTEAM_IsPacketAvailable,
+	CSTEAM_ReadPacket,
+	CSTEAM_CloseP2P,
+	CSTEAM_DrainQueue,
+	dnSteamFormatID,
+};
+
+//
+// Loopback
+//
+
+static netQueue_t loopQueues[NET_MAX_LOOPBACK][MAX_CHANNELS];
+static int loopEndpoint = 0;
+
+static
+int dnLoopOpen( void ) {
+	return 1;
+}
+
+static
+void dnLoopClose( void ) {
+	for ( int i = 0; i < NET_MAX_LOOPBACK; i++ ) {
+		for ( int c = 0; c < MAX_CHANNELS; c++ ) {
+			dnNetQueueClear( &loopQueues[i][c] );
+		}
+	}
+}
+
+static
+steam_id_t dnLoopMyID( void ) {
+	return NETID_LOOPBACK | (steam_id_t)loopEndpoint;
+}
+
+static
+int dnLoopSend( steam_id_t peer, const void *buffer, unsigned int bufsize, int reliable, int channel ) {
+	unsigned int endpoint = (unsigned int)( peer & 0xFFFF );
+	netMessage_t *msg;
+
+	if ( ( peer & NETID_KIND_MASK ) != NETID_LOOPBACK || endpoint >= NET_MAX_LOOPBACK ) {
+		return 0;
+	}
+	msg = dnNetAllocMessage( dnLoopMyID(), buffer, bufsize );
+	if ( msg == NULL ) {
+		return 0;
+	}
+	dnNetQueuePush( &loopQueues[endpoint][channel], msg );
+	return 1;
+}
+
+static
+int dnLoopIsPacketAvailable( unsigned int *bufsize, int channel ) {
+	netMessage_t *msg = loopQueues[loopEndpoint][channel].head;
+	if ( msg != NULL ) {
+		*bufsize = msg->size;
+		return 1;
+	}
+	return 0;
+}
+
+static
+int dnLoopReadPacket( void *buffer, unsigned int bufsize, unsigned int *msgsize, steam_id_t *remote, int channel ) {
+	return dnNetQueueRead( &loopQueues[loopEndpoint][channel], buffer, bufsize, msgsize, remote );
+}
+
+static
+void dnLoopClosePeer( steam_id_t peer ) {
+	for ( int c = 0; c < MAX_CHANNELS; c++ ) {
+		dnNetQueueDropFrom( &loopQueues[loopEndpoint][c], peer );
+	}
+}
+
+static
+void dnLoopDrain( void ) {
+	for ( int c = 0; c < MAX_CHANNELS; c++ ) {
+		dnNetQueueClear( &loopQueues[loopEndpoint][c] );
+	}
+}
+
+static
+const char *dnLoopFormatID( steam_id_t id ) {
+	char *buf = (char*)dnNetIDBuffer();
+	snprintf( buf, 32, "loop#%u", (unsigned int)( id & 0xFFFF ) );
+	return buf;
+}
+
+static const netTransport_t loopTransport = {
+	"loopback",
+	dnLoopOpen,
+	dnLoopClose,
+	dnLoopMyID,
+	dnLoopSend,
+	dnLoopIsPacketAvailable,
+	dnLoopReadPacket,
+	dnLoopClosePeer,
+	dnLoopDrain,
+	dnLoopFormatID,
+};
+
+//
+// UDP
+//
+
+#define UDP_RELIABLE 1		// acked, resent until it is, and handed over in order of seq
+#define UDP_ACK 2			// no payload, acks seq on channel
+
+#pragma pack(push,1)
+typedef struct {
+	unsigned char magic;
+	unsigned char channel;
+	unsigned char flags;
+	unsigned char unused;
+	unsigned short seq;
+	unsigned short msgid;
+	unsigned short fragment;
+	unsigned short numfragments;
+} udpHeader_t;
+#pragma pack(pop)
+
+typedef struct {
+	steam_id_t remote;
+	unsigned short msgid, numfragments, received, seq;
+	int channel, flags;
+	unsigned int size;
+	double started;
+	unsigned char *data;
+	unsigned char *have;
+} udpReassembly_t;
+
+// a reliable message kept until the peer acks it
+typedef struct udpPending_s {
+	struct udpPending_s *next;
+	steam_id_t remote;
+	int channel;
+	unsigned short seq, msgid;
+	double firstSent, resendAt, rto;
+	unsigned int size;
+	unsigned char data[1];
+} udpPending_t;
+
+typedef struct {
+	steam_id_t remote;
+	unsigned short sendSeq[MAX_CHANNELS];
+	unsigned short recvSeq[MAX_CHANNELS];		// the next one to hand over
+	netMessage_t *held[MAX_CHANNELS][UDP_MAX_HELD];
+} udpPeer_t;
+
+static SOCKET udpSocket = INVALID_SOCKET;
+static int udpPort = NET_DEFAULT_PORT;
+static unsigned int udpMyAddress;
+static unsigned short udpNextMsgID;
+static netQueue_t udpIncoming[MAX_CHANNELS];
+static netQueue_t udpOutgoing, udpOutgoingBulk;	// single datagrams go ahead of fragmented messages
+static unsigned int udpQueuedBytes;
+static double udpCredit, udpLastPump;
+static udpReassembly_t udpReassembly[UDP_MAX_REASSEMBLY];
+static udpPending_t *udpPending;
+static udpPeer_t udpPeers[UDP_MAX_PEERS];
+
+static bool dnSimLoseDatagram( void );
+static const char *dnUDPFormatID( steam_id_t id );
+
+static
+steam_id_t dnUDPMakeID( const struct sockaddr_in *addr ) {
+	return NETID_UDP | ( (steam_id_t)ntohl( addr->sin_addr.s_addr ) << 16 ) | ntohs( addr->sin_port );
+}
+
+static
+void dnUDPMakeAddress( steam_id_t id, struct sockaddr_in *addr ) {
+	memset( addr, 0, sizeof( struct sockaddr_in ) );
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl( (unsigned int)( ( id >> 16 ) & 0xFFFFFFFF ) );
+	addr->sin_port = htons( (unsigned short)( id & 0xFFFF ) );
+}
+
+static
+udpPeer_t *dnUDPPeer( steam_id_t remote, bool create ) {
+	udpPeer_t *free = NULL;
+
+	for ( int i = 0; i < UDP_MAX_PEERS; i++ ) {
+		if ( udpPeers[i].remote == remote ) {
+			return &udpPeers[i];
+		}
+		if ( free == NULL && udpPeers[i].remote == 0 ) {
+			free = &udpPeers[i];
+		}
+	}
+	if ( !create || free == NULL ) {
+		return NULL;
+	}
+	free->remote = remote;
+	return free;
+}
+
+static
+void dnUDPForgetPeer( udpPeer_t *peer ) {
+	for ( int c = 0; c < MAX_CHANNELS; c++ ) {
+		for ( int i = 0; i < UDP_MAX_HELD; i++ ) {
+			free( peer->held[c][i] );
+		}
+	}
+	memset( peer, 0, sizeof( udpPeer_t ) );
+}
+
+static
+void dnUDPDropPending( steam_id_t remote, bool all ) {
+	udpPending_t **pp = &udpPending;
+
+	while ( *pp != NULL ) {
+		udpPending_t *p = *pp;
+		if ( all || p->remote == remote ) {
+			*pp = p->next;
+			free( p );
+		} else {
+			pp = &p->next;
+		}
+	}
+}
+
+// the address other machines on the network reach this one by; no packet is sent,
+// connecting a datagram socket only looks up the route
+static
+unsigned int dnUDPLocalAddress( void ) {
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof( addr );
+	unsigned int ip = INADDR_LOOPBACK;
+	SOCKET s = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+
+	if ( s == INVALID_SOCKET ) {
+		return ip;
+	}
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr( "8.8.8.8" );
+	addr.sin_port = htons( 53 );
+	if ( connect( s, (struct sockaddr*)&addr, sizeof( addr ) ) == 0 &&
+		getsockname( s, (struct sockaddr*)&addr, &addrlen ) == 0 && addr.sin_addr.s_addr != htonl( INADDR_ANY ) ) {
+		ip = ntohl( addr.sin_addr.s_addr );
+	}
+	closesocket( s );
+	return ip;
+}
+
+static
+void dnUDPFreeReassembly( udpReassembly_t *r ) {
+	free( r->data );
+	free( r->have );
+	memset( r, 0, sizeof( udpReassembly_t ) );
+}
+
+static
+int dnUDPOpen( void ) {
+	struct sockaddr_in addr;
+	int bufsize = UDP_SOCKET_BUFFER;
+
+#ifdef _WIN32
+	static int wsaStarted = 0;
+	if ( !wsaStarted ) {
+		WSADATA wsa;
+		if ( WSAStartup( MAKEWORD( 2, 2 ), &wsa ) != 0 ) {
+			Sys_DPrintf( "[DUKEMP] dnUDPOpen: WSAStartup failed\n" );
+			return 0;
+		}
+		wsaStarted = 1;
+	}
+#endif
+
+	udpSocket = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( udpSocket == INVALID_SOCKET ) {
+		Sys_DPrintf( "[DUKEMP] dnUDPOpen: can't create socket\n" );
+		return 0;
+	}
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_ANY );
+	addr.sin_port = htons( (unsigned short)udpPort );
+	if ( bind( udpSocket, (struct sockaddr*)&addr, sizeof( addr ) ) != 0 ) {
+		Sys_DPrintf( "[DUKEMP] dnUDPOpen: can't bind port %d\n", udpPort );
+		closesocket( udpSocket );
+		udpSocket = INVALID_SOCKET;
+		return 0;
+	}
+
+#ifdef _WIN32
+	u_long nonblocking = 1;
+	ioctlsocket( udpSocket, FIONBIO, &nonblocking );
+#else
+	fcntl( udpSocket, F_SETFL, fcntl( udpSocket, F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+	setsockopt( udpSocket, SOL_SOCKET, SO_RCVBUF, (const char*)&bufsize, sizeof( bufsize ) );
+	setsockopt( udpSocket, SOL_SOCKET, SO_SNDBUF, (const char*)&bufsize, sizeof( bufsize ) );
+
+	udpMyAddress = dnUDPLocalAddress();
+	udpCredit = UDP_SEND_BURST;
+	udpLastPump = Sys_GetTicks();
+	Sys_DPrintf( "[DUKEMP] dnUDPOpen: listening on port %d\n", udpPort );
+	return 1;
+}
+
+static
+void dnUDPClose( void ) {
+	if ( udpSocket != INVALID_SOCKET ) {
+		closesocket( udpSocket );
+		udpSocket = INVALID_SOCKET;
+	}
+	for ( int c = 0; c < MAX_CHANNELS; c++ ) {
+		dnNetQueueClear( &udpIncoming[c] );
+	}
+	dnNetQueueClear( &udpOutgoing );
+	dnNetQueueClear( &udpOutgoingBulk );
+	udpQueuedBytes = 0;
+	for ( int i = 0; i < UDP_MAX_REASSEMBLY; i++ ) {
+		dnUDPFreeReassembly( &udpReassembly[i] );
+	}
+	dnUDPDropPending( 0, true );
+	for ( int i = 0; i < UDP_MAX_PEERS; i++ ) {
+		dnUDPForgetPeer( &udpPeers[i] );
+	}
+}
+
+static
+steam_id_t dnUDPMyID( void ) {
+	return NETID_UDP | ( (steam_id_t)udpMyAddress << 16 ) | (steam_id_t)udpPort;
+}
+
+static
+void dnUDPFlush( void ) {
+	double now = Sys_GetTicks();
+
+	udpCredit += ( now - udpLastPump ) * ( UDP_SEND_RATE / 1000.0 );
+	if ( udpCredit > UDP_SEND_BURST ) {
+		udpCredit = UDP_SEND_BURST;
+	}
+	udpLastPump = now;
+
+	while ( udpCredit > 0 ) {
+		netQueue_t *q = udpOutgoing.head != NULL ? &udpOutgoing : &udpOutgoingBulk;
+		netMessage_t *msg = q->head;
+		struct sockaddr_in addr;
+
+		if ( msg == NULL ) {
+			break;
+		}
+		// the simulator loses reliable traffic on the wire so the resending gets exercised
+		if ( !( ( (const udpHeader_t*)msg->data )->flags & ( UDP_RELIABLE | UDP_ACK ) ) || !dnSimLoseDatagram() ) {
+			dnUDPMakeAddress( msg->remote, &addr );
+			if ( sendto( udpSocket, (const char*)msg->data, msg->size, 0, (struct sockaddr*)&addr, sizeof( addr ) ) < 0 ) {
+#ifdef _WIN32
+				if ( WSAGetLastError() == WSAEWOULDBLOCK ) break;
+#else
+				if ( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+#endif
+			}
+		}
+		udpCredit -= msg->size;
+		udpQueuedBytes -= msg->size;
+		free( dnNetQueuePop( q ) );
+	}
+}
+
+static
+int dnUDPQueueMessage( steam_id_t peer, const void *buffer, unsigned int bufsize, int channel, int flags, unsigned short seq, unsigned short msgid ) {
+	const unsigned char *src = (const unsigned char*)buffer;
+	unsigned int numfragments = ( bufsize + UDP_FRAGMENT_SIZE - 1 ) / UDP_FRAGMENT_SIZE;
+
+	if ( numfragments == 0 ) {
+		numfragments = 1;
+	}
+
+	for ( unsigned int i = 0; i < numfragments; i++ ) {
+		unsigned int size = bufsize - i * UDP_FRAGMENT_SIZE;
+		netMessage_t *msg;
+		udpHeader_t header;
+
+		if ( size > UDP_FRAGMENT_SIZE ) {
+			size = UDP_FRAGMENT_SIZE;
+		}
+		msg = dnNetAllocMessage( peer, NULL, sizeof( udpHeader_t ) + size );
+		if ( msg == NULL ) {
+			return 0;
+		}
+		header.magic = UDP_MAGIC;
+		header.channel = (unsigned char)channel;
+		header.flags = (unsigned char)flags;
+		header.unused = 0;
+		header.seq = htons( seq );
+		header.msgid = htons( msgid );
+		header.fragment = htons( (unsigned short)i );
+		header.numfragments = htons( (unsigned short)numfragments );
+		memcpy( msg->data, &header, sizeof( udpHeader_t ) );
+		memcpy( msg->data + sizeof( udpHeader_t ), src + i * UDP_FRAGMENT_SIZE, size );
+		udpQueuedBytes += msg->size;
+		dnNetQueuePush( numfragments == 1 ? &udpOutgoing : &udpOutgoingBulk, msg );
+	}
+	return 1;
+}
+
+// when a resend is due, counted from the time whatever is queued ahead of it has gone out
+static
+double dnUDPResendTime( double now, double rto ) {
+	return now + rto + udpQueuedBytes * 1000.0 / UDP_SEND_RATE;
+}
+
+// the receiver only holds UDP_MAX_HELD messages past the one it is waiting for, so
+// nothing further ahead of the oldest unacked one is sent
+static
+bool dnUDPInWindow( const udpPending_t *p ) {
+	for ( const udpPending_t *q = udpPending; q != p; q = q->next ) {
+		if ( q->remote == p->remote && q->channel == p->channel ) {
+			return (short)( p->seq - q->seq ) < UDP_MAX_HELD;
+		}
+	}
+	return true;
+}
+
+static
+void dnUDPResend( void ) {
+	double now = Sys_GetTicks();
+	udpPending_t **pp = &udpPending;
+
+	while ( *pp != NULL ) {
+		udpPending_t *p = *pp;
+		if ( p->resendAt > now ) {
+			pp = &p->next;
+			continue;
+		}
+		if ( p->firstSent == 0 ) {
+			if ( dnUDPInWindow( p ) ) {
+				dnUDPQueueMessage( p->remote, p->data, p->size, p->channel, UDP_RELIABLE, p->seq, p->msgid );
+				p->firstSent = now;
+				p->resendAt = dnUDPResendTime( now, p->rto );
+			}
+			pp = &p->next;
+			continue;
+		}
+		if ( now - p->firstSent > UDP_RELIABLE_GIVEUP ) {
+			Sys_DPrintf( "[DUKEMP] dnUDPResend: %s never acked seq %u on channel %d\n", dnUDPFormatID( p->remote ), p->seq, p->channel );
+			*pp = p->next;
+			free( p );
+			continue;
+		}
+		dnUDPQueueMessage( p->remote, p->data, p->size, p->channel, UDP_RELIABLE, p->seq, p->msgid );
+		p->rto = p->rto * 2 < UDP_RTO_MAX ? p->rto * 2 : UDP_RTO_MAX;
+		p->resendAt = dnUDPResendTime( now, p->rto );
+		pp = &p->next;
+	}
+}
+
+static
+void dnUDPQueueAck( steam_id_t remote, int channel, unsigned short seq ) {
+	netMessage_t *msg = dnNetAllocMessage( remote, NULL, sizeof( udpHeader_t ) );
+	udpHeader_t header;
+
+	if ( msg == NULL ) {
+		return;
+	}
+	memset( &header, 0, sizeof( header ) );
+	header.magic = UDP_MAGIC;
+	header.channel = (unsigned char)channel;
+	header.flags = UDP_ACK;
+	header.seq = htons( seq );
+	header.numfragments = htons( 1 );
+	memcpy( msg->data, &header, sizeof( udpHeader_t ) );
+	udpQueuedBytes += msg->size;
+	dnNetQueuePush( &udpOutgoing, msg );
+}
+
+static
+void dnUDPAcked( steam_id_t remote, int channel, unsigned short seq ) {
+	for ( udpPending_t **pp = &udpPending; *pp != NULL; pp = &(*pp)->next ) {
+		udpPending_t *p = *pp;
+		if ( p->remote == remote && p->channel == channel && p->seq == seq ) {
+			*pp = p->next;
+			free( p );
+			return;
+		}
+	}
+}
+
+// whether a reliable message is still to be had; one that is already here is acked again,
+// as the resend means the ack was lost
+static
+udpPeer_t *dnUDPWanted( steam_id_t remote, int channel, unsigned short seq ) {
+	udpPeer_t *peer = dnUDPPeer( remote, true );
+	short ahead;
+
+	if ( peer == NULL ) {
+		return NULL;
+	}
+	ahead = (short)( seq - peer->recvSeq[channel] );
+	if ( ahead < 0 || ( ahead < UDP_MAX_HELD && peer->held[channel][seq % UDP_MAX_HELD] != NULL ) ) {
+		dnUDPQueueAck( remote, channel, seq );
+		return NULL;
+	}
+	// past the window it isn't acked, and comes again once the gap has been filled
+	return ahead < UDP_MAX_HELD ? peer : NULL;
+}
+
+// a whole message has arrived; reliable ones are acked and handed over in order, once
+static
+void dnUDPDeliver( steam_id_t remote, int channel, int flags, unsigned short seq, const unsigned char *data, unsigned int size ) {
+	udpPeer_t *peer;
+	netMessage_t *msg;
+
+	if ( !( flags & UDP_RELIABLE ) ) {
+		if ( ( msg = dnNetAllocMessage( remote, data, size ) ) != NULL ) {
+			dnNetQueuePush( &udpIncoming[channel], msg );
+		}
+		return;
+	}
+
+	if ( ( peer = dnUDPWanted( remote, channel, seq ) ) == NULL || ( msg = dnNetAllocMessage( remote, data, size ) ) == NULL ) {
+		return;
+	}
+	dnUDPQueueAck( remote, channel, seq );
+	peer->held[channel][seq % UDP_MAX_HELD] = msg;
+
+	while ( ( msg = peer->held[channel][peer->recvSeq[channel] % UDP_MAX_HELD] ) != NULL ) {
+		peer->held[channel][peer->recvSeq[channel] % UDP_MAX_HELD] = NULL;
+		peer->recvSeq[channel]++;
+		dnNetQueuePush( &udpIncoming[channel], msg );
+	}
+}
+
+static
+void dnUDPReceiveFragment( steam_id_t remote, const udpHeader_t *header, const unsigned char *payload, unsigned int size ) {
+	unsigned short msgid = ntohs( header->msgid );
+	unsigned short fragment = ntohs( header->fragment );
+	unsigned short numfragments = ntohs( header->numfragments );
+	udpReassembly_t *r = NULL, *oldest = &udpReassembly[0];
+	double now = Sys_GetTicks();
+
+	if ( ( header->flags & UDP_RELIABLE ) && dnUDPWanted( remote, header->channel, ntohs( header->seq ) ) == NULL ) {
+		return;
+	}
+
+	for ( int i = 0; i < UDP_MAX_REASSEMBLY; i++ ) {
+		udpReassembly_t *t = &udpReassembly[i];
+		if ( t->data != NULL && t->started + UDP_REASSEMBLY_TIMEOUT < now ) {
+			dnUDPFreeReassembly( t );
+		}
+		if ( t->data != NULL && t->remote == remote && t->msgid == msgid && t->channel == header->channel ) {
+			r = t;
+		}
+		if ( t->started < oldest->started ) {
+			oldest = t;
+		}
+	}
+
+	if ( r == NULL ) {
+		r = oldest;
+		for ( int i = 0; i < UDP_MAX_REASSEMBLY; i++ ) {
+			if ( udpReassembly[i].data == NULL ) {
+				r = &udpReassembly[i];
+				break;
+			}
+		}
+		dnUDPFreeReassembly( r );
+		r->data = (unsigned char*)malloc( numfragments * UDP_FRAGMENT_SIZE );
+		r->have = (unsigned char*)calloc( numfragments, 1 );
+		if ( r->data == NULL || r->have == NULL ) {
+			dnUDPFreeReassembly( r );
+			return;
+		}
+		r->remote = remote;
+		r->msgid = msgid;
+		r->channel = header->channel;
+		r->flags = header->flags;
+		r->seq = ntohs( header->seq );
+		r->numfragments = numfragments;
+		r->started = now;
+	}
+
+	if ( r->numfragments != numfragments || r->have[fragment] ) {
+		return;
+	}
+	if ( fragment != numfragments - 1 && size != UDP_FRAGMENT_SIZE ) {
+		return;
+	}
+	memcpy( r->data + fragment * UDP_FRAGMENT_SIZE, payload, size );
+	r->have[fragment] = 1;
+	r->received++;
+	if ( fragment == numfragments - 1 ) {
+		r->size = fragment * UDP_FRAGMENT_SIZE + size;
+	}
+
+	if ( r->received == r->numfragments ) {
+		dnUDPDeliver( remote, r->channel, r->flags, r->seq, r->data, r->size );
+		dnUDPFreeReassembly( r );
+	}
+}
+
+static
+void dnUDPPump( void ) {
+	unsigned char datagram[sizeof( udpHeader_t ) + UDP_FRAGMENT_SIZE];
+
+	if ( udpSocket == INVALID_SOCKET ) {
+		return;
+	}
+
+	dnUDPResend();
+	dnUDPFlush();
+
+	for ( int n = 0; n < 1024; n++ ) {
+		struct sockaddr_in addr;
+		socklen_t addrlen = sizeof( addr );
+		const udpHeader_t *header = (const udpHeader_t*)datagram;
+		int len = (int)recvfrom( udpSocket, (char*)datagram, sizeof( datagram ), 0, (struct sockaddr*)&addr, &addrlen );
+		unsigned int size;
+
+		if ( len < 0 ) {
+			break;
+		}
+		if ( len < (int)sizeof( udpHeader_t ) || header->magic != UDP_MAGIC || header->channel >= MAX_CHANNELS ) {
+			continue;
+		}
+		if ( header->flags & UDP_ACK ) {
+			dnUDPAcked( dnUDPMakeID( &addr ), header->channel, ntohs( header->seq ) );
+			continue;
+		}
+		if ( ntohs( header->numfragments ) == 0 || ntohs( header->numfragments ) > UDP_MAX_FRAGMENTS ||
+			ntohs( header->fragment ) >= ntohs( header->numfragments ) ) {
+			continue;
+		}
+		size = len - sizeof( udpHeader_t );
+		if ( ntohs( header->numfragments ) == 1 ) {
+			dnUDPDeliver( dnUDPMakeID( &addr ), header->channel, header->flags, ntohs( header->seq ), datagram + sizeof( udpHeader_t ), size );
+		} else {
+			dnUDPReceiveFragment( dnUDPMakeID( &addr ), header, datagram + sizeof( udpHeader_t ), size );
+		}
+	}
+}
+
+static
+int dnUDPSend( steam_id_t peer, const void *buffer, unsigned int bufsize, int reliable, int channel ) {
+	unsigned short msgid = udpNextMsgID++;
+	unsigned short seq = 0;
+	udpPeer_t *state;
+	udpPending_t *p, **pp;
+
+	if ( udpSocket == INVALID_SOCKET || ( peer & NETID_KIND_MASK ) != NETID_UDP || bufsize > UDP_MAX_MESSAGE ) {
+		return 0;
+	}
+
+	if ( reliable ) {
+		if ( ( state = dnUDPPeer( peer, true ) ) == NULL ) {
+			return 0;
+		}
+		p = (udpPending_t*)malloc( sizeof( udpPending_t ) + bufsize );
+		if ( p == NULL ) {
+			return 0;
+		}
+		seq = state->sendSeq[channel]++;
+		p->remote = peer;
+		p->channel = channel;
+		p->seq = seq;
+		p->msgid = msgid;
+		p->size = bufsize;
+		memcpy( p->data, buffer, bufsize );
+		p->firstSent = 0;
+		p->rto = UDP_RTO_MIN;
+		p->resendAt = 0;
+		p->next = NULL;
+
+		// kept oldest first, the window and the order of sending go by it
+		for ( pp = &udpPending; *pp != NULL; pp = &(*pp)->next ) {
+		}
+		*pp = p;
+		dnUDPResend();
+	} else if ( !dnUDPQueueMessage( peer, buffer, bufsize, channel, 0, seq, msgid ) ) {
+		return 0;
+	}
+	dnUDPFlush();
+	return 1;
+}
+
+static
+int dnUDPIsPacketAvailable( unsigned int *bufsize, int channel ) {
+	dnUDPPump();
+	if ( udpIncoming[channel].head != NULL ) {
+		*bufsize = udpIncoming[channel].head->size;
+		return 1;
+	}
+	return 0;
+}
+
+static
+int dnUDPReadPacket( void *buffer, unsigned int bufsize, unsigned int *msgsize, steam_id_t *remote, int channel ) {
+	dnUDPPump();
+	return dnNetQueueRead( &udpIncoming[channel], buffer, bufsize, msgsize, remote );
+}
+
+static
+void dnUDPClosePeer( steam_id_t peer ) {
+	for ( int c = 0; c < MAX_CHANNELS; c++ ) {
+		dnNetQueueDropFrom( &udpIncoming[c], peer );
+	}
+	dnNetQueueDropFrom( &udpOutgoing, peer );
+	dnNetQueueDropFrom( &udpOutgoingBulk, peer );
+	udpQueuedBytes = 0;
+	for ( netMessage_t *msg = udpOutgoing.head; msg != NULL; msg = msg->next ) {
+		udpQueuedBytes += msg->size;
+	}
+	for ( netMessage_t *msg = udpOutgoingBulk.head; msg != NULL; msg = msg->next ) {
+		udpQueuedBytes += msg->size;
+	}
+	dnUDPDropPending( peer, false );
+	if ( udpPeer_t *state = dnUDPPeer( peer, false ) ) {
+		dnUDPForgetPeer( state );
+	}
+}
+
+static
+void dnUDPDrain( void ) {
+	dnUDPPump();
+	for ( int c = 0; c < MAX_CHANNELS; c++ ) {
+		dnNetQueueClear( &udpIncoming[c] );
+	}
+}
+
+static
+const char *dnUDPFormatID( steam_id_t id ) {
+	char *buf = (char*)dnNetIDBuffer();
+	unsigned int ip = (unsigned int)( ( id >> 16 ) & 0xFFFFFFFF );
+	snprintf( buf, 32, "%u.%u.%u.%u:%u", ip >> 24, ( ip >> 16 ) & 255, ( ip >> 8 ) & 255, ip & 255, (unsigned int)( id & 0xFFFF ) );
+	return buf;
+}
+
+static const netTransport_t udpTransport = {
+	"udp",
+	dnUDPOpen,
+	dnUDPClose,
+	dnUDPMyID,
+	dnUDPSend,
+	dnUDPIsPacketAvailable,
+	dnUDPReadPacket,
+	dnUDPClosePeer,
+	dnUDPDrain,
+	dnUDPFormatID,
+};
+
+//
+// Transport selection
+//
+
+static const netTransport_t *transports[] = {
+	&steamTransport,
+	&udpTransport,
+	&loopTransport,
+};
+
+static netTransportKind_t transportKind = NET_TRANSPORT_STEAM;
+static const netTransport_t *transport = &steamTransport;
+
+//
+// Simulator
+//
+
+typedef struct simPacket_s {
+	struct simPacket_s *next;
+	double deliverAt;
+	steam_id_t peer;
+	int reliable, channel;
+	unsigned int size;
+	unsigned char data[1];
+} simPacket_t;
+
+static netSimParams_t simParams = { 0 };
+static bool simEnabled = false;
+static simPacket_t *simQueue = NULL;
+static int simPending = 0;
+static unsigned int simRandState = 1;
+
+static struct {
+	steam_id_t peer;
+	double linkFree;
+	double lastReliable[MAX_CHANNELS];
+} simLinks[SIM_MAX_LINKS];
+
+static
+unsigned int dnSimRandom( void ) {
+	simRandState = simRandState * 1103515245 + 12345;
+	return ( simRandState >> 16 ) & 0x7FFF;
+}
+
+static
+bool dnSimLoseDatagram( void ) {
+	return simEnabled && simParams.loss > 0 && (int)( dnSimRandom() % 1000 ) < simParams.loss;
+}
+
+static
+void dnSimFlush( double until ) {
+	while ( simQueue != NULL && simQueue->deliverAt <= until ) {
+		simPacket_t *p = simQueue;
+		simQueue = p->next;
+		simPending--;
+		transport->send( p->peer, p->data, p->size, p->reliable, p->channel );
+		free( p );
+	}
+}
+
+static
+void dnSimDiscard( void ) {
+	while ( simQueue != NULL ) {
+		simPacket_t *p = simQueue;
+		simQueue = p->next;
+		free( p );
+	}
+	simPending = 0;
+	memset( simLinks, 0, sizeof( simLinks ) );
+}
+
+static
+int dnSimSchedule( steam_id_t peer, const void *buffer, unsigned int bufsize, int reliable, int channel ) {
+	double now = Sys_GetTicks(), start, at;
+	int link, lost;
+	simPacket_t *p, **pp;
+
+	link = -1;
+	for ( int i = 0; i < SIM_MAX_LINKS; i++ ) {
+		if ( simLinks[i].peer == peer ) {
+			link = i;
+			break;
+		}
+		if ( link < 0 && simLinks[i].peer == 0 ) {
+			link = i;
+		}
+	}
+	if ( link < 0 ) {
+		link = (int)( peer % SIM_MAX_LINKS );
+	}
+	if ( simLinks[link].peer != peer ) {
+		memset( &simLinks[link], 0, sizeof( simLinks[link] ) );
+		simLinks[link].peer = peer;
+	}
+
+	// the packet goes out when the link has finished with everything queued before it
+	start = simLinks[link].linkFree > now ? simLinks[link].linkFree : now;
+	if ( simParams.bandwidth > 0 ) {
+		start += bufsize * 1000.0 / simParams.bandwidth;
+	}
+	simLinks[link].linkFree = start;
+
+	at = start + simParams.latency;
+	if ( simParams.jitter > 0 ) {
+		at += (int)( dnSimRandom() % ( 2 * simParams.jitter + 1 ) ) - simParams.jitter;
+	}
+	if ( at < start ) {
+		at = start;
+	}
+
+	lost = simParams.loss > 0 && (int)( dnSimRandom() % 1000 ) < simParams.loss;
+	if ( lost && !reliable ) {
+		return 1;
+	}
+	if ( reliable && transportKind == NET_TRANSPORT_UDP ) {
+		// the udp backend does its own resending, it loses the datagrams itself
+		lost = 0;
+	}
+	if ( reliable ) {
+		double rto = 2.0 * ( simParams.latency + simParams.jitter );
+		if ( rto < 20.0 ) {
+			rto = 20.0;
+		}
+		for ( int tries = 0; lost && tries < 10; tries++ ) {
+			at += rto;
+			lost = (int)( dnSimRandom() % 1000 ) < simParams.loss;
+		}
+		if ( at < simLinks[link].lastReliable[channel] ) {
+			at = simLinks[link].lastReliable[channel];
+		}
+		simLinks[link].lastReliable[channel] = at;
+	}
+
+	p = (simPacket_t*)malloc( sizeof( simPacket_t ) + bufsize );
+	if ( p == NULL ) {
+		return 0;
+	}
+	p->deliverAt = at;
+	p->peer = peer;
+	p->reliable = reliable;
+	p->channel = channel;
+	p->size = bufsize;
+	memcpy( p->data, buffer, bufsize );
+
+	for ( pp = &simQueue; *pp != NULL && (*pp)->deliverAt <= at; pp = &(*pp)->next ) {
+	}
+	p->next = *pp;
+	*pp = p;
+	simPending++;
+
+	return 1;
+}
+
+//
+// Public interface
+//
+
+extern "C"
+int  dnNetSetTransport( netTransportKind_t kind ) {
+	const netTransport_t *previous = transport;
+
+	if ( (unsigned int)kind >= sizeof( transports ) / sizeof( transports[0] ) ) {
+		return 0;
+	}
+
+	dnSimDiscard();
+	transport->close();
+	transport = transports[kind];
+	if ( !transport->open() ) {
+		Sys_DPrintf( "[DUKEMP] dnNetSetTransport: can't open %s transport\n", transport->name );
+		transport = previous;
+		transport->open();
+		return 0;
+	}
+	transportKind = kind;
+
+	Sys_DPrintf( "[DUKEMP] dnNetSetTransport: using %s transport\n", transport->name );
+	return 1;
+}
+
+extern "C"
+netTransportKind_t dnNetGetTransport( void ) {
+	return transportKind;
+}
+
+extern "C"
+const char *dnNetTransportName( netTransportKind_t kind ) {
+	if ( (unsigned int)kind >= sizeof( transports ) / sizeof( transports[0] ) ) {
+		return "unknown";
+	}
+	return transports[kind]->name;
+}
+
+extern "C"
+int  dnNetFindTransport( const char *name ) {
+	for ( unsigned int i = 0; i < sizeof( transports ) / sizeof( transports[0] ); i++ ) {
+		if ( !strcmp( transports[i]->name, name ) ) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+static struct {
+	steam_id_t peer;
+	netTraffic_t traffic;
+} trafficPeers[TRAFFIC_MAX_PEERS];
+
+static
+netTraffic_t *dnTrafficFor( steam_id_t peer, bool create ) {
+	int free = -1;
+	if ( peer == 0 ) {
+		return NULL;
+	}
+	for ( int i = 0; i < TRAFFIC_MAX_PEERS; i++ ) {
+		if ( trafficPeers[i].peer == peer ) {
+			return &trafficPeers[i].traffic;
+		}
+		if ( free < 0 && trafficPeers[i].peer == 0 ) {
+			free = i;
+		}
+	}
+	if ( !create || free < 0 ) {
+		return NULL;
+	}
+	trafficPeers[free].peer = peer;
+	return &trafficPeers[free].traffic;
+}
+
+extern "C"
+int  dnNetSend( steam_id_t peer, const void *buffer, unsigned int bufsize, int reliable, int channel ) {
+	if ( channel < 0 || channel >= MAX_CHANNELS ) {
+		return 0;
+	}
+	if ( netTraffic_t *traffic = dnTrafficFor( peer, true ) ) {
+		traffic->packetsOut[channel]++;
+		traffic->bytesOut[channel] += bufsize;
+	}
+	if ( simEnabled ) {
+		dnSimFlush( Sys_GetTicks() );
+		return dnSimSchedule( peer, buffer, bufsize, reliable, channel );
+	}
+	return transport->send( peer, buffer, bufsize, reliable, channel );
+}
+
+extern "C"
+int  dnNetIsPacketAvailable( unsigned int *bufsize, int channel ) {
+	if ( channel < 0 || channel >= MAX_CHANNELS ) {
+		return 0;
+	}
+	if ( simQueue != NULL ) {
+		dnSimFlush( Sys_GetTicks() );
+	}
+	return transport->isPacketAvailable( bufsize, channel );
+}
+
+extern "C"
+int  dnNetReadPacket( void *buffer, unsigned int bufsize, unsigned int *msgsize, steam_id_t *remote, int channel ) {
+	if ( channel < 0 || channel >= MAX_CHANNELS ) {
+		return 0;
+	}
+	if ( !transport->readPacket( buffer, bufsize, msgsize, remote, channel ) ) {
+		return 0;
+	}
+	if ( netTraffic_t *traffic = dnTrafficFor( *remote, true ) ) {
+		traffic->packetsIn[channel]++;
+		traffic->bytesIn[channel] += *msgsize;
+	}
+	return 1;
+}
+
+extern "C"
+void dnNetGetTraffic( steam_id_t peer, netTraffic_t *traffic ) {
+	netTraffic_t *found = dnTrafficFor( peer, false );
+	if ( found != NULL ) {
+		*traffic = *found;
+	} else {
+		memset( traffic, 0, sizeof( netTraffic_t ) );
+	}
+}
+
+extern "C"
+void dnNetClosePeer( steam_id_t peer ) {
+	transport->closePeer( peer );
+}
+
+extern "C"
+void dnNetDrain( void ) {
+	dnSimFlush( Sys_GetTicks() );
+	transport->drain();
+}
+
+extern "C"
+steam_id_t dnNetMyID( void ) {
+	return transport->myID();
+}
+
+extern "C"
+const char *dnNetFormatID( steam_id_t id ) {
+	return transport->formatID( id );
+}
+
+extern "C"
+steam_id_t dnNetParseAddress( const char *address ) {
+	char host[256], *colon, *end;
+	unsigned long port = NET_DEFAULT_PORT;
+	struct sockaddr_in addr;
+
+	switch ( transportKind ) {
+		case NET_TRANSPORT_LOOPBACK: {
+			unsigned long endpoint = strtoul( address, &end, 10 );
+			if ( end == address || *end != 0 || endpoint >= NET_MAX_LOOPBACK ) {
+				return 0;
+			}
+			return NETID_LOOPBACK | endpoint;
+		}
+		case NET_TRANSPORT_UDP:
+			break;
+		default:
+			return strtoull( address, NULL, 10 );
+	}
+
+	strncpy( host, address, sizeof( host ) - 1 );
+	host[sizeof( host ) - 1] = 0;
+	colon = strrchr( host, ':' );
+	if ( colon != NULL ) {
+		*colon = 0;
+		port = strtoul( colon + 1, &end, 10 );
+		if ( end == colon + 1 || *end != 0 || port == 0 || port > 65535 ) {
+			return 0;
+		}
+	}
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_addr.s_addr = inet_addr( host );
+	if ( addr.sin_addr.s_addr == INADDR_NONE ) {
+		struct hostent *he = gethostbyname( host );
+		if ( he == NULL || he->h_addrtype != AF_INET ) {
+			return 0;
+		}
+		memcpy( &addr.sin_addr, he->h_addr_list[0], sizeof( addr.sin_addr ) );
+	}
+	addr.sin_port = htons( (unsigned short)port );
+	return dnUDPMakeID( &addr );
+}
+
+extern "C"
+void dnNetSetUDPPort( int port ) {
+	if ( port > 0 && port < 65536 ) {
+		udpPort = port;
+	}
+}
+
+extern "C"
+int  dnNetGetUDPPort( void ) {
+	return udpPort;
+}
+
+extern "C"
+void dnNetLoopbackSelect( int endpoint ) {
+	if ( endpoint >= 0 && endpoint < NET_MAX_LOOPBACK ) {
+		loopEndpoint = endpoint;
+	}
+}
+
+extern "C"
+int  dnNetLoopbackCurrent( void ) {
+	return loopEndpoint;
+}
+
+extern "C"
+void dnNetSetSimParams( const netSimParams_t *params ) {
+	simParams = *params;
+	if ( simParams.latency < 0 ) simParams.latency = 0;
+	if ( simParams.jitter < 0 ) simParams.jitter = 0;
+	if ( simParams.loss < 0 ) simParams.loss = 0;
+	if ( simParams.loss > 1000 ) simParams.loss = 1000;
+	if ( simParams.bandwidth < 0 ) simParams.bandwidth = 0;
+	simRandState = simParams.seed;
+
+	simEnabled = simParams.latency > 0 || simParams.jitter > 0 || simParams.loss > 0 || simParams.bandwidth > 0;
+	if ( !simEnabled ) {
+		// hand over whatever is still held back
+		dnSimFlush( 1e300 );
+		memset( simLinks, 0, sizeof( simLinks ) );
+	}
+}
+
+extern "C"
+void dnNetGetSimParams( netSimParams_t *params ) {
+	*params = simParams;
+}
+
+extern "C"
+int  dnNetSimPending( void ) {
+	return simPending;
+}
@@ -0,0 +1,102 @@
+//
+//  dnTransport.h
+//  duke3d
+//
+//  Network transports behind dnMulti and mmulti_steam
+//
+
+#ifndef duke3d_dnTransport_h
+#define duke3d_dnTransport_h
+
+/*
+
+ Everything the multiplayer code sends or receives goes through the dnNet* calls below,
+ which forward to one of three transports:
+	steam		Steam P2P networking (the default)
+	udp			plain UDP sockets, peers are addressed by ip:port
+	loopback	in-process queues between numbered endpoints, no sockets at all
+
+ The calls mirror CSTEAM_SendPacket/IsPacketAvailable/ReadPacket, channels included, and peers
+ are still named by a 64-bit steam_id_t. For udp the id packs the IPv4 address and port, for
+ loopback it packs the endpoint number, see dnNetParseAddress().
+
+ UDP splits messages into datagrams and reassembles them. An unreliable message with a lost
+ fragment is dropped. Reliable ones carry a sequence number per peer and channel: the receiver
+ acks each one and hands them over in order, once, and the sender resends whatever isn't acked
+ with a doubling timeout, keeping at most a window of them in flight, until it gives up after
+ 30 seconds.
+
+ Outgoing packets can be run through a simulator that adds latency, jitter, loss and a bandwidth
+ cap on any transport. Unreliable packets it loses are dropped. On udp it loses the datagrams of
+ reliable messages and their acks as they go out, so the resending above does the recovering;
+ on steam and loopback, whose reliable mode is out of reach, a lost reliable packet is delayed
+ by a retransmission timeout instead and stays in order.
+ The simulator's random numbers come from its own seed so runs can be repeated.
+
+ Packets and bytes are counted per peer and channel as the game hands them over and reads
+ them, before the simulator, for the telemetry in dnTelemetry.h.
+
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "csteam.h"
+
+typedef enum {
+	NET_TRANSPORT_STEAM = 0,
+	NET_TRANSPORT_UDP = 1,
+	NET_TRANSPORT_LOOPBACK = 2,
+} netTransportKind_t;
+
+#define NET_DEFAULT_PORT 0x5bd9
+#define NET_MAX_LOOPBACK 16
+#define NET_MAX_CHANNELS 4
+
+typedef struct {
+	int latency;		// one-way delay in ms
+	int jitter;			// +/- ms added at random to the latency
+	int loss;			// packets lost per 1000
+	int bandwidth;		// bytes per second per peer, 0 for no limit
+	unsigned int seed;
+} netSimParams_t;
+
+typedef struct {
+	unsigned int packetsIn[NET_MAX_CHANNELS], packetsOut[NET_MAX_CHANNELS];
+	unsigned int bytesIn[NET_MAX_CHANNELS], bytesOut[NET_MAX_CHANNELS];
+} netTraffic_t;
+
+int  dnNetSetTransport( netTransportKind_t kind );
+netTransportKind_t dnNetGetTransport( void );
+const char *dnNetTransportName( netTransportKind_t kind );
+int  dnNetFindTransport( const char *name );	// -1 if the name is unknown
+
+int  dnNetSend( steam_id_t peer, const void *buffer, unsigned int bufsize, int reliable, int channel );
+int  dnNetIsPacketAvailable( unsigned int *bufsize, int channel );
+int  dnNetReadPacket( void *buffer, unsigned int bufsize, unsigned int *msgsize, steam_id_t *remote, int channel );
+void dnNetClosePeer( steam_id_t peer );
+void dnNetDrain( void );
+steam_id_t dnNetMyID( void );
+const char *dnNetFormatID( steam_id_t id );
+
+// "host[:port]" for udp, endpoint number for loopback, 0 when it can't be parsed
+steam_id_t dnNetParseAddress( const char *address );
+
+void dnNetSetUDPPort( int port );	// takes effect the next time udp is selected
+int  dnNetGetUDPPort( void );
+
+void dnNetLoopbackSelect( int endpoint );	// the endpoint this process sends and reads as
+int  dnNetLoopbackCurrent( void );
+
+void dnNetSetSimParams( const netSimParams_t *params );
+void dnNetGetSimParams( netSimParams_t *params );
+int  dnNetSimPending( void );	// packets the simulator is still holding back
+
+void dnNetGetTraffic( steam_id_t peer, netTraffic_t *traffic );	// totals since startup
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
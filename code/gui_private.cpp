@@ -23,7 +23,9 @@
 #include "csteam.h"
 #include "dnAPI.h"
 #include "dnMulti.h"
+#include "dnTransport.h"
 #include "dnMouseInput.h"
+#include "dnSaveFile.h"
 //#include "duke3d.h"
 //#include "glguard.h"
 
@@ -1759,6 +1761,8 @@ void GUI::NewNetworkGame(lobby_info_t *lobby_info) {
     gamedesc.fraglimit = lobby_info->fraglimit;
     gamedesc.timelimit = lobby_info->timelimit;
     
+	// lobby player ids are Steam ids, whatever net_transport was set to
+	dnNetSetTransport( NET_TRANSPORT_STEAM );
 	dnEnterMultiMode( lobby_info );
 	
 	dnNewGame(&gamedesc);
@@ -2940,6 +2944,7 @@ void GUI::DidClearItem(Rocket::Core::Element *menu_item) {
 				char filename[15];
 				sprintf(filename, "game%d_%d.sav", slot, dnGetAddonId());
 				CSTEAM_DeleteCloudFile(filename);
+				dnSaveFlush();
                 unlink(filename);
 			}
 		};
@@ -10,6 +10,7 @@
 #include <X11/Xlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <errno.h>
 #include <SDL/SDL.h>
 #include <unistd.h>
 
@@ -30,15 +31,15 @@ void Sys_StoreData(const char *filepath, const char *data) {
     }
 }
 
+static long long CountNanos() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) return 0;
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 double CountTicks() {
-    double ti;
-    struct timeval tv;
-    if (gettimeofday(&tv,NULL) < 0) return 0;
-    // tv is sec.usec, GTC gives msec
-    ti = tv.tv_sec * 1000;
-    ti += tv.tv_usec / 1000.0;
-    //printf("Timer: %f\n", ti);
-    return ti;
+    // msec, from a clock that doesn't jump when the wall time is changed
+    return CountNanos() / 1000000.0;
 }
 
 
@@ -61,31 +62,54 @@ double Sys_GetTicks() {
 }
 
 
+// Frames are paced against absolute deadlines one period apart rather than
+// by sleeping for "period minus what the frame took", so neither rendering
+// time nor oversleeping accumulates as drift. We sleep until a margin before
+// the deadline and spin the rest; the margin follows how late the kernel
+// actually wakes us up.
+#define THROTTLE_MINSPIN 50000LL        // nsec
+#define THROTTLE_MAXSPIN 3000000LL
+
 void Sys_ThrottleFPS(int max_fps) {
-	static int throttler_ready = 0;
-	static double end_of_prev_frame;
-	double frame_time, current_time, time_to_wait;
-    struct timespec ts = { 0 };
-    
-	if (throttler_ready) {
-		frame_time = 1000.0/max_fps;
-
-        do {
-            current_time = Sys_GetTicks();
-            time_to_wait = frame_time - (current_time - end_of_prev_frame);
-                        
-            if (time_to_wait > 0) {
-                ts.tv_sec = 0;
-                ts.tv_nsec = (long)(time_to_wait*1000000.0);
-                nanosleep(&ts, NULL);
-            }
-        } while (0);
-        
-	} else {
-        throttler_ready = 1;
-	}
-    end_of_prev_frame = Sys_GetTicks();
+    static long long deadline = 0, spin = 1000000LL;
+    static int last_fps = 0;
+    long long period, now, wake, late;
+    struct timespec ts;
+
+    period = 1000000000LL / max_fps;
+    now = CountNanos();
+
+    // first frame, a new rate, or a hitch of more than a whole frame:
+    // restart the schedule from now instead of rushing to catch up
+    if (!deadline || max_fps != last_fps || now - deadline > period) {
+        deadline = now;
+        last_fps = max_fps;
+        return;
+    }
 
+    deadline += period;
+    if (deadline <= now) {
+        return;
+    }
+
+    wake = deadline - spin;
+    if (wake > now) {
+        ts.tv_sec = (time_t)(wake / 1000000000LL);
+        ts.tv_nsec = (long)(wake % 1000000000LL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) ;
+
+        // aim for twice the typical wakeup latency
+        late = CountNanos() - wake;
+        spin += (late * 2 - spin) / 8;
+        if (spin < THROTTLE_MINSPIN) spin = THROTTLE_MINSPIN;
+        if (spin > THROTTLE_MAXSPIN) spin = THROTTLE_MAXSPIN;
+    }
+
+    while (CountNanos() < deadline) {
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#endif
+    }
 }
 
 void Sys_GetScreenSize(int *width, int *height) {
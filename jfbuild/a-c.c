@@ -6,7 +6,9 @@
 // Ken Silverman's official web site: "http://www.advsys.net/ken"
 // See the included license file "BUILDLIC.TXT" for license info.
 
+#include "compat.h"
 #include "a.h"
+#include "cpufeat.h"
 
 #ifdef ENGINE_USING_A_C
 
@@ -16,11 +18,289 @@ long krecip(long num);	// from engine.c
 #define BITSOFPRECISIONPOW 8
 
 extern long asm1, asm2, asm3, asm4, fpuasm, globalx3, globaly3;
-extern void *reciptable;
+extern long reciptable[2048];
 
 static long bpl, transmode = 0;
-static long glogx, glogy, gbxinc, gbyinc, gpinc;
-static char *gbuf, *gpal, *ghlinepal, *gtrans;
+static char *gtrans;
+static BTHREADLOCAL long glogx, glogy, gbxinc, gbyinc, gpinc;
+static BTHREADLOCAL char *gbuf, *gpal, *ghlinepal;
+
+	//Per-thread state snapshots
+void getrasterstate(rasterstate *st)
+{
+	st->glogx = glogx; st->glogy = glogy;
+	st->gbxinc = gbxinc; st->gbyinc = gbyinc; st->gpinc = gpinc;
+	st->gbuf = gbuf; st->gpal = gpal; st->ghlinepal = ghlinepal;
+}
+void setrasterstate(const rasterstate *st)
+{
+	glogx = st->glogx; glogy = st->glogy;
+	gbxinc = st->gbxinc; gbyinc = st->gbyinc; gpinc = st->gpinc;
+	gbuf = st->gbuf; gpal = st->gpal; ghlinepal = st->ghlinepal;
+}
+
+	//Vectorised inner loops
+	//
+	//The SSE2 versions step the texture coordinates of four pixels at a
+	//time. The AVX2 slopevlin works out the per-pixel reciprocal for eight
+	//pixels at once with a gather from reciptable; without the gather that
+	//is no quicker than krecip(), so SSE2 leaves slopevlin alone. Texture
+	//and palette fetches stay scalar.
+	//They draw exactly the same pixels as the plain loops (shift counts are
+	//masked to five bits like the x86 shift instructions do) and are only
+	//enabled where long is 32 bits, as the coordinate arithmetic wraps there.
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# define RASTER_SSE2 __attribute__((target("sse2")))
+# define RASTER_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+# define RASTER_SSE2
+# if (_MSC_VER >= 1800)
+#  define RASTER_AVX2
+# endif
+#endif
+
+static long simdlevel = 0;	// 0 = plain C, 1 = SSE2, 2 = AVX2
+
+#ifdef RASTER_SSE2
+#include <emmintrin.h>
+#ifdef RASTER_AVX2
+#include <immintrin.h>
+#endif
+
+typedef union { __m128i v; unsigned int i[4]; } lanes4;
+
+	//Four successive values of a coordinate stepping by inc
+static RASTER_SSE2 __m128i ramp4(unsigned long start, long inc)
+{
+	unsigned int s = (unsigned int)start, d = (unsigned int)inc;
+	return _mm_set_epi32((int)(s+d*3), (int)(s+d*2), (int)(s+d), (int)s);
+}
+
+	//Low 32 bits of a 32x32 multiply in each lane (SSE2 has no pmulld)
+static RASTER_SSE2 __m128i mullo4(__m128i a, __m128i b)
+{
+	__m128i ev = _mm_mul_epu32(a, b);
+	__m128i od = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(ev, _MM_SHUFFLE(0,0,2,0)),
+		_mm_shuffle_epi32(od, _MM_SHUFFLE(0,0,2,0)));
+}
+
+static RASTER_SSE2 void vlineasm1_sse2(long vinc, long cnt, unsigned long vplc, long p)
+{
+	char *buf = gbuf, *pal = gpal;
+	long s = glogy&31;
+	__m128i v = ramp4(vplc, vinc), inc = _mm_set1_epi32((int)((unsigned int)vinc<<2));
+	__m128i sh = _mm_cvtsi32_si128(s);
+	lanes4 t;
+
+	for(cnt++;cnt>=4;cnt-=4)
+	{
+		t.v = _mm_srl_epi32(v, sh); v = _mm_add_epi32(v, inc);
+		*((char *)p) = pal[buf[t.i[0]]]; p += bpl;
+		*((char *)p) = pal[buf[t.i[1]]]; p += bpl;
+		*((char *)p) = pal[buf[t.i[2]]]; p += bpl;
+		*((char *)p) = pal[buf[t.i[3]]]; p += bpl;
+	}
+	vplc = (unsigned int)_mm_cvtsi128_si32(v);
+	for(;cnt>0;cnt--)
+	{
+		*((char *)p) = pal[buf[(unsigned int)vplc>>s]];
+		p += bpl;
+		vplc += vinc;
+	}
+}
+
+static RASTER_SSE2 void mvlineasm1_sse2(long vinc, long cnt, unsigned long vplc, long p)
+{
+	char *buf = gbuf, *pal = gpal, ch;
+	long s = glogy&31, k;
+	__m128i v = ramp4(vplc, vinc), inc = _mm_set1_epi32((int)((unsigned int)vinc<<2));
+	__m128i sh = _mm_cvtsi32_si128(s);
+	lanes4 t;
+
+	for(cnt++;cnt>=4;cnt-=4)
+	{
+		t.v = _mm_srl_epi32(v, sh); v = _mm_add_epi32(v, inc);
+		for(k=0;k<4;k++,p+=bpl)
+			{ ch = buf[t.i[k]]; if (ch != 255) *((char *)p) = pal[ch]; }
+	}
+	vplc = (unsigned int)_mm_cvtsi128_si32(v);
+	for(;cnt>0;cnt--)
+	{
+		ch = buf[(unsigned int)vplc>>s]; if (ch != 255) *((char *)p) = pal[ch];
+		p += bpl;
+		vplc += vinc;
+	}
+}
+
+static RASTER_SSE2 void tvlineasm1_sse2(long vinc, long cnt, unsigned long vplc, long p)
+{
+	char *buf = gbuf, *pal = gpal, ch;
+	long s = glogy&31, k;
+	__m128i v = ramp4(vplc, vinc), inc = _mm_set1_epi32((int)((unsigned int)vinc<<2));
+	__m128i sh = _mm_cvtsi32_si128(s);
+	lanes4 t;
+
+	for(cnt++;cnt>=4;cnt-=4)
+	{
+		t.v = _mm_srl_epi32(v, sh); v = _mm_add_epi32(v, inc);
+		if (transmode)
+		{
+			for(k=0;k<4;k++,p+=bpl)
+				{ ch = buf[t.i[k]]; if (ch != 255) *((char *)p) = gtrans[(*((char *)p))+(pal[ch]<<8)]; }
+		}
+		else
+		{
+			for(k=0;k<4;k++,p+=bpl)
+				{ ch = buf[t.i[k]]; if (ch != 255) *((char *)p) = gtrans[((*((char *)p))<<8)+pal[ch]]; }
+		}
+	}
+	vplc = (unsigned int)_mm_cvtsi128_si32(v);
+	for(;cnt>0;cnt--)
+	{
+		ch = buf[(unsigned int)vplc>>s];
+		if (ch != 255)
+		{
+			if (transmode) *((char *)p) = gtrans[(*((char *)p))+(pal[ch]<<8)];
+			else *((char *)p) = gtrans[((*((char *)p))<<8)+pal[ch]];
+		}
+		p += bpl;
+		vplc += vinc;
+	}
+}
+
+static RASTER_SSE2 void hlineasm4_sse2(long cnt, char *palptr, unsigned long by, unsigned long bx, long p)
+{
+	char *buf = gbuf;
+	long sx = (32-glogx)&31, sy = (32-glogy)&31, ly = glogy&31;
+	__m128i vx = ramp4(bx, -gbxinc), vy = ramp4(by, -gbyinc);
+	__m128i ix = _mm_set1_epi32((int)((unsigned int)-gbxinc<<2));
+	__m128i iy = _mm_set1_epi32((int)((unsigned int)-gbyinc<<2));
+	__m128i shx = _mm_cvtsi32_si128(sx), shy = _mm_cvtsi32_si128(sy), shl = _mm_cvtsi32_si128(ly);
+	lanes4 t;
+
+	for(cnt++;cnt>=4;cnt-=4)
+	{
+		t.v = _mm_add_epi32(_mm_sll_epi32(_mm_srl_epi32(vx, shx), shl), _mm_srl_epi32(vy, shy));
+		vx = _mm_add_epi32(vx, ix); vy = _mm_add_epi32(vy, iy);
+		*((char *)p) = palptr[buf[t.i[0]]]; p--;
+		*((char *)p) = palptr[buf[t.i[1]]]; p--;
+		*((char *)p) = palptr[buf[t.i[2]]]; p--;
+		*((char *)p) = palptr[buf[t.i[3]]]; p--;
+	}
+	bx = (unsigned int)_mm_cvtsi128_si32(vx);
+	by = (unsigned int)_mm_cvtsi128_si32(vy);
+	for(;cnt>0;cnt--)
+	{
+		*((char *)p) = palptr[buf[(((unsigned int)bx>>sx)<<ly)+((unsigned int)by>>sy)]];
+		bx -= gbxinc;
+		by -= gbyinc;
+		p--;
+	}
+}
+
+static RASTER_SSE2 void spritevline_sse2(long bx, long by, long cnt, long p)
+{
+	char *buf = gbuf, *pal = gpal;
+	__m128i vx = ramp4(bx, gbxinc), vy = ramp4(by, gbyinc);
+	__m128i ix = _mm_set1_epi32((int)((unsigned int)gbxinc<<2));
+	__m128i iy = _mm_set1_epi32((int)((unsigned int)gbyinc<<2));
+	__m128i ys = _mm_set1_epi32((int)glogy);
+	lanes4 t;
+
+	for(cnt--;cnt>=4;cnt-=4)
+	{
+		t.v = _mm_add_epi32(mullo4(_mm_srai_epi32(vx, 16), ys), _mm_srai_epi32(vy, 16));
+		vx = _mm_add_epi32(vx, ix); vy = _mm_add_epi32(vy, iy);
+		(*(char *)p) = pal[buf[(int)t.i[0]]]; p += bpl;
+		(*(char *)p) = pal[buf[(int)t.i[1]]]; p += bpl;
+		(*(char *)p) = pal[buf[(int)t.i[2]]]; p += bpl;
+		(*(char *)p) = pal[buf[(int)t.i[3]]]; p += bpl;
+	}
+	bx = _mm_cvtsi128_si32(vx);
+	by = _mm_cvtsi128_si32(vy);
+	for(;cnt>0;cnt--)
+	{
+		(*(char *)p) = pal[buf[(bx>>16)*glogy+(by>>16)]];
+		bx += gbxinc;
+		by += gbyinc;
+		p += bpl;
+	}
+}
+
+#ifdef RASTER_AVX2
+	//Eight reciprocals at a time with a gather from reciptable
+static RASTER_AVX2 void slopevlin_avx2(long p, long slopaloffs, long cnt, long bx, long by)
+{
+	long *slopalptr = (long *)slopaloffs, bz, bzinc, k, r;
+	long sx = (32-glogx)&31, sy = (32-glogy)&31, ly = glogy&31;
+	__m256i vz, zinc, bits, tidx, tsh, tsgn, vi, u, v;
+	__m256i gx3 = _mm256_set1_epi32((int)globalx3), gy3 = _mm256_set1_epi32((int)globaly3);
+	__m256i vbx = _mm256_set1_epi32((int)bx), vby = _mm256_set1_epi32((int)by);
+	__m128i shx = _mm_cvtsi32_si128(sx), shy = _mm_cvtsi32_si128(sy), shl = _mm_cvtsi32_si128(ly);
+	union { __m256i v; unsigned int i[8]; } t;
+	unsigned long uu, vv;
+	unsigned int d;
+
+	bz = asm3; bzinc = (asm1>>3);
+	d = (unsigned int)bzinc;
+	vz = _mm256_add_epi32(_mm256_set1_epi32((int)bz),
+		_mm256_set_epi32((int)(d*7),(int)(d*6),(int)(d*5),(int)(d*4),(int)(d*3),(int)(d*2),(int)d,0));
+	zinc = _mm256_set1_epi32((int)(d<<3));
+
+	for(;cnt>=8;cnt-=8)
+	{
+		bits = _mm256_castps_si256(_mm256_cvtepi32_ps(_mm256_srai_epi32(vz, 6)));
+		vz = _mm256_add_epi32(vz, zinc);
+		tidx = _mm256_and_si256(_mm256_srli_epi32(bits, 12), _mm256_set1_epi32(2047));
+		tsh = _mm256_and_si256(_mm256_srli_epi32(_mm256_sub_epi32(bits, _mm256_set1_epi32(0x3f800000)), 23), _mm256_set1_epi32(31));
+		tsgn = _mm256_srai_epi32(bits, 31);
+		vi = _mm256_xor_si256(_mm256_srav_epi32(_mm256_i32gather_epi32((const int *)reciptable, tidx, 4), tsh), tsgn);
+
+		u = _mm256_add_epi32(vbx, _mm256_mullo_epi32(gx3, vi));
+		v = _mm256_add_epi32(vby, _mm256_mullo_epi32(gy3, vi));
+		t.v = _mm256_add_epi32(_mm256_sll_epi32(_mm256_srl_epi32(u, shx), shl), _mm256_srl_epi32(v, shy));
+		for(k=0;k<8;k++)
+		{
+			(*(char *)p) = *(char *)(slopalptr[0]+gbuf[t.i[k]]);
+			slopalptr--;
+			p += gpinc;
+		}
+	}
+	bz = _mm_cvtsi128_si32(_mm256_castsi256_si128(vz));
+	for(;cnt>0;cnt--)
+	{
+		r = krecip(bz>>6); bz += bzinc;
+		uu = bx+globalx3*r;
+		vv = by+globaly3*r;
+		(*(char *)p) = *(char *)(slopalptr[0]+gbuf[(((unsigned int)uu>>sx)<<ly)+((unsigned int)vv>>sy)]);
+		slopalptr--;
+		p += gpinc;
+	}
+}
+#endif
+
+#endif	// RASTER_SSE2
+
+long setrastersimd(long level)
+{
+	long have = 0;
+
+#ifdef RASTER_SSE2
+	if (sizeof(long) == 4) {
+		if (getcpufeatures() & CPUFEAT_SSE2) have = 1;
+#ifdef RASTER_AVX2
+		if (getcpufeatures() & CPUFEAT_AVX2) have = 2;
+#endif
+	}
+#endif
+	if (level < 0) level = 0;
+	simdlevel = min(level, have);
+	return simdlevel;
+}
+
+long getrastersimd(void) { return simdlevel; }
+
 
 	//Global variable functions
 void setvlinebpl(long dabpl) { bpl = dabpl; }
@@ -40,6 +320,9 @@ void hlineasm4(long cnt, long skiploadincs, long paloffs, unsigned long by, unsi
 
 	palptr = (char *)&ghlinepal[paloffs];
 	if (!skiploadincs) { gbxinc = asm1; gbyinc = asm2; }
+#ifdef RASTER_SSE2
+	if (simdlevel) { hlineasm4_sse2(cnt,palptr,by,bx,p); return; }
+#endif
 	for(;cnt>=0;cnt--)
 	{
 		*((char *)p) = palptr[gbuf[((bx>>(32-glogx))<<glogy)+(by>>(32-glogy))]];
@@ -61,6 +344,11 @@ void slopevlin(long p, long i, long slopaloffs, long cnt, long bx, long by)
 	long *slopalptr, bz, bzinc;
 	unsigned long u, v;
 
+#ifdef RASTER_SSE2
+#ifdef RASTER_AVX2
+	if (simdlevel >= 2) { slopevlin_avx2(p,slopaloffs,cnt,bx,by); return; }
+#endif
+#endif
 	bz = asm3; bzinc = (asm1>>3);
 	slopalptr = (long *)slopaloffs;
 	for(;cnt>0;cnt--)
@@ -81,6 +369,9 @@ void vlineasm1(long vinc, long paloffs, long cnt, unsigned long vplc, long bufpl
 {
 	gbuf = (char *)bufplc;
 	gpal = (char *)paloffs;
+#ifdef RASTER_SSE2
+	if (simdlevel) { vlineasm1_sse2(vinc,cnt,vplc,p); return; }
+#endif
 	for(;cnt>=0;cnt--)
 	{
 		*((char *)p) = gpal[gbuf[vplc>>glogy]];
@@ -96,6 +387,9 @@ void mvlineasm1(long vinc, long paloffs, long cnt, unsigned long vplc, long bufp
 
 	gbuf = (char *)bufplc;
 	gpal = (char *)paloffs;
+#ifdef RASTER_SSE2
+	if (simdlevel) { mvlineasm1_sse2(vinc,cnt,vplc,p); return; }
+#endif
 	for(;cnt>=0;cnt--)
 	{
 		ch = gbuf[vplc>>glogy]; if (ch != 255) *((char *)p) = gpal[ch];
@@ -111,6 +405,9 @@ void tvlineasm1(long vinc, long paloffs, long cnt, unsigned long vplc, long bufp
 
 	gbuf = (char *)bufplc;
 	gpal = (char *)paloffs;
+#ifdef RASTER_SSE2
+	if (simdlevel) { tvlineasm1_sse2(vinc,cnt,vplc,p); return; }
+#endif
 	if (transmode)
 	{
 		for(;cnt>=0;cnt--)
@@ -194,6 +491,9 @@ void setupspritevline(long paloffs, long bxinc, long byinc, long ysiz)
 void spritevline(long bx, long by, long cnt, long bufplc, long p)
 {
 	gbuf = (char *)bufplc;
+#ifdef RASTER_SSE2
+	if (simdlevel) { spritevline_sse2(bx,by,cnt,p); return; }
+#endif
 	for(;cnt>1;cnt--)
 	{
 		(*(char *)p) = gpal[gbuf[(bx>>16)*glogy+(by>>16)]];
@@ -267,11 +567,11 @@ void setupdrawslab (long dabpl, long pal)
 
 void drawslab (long dx, long v, long dy, long vi, long vptr, long p)
 {
-	long x;
-	
+	if (dx <= 0) return;
 	while (dy > 0)
 	{
-		for(x=0;x<dx;x++) *(char *)(p+x) = gpal[(long)(*(char *)((v>>16)+vptr))];
+			//every pixel of a slab row has the same colour
+		memset((void *)p, gpal[(long)(*(char *)((v>>16)+vptr))], dx);
 		p += bpl; v += vi; dy--;
 	}
 }
@@ -287,6 +587,109 @@ void stretchhline (long p0, long u, long cnt, long uinc, long rptr, long p)
 }
 
 
+	//Checks every vectorised loop against the plain C one on random input:
+	//both draw into copies of the same buffer, which must come out equal.
+	//Returns the number of differing runs, naming the first culprit, or
+	//-1 when out of memory and -2 when there are no vector loops to test.
+static unsigned long testseed;
+static long testrand(long n) { testseed = testseed*1103515245+12345; return (long)((testseed>>8)%(unsigned long)n); }
+
+long testrasterizers(long iterations, const char **failed)
+{
+	enum { TW = 256, TH = 256 };
+	char *tex, *palmem, *pal, *transmem, *trans, *dinit, *da, *db;
+	long *slopal;
+	long savebpl = bpl, savetransmode = transmode, savelevel = simdlevel;
+	long saveasm1 = asm1, saveasm3 = asm3, savex3 = globalx3, savey3 = globaly3;
+	char *savetrans = gtrans;
+	rasterstate savest;
+	long i, k, n, func, level, maxlevel, bad = 0;
+	long a0, a1, a2, a3, a4, a5;
+
+	*failed = NULL;
+	tex = palmem = transmem = dinit = da = db = NULL; slopal = NULL;
+	maxlevel = setrastersimd(2);
+	if (!maxlevel) return -2;
+
+		//palette and translucency lookups may be indexed with signed chars
+	tex = (char *)malloc(65536+256); palmem = (char *)malloc(1024); transmem = (char *)malloc(131072);
+	dinit = (char *)malloc(TW*TH); da = (char *)malloc(TW*TH); db = (char *)malloc(TW*TH);
+	slopal = (long *)malloc(256*sizeof(long));
+	if (!tex || !palmem || !transmem || !dinit || !da || !db || !slopal) { bad = -1; goto done; }
+	pal = palmem+256; trans = transmem+65536;
+
+	getrasterstate(&savest);
+	testseed = 1;
+	for(i=0;i<65536+256;i++) tex[i] = (char)(testrand(8) ? testrand(255) : 255);
+	for(i=0;i<1024;i++) palmem[i] = (char)testrand(256);
+	for(i=0;i<131072;i++) transmem[i] = (char)testrand(256);
+	for(i=0;i<TW*TH;i++) dinit[i] = (char)testrand(256);
+	for(i=0;i<256;i++) slopal[i] = (long)(pal+testrand(256));
+	bpl = TW; gtrans = trans;
+
+	for(n=0;n<iterations;n++)
+		for(func=0;func<6;func++)
+			for(level=1;level<=maxlevel;level++)
+			{
+				transmode = testrand(2);
+				glogx = 1+testrand(8); glogy = 1+testrand(8);
+				asm1 = testrand(0x7fffffff)-0x40000000; asm3 = testrand(0x7fffffff)-0x40000000;
+				globalx3 = testrand(0x7fffffff)-0x40000000; globaly3 = testrand(0x7fffffff)-0x40000000;
+				gbxinc = testrand(0x7fffffff)-0x40000000; gbyinc = testrand(0x7fffffff)-0x40000000;
+				a0 = testrand(0x7fffffff)-0x40000000; a3 = testrand(0x7fffffff)-0x40000000;
+				a1 = testrand(0x7fffffff)-0x40000000; a4 = testrand(0x7fffffff)-0x40000000;
+				a2 = testrand(202)-1; a5 = testrand(TW);
+				k = glogy;
+
+				for(i=0;i<2;i++)
+				{
+					char *d = i ? db : da;
+					memcpy(d,dinit,TW*TH);
+					simdlevel = i ? level : 0;
+					glogy = k; ghlinepal = pal; gpal = pal; gbuf = tex;
+					switch(func)
+					{
+						case 0: case 1: case 2:
+							glogy = 24+(k&7);
+							if (func == 0) vlineasm1(a0,(long)pal,a2,a1,(long)(tex+(a4&65535)),(long)(d+a5));
+							else if (func == 1) mvlineasm1(a0,(long)pal,a2,a1,(long)(tex+(a4&65535)),(long)(d+a5));
+							else tvlineasm1(a0,(long)pal,a2,a1,(long)(tex+(a4&65535)),(long)(d+a5));
+							break;
+						case 3:
+							hlineasm4(a2,1,0,a1,a3,(long)(d+TW*(a5&127)+TW-1-(a5>>7)));
+							break;
+						case 4:
+							gbxinc = a0&32767; gbyinc = a1&32767; glogy = 1+(k*16&127);
+							spritevline(a3&((128<<16)-1),a4&((128<<16)-1),a2&63,(long)tex,(long)(d+a5));
+							break;
+						case 5:
+							gpinc = -TW;
+							slopevlin((long)(d+TW*(TH-1)+a5),0,(long)&slopal[255],a2+1,a0,a1);
+							break;
+					}
+				}
+				if (memcmp(da,db,TW*TH))
+				{
+					static const char *names[6] = { "vlineasm1", "mvlineasm1", "tvlineasm1", "hlineasm4", "spritevline", "slopevlin" };
+					if (!*failed) *failed = names[func];
+					bad++;
+				}
+			}
+
+	setrasterstate(&savest);
+done:
+	bpl = savebpl; transmode = savetransmode; gtrans = savetrans; simdlevel = savelevel;
+	asm1 = saveasm1; asm3 = saveasm3; globalx3 = savex3; globaly3 = savey3;
+	if (tex) free(tex);
+	if (palmem) free(palmem);
+	if (transmem) free(transmem);
+	if (dinit) free(dinit);
+	if (da) free(da);
+	if (db) free(db);
+	if (slopal) free(slopal);
+	return bad;
+}
+
 void mmxoverlay() { }
 
 #endif
@@ -195,6 +195,22 @@ extern void _cdecl stretchhline(long,long,long,long,long,long);
 #define ENGINE_USING_A_C
 #endif
 
+	// The rasterizer's set-up state is kept per thread so that columns and
+	// spans can be drawn from several threads at once. A thread joining in
+	// on a job loads a snapshot of the state taken by the thread that set it up.
+typedef struct {
+	long glogx, glogy, gbxinc, gbyinc, gpinc;
+	char *gbuf, *gpal, *ghlinepal;
+} rasterstate;
+void getrasterstate(rasterstate *st);
+void setrasterstate(const rasterstate *st);
+
+	// Vectorised versions of the column and span loops: 0 = plain C,
+	// 1 = SSE2, 2 = AVX2. Requests above what the CPU has are clamped.
+long setrastersimd(long level);
+long getrastersimd(void);
+long testrasterizers(long iterations, const char **failed);
+
 void setvlinebpl(long dabpl);
 void fixtransluscence(long datransoff);
 void settransnormal(void);
@@ -2,6 +2,9 @@
 #include "osd.h"
 #include "build.h"
 #include "baselayer.h"
+#include "a.h"
+#include "cache1d.h"
+#include "kplib.h"
 
 #ifdef RENDERTYPEWIN
 #include "winlayer.h"
@@ -134,6 +137,76 @@ static int osdcmd_glinfo(const osdfuncparm_t *parm)
 }
 #endif
 
+#ifdef ENGINE_USING_A_C
+static int osdcmd_rastertest(const osdfuncparm_t *parm)
+{
+	const char *failed;
+	long iterations = 1000, bad;
+
+	if (parm->numparms > 0) iterations = max(1, atol(parm->parms[0]));
+
+	bad = testrasterizers(iterations, &failed);
+	if (bad == -2) OSD_Printf("rastertest: no vectorised rasterizers on this machine\n");
+	else if (bad < 0) OSD_Printf("rastertest: out of memory\n");
+	else if (bad) OSD_Printf("rastertest: %ld mismatching runs, first in %s\n", bad, failed);
+	else OSD_Printf("rastertest: %ld runs matched the C rasterizers\n", iterations);
+	return OSDCMD_OK;
+}
+#endif
+
+static int osdcmd_pictest(const osdfuncparm_t *parm)
+{
+	long i, j, fil, leng, xsiz, ysiz, runs, r0, r1, oldpng, oldjpg;
+	unsigned long t0, t1, t2;
+	char *buf;
+	long *pic0, *pic1;
+
+	if (parm->numparms < 1) return OSDCMD_SHOWHELP;
+
+	oldpng = kpngfast;
+	oldjpg = kpegfast;
+	for (i = 0; i < parm->numparms; i++) {
+		fil = kopen4load((char *)parm->parms[i], 0);
+		if (fil < 0) { OSD_Printf("pictest: %s not found\n", parm->parms[i]); continue; }
+		leng = kfilelength(fil);
+		buf = (char *)Bmalloc(leng);
+		if (!buf) { kclose(fil); OSD_Printf("pictest: out of memory\n"); break; }
+		kread(fil, buf, leng);
+		kclose(fil);
+
+		xsiz = ysiz = 0;
+		kpgetdim(buf, leng, &xsiz, &ysiz);
+		pic0 = (long *)Bmalloc(xsiz*ysiz*4);
+		pic1 = (long *)Bmalloc(xsiz*ysiz*4);
+		if (xsiz <= 0 || ysiz <= 0 || !pic0 || !pic1) {
+			OSD_Printf("pictest: can't decode %s\n", parm->parms[i]);
+		} else {
+			// repeat small pictures so the timings mean something
+			runs = max(1, (1<<20) / (xsiz*ysiz));
+			memset(pic0, 0, xsiz*ysiz*4);
+			memset(pic1, 0, xsiz*ysiz*4);
+
+			t0 = getusecticks();
+			kpngfast = kpegfast = 0;
+			for (j = r0 = 0; j < runs; j++) r0 |= kprender(buf, leng, (long)pic0, xsiz*4, xsiz, ysiz, 0, 0);
+			t1 = getusecticks();
+			kpngfast = kpegfast = 1;
+			for (j = r1 = 0; j < runs; j++) r1 |= kprender(buf, leng, (long)pic1, xsiz*4, xsiz, ysiz, 0, 0);
+			t2 = getusecticks();
+
+			OSD_Printf("pictest: %s %ldx%ld: %ld us -> %ld us per decode, %s\n", parm->parms[i], xsiz, ysiz,
+				(long)(t1-t0)/runs, (long)(t2-t1)/runs,
+				(r0 || r1) ? "decode failed" : memcmp(pic0, pic1, xsiz*ysiz*4) ? "PIXELS DIFFER" : "pixels match");
+		}
+		if (pic0) Bfree(pic0);
+		if (pic1) Bfree(pic1);
+		Bfree(buf);
+	}
+	kpngfast = oldpng;
+	kpegfast = oldjpg;
+	return OSDCMD_OK;
+}
+
 static int osdcmd_vars(const osdfuncparm_t *parm)
 {
 	int showval = (parm->numparms < 1);
@@ -151,6 +224,28 @@ static int osdcmd_vars(const osdfuncparm_t *parm)
 		}
 		return OSDCMD_OK;
 	}
+#ifdef ENGINE_USING_A_C
+	else if (!Bstrcasecmp(parm->name, "rastersimd")) {
+		if (showval) { OSD_Printf("rastersimd is %ld\n", getrastersimd()); }
+		else { OSD_Printf("rastersimd set to %ld\n", setrastersimd(atol(parm->parms[0]))); }
+		return OSDCMD_OK;
+	}
+#endif
+	else if (!Bstrcasecmp(parm->name, "pngfast")) {
+		if (showval) { OSD_Printf("pngfast is %ld\n", kpngfast); }
+		else { kpngfast = (atoi(parm->parms[0]) != 0); }
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "jpgfast")) {
+		if (showval) { OSD_Printf("jpgfast is %ld\n", kpegfast); }
+		else { kpegfast = (atoi(parm->parms[0]) != 0); }
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "parallelrender")) {
+		if (showval) { OSD_Printf("parallelrender is %d\n", parallelrender); }
+		else { parallelrender = (atoi(parm->parms[0]) != 0); }
+		return OSDCMD_OK;
+	}
 #ifdef SUPERBUILD
 	else if (!Bstrcasecmp(parm->name, "novoxmips")) {
 		if (showval) { OSD_Printf("novoxmips is %d\n", novoxmips); }
@@ -179,6 +274,14 @@ int baselayer_init(void)
 			osdfunc_setrendermode);
 #endif
 	OSD_RegisterFunction("screencaptureformat","screencaptureformat: sets the output format for screenshots (TGA or PCX)",osdcmd_vars);
+#ifdef ENGINE_USING_A_C
+	OSD_RegisterFunction("rastersimd","rastersimd: picks the classic-mode column/span loops (0 = C, 1 = SSE2, 2 = AVX2)",osdcmd_vars);
+	OSD_RegisterFunction("rastertest","rastertest [runs]: checks the vectorised column/span loops draw the same pixels as the C ones",osdcmd_rastertest);
+#endif
+	OSD_RegisterFunction("pngfast","pngfast: decode PNGs a whole scanline at a time with SIMD filters (0 = old byte-at-a-time path)",osdcmd_vars);
+	OSD_RegisterFunction("jpgfast","jpgfast: decode JPEGs with the SIMD IDCT and colour conversion, spreading big ones over the worker threads",osdcmd_vars);
+	OSD_RegisterFunction("pictest","pictest <file> [...]: times the old and fast PNG/JPEG decode paths on the given pictures and checks they agree",osdcmd_pictest);
+	OSD_RegisterFunction("parallelrender","parallelrender: enable/disable drawing classic-mode walls and flats on several threads",osdcmd_vars);
 #ifdef SUPERBUILD
 	OSD_RegisterFunction("novoxmips","novoxmips: turn off/on the use of mipmaps when rendering 8-bit voxels",osdcmd_vars);
 	OSD_RegisterFunction("usevoxels","usevoxels: enable/disable automatic sprite->voxel rendering",osdcmd_vars);
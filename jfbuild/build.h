@@ -244,6 +244,7 @@ extern palette_t curpalette[256], curpalettefaded[256], palfadergb;
 extern char palfadedelta;
 
 extern long dommxoverlay, novoxmips;
+extern long parallelrender;
 
 #ifdef SUPERBUILD
 extern long tiletovox[MAXTILES];
@@ -373,6 +374,7 @@ long   tile_exists(long picnum);
 long   loadpics(char *filename, long askedsize);
 void   loadtile(short tilenume);
 long   qloadkvx(long voxindex, char *filename);
+void   qloadkvxflush(void);
 long   allocatepermanenttile(short tilenume, long xsiz, long ysiz);
 void   copytilepiece(long tilenume1, long sx1, long sy1, long xsiz, long ysiz, long tilenume2, long sx2, long sy2);
 void   makepalookup(long palnum, char *remapbuf, signed char r, signed char g, signed char b, char dastat);
@@ -412,6 +414,7 @@ void   getzrange(long x, long y, long z, short sectnum, long *ceilz, long *ceilh
 long   hitscan(long xs, long ys, long zs, short sectnum, long vx, long vy, long vz, short *hitsect, short *hitwall, short *hitsprite, long *hitx, long *hity, long *hitz, unsigned long cliptype);
 long   neartag(long xs, long ys, long zs, short sectnum, short ange, short *neartagsector, short *neartagwall, short *neartagsprite, long *neartaghitdist, long neartagrange, char tagsearch);
 long   cansee(long x1, long y1, long z1, short sect1, long x2, long y2, long z2, short sect2);
+long   cansee_r(long x1, long y1, long z1, short sect1, long x2, long y2, long z2, short sect2);
 void   updatesector(long x, long y, short *sectnum);
 void   updatesectorz(long x, long y, long z, short *sectnum);
 long   inside(long x, long y, short sectnum);
@@ -487,6 +490,7 @@ extern long glusetexcompr;
 extern long gltexfiltermode;
 extern long glredbluemode;
 extern long glusetexcache;
+extern long glusevoxcache;
 extern long glmultisample, glnvmultisamplehint;
 void gltexapplyprops (void);
 
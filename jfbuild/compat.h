@@ -91,6 +91,15 @@ typedef long long int64;
 typedef unsigned long long uint64;
 #endif
 
+// Per-thread storage for state that worker threads need their own copy of
+#if defined(_MSC_VER)
+# define BTHREADLOCAL __declspec(thread)
+#elif defined(__GNUC__)
+# define BTHREADLOCAL __thread
+#else
+# define BTHREADLOCAL
+#endif
+
 #ifndef NULL
 # define NULL ((void *)0)
 #endif
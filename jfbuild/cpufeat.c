@@ -0,0 +1,57 @@
+// CPU feature detection for choosing vectorised code paths at run time
+
+#include "compat.h"
+#include "cpufeat.h"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+# include <intrin.h>
+# define CPUFEAT_X86
+static void getcpuid(int leaf, int sub, int *r) { __cpuidex(r, leaf, sub); }
+static unsigned long long getxcr0(void) { return _xgetbv(0); }
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# include <cpuid.h>
+# define CPUFEAT_X86
+static void getcpuid(int leaf, int sub, int *r)
+{
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, sub, a, b, c, d);
+	r[0] = a; r[1] = b; r[2] = c; r[3] = d;
+}
+static unsigned long long getxcr0(void)
+{
+	unsigned int lo, hi;
+	__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (lo), "=d" (hi) : "c" (0));
+	return ((unsigned long long)hi << 32) | lo;
+}
+#endif
+
+static int cpufeatures = -1;
+
+int getcpufeatures(void)
+{
+#ifdef CPUFEAT_X86
+	int r[4], maxleaf;
+#endif
+
+	if (cpufeatures >= 0) return cpufeatures;
+	cpufeatures = 0;
+
+#ifdef CPUFEAT_X86
+	getcpuid(0, 0, r);
+	maxleaf = r[0];
+	if (maxleaf < 1) return cpufeatures;
+
+	getcpuid(1, 0, r);
+	if (r[3] & (1<<26)) cpufeatures |= CPUFEAT_SSE2;
+	if (r[2] & (1<<9))  cpufeatures |= CPUFEAT_SSSE3;
+	if (r[2] & (1<<19)) cpufeatures |= CPUFEAT_SSE41;
+
+		// AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0)
+	if (maxleaf >= 7 && (r[2] & (1<<27)) && (r[2] & (1<<28)) && (getxcr0() & 6) == 6) {
+		getcpuid(7, 0, r);
+		if (r[1] & (1<<5)) cpufeatures |= CPUFEAT_AVX2;
+	}
+#endif
+
+	return cpufeatures;
+}
@@ -0,0 +1,22 @@
+#ifndef __cpufeat_h__
+#define __cpufeat_h__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Instruction set extensions the running CPU and OS both support, for
+// picking between the plain C and vectorised versions of inner loops.
+
+#define CPUFEAT_SSE2	1
+#define CPUFEAT_SSSE3	2
+#define CPUFEAT_SSE41	4
+#define CPUFEAT_AVX2	8
+
+int getcpufeatures(void);	// CPUFEAT_* bits, probed once and cached
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1076,6 +1076,7 @@ int loaddefinitionsfile(char *fn)
 	if (!script) return -1;
 
 	defsparser(script);
+	qloadkvxflush();	// convert the voxels it named all at once
 
 	scriptfile_close(script);
 	scriptfile_clearsymbols();
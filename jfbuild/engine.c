@@ -45,6 +45,7 @@
 #include <assert.h>
 
 #include "engine_priv.h"
+#include "workers.h"
 
 void *kmalloc(bsize_t size) { return(Bmalloc(size)); }
 #define kkmalloc kmalloc
@@ -532,6 +533,7 @@ char globparaceilclip, globparaflorclip;
 long xyaspect, viewingrangerecip, pixelaspect, widescreen = 0, tallscreen = 0;
 
 long asm1, asm2, asm3, asm4;
+long parallelrender = 1;	// split wall columns and flat spans across the worker threads
 long vplce[4], vince[4], palookupoffse[4], bufplce[4];
 char globalxshift, globalyshift;
 long globalxpanning, globalypanning, globalshade;
@@ -768,13 +770,100 @@ skipitaddwall:
 }
 
 
+//
+// renderstrips (internal)
+//
+// How many columns or spans each thread should take of a job of 'count'
+// items. Returns count itself, meaning draw it all on this thread, when
+// parallel rendering is off or the job is too small to be worth splitting.
+//
+#define MINSTRIPITEMS 48
+static long renderstrips(long count)
+{
+	long n;
+
+	if (!parallelrender) return count;
+	n = getworkercount();
+	if (n <= 1 || count < MINSTRIPITEMS*2) return count;
+	n = (count+n*2-1)/(n*2);
+	return max(n,MINSTRIPITEMS);
+}
+
+
+#ifdef ENGINE_USING_A_C
+	// A run of wall columns handed to wallscanstrip() or maskwallscanstrip().
+	// Every column is independent of its neighbours, so the run can be split
+	// into strips and drawn on several threads.
+typedef struct {
+	long x1;
+	short *uwal, *dwal;
+	long *swal, *lwal;
+	long tsizx, tsizy, xnice, ynice, fpalookup;
+	rasterstate st;
+} wallscanjob;
+
+static void wallscanstrip(void *arg, long start, long end)
+{
+	wallscanjob *job = (wallscanjob *)arg;
+	long x, xe, y1v, y2v, palookupoffs, bufplc, vinc, vplc;
+
+	setrasterstate(&job->st);
+	for(x=job->x1+start,xe=job->x1+end;x<xe;x++)
+	{
+		y1v = max(job->uwal[x],umost[x]);
+		y2v = min(job->dwal[x],dmost[x]);
+		if (y2v <= y1v) continue;
+
+		palookupoffs = job->fpalookup+(getpalookup((long)mulscale16(job->swal[x],globvis),globalshade)<<8);
+
+		bufplc = job->lwal[x] + globalxpanning;
+		if (bufplc >= job->tsizx) { if (job->xnice == 0) bufplc %= job->tsizx; else bufplc &= job->tsizx; }
+		if (job->ynice == 0) bufplc *= job->tsizy; else bufplc <<= job->tsizy;
+
+		vinc = job->swal[x]*globalyscale;
+		vplc = globalzd + vinc*(y1v-globalhoriz+1);
+
+		vlineasm1(vinc,palookupoffs,y2v-y1v-1,vplc,bufplc+waloff[globalpicnum],x+frameoffset+ylookup[y1v]);
+	}
+}
+
+static void maskwallscanstrip(void *arg, long start, long end)
+{
+	wallscanjob *job = (wallscanjob *)arg;
+	long x, xe, y1v, y2v, palookupoffs, bufplc, vinc, vplc;
+
+	setrasterstate(&job->st);
+	for(x=job->x1+start,xe=job->x1+end;x<xe;x++)
+	{
+		y1v = max(job->uwal[x],startumost[x+windowx1]-windowy1);
+		y2v = min(job->dwal[x],startdmost[x+windowx1]-windowy1);
+		if (y2v <= y1v) continue;
+
+		palookupoffs = job->fpalookup+(getpalookup((long)mulscale16(job->swal[x],globvis),globalshade)<<8);
+
+		bufplc = job->lwal[x] + globalxpanning;
+		if (bufplc >= job->tsizx) { if (job->xnice == 0) bufplc %= job->tsizx; else bufplc &= job->tsizx; }
+		if (job->ynice == 0) bufplc *= job->tsizy; else bufplc <<= job->tsizy;
+
+		vinc = job->swal[x]*globalyscale;
+		vplc = globalzd + vinc*(y1v-globalhoriz+1);
+
+		mvlineasm1(vinc,palookupoffs,y2v-y1v-1,vplc,bufplc+waloff[globalpicnum],x+frameoffset+ylookup[y1v]);
+	}
+}
+#endif
+
+
 //
 // maskwallscan (internal)
 //
 static void maskwallscan(long x1, long x2, short *uwal, short *dwal, long *swal, long *lwal)
 {
-	long i, x, startx, xnice, ynice, fpalookup;
-	long y1ve[4], y2ve[4], u4, d4, dax, z, p, tsizx, tsizy;
+	long i, startx, xnice, ynice, fpalookup;
+	long u4, d4, dax, z, tsizx, tsizy;
+#ifndef ENGINE_USING_A_C
+	long x, y1ve[4], y2ve[4], p;
+#endif
 	char bad;
 
 	tsizx = tilesizx[globalpicnum];
@@ -899,23 +988,15 @@ static void maskwallscan(long x1, long x2, short *uwal, short *dwal, long *swal,
 
 #else	// ENGINE_USING_A_C
 
-	p = startx+frameoffset;
-	for(x=startx;x<=x2;x++,p++)
+	if (x2 >= startx)
 	{
-		y1ve[0] = max(uwal[x],startumost[x+windowx1]-windowy1);
-		y2ve[0] = min(dwal[x],startdmost[x+windowx1]-windowy1);
-		if (y2ve[0] <= y1ve[0]) continue;
-
-		palookupoffse[0] = fpalookup+(getpalookup((long)mulscale16(swal[x],globvis),globalshade)<<8);
+		wallscanjob job;
 
-		bufplce[0] = lwal[x] + globalxpanning;
-		if (bufplce[0] >= tsizx) { if (xnice == 0) bufplce[0] %= tsizx; else bufplce[0] &= tsizx; }
-		if (ynice == 0) bufplce[0] *= tsizy; else bufplce[0] <<= tsizy;
-
-		vince[0] = swal[x]*globalyscale;
-		vplce[0] = globalzd + vince[0]*(y1ve[0]-globalhoriz+1);
-
-		mvlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0]+waloff[globalpicnum],p+ylookup[y1ve[0]]);
+		job.x1 = startx; job.uwal = uwal; job.dwal = dwal; job.swal = swal; job.lwal = lwal;
+		job.tsizx = tsizx; job.tsizy = tsizy; job.xnice = xnice; job.ynice = ynice;
+		job.fpalookup = fpalookup;
+		getrasterstate(&job.st);
+		runworkers(maskwallscanstrip,&job,x2-startx+1,renderstrips(x2-startx+1));
 	}
 
 #endif
@@ -998,6 +1079,63 @@ static long bunchfront(long b1, long b2)
 }
 
 
+//
+// hline batching (internal)
+//
+// The plain ceiling and floor scans emit their spans through hline(). Each
+// span covers pixels no other span of the same scan touches, so when
+// parallel rendering is on they are queued here and drawn all at once.
+//
+typedef struct { long xl, xr, yp, x2, y1; } hlinespan;
+#define MAXHLINESPANS 4096
+static hlinespan hlinespans[MAXHLINESPANS];
+static long hlinespancnt = -1;	// -1 when spans are drawn as they come
+
+#ifdef ENGINE_USING_A_C
+static void drawhlinespans(void *arg, long start, long end)
+{
+	hlinespan *sp;
+	long r, s;
+
+	setrasterstate((rasterstate *)arg);
+	for(sp=&hlinespans[start];start<end;start++,sp++)
+	{
+		r = horizlookup2[sp->yp-globalhoriz+horizycent];
+		s = ((long)getpalookup((long)mulscale16(r,globvis),globalshade)<<8);
+		setuphlineasm4(globalx1*r,globaly2*r);
+		hlineasm4(sp->xr-sp->xl,1L,s,sp->x2*r+globalypanning,sp->y1*r+globalxpanning,
+			ylookup[sp->yp]+sp->xr+frameoffset);
+	}
+}
+
+#endif
+
+static void flushhlines(void)
+{
+#ifdef ENGINE_USING_A_C
+	rasterstate st;
+
+	if (hlinespancnt <= 0) return;
+	getrasterstate(&st);
+	runworkers(drawhlinespans,&st,hlinespancnt,renderstrips(hlinespancnt));
+#endif
+	hlinespancnt = 0;
+}
+
+static void beginhlines(void)
+{
+#ifdef ENGINE_USING_A_C
+	if (renderstrips(xdimen) < xdimen) hlinespancnt = 0;
+#endif
+}
+
+static void endhlines(void)
+{
+	flushhlines();
+	hlinespancnt = -1;
+}
+
+
 //
 // hline (internal)
 //
@@ -1006,6 +1144,14 @@ static void hline(long xr, long yp)
 	long xl, r, s;
 
 	xl = lastx[yp]; if (xl > xr) return;
+	if (hlinespancnt >= 0)
+	{
+		hlinespan *sp = &hlinespans[hlinespancnt++];
+		sp->xl = xl; sp->xr = xr; sp->yp = yp;
+		sp->x2 = globalx2; sp->y1 = globaly1;
+		if (hlinespancnt == MAXHLINESPANS) flushhlines();
+		return;
+	}
 	r = horizlookup2[yp-globalhoriz+horizycent];
 	asm1 = globalx1*r;
 	asm2 = globaly2*r;
@@ -1486,6 +1632,7 @@ static void ceilscan(long x1, long x2, long sectnum)
 
 	if (!(globalorientation&0x180))
 	{
+		beginhlines();
 		y1 = umost[x1]; y2 = y1;
 		for(x=x1;x<=x2;x++)
 		{
@@ -1514,6 +1661,7 @@ static void ceilscan(long x1, long x2, long sectnum)
 			globalx2 += globaly2; globaly1 += globalx1;
 		}
 		while (y1 < y2-1) hline(x2,++y1);
+		endhlines();
 		faketimerhandler();
 		return;
 	}
@@ -1657,6 +1805,7 @@ static void florscan(long x1, long x2, long sectnum)
 
 	if (!(globalorientation&0x180))
 	{
+		beginhlines();
 		y1 = max(dplc[x1],umost[x1]); y2 = y1;
 		for(x=x1;x<=x2;x++)
 		{
@@ -1685,6 +1834,7 @@ static void florscan(long x1, long x2, long sectnum)
 			globalx2 += globaly2; globaly1 += globalx1;
 		}
 		while (y1 < y2-1) hline(x2,++y1);
+		endhlines();
 		faketimerhandler();
 		return;
 	}
@@ -1741,8 +1891,11 @@ static void florscan(long x1, long x2, long sectnum)
 //
 static void wallscan(long x1, long x2, short *uwal, short *dwal, long *swal, long *lwal)
 {
-	long i, x, xnice, ynice, fpalookup;
-	long y1ve[4], y2ve[4], u4, d4, z, tsizx, tsizy;
+	long i, xnice, ynice, fpalookup;
+	long u4, d4, z, tsizx, tsizy;
+#ifndef ENGINE_USING_A_C
+	long x, y1ve[4], y2ve[4];
+#endif
 	char bad;
 	
 	if (x2 >= xdim) x2 = xdim-1;
@@ -1865,22 +2018,15 @@ static void wallscan(long x1, long x2, short *uwal, short *dwal, long *swal, lon
 
 #else	// ENGINE_USING_A_C
 
-	for(x=x1;x<=x2;x++)
+	if (x2 >= x1)
 	{
-		y1ve[0] = max(uwal[x],umost[x]);
-		y2ve[0] = min(dwal[x],dmost[x]);
-		if (y2ve[0] <= y1ve[0]) continue;
+		wallscanjob job;
 
-		palookupoffse[0] = fpalookup+(getpalookup((long)mulscale16(swal[x],globvis),globalshade)<<8);
-
-		bufplce[0] = lwal[x] + globalxpanning;
-		if (bufplce[0] >= tsizx) { if (xnice == 0) bufplce[0] %= tsizx; else bufplce[0] &= tsizx; }
-		if (ynice == 0) bufplce[0] *= tsizy; else bufplce[0] <<= tsizy;
-
-		vince[0] = swal[x]*globalyscale;
-		vplce[0] = globalzd + vince[0]*(y1ve[0]-globalhoriz+1);
-
-		vlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0]+waloff[globalpicnum],x+frameoffset+ylookup[y1ve[0]]);
+		job.x1 = x1; job.uwal = uwal; job.dwal = dwal; job.swal = swal; job.lwal = lwal;
+		job.tsizx = tsizx; job.tsizy = tsizy; job.xnice = xnice; job.ynice = ynice;
+		job.fpalookup = fpalookup;
+		getrasterstate(&job.st);
+		runworkers(wallscanstrip,&job,x2-x1+1,renderstrips(x2-x1+1));
 	}
 	
 #endif
@@ -5397,6 +5543,10 @@ int initengine(void)
 	
 	if (loadtables()) return 1;
 
+#ifdef ENGINE_USING_A_C
+	setrastersimd(2);
+#endif
+
 	xyaspect = -1;
 
 	pskyoff[0] = 0; pskybits = 0;
@@ -5683,12 +5833,136 @@ void drawrooms(long daposx, long daposy, long daposz,
 }
 
 
+//
+// sortspritemasks (internal)
+//
+// Orders the visible sprites back to front for drawmasks(): by depth
+// (spritesy), then within a run of equal depth by statnum and then by
+// distance of the sprite's centre from the eye height. Depth goes through a
+// stable LSD radix sort on 11-bit digits (skipping digits every key shares)
+// rather than the old shell sort, and the ties through a single insertion
+// pass on a packed (statnum,z-distance) key instead of two exchange sorts.
+//
+#define SORTRADIXBITS 11
+#define SORTRADIX (1<<SORTRADIXBITS)
+static unsigned long sortkey[2][MAXSPRITESONSCREEN];
+static short sortidx[2][MAXSPRITESONSCREEN];
+static long sorthist[3][SORTRADIX];
+static spritetype *sortptrtmp[MAXSPRITESONSCREEN];
+static long sortxtmp[MAXSPRITESONSCREEN], sortytmp[MAXSPRITESONSCREEN];
+static int64 sortgroupkey[MAXSPRITESONSCREEN];
+
+static void sortspritemasks(void)
+{
+	long i, j, k, l, n, p, d, shift, *h;
+	unsigned long key, *ksrc, *kdst;
+	short *isrc, *idst, ix;
+	int64 gk;
+	spritetype *tspr;
+	long yoff, yspan;
+
+	n = spritesortcnt;
+	if (n <= 1) { if (n == 1) spritesy[1] = (spritesy[0]^1); return; }
+
+	// flip the sign bit so unsigned order matches signed depth order
+	for(i=0;i<n;i++) { sortkey[0][i] = ((unsigned long)spritesy[i]^0x80000000UL)&0xffffffffUL; sortidx[0][i] = (short)i; }
+	ksrc = sortkey[0]; kdst = sortkey[1];
+	isrc = sortidx[0]; idst = sortidx[1];
+
+	if (n < 32)
+	{
+		for(i=1;i<n;i++)
+		{
+			key = ksrc[i]; ix = isrc[i];
+			for(l=i-1;l>=0 && ksrc[l] > key;l--)
+				{ ksrc[l+1] = ksrc[l]; isrc[l+1] = isrc[l]; }
+			ksrc[l+1] = key; isrc[l+1] = ix;
+		}
+	}
+	else
+	{
+		clearbufbyte(sorthist,sizeof(sorthist),0L);
+		for(i=0;i<n;i++)
+		{
+			key = ksrc[i];
+			sorthist[0][key&(SORTRADIX-1)]++;
+			sorthist[1][(key>>SORTRADIXBITS)&(SORTRADIX-1)]++;
+			sorthist[2][(key>>(SORTRADIXBITS*2))&(SORTRADIX-1)]++;
+		}
+		for(p=0,shift=0;p<3;p++,shift+=SORTRADIXBITS)
+		{
+			h = sorthist[p];
+			if (h[(ksrc[0]>>shift)&(SORTRADIX-1)] == n) continue;	//every key has this digit
+			for(i=0,j=0;i<SORTRADIX;i++) { k = h[i]; h[i] = j; j += k; }
+			for(i=0;i<n;i++)
+			{
+				d = h[(ksrc[i]>>shift)&(SORTRADIX-1)]++;
+				kdst[d] = ksrc[i]; idst[d] = isrc[i];
+			}
+			kdst = ksrc; ksrc = (kdst == sortkey[0]) ? sortkey[1] : sortkey[0];
+			idst = isrc; isrc = (idst == sortidx[0]) ? sortidx[1] : sortidx[0];
+		}
+	}
+
+	for(i=0;i<n;i++)
+	{
+		ix = isrc[i];
+		sortptrtmp[i] = tspriteptr[ix];
+		sortxtmp[i] = spritesx[ix];
+		sortytmp[i] = spritesy[ix];
+	}
+	for(i=0;i<n;i++)
+	{
+		tspriteptr[i] = sortptrtmp[i];
+		spritesx[i] = sortxtmp[i];
+		spritesy[i] = sortytmp[i];
+	}
+	spritesy[n] = (spritesy[n-1]^1);
+
+		//Break depth ties by statnum, then by how far the sprite's
+		//centre is from the eye
+	for(i=0,j=1;j<=n;j++)
+	{
+		if (spritesy[j] == spritesy[i]) continue;
+		if (j > i+1)
+		{
+			for(k=i;k<j;k++)
+			{
+				tspr = tspriteptr[k];
+				spritesz[k] = tspr->z;
+				if ((tspr->cstat&48) != 32)
+				{
+					yoff = (long)((signed char)((picanm[tspr->picnum]>>16)&255))+((long)tspr->yoffset);
+					spritesz[k] -= ((yoff*tspr->yrepeat)<<2);
+					yspan = (tilesizy[tspr->picnum]*tspr->yrepeat<<2);
+					if (!(tspr->cstat&128)) spritesz[k] -= (yspan>>1);
+					if (klabs(spritesz[k]-globalposz) < (yspan>>1)) spritesz[k] = globalposz;
+				}
+				sortgroupkey[k] = (((int64)tspr->statnum)<<32) + (int64)klabs(spritesz[k]-globalposz);
+			}
+			for(k=i+1;k<j;k++)
+			{
+				gk = sortgroupkey[k]; tspr = tspriteptr[k]; d = spritesx[k];
+				for(l=k-1;l>=i && sortgroupkey[l] > gk;l--)
+				{
+					sortgroupkey[l+1] = sortgroupkey[l];
+					tspriteptr[l+1] = tspriteptr[l];
+					spritesx[l+1] = spritesx[l];
+				}
+				sortgroupkey[l+1] = gk; tspriteptr[l+1] = tspr; spritesx[l+1] = d;
+			}
+		}
+		i = j;
+	}
+}
+
+
 //
 // drawmasks
 //
 void drawmasks(void)
 {
-	long i, j, k, l, gap, xs, ys, xp, yp, yoff, yspan;
+	long i, j, k, gap, xs, ys, xp, yp;
 
 	for(i=spritesortcnt-1;i>=0;i--) tspriteptr[i] = &tsprite[i];
 	for(i=spritesortcnt-1;i>=0;i--)
@@ -5716,59 +5990,7 @@ killsprite:
 		spritesy[i] = yp;
 	}
 
-	gap = 1; while (gap < spritesortcnt) gap = (gap<<1)+1;
-	for(gap>>=1;gap>0;gap>>=1)      //Sort sprite list
-		for(i=0;i<spritesortcnt-gap;i++)
-			for(l=i;l>=0;l-=gap)
-			{
-				if (spritesy[l] <= spritesy[l+gap]) break;
-				swaplong(&tspriteptr[l],&tspriteptr[l+gap]);
-				swaplong(&spritesx[l],&spritesx[l+gap]);
-				swaplong(&spritesy[l],&spritesy[l+gap]);
-			}
-
-	if (spritesortcnt > 0)
-		spritesy[spritesortcnt] = (spritesy[spritesortcnt-1]^1);
-
-	ys = spritesy[0]; i = 0;
-	for(j=1;j<=spritesortcnt;j++)
-	{
-		if (spritesy[j] == ys) continue;
-		ys = spritesy[j];
-		if (j > i+1)
-		{
-			for(k=i;k<j;k++)
-			{
-				spritesz[k] = tspriteptr[k]->z;
-				if ((tspriteptr[k]->cstat&48) != 32)
-				{
-					yoff = (long)((signed char)((picanm[tspriteptr[k]->picnum]>>16)&255))+((long)tspriteptr[k]->yoffset);
-					spritesz[k] -= ((yoff*tspriteptr[k]->yrepeat)<<2);
-					yspan = (tilesizy[tspriteptr[k]->picnum]*tspriteptr[k]->yrepeat<<2);
-					if (!(tspriteptr[k]->cstat&128)) spritesz[k] -= (yspan>>1);
-					if (klabs(spritesz[k]-globalposz) < (yspan>>1)) spritesz[k] = globalposz;
-				}
-			}
-			for(k=i+1;k<j;k++)
-				for(l=i;l<k;l++)
-					if (klabs(spritesz[k]-globalposz) < klabs(spritesz[l]-globalposz))
-					{
-						swaplong(&tspriteptr[k],&tspriteptr[l]);
-						swaplong(&spritesx[k],&spritesx[l]);
-						swaplong(&spritesy[k],&spritesy[l]);
-						swaplong(&spritesz[k],&spritesz[l]);
-					}
-			for(k=i+1;k<j;k++)
-				for(l=i;l<k;l++)
-					if (tspriteptr[k]->statnum < tspriteptr[l]->statnum)
-					{
-						swaplong(&tspriteptr[k],&tspriteptr[l]);
-						swaplong(&spritesx[k],&spritesx[l]);
-						swaplong(&spritesy[k],&spritesy[l]);
-					}
-		}
-		i = j;
-	}
+	sortspritemasks();
 
 	begindrawing();	//{{{
 	
@@ -7071,6 +7293,9 @@ void nextpage(void)
 			enddrawing();	//}}}
 
 			OSD_Draw();
+#ifdef USE_OPENGL
+			if (rendmode == 3) polymost_endframe();
+#endif
 			showframe(0);
 
 			/*
@@ -7423,14 +7648,21 @@ long qloadkvx(long voxindex, char *filename)
 	kclose(fil);
 
 #if defined POLYMOST && defined USE_OPENGL
-	if (voxmodels[voxindex]) {
-		voxfree(voxmodels[voxindex]);
-		voxmodels[voxindex] = NULL;
-	}
-	voxmodels[voxindex] = voxload(filename);
+		// the polygon version is built by qloadkvxflush()
+	voxloadqueue(voxindex, filename);
 #endif
 	return 0;
 }
+
+//
+// qloadkvxflush
+//
+void qloadkvxflush(void)
+{
+#if defined POLYMOST && defined USE_OPENGL
+	voxloadflush();
+#endif
+}
 #endif
 
 
@@ -7718,7 +7950,7 @@ long nextsectorneighborz(short sectnum, long thez, short topbottom, short direct
 //
 // cansee
 //
-long cansee(long x1, long y1, long z1, short sect1, long x2, long y2, long z2, short sect2)
+static long canseeinto(short *sectlist, long x1, long y1, long z1, short sect1, long x2, long y2, long z2, short sect2)
 {
 	sectortype *sec;
 	walltype *wal, *wal2;
@@ -7729,10 +7961,10 @@ long cansee(long x1, long y1, long z1, short sect1, long x2, long y2, long z2, s
 
 	x21 = x2-x1; y21 = y2-y1; z21 = z2-z1;
 
-	clipsectorlist[0] = sect1; danum = 1;
+	sectlist[0] = sect1; danum = 1;
 	for(dacnt=0;dacnt<danum;dacnt++)
 	{
-		dasectnum = clipsectorlist[dacnt]; sec = &sector[dasectnum];
+		dasectnum = sectlist[dacnt]; sec = &sector[dasectnum];
 		for(cnt=sec->wallnum,wal=&wall[sec->wallptr];cnt>0;cnt--,wal++)
 		{
 			wal2 = &wall[wal->point2];
@@ -7756,14 +7988,29 @@ long cansee(long x1, long y1, long z1, short sect1, long x2, long y2, long z2, s
 			getzsofslope((short)nexts,x,y,&cz,&fz);
 			if ((z <= cz) || (z >= fz)) return(0);
 
-			for(i=danum-1;i>=0;i--) if (clipsectorlist[i] == nexts) break;
-			if (i < 0) clipsectorlist[danum++] = nexts;
+			for(i=danum-1;i>=0;i--) if (sectlist[i] == nexts) break;
+			if (i < 0) sectlist[danum++] = nexts;
 		}
 	}
-	for(i=danum-1;i>=0;i--) if (clipsectorlist[i] == sect2) return(1);
+	for(i=danum-1;i>=0;i--) if (sectlist[i] == sect2) return(1);
 	return(0);
 }
 
+long cansee(long x1, long y1, long z1, short sect1, long x2, long y2, long z2, short sect2)
+{
+	return canseeinto(clipsectorlist,x1,y1,z1,sect1,x2,y2,z2,sect2);
+}
+
+//
+// cansee_r (reentrant version for use off the main thread)
+//
+long cansee_r(long x1, long y1, long z1, short sect1, long x2, long y2, long z2, short sect2)
+{
+	short sectlist[MAXCLIPNUM];
+
+	return canseeinto(sectlist,x1,y1,z1,sect1,x2,y2,z2,sect2);
+}
+
 
 //
 // hitscan
@@ -58,6 +58,15 @@ void (APIENTRY * bglColor4ub)( GLubyte red, GLubyte green, GLubyte blue, GLubyte
 void (APIENTRY * bglTexCoord2d)( GLdouble s, GLdouble t );
 void (APIENTRY * bglTexCoord2f)( GLfloat s, GLfloat t );
 
+// Vertex arrays
+void (APIENTRY * bglEnableClientState)( GLenum cap );	// 1.1
+void (APIENTRY * bglDisableClientState)( GLenum cap );	// 1.1
+void (APIENTRY * bglVertexPointer)( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr );	// 1.1
+void (APIENTRY * bglTexCoordPointer)( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr );	// 1.1
+void (APIENTRY * bglColorPointer)( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr );	// 1.1
+void (APIENTRY * bglDrawArrays)( GLenum mode, GLint first, GLsizei count );	// 1.1
+void (APIENTRY * bglDrawElements)( GLenum mode, GLsizei count, GLenum type, const GLvoid *indices );	// 1.1
+
 // Lighting
 void (APIENTRY * bglShadeModel)( GLenum mode );
 
@@ -233,6 +242,15 @@ int loadgldriver(const char *driver)
 	bglColor4ub		= GETPROC("glColor4ub");
 	bglTexCoord2d		= GETPROC("glTexCoord2d");
 	bglTexCoord2f		= GETPROC("glTexCoord2f");
+
+	// Vertex arrays
+	bglEnableClientState	= GETPROC("glEnableClientState");
+	bglDisableClientState	= GETPROC("glDisableClientState");
+	bglVertexPointer	= GETPROC("glVertexPointer");
+	bglTexCoordPointer	= GETPROC("glTexCoordPointer");
+	bglColorPointer		= GETPROC("glColorPointer");
+	bglDrawArrays		= GETPROC("glDrawArrays");
+	bglDrawElements		= GETPROC("glDrawElements");
     
 	// Lighting
 	bglShadeModel		= GETPROC("glShadeModel");
@@ -343,6 +361,15 @@ int unloadgldriver(void)
 	bglColor4ub		= NULL;
 	bglTexCoord2d		= NULL;
 	bglTexCoord2f		= NULL;
+
+	// Vertex arrays
+	bglEnableClientState	= NULL;
+	bglDisableClientState	= NULL;
+	bglVertexPointer	= NULL;
+	bglTexCoordPointer	= NULL;
+	bglColorPointer		= NULL;
+	bglDrawArrays		= NULL;
+	bglDrawElements		= NULL;
     
 	// Lighting
 	bglShadeModel		= NULL;
@@ -82,6 +82,15 @@ extern void (APIENTRY * bglColor4ub)( GLubyte red, GLubyte green, GLubyte blue,
 extern void (APIENTRY * bglTexCoord2d)( GLdouble s, GLdouble t );
 extern void (APIENTRY * bglTexCoord2f)( GLfloat s, GLfloat t );
 
+// Vertex arrays
+extern void (APIENTRY * bglEnableClientState)( GLenum cap );	// 1.1
+extern void (APIENTRY * bglDisableClientState)( GLenum cap );	// 1.1
+extern void (APIENTRY * bglVertexPointer)( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr );	// 1.1
+extern void (APIENTRY * bglTexCoordPointer)( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr );	// 1.1
+extern void (APIENTRY * bglColorPointer)( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr );	// 1.1
+extern void (APIENTRY * bglDrawArrays)( GLenum mode, GLint first, GLsizei count );	// 1.1
+extern void (APIENTRY * bglDrawElements)( GLenum mode, GLsizei count, GLenum type, const GLvoid *indices );	// 1.1
+
 // Lighting
 extern void (APIENTRY * bglShadeModel)( GLenum mode );
 
@@ -168,6 +177,15 @@ extern BOOL (WINAPI * bwglSetPixelFormat)(HDC,int,const PIXELFORMATDESCRIPTOR*);
 #define bglTexCoord2d		glTexCoord2d
 #define bglTexCoord2f		glTexCoord2f
 
+// Vertex arrays
+#define bglEnableClientState	glEnableClientState
+#define bglDisableClientState	glDisableClientState
+#define bglVertexPointer	glVertexPointer
+#define bglTexCoordPointer	glTexCoordPointer
+#define bglColorPointer		glColorPointer
+#define bglDrawArrays		glDrawArrays
+#define bglDrawElements		glDrawElements
+
 // Lighting
 #define bglShadeModel		glShadeModel
 
@@ -34,6 +34,8 @@ credits.
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "cpufeat.h"
+#include "workers.h"
 
 #if defined(__POWERPC__)
 #define BIGENDIAN 1
@@ -94,6 +96,17 @@ static __inline long filelength (int h)
 #define ASMNAME(x) asm(x)
 #else
 #define ASMNAME(x)
+#endif
+
+	//SSE2 paths for the PNG filters and the JPEG IDCT/colour conversion,
+	//picked at run time from getcpufeatures()
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define KP_SSE2 __attribute__((target("sse2")))
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define KP_SSE2
+#endif
+#ifdef KP_SSE2
+#include <emmintrin.h>
 #endif
 
 static long frameplace, bytesperline, xres, yres, globxoffs, globyoffs;
@@ -187,6 +200,17 @@ static long gotcmov = -2, abstab10[1024] ASMNAME("abstab10");
 static long qhufval0[1<<LOGQHUFSIZ0], qhufval1[1<<LOGQHUFSIZ1];
 static unsigned char qhufbit0[1<<LOGQHUFSIZ0], qhufbit1[1<<LOGQHUFSIZ1];
 
+	//Line-at-a-time PNG decoder (kpngfast): a bigger literal/length table
+	//whose entries can hold two literals at once, and whole scanlines
+	//unfiltered in order before being flipped into olinbuf for drawing.
+#define LOGQHUFSIZ2 12
+static long qhufval2[1<<LOGQHUFSIZ2], qhufpair2[1<<LOGQHUFSIZ2];
+static unsigned char qhufbit2[1<<LOGQHUFSIZ2], qhufpbit2[1<<LOGQHUFSIZ2];
+static unsigned char pnglinbuf[3][65536+16]; //+16: the SSE2 filters read and write past the end
+static unsigned char *linraw = pnglinbuf[0], *lincur = pnglinbuf[1], *linprv = pnglinbuf[2];
+static long linleng, pngbpp;
+long kpngfast = 1;
+
 #if defined(__WATCOMC__) && !defined(NOASM)
 
 long bswap (long);
@@ -485,6 +509,23 @@ static void qhufgencode (long *hitab, long *hbmax, long *qhval, unsigned char *q
 	//return(k);
 }
 
+	//Finds the table entries whose bits hold a whole second literal after
+	//the first one, so the decoder can emit both with a single lookup
+static void qhufgenpairs (long *qhval, unsigned char *qhbit, long *qpval, unsigned char *qpbit, long numbits)
+{
+	long i, j, n;
+
+	for(i=pow2mask[numbits];i>=0;i--)
+	{
+		qpbit[i] = 0; n = qhbit[i];
+		if ((!n) || (qhval[i] >= 256)) continue;
+		j = (i>>n); //the bits after the first code, unknown ones left 0
+		if ((!qhbit[j]) || (qhbit[j] > numbits-n) || (qhval[j] >= 256)) continue;
+		qpval[i] = qhval[i]+(qhval[j]<<8);
+		qpbit[i] = (unsigned char)(n+qhbit[j]);
+	}
+}
+
 	//inbuf[inum] : Bit length of each symbol
 	//inum        : Number of indices
 	//hitab[inum] : Indices from size-ordered list to original symbol
@@ -532,6 +573,7 @@ static long initpass () //Interlaced images have 7 "passes", non-interlaced have
 	}
 
 	memset(olinbuf,0,(xsizbpl+1)*sizeof(olinbuf[0]));
+	memset(linprv,0,xsizbpl+16); linleng = 0;
 	*(long *)&opixbuf0[0] = *(long *)&opixbuf1[0] = 0;
 	xplc = xsizbpl; yplc = globyoffs+iyoff; xm = 0; filt = -1;
 
@@ -790,6 +832,67 @@ static inline void pal8hlineasm (long x, long xr1, long p, long ixstp)
 
 #endif
 
+	//Draws the scanline in olinbuf (stored backwards) at yplc
+static void putline ()
+{
+	long x, p;
+
+	if ((unsigned long)yplc < (unsigned long)yres)
+	{
+		x = xr0; p = nfplace;
+		switch (coltype)
+		{
+			case 2:
+				rgbhlineasm(x,xr1,p,ixstp);
+				break;
+			case 4:
+				for(;x>xr1;p+=ixstp,x-=2)
+				{
+#if (PROCESSALPHAHERE == 1)
+						//Enable this code to process alpha right here!
+					if (olinbuf[x-1] == 255) { *(long *)p = palcol[olinbuf[x]]; continue; }
+					if (!olinbuf[x-1]) { *(long *)p = bakcol; continue; }
+						//I do >>8, but theoretically should be: /255
+					*(char *)(p) = *(char *)(p+1) = *(char *)(p+2) = *(char *)(p+3) =
+						(((((long)olinbuf[x])-bakr)*(long)olinbuf[x-1])>>8) + bakr;
+#else
+					*(long *)p = (palcol[olinbuf[x]]&LSWAPIB(0xffffff))|LSWAPIL((long)olinbuf[x-1]);
+#endif
+				}
+				break;
+			case 6:
+				for(;x>xr1;p+=ixstp,x-=4)
+				{
+#if (PROCESSALPHAHERE == 1)
+						//Enable this code to process alpha right here!
+					if (olinbuf[x-1] == 255) { *(long *)p = *(long *)&olinbuf[x]; continue; }
+					if (!olinbuf[x-1]) { *(long *)p = bakcol; continue; }
+						//I do >>8, but theoretically should be: /255
+					*(char *)(p  ) = (((((long)olinbuf[x  ])-bakr)*(long)olinbuf[x-1])>>8) + bakr;
+					*(char *)(p+1) = (((((long)olinbuf[x+1])-bakg)*(long)olinbuf[x-1])>>8) + bakg;
+					*(char *)(p+2) = (((((long)olinbuf[x+2])-bakb)*(long)olinbuf[x-1])>>8) + bakb;
+#else
+					*(char *)(p  ) = olinbuf[x  ]; //R
+					*(char *)(p+1) = olinbuf[x+1]; //G
+					*(char *)(p+2) = olinbuf[x+2]; //B
+					*(char *)(p+3) = olinbuf[x-1]; //A
+#endif
+				}
+				break;
+			default:
+				switch(bitdepth)
+				{
+					case 1: for(;x>xr1;p+=ixstp,x-- ) *(long *)p = palcol[olinbuf[x>>3]>>(x&7)]; break;
+					case 2: for(;x>xr1;p+=ixstp,x-=2) *(long *)p = palcol[olinbuf[x>>3]>>(x&6)]; break;
+					case 4: for(;x>xr1;p+=ixstp,x-=4) *(long *)p = palcol[olinbuf[x>>3]>>(x&4)]; break;
+					case 8: pal8hlineasm(x,xr1,p,ixstp); break; //for(;x>xr1;p+=ixstp,x--) *(long *)p = palcol[olinbuf[x]]; break;
+				}
+				break;
+		}
+		nfplace += nbpl;
+	}
+}
+
 	//Autodetect filter
 	//    /f0: 0000000...
 	//    /f1: 1111111...
@@ -801,7 +904,7 @@ static inline void pal8hlineasm (long x, long xr1, long p, long ixstp)
 static long filter1st, filterest;
 static void putbuf (const unsigned char *buf, long leng)
 {
-	long i, x, p;
+	long i, x;
 
 	if (filt < 0)
 	{
@@ -859,61 +962,7 @@ static void putbuf (const unsigned char *buf, long leng)
 
 		if (xplc > 0) return;
 
-			//Draw line!
-		if ((unsigned long)yplc < (unsigned long)yres)
-		{
-			x = xr0; p = nfplace;
-			switch (coltype)
-			{
-				case 2:
-					rgbhlineasm(x,xr1,p,ixstp);
-					break;
-				case 4:
-					for(;x>xr1;p+=ixstp,x-=2)
-					{
-#if (PROCESSALPHAHERE == 1)
-							//Enable this code to process alpha right here!
-						if (olinbuf[x-1] == 255) { *(long *)p = palcol[olinbuf[x]]; continue; }
-						if (!olinbuf[x-1]) { *(long *)p = bakcol; continue; }
-							//I do >>8, but theoretically should be: /255
-						*(char *)(p) = *(char *)(p+1) = *(char *)(p+2) = *(char *)(p+3) =
-							(((((long)olinbuf[x])-bakr)*(long)olinbuf[x-1])>>8) + bakr;
-#else
-						*(long *)p = (palcol[olinbuf[x]]&LSWAPIB(0xffffff))|LSWAPIL((long)olinbuf[x-1]);
-#endif
-					}
-					break;
-				case 6:
-					for(;x>xr1;p+=ixstp,x-=4)
-					{
-#if (PROCESSALPHAHERE == 1)
-							//Enable this code to process alpha right here!
-						if (olinbuf[x-1] == 255) { *(long *)p = *(long *)&olinbuf[x]; continue; }
-						if (!olinbuf[x-1]) { *(long *)p = bakcol; continue; }
-							//I do >>8, but theoretically should be: /255
-						*(char *)(p  ) = (((((long)olinbuf[x  ])-bakr)*(long)olinbuf[x-1])>>8) + bakr;
-						*(char *)(p+1) = (((((long)olinbuf[x+1])-bakg)*(long)olinbuf[x-1])>>8) + bakg;
-						*(char *)(p+2) = (((((long)olinbuf[x+2])-bakb)*(long)olinbuf[x-1])>>8) + bakb;
-#else
-						*(char *)(p  ) = olinbuf[x  ]; //R
-						*(char *)(p+1) = olinbuf[x+1]; //G
-						*(char *)(p+2) = olinbuf[x+2]; //B
-						*(char *)(p+3) = olinbuf[x-1]; //A
-#endif
-					}
-					break;
-				default:
-					switch(bitdepth)
-					{
-						case 1: for(;x>xr1;p+=ixstp,x-- ) *(long *)p = palcol[olinbuf[x>>3]>>(x&7)]; break;
-						case 2: for(;x>xr1;p+=ixstp,x-=2) *(long *)p = palcol[olinbuf[x>>3]>>(x&6)]; break;
-						case 4: for(;x>xr1;p+=ixstp,x-=4) *(long *)p = palcol[olinbuf[x>>3]>>(x&4)]; break;
-						case 8: pal8hlineasm(x,xr1,p,ixstp); break; //for(;x>xr1;p+=ixstp,x--) *(long *)p = palcol[olinbuf[x]]; break;
-					}
-					break;
-			}
-			nfplace += nbpl;
-		}
+		putline();
 
 		*(long *)&opixbuf0[0] = *(long *)&opixbuf1[0] = 0;
 		xplc = xsizbpl; yplc += iystp;
@@ -927,6 +976,154 @@ static void putbuf (const unsigned char *buf, long leng)
 	}
 }
 
+	//Whole-line PNG unfilters for kpngfast: raw[] (filter byte removed) is
+	//decoded against the previous line prv[] into cur[]. The SSE2 versions
+	//work a pixel (bpp 3 or 4) or 16 bytes (Up) at a time; for 3-byte pixels
+	//the extra byte they write is overwritten by the next pixel.
+
+static void pngunfilter_c (long f, const unsigned char *raw, unsigned char *cur, const unsigned char *prv, long n, long bpp)
+{
+	long i;
+
+	switch(f)
+	{
+		case 1:
+			for(i=0;i<bpp;i++) cur[i] = raw[i];
+			for(;i<n;i++) cur[i] = raw[i]+cur[i-bpp];
+			break;
+		case 2:
+			for(i=0;i<n;i++) cur[i] = raw[i]+prv[i];
+			break;
+		case 3:
+			for(i=0;i<bpp;i++) cur[i] = raw[i]+(prv[i]>>1);
+			for(;i<n;i++) cur[i] = raw[i]+((cur[i-bpp]+prv[i])>>1);
+			break;
+		case 4:
+			for(i=0;i<bpp;i++) cur[i] = raw[i]+prv[i]; //Paeth(0,b,0) == b
+			for(;i<n;i++) cur[i] = (unsigned char)(raw[i]+Paeth(cur[i-bpp],prv[i],prv[i-bpp]));
+			break;
+		default:
+			memcpy(cur,raw,n);
+			break;
+	}
+}
+
+#ifdef KP_SSE2
+
+static KP_SSE2 _inline __m128i load4 (const unsigned char *p) { return(_mm_cvtsi32_si128(*(const int *)p)); }
+static KP_SSE2 _inline void store4 (unsigned char *p, __m128i v) { *(int *)p = _mm_cvtsi128_si32(v); }
+
+static KP_SSE2 void pngunfilter_sse2 (long f, const unsigned char *raw, unsigned char *cur, const unsigned char *prv, long n, long bpp)
+{
+	__m128i a, b, c, d, z, pa, pb, pc, m;
+	long i;
+
+	if (f == 2)
+	{
+		for(i=0;i<n;i+=16)
+			_mm_storeu_si128((__m128i *)&cur[i],_mm_add_epi8(_mm_loadu_si128((const __m128i *)&raw[i]),
+																		 _mm_loadu_si128((const __m128i *)&prv[i])));
+		return;
+	}
+	if ((bpp < 3) || (f < 1) || (f > 4)) { pngunfilter_c(f,raw,cur,prv,n,bpp); return; }
+
+	z = _mm_setzero_si128(); a = c = z;
+	switch(f)
+	{
+		case 1:
+			for(i=0;i<n;i+=bpp) { a = _mm_add_epi8(load4(&raw[i]),a); store4(&cur[i],a); }
+			break;
+		case 3:
+			for(i=0;i<n;i+=bpp)
+			{
+				b = load4(&prv[i]); //floor((a+b)/2) = round-up average - odd bit
+				d = _mm_sub_epi8(_mm_avg_epu8(a,b),_mm_and_si128(_mm_xor_si128(a,b),_mm_set1_epi8(1)));
+				a = _mm_add_epi8(load4(&raw[i]),d); store4(&cur[i],a);
+			}
+			break;
+		case 4:
+			for(i=0;i<n;i+=bpp)
+			{
+				b = _mm_unpacklo_epi8(load4(&prv[i]),z);
+				pa = _mm_sub_epi16(b,c); //b-c
+				pb = _mm_sub_epi16(a,c); //a-c
+				pc = _mm_add_epi16(pa,pb);
+				pa = _mm_max_epi16(pa,_mm_sub_epi16(z,pa));
+				pb = _mm_max_epi16(pb,_mm_sub_epi16(z,pb));
+				pc = _mm_max_epi16(pc,_mm_sub_epi16(z,pc));
+					//a if (pa <= pb && pa <= pc), else b if (pb <= pc), else c
+				m = _mm_cmpgt_epi16(pb,pc);
+				d = _mm_or_si128(_mm_and_si128(m,c),_mm_andnot_si128(m,b));
+				m = _mm_or_si128(_mm_cmpgt_epi16(pa,pb),_mm_cmpgt_epi16(pa,pc));
+				d = _mm_or_si128(_mm_and_si128(m,d),_mm_andnot_si128(m,a));
+				d = _mm_add_epi8(_mm_packus_epi16(d,d),load4(&raw[i]));
+				store4(&cur[i],d);
+				a = _mm_unpacklo_epi8(d,z); c = b;
+			}
+			break;
+	}
+}
+
+	//olinbuf[n..1] = cur[0..n-1]
+static KP_SSE2 void pngflipline_sse2 (unsigned char *dst, const unsigned char *src, long n)
+{
+	__m128i v;
+	long i;
+
+	for(i=0;i+16<=n;i+=16)
+	{
+		v = _mm_loadu_si128((const __m128i *)&src[i]);
+		v = _mm_shuffle_epi32(v,_MM_SHUFFLE(0,1,2,3));
+		v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v,_MM_SHUFFLE(2,3,0,1)),_MM_SHUFFLE(2,3,0,1));
+		v = _mm_or_si128(_mm_slli_epi16(v,8),_mm_srli_epi16(v,8));
+		_mm_storeu_si128((__m128i *)&dst[n-i-15],v);
+	}
+	for(;i<n;i++) dst[n-i] = src[i];
+}
+#endif
+
+static void pngunfilter (long f, const unsigned char *raw, unsigned char *cur, const unsigned char *prv, long n, long bpp)
+{
+#ifdef KP_SSE2
+	if (getcpufeatures() & CPUFEAT_SSE2) { pngunfilter_sse2(f,raw,cur,prv,n,bpp); return; }
+#endif
+	pngunfilter_c(f,raw,cur,prv,n,bpp);
+}
+
+static void pngflipline (unsigned char *dst, const unsigned char *src, long n)
+{
+	long i;
+
+#ifdef KP_SSE2
+	if (getcpufeatures() & CPUFEAT_SSE2) { pngflipline_sse2(dst,src,n); return; }
+#endif
+	for(i=0;i<n;i++) dst[n-i] = src[i];
+}
+
+	//kpngfast version of putbuf(): gathers whole scanlines before decoding them
+static void putlines (const unsigned char *buf, long leng)
+{
+	long n;
+	unsigned char *t;
+
+	while (leng > 0)
+	{
+		n = min(leng,xsizbpl+1-linleng);
+		memcpy(&linraw[linleng],buf,n); linleng += n; buf += n; leng -= n;
+		if (linleng <= xsizbpl) return;
+
+		filt = linraw[0];
+		if (filter1st < 0) filter1st = filt; else filterest |= (1<<filt);
+		pngunfilter(filt,&linraw[1],lincur,linprv,xsizbpl,pngbpp);
+		pngflipline(olinbuf,lincur,xsizbpl);
+		putline();
+
+		t = linprv; linprv = lincur; lincur = t; linleng = 0;
+		yplc += iystp;
+		if ((intlac) && (yplc >= globyoffs+ysiz)) { intlac--; initpass(); }
+	}
+}
+
 static void initpngtables()
 {
 	long i, j, k;
@@ -961,8 +1158,9 @@ static long kpngrend (const char *kfilebuf, long kfilength,
 	long daframeplace, long dabytesperline, long daxres, long dayres,
 	long daglobxoffs, long daglobyoffs)
 {
-	long i, j, k, bfinal, btype, hlit, hdist, leng;
+	long i, j, k, bfinal, btype, hlit, hdist, leng, fast;
 	long slidew, slider;
+	void (*daputbuf)(const unsigned char *, long);
 	//long qhuf0v, qhuf1v;
 
 	if (!pnginited) { pnginited = 1; initpngtables(); }
@@ -1066,11 +1264,13 @@ static long kpngrend (const char *kfilebuf, long kfilength,
 
 	switch (coltype)
 	{
-		case 4: xmn[0] = 1; xmn[1] = 0; break;
-		case 2: xmn[0] = 1; xmn[1] = 2; xmn[2] = 0; break;
-		case 6: xmn[0] = 1; xmn[1] = 2; xmn[2] = 3; xmn[3] = 0; break;
-		default: xmn[0] = 0; break;
+		case 4: xmn[0] = 1; xmn[1] = 0; pngbpp = 2; break;
+		case 2: xmn[0] = 1; xmn[1] = 2; xmn[2] = 0; pngbpp = 3; break;
+		case 6: xmn[0] = 1; xmn[1] = 2; xmn[2] = 3; xmn[3] = 0; pngbpp = 4; break;
+		default: xmn[0] = 0; pngbpp = 1; break;
 	}
+	fast = ((kpngfast) && (xsiz*ysiz >= 16384)); //table setup outweighs the gain on tiny images
+	if (fast) daputbuf = putlines; else daputbuf = putbuf;
 	switch (bitdepth)
 	{
 		case 1: for(i=2;i<256;i++) palcol[i] = palcol[i&1]; break;
@@ -1112,7 +1312,7 @@ static long kpngrend (const char *kfilebuf, long kfilength,
 			{
 				if (slidew >= slider)
 				{
-					putbuf(&slidebuf[(slider-16384)&32767],16384); slider += 16384;
+					daputbuf(&slidebuf[(slider-16384)&32767],16384); slider += 16384;
 					if ((yplc >= yres) && (intlac < 2)) goto kpngrend_goodret;
 				}
 				slidebuf[(slidew++)&32767] = (char)getbits(8);
@@ -1154,7 +1354,12 @@ static long kpngrend (const char *kfilebuf, long kfilength,
 
 		hufgencode(clen,hlit,ibuf0,nbuf0);
 		//qhuf0v = //hufgetsym_skipb related code
-		qhufgencode(ibuf0,nbuf0,qhufval0,qhufbit0,LOGQHUFSIZ0);
+		if (fast)
+		{
+			qhufgencode(ibuf0,nbuf0,qhufval2,qhufbit2,LOGQHUFSIZ2);
+			qhufgenpairs(qhufval2,qhufbit2,qhufpair2,qhufpbit2,LOGQHUFSIZ2);
+		}
+		else qhufgencode(ibuf0,nbuf0,qhufval0,qhufbit0,LOGQHUFSIZ0);
 
 		hufgencode(&clen[hlit],hdist,ibuf1,nbuf1);
 		//qhuf1v = //hufgetsym_skipb related code
@@ -1164,16 +1369,33 @@ static long kpngrend (const char *kfilebuf, long kfilength,
 		{
 			if (slidew >= slider)
 			{
-				putbuf(&slidebuf[(slider-16384)&32767],16384); slider += 16384;
+				daputbuf(&slidebuf[(slider-16384)&32767],16384); slider += 16384;
 				if ((yplc >= yres) && (intlac < 2)) goto kpngrend_goodret;
 			}
 
+			if (fast)
+			{
+				k = peekbits(LOGQHUFSIZ2);
+				if (qhufpbit2[k]) //two literals
+				{
+					slidebuf[(slidew++)&32767] = (char)qhufpair2[k];
+					slidebuf[(slidew++)&32767] = (char)(qhufpair2[k]>>8);
+					suckbits((long)qhufpbit2[k]);
+					continue;
+				}
+				if (qhufbit2[k]) { i = qhufval2[k]; suckbits((long)qhufbit2[k]); } else i = hufgetsym(ibuf0,nbuf0);
+				if (i < 256) { slidebuf[(slidew++)&32767] = (char)i; continue; }
+				if (i == 256) break;
+				goto kpngrend_havelength;
+			}
+
 			k = peekbits(LOGQHUFSIZ0);
 			if (qhufbit0[k]) { i = qhufval0[k]; suckbits((long)qhufbit0[k]); } else i = hufgetsym(ibuf0,nbuf0);
 			//else i = hufgetsym_skipb(ibuf0,nbuf0,LOGQHUFSIZ0,qhuf0v); //hufgetsym_skipb related code
 
 			if (i < 256) { slidebuf[(slidew++)&32767] = (char)i; continue; }
 			if (i == 256) break;
+kpngrend_havelength:;
 			i = getbits(hxbit[i+30-257][0]) + hxbit[i+30-257][1];
 
 			k = peekbits(LOGQHUFSIZ1);
@@ -1187,11 +1409,11 @@ static long kpngrend (const char *kfilebuf, long kfilength,
 
 	slider -= 16384;
 	if (!((slider^slidew)&32768))
-		putbuf(&slidebuf[slider&32767],slidew-slider);
+		daputbuf(&slidebuf[slider&32767],slidew-slider);
 	else
 	{
-		putbuf(&slidebuf[slider&32767],(-slider)&32767);
-		putbuf(slidebuf,slidew&32767);
+		daputbuf(&slidebuf[slider&32767],(-slider)&32767);
+		daputbuf(slidebuf,slidew&32767);
 	}
 
 kpngrend_goodret:;
@@ -1215,7 +1437,7 @@ static long clipxdim, clipydim;
 static long hufmaxatbit[8][20], hufvalatbit[8][20], hufcnt[8];
 static unsigned char hufnumatbit[8][20], huftable[8][256];
 static long hufquickval[8][1024], hufquickbits[8][1024], hufquickcnt[8];
-static long quantab[4][64], dct[12][64], lastdc[4], unzig[64], zigit[64]; //dct:10=MAX (says spec);+2 for hacks
+static long quantab[4][64], dct[16][64], lastdc[4], unzig[64], zigit[64]; //dct:10=MAX (says spec);+6 for hacks (grey chroma reads run up to dct[14])
 static unsigned char gnumcomponents, dcflagor[64];
 static long gcompid[4], gcomphsamp[4], gcompvsamp[4], gcompquantab[4], gcomphsampshift[4], gcompvsampshift[4];
 static long lnumcomponents, lcompid[4], lcompdc[4], lcompac[4], lcomphsamp[4], lcompvsamp[4], lcompquantab[4];
@@ -1292,6 +1514,8 @@ static inline long mulshr32 (long a, long b)
 static long cosqr16[8] =    //cosqr16[i] = ((cos(PI*i/16)*sqrt(2))<<24);
   {23726566,23270667,21920489,19727919,16777216,13181774,9079764,4628823};
 static long crmul[4096], cbmul[4096];
+static long kpegsimd = 0, kpegthreads = 0;
+long kpegfast = 1;
 
 static void initkpeg ()
 {
@@ -1334,7 +1558,7 @@ static void initkpeg ()
 		cbmul[(i<<1)+1] = (i-1024)*1858077; //1.772*1048576
 	}
 
-	memset((void *)&dct[10][0],0,64*2*sizeof(dct[0][0]));
+	memset((void *)&dct[10][0],0,64*6*sizeof(dct[0][0]));
 }
 
 static void huffgetval (long index, long curbits, long num, long *daval, long *dabits)
@@ -1358,14 +1582,136 @@ static void huffgetval (long index, long curbits, long num, long *daval, long *d
 	*dabits = 16; *daval = 0;
 }
 
+#define SQRT2 23726566   //(sqrt(2))<<24
+#define C182 31000253    //(cos(PI/8)*2)<<24
+#define C18S22 43840978  //(cos(PI/8)*sqrt(2)*2)<<24
+#define C38S22 18159528  //(cos(PI*3/8)*sqrt(2)*2)<<24
+
+#ifdef KP_SSE2
+	//High 32 bits of a*k for 4 signed a's and a positive constant k
+static KP_SSE2 _inline __m128i mulshr32x4 (__m128i a, __m128i k)
+{
+	__m128i e, o;
+
+	e = _mm_srli_epi64(_mm_mul_epu32(a,k),32);
+	o = _mm_and_si128(_mm_mul_epu32(_mm_srli_epi64(a,32),k),_mm_set_epi32(-1,0,-1,0));
+	return(_mm_sub_epi32(_mm_or_si128(e,o),_mm_and_si128(_mm_srai_epi32(a,31),k)));
+}
+
+	//Low 32 bits of a*k
+static KP_SSE2 _inline __m128i mullo32x4 (__m128i a, __m128i k)
+{
+	__m128i e, o;
+
+	e = _mm_mul_epu32(a,k);
+	o = _mm_mul_epu32(_mm_srli_epi64(a,32),_mm_srli_epi64(k,32));
+	return(_mm_unpacklo_epi32(_mm_shuffle_epi32(e,_MM_SHUFFLE(0,0,2,0)),_mm_shuffle_epi32(o,_MM_SHUFFLE(0,0,2,0))));
+}
+
+static KP_SSE2 _inline void transpose4x4 (__m128i *a, __m128i *b, __m128i *c, __m128i *d)
+{
+	__m128i t0, t1, t2, t3;
+
+	t0 = _mm_unpacklo_epi32(*a,*b); t1 = _mm_unpacklo_epi32(*c,*d);
+	t2 = _mm_unpackhi_epi32(*a,*b); t3 = _mm_unpackhi_epi32(*c,*d);
+	*a = _mm_unpacklo_epi64(t0,t1); *b = _mm_unpackhi_epi64(t0,t1);
+	*c = _mm_unpacklo_epi64(t2,t3); *d = _mm_unpackhi_epi64(t2,t3);
+}
+
+	//m[r*2+h] holds row r, columns h*4..h*4+3
+static KP_SSE2 void transpose8x8 (__m128i *m)
+{
+	__m128i t;
+	long i;
+
+	transpose4x4(&m[0],&m[2],&m[4],&m[6]);
+	transpose4x4(&m[1],&m[3],&m[5],&m[7]);
+	transpose4x4(&m[8],&m[10],&m[12],&m[14]);
+	transpose4x4(&m[9],&m[11],&m[13],&m[15]);
+	for(i=0;i<4;i++) { t = m[i*2+1]; m[i*2+1] = m[i*2+8]; m[i*2+8] = t; }
+}
+
+	//Same butterflies as invdct8x8(), run on 4 columns at once: v[k*2] is row k
+static KP_SSE2 void idct8x4_sse2 (__m128i *v)
+{
+	__m128i t0, t1, t2, t3, t4, t5, t6, t7;
+
+	t3 = _mm_add_epi32(v[2*2],v[6*2]);
+	t2 = _mm_sub_epi32(_mm_slli_epi32(mulshr32x4(_mm_sub_epi32(v[2*2],v[6*2]),_mm_set1_epi32(SQRT2<<6)),2),t3);
+	t4 = _mm_add_epi32(v[0*2],v[4*2]); t5 = _mm_sub_epi32(v[0*2],v[4*2]);
+	t0 = _mm_add_epi32(t4,t3); t3 = _mm_sub_epi32(t4,t3); t1 = _mm_add_epi32(t5,t2); t2 = _mm_sub_epi32(t5,t2);
+	t4 = _mm_slli_epi32(mulshr32x4(_mm_sub_epi32(_mm_add_epi32(v[5*2],v[1*2]),_mm_add_epi32(v[3*2],v[7*2])),_mm_set1_epi32(C182<<6)),2);
+	t7 = _mm_add_epi32(_mm_add_epi32(v[1*2],v[7*2]),_mm_add_epi32(v[5*2],v[3*2]));
+	t6 = _mm_sub_epi32(_mm_add_epi32(_mm_slli_epi32(mulshr32x4(_mm_sub_epi32(v[3*2],v[5*2]),_mm_set1_epi32(C18S22<<5)),3),t4),t7);
+	t5 = _mm_sub_epi32(_mm_slli_epi32(mulshr32x4(_mm_sub_epi32(_mm_add_epi32(v[1*2],v[7*2]),_mm_add_epi32(v[5*2],v[3*2])),_mm_set1_epi32(SQRT2<<6)),2),t6);
+	t4 = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(mulshr32x4(_mm_sub_epi32(v[1*2],v[7*2]),_mm_set1_epi32(C38S22<<6)),2),t4),t5);
+	v[0*2] = _mm_add_epi32(t0,t7); v[7*2] = _mm_sub_epi32(t0,t7);
+	v[1*2] = _mm_add_epi32(t1,t6); v[6*2] = _mm_sub_epi32(t1,t6);
+	v[2*2] = _mm_add_epi32(t2,t5); v[5*2] = _mm_sub_epi32(t2,t5);
+	v[4*2] = _mm_add_epi32(t3,t4); v[3*2] = _mm_sub_epi32(t3,t4);
+}
+
+	//Rows first (on the transposed block) then columns, like the C version.
+	//Rows dcflag says are empty stay zero either way, so they aren't skipped.
+static KP_SSE2 void invdct8x8_sse2 (long *dc)
+{
+	__m128i m[16];
+	long i;
+
+	for(i=0;i<16;i++) m[i] = _mm_loadu_si128((__m128i *)&dc[i<<2]);
+	transpose8x8(m); idct8x4_sse2(&m[0]); idct8x4_sse2(&m[1]);
+	transpose8x8(m); idct8x4_sse2(&m[0]); idct8x4_sse2(&m[1]);
+	for(i=0;i<16;i++) _mm_storeu_si128((__m128i *)&dc[i<<2],m[i]);
+}
+
+	//One 8-pixel line of yrbrend()'s two fast cases. crmul/cbmul[((c>>13)&~1)+2048+k]
+	//is (c>>14) times a constant and colclip*[(unsigned)v>>22] is clamp((v>>22)+128),
+	//so both table lookups become arithmetic.
+static KP_SSE2 void yrbline8_sse2 (long *p, const long *dc, const long *dc2, long hsamp)
+{
+	__m128i y0, y1, r0, r1, b0, b1, g0, g1, c, r, g, b, a;
+
+	if (hsamp == 1)
+	{
+		r0 = _mm_loadu_si128((__m128i *)&dc2[64]); r1 = _mm_loadu_si128((__m128i *)&dc2[68]);
+		b0 = _mm_loadu_si128((__m128i *)&dc2[0]); b1 = _mm_loadu_si128((__m128i *)&dc2[4]);
+	}
+	else
+	{
+		c = _mm_loadu_si128((__m128i *)&dc2[64]); r0 = _mm_unpacklo_epi32(c,c); r1 = _mm_unpackhi_epi32(c,c);
+		c = _mm_loadu_si128((__m128i *)&dc2[0]); b0 = _mm_unpacklo_epi32(c,c); b1 = _mm_unpackhi_epi32(c,c);
+	}
+	r0 = _mm_srai_epi32(r0,14); r1 = _mm_srai_epi32(r1,14);
+	b0 = _mm_srai_epi32(b0,14); b1 = _mm_srai_epi32(b1,14);
+
+	y0 = _mm_loadu_si128((__m128i *)&dc[0]); y1 = _mm_loadu_si128((__m128i *)&dc[4]);
+	g0 = _mm_add_epi32(y0,_mm_add_epi32(mullo32x4(r0,_mm_set1_epi32(-748830)),mullo32x4(b0,_mm_set1_epi32(-360857))));
+	g1 = _mm_add_epi32(y1,_mm_add_epi32(mullo32x4(r1,_mm_set1_epi32(-748830)),mullo32x4(b1,_mm_set1_epi32(-360857))));
+	r0 = _mm_add_epi32(y0,mullo32x4(r0,_mm_set1_epi32(1470104)));
+	r1 = _mm_add_epi32(y1,mullo32x4(r1,_mm_set1_epi32(1470104)));
+	b0 = _mm_add_epi32(y0,mullo32x4(b0,_mm_set1_epi32(1858077)));
+	b1 = _mm_add_epi32(y1,mullo32x4(b1,_mm_set1_epi32(1858077)));
+
+	c = _mm_set1_epi16(128);
+	r = _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(r0,22),_mm_srai_epi32(r1,22)),c);
+	g = _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(g0,22),_mm_srai_epi32(g1,22)),c);
+	b = _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(b0,22),_mm_srai_epi32(b1,22)),c);
+	r = _mm_packus_epi16(r,r); g = _mm_packus_epi16(g,g); b = _mm_packus_epi16(b,b);
+
+	b = _mm_unpacklo_epi8(b,g); //BGBG...
+	a = _mm_unpacklo_epi8(r,_mm_set1_epi8(-1)); //RARA...
+	_mm_storeu_si128((__m128i *)&p[0],_mm_unpacklo_epi16(b,a));
+	_mm_storeu_si128((__m128i *)&p[4],_mm_unpackhi_epi16(b,a));
+}
+#endif
+
 static void invdct8x8 (long *dc, unsigned char dcflag)
 {
-	#define SQRT2 23726566   //(sqrt(2))<<24
-	#define C182 31000253    //(cos(PI/8)*2)<<24
-	#define C18S22 43840978  //(cos(PI/8)*sqrt(2)*2)<<24
-	#define C38S22 18159528  //(cos(PI*3/8)*sqrt(2)*2)<<24
 	long *edc, t0, t1, t2, t3, t4, t5, t6, t7;
 
+#ifdef KP_SSE2
+	if (kpegsimd) { invdct8x8_sse2(dc); return; }
+#endif
 	edc = dc+64;
 	do
 	{
@@ -1403,7 +1749,8 @@ static void invdct8x8 (long *dc, unsigned char dcflag)
 	} while (dc < edc);
 }
 
-static void yrbrend (long x, long y)
+	//dct: the MCU's IDCT'd blocks, as laid out in the global dct[]
+static void yrbrend (long x, long y, long (*dct)[64])
 {
 	long i, j, ox, oy, xx, yy, xxx, yyy, xxxend, yyyend, yv, cr, cb, p, pp, *odc, *dc, *dc2;
 
@@ -1420,6 +1767,19 @@ static void yrbrend (long x, long y)
 			if (lnumcomponents > 1) dc2 = &dct[lcomphvsamp0][((yy>>lcompvsampshift0)<<3)+(xx>>lcomphsampshift0)];
 			xxxend = min(clipxdim-ox,8);
 			yyyend = min(clipydim-oy,8);
+#ifdef KP_SSE2
+			if ((kpegsimd) && (lcomphsamp[0] <= 2) && (xxxend == 8))
+			{
+				for(yyy=0;yyy<yyyend;yyy++)
+				{
+					yrbline8_sse2((long *)p,dc,dc2,lcomphsamp[0]);
+					p += bytesperline;
+					dc += 8;
+					if (!((yyy+1)&(lcompvsamp[0]-1))) dc2 += 8;
+				}
+			}
+			else
+#endif
 			if ((lcomphsamp[0] == 1) && (xxxend == 8))
 			{
 				for(yyy=0;yyy<yyyend;yyy++)
@@ -1492,6 +1852,35 @@ static void yrbrend (long x, long y)
 	}
 }
 
+	//Last stage of a buffered (progressive or threaded) decode: dequantizes,
+	//IDCTs and draws MCU rows [y0,y1). Each call has its own block scratch,
+	//so runworkers() can hand the rows out to several threads.
+typedef struct { short **dctptr; long *dctx, *lshx, *lshy, xdim; } kpegrows_t;
+
+static void kpegrows (void *arg, long y0, long y1)
+{
+	kpegrows_t *kf = (kpegrows_t *)arg;
+	long x, y, c, xx, yy, z, *dc, *quanptr, blk[16][64];
+	short *dcs;
+
+	memset((void *)&blk[10][0],0,64*6*sizeof(blk[0][0]));
+	for(y=y0*gcompvsamp[0];y<y1*gcompvsamp[0];y+=gcompvsamp[0])
+		for(x=0;x<kf->xdim;x+=gcomphsamp[0])
+		{
+			dc = blk[0];
+			for(c=0;c<gnumcomponents;c++)
+				for(yy=0;yy<gcompvsamp[c];yy+=8)
+					for(xx=0;xx<gcomphsamp[c];xx+=8,dc+=64)
+					{
+						dcs = &kf->dctptr[c][(((y+yy)>>kf->lshy[c])*kf->dctx[c] + ((x+xx)>>kf->lshx[c]))<<6];
+						quanptr = &quantab[gcompquantab[c]][0];
+						for(z=0;z<64;z++) dc[z] = ((long)dcs[zigit[z]])*quanptr[z];
+						invdct8x8(dc,-1);
+					}
+			yrbrend(x,y,blk);
+		}
+}
+
 static long kpegrend (const char *kfilebuf, long kfilength,
 	long daframeplace, long dabytesperline, long daxres, long dayres,
 	long daglobxoffs, long daglobyoffs)
@@ -1503,8 +1892,12 @@ static long kpegrend (const char *kfilebuf, long kfilength,
 	short *dctbuf = 0, *dctptr[12], *ldctptr[12], *dcs;
 	unsigned char ch, marker, dcflag;
 	const unsigned char *kfileptr;
+	kpegrows_t kf;
 
 	if (!kpeginited) { kpeginited = 1; initkpeg(); }
+#ifdef KP_SSE2
+	kpegsimd = ((kpegfast) && (sizeof(long) == 4) && (getcpufeatures()&CPUFEAT_SSE2));
+#endif
 
 	kfileptr = (unsigned char *)kfilebuf;
 
@@ -1534,6 +1927,10 @@ static long kpegrend (const char *kfilebuf, long kfilength,
 
 				ydim = SSWAPIL(*(unsigned short *)&kfileptr[0]);
 				xdim = SSWAPIL(*(unsigned short *)&kfileptr[2]);
+
+					//Big pictures get buffered like progressive ones so the
+					//IDCT and colour conversion can run on the worker threads
+				kpegthreads = ((kpegfast) && (xdim*ydim >= 256*256) && (xdim*ydim <= 4096*4096) && (getworkercount() > 1));
 				//printf("%s: %ld / %ld = %ld\n",filename,xdim*ydim*3,kfilength,(xdim*ydim*3)/kfilength);
 
 				frameplace = daframeplace;
@@ -1636,7 +2033,7 @@ static long kpegrend (const char *kfilebuf, long kfilength,
 				kfileptr += 3;
 				//printf("passcnt=%d, Ss=%d, Se=%d, Ah=%d, Al=%d\n",passcnt,Ss,Se,Ah,Al);
 
-				if ((!passcnt) && ((Ss) || (Se != 63) || (Ah) || (Al)))
+				if ((!passcnt) && ((Ss) || (Se != 63) || (Ah) || (Al) || (kpegthreads)))
 				{
 					for(z=zz=0;z<gnumcomponents;z++)
 					{
@@ -1834,7 +2231,7 @@ static long kpegrend (const char *kfilebuf, long kfilength,
 								}
 							}
 
-						if (!dctbuf) yrbrend(x,y);
+						if (!dctbuf) yrbrend(x,y,dct);
 
 						restartcnt--;
 						if (!restartcnt)
@@ -1868,21 +2265,11 @@ kpegrend_break2:;
 	lcomphsampshift0 = gcomphsampshift[0];
 	lcompvsampshift0 = gcompvsampshift[0];
 	lcomphvsamp0 = (lcomphsamp[0]<<lcompvsampshift0);
-	for(y=0;y<ydim;y+=gcompvsamp[0])
-		for(x=0;x<xdim;x+=gcomphsamp[0])
-		{
-			dc = dct[0];
-			for(c=0;c<gnumcomponents;c++)
-				for(yy=0;yy<gcompvsamp[c];yy+=8)
-					for(xx=0;xx<gcomphsamp[c];xx+=8,dc+=64)
-					{
-						dcs = &dctptr[c][(((y+yy)>>lshy[c])*dctx[c] + ((x+xx)>>lshx[c]))<<6];
-						quanptr = &quantab[gcompquantab[c]][0];
-						for(z=0;z<64;z++) dc[z] = ((long)dcs[zigit[z]])*quanptr[z];
-						invdct8x8(dc,-1);
-					}
-			yrbrend(x,y);
-		}
+
+	kf.dctptr = dctptr; kf.dctx = dctx; kf.lshx = lshx; kf.lshy = lshy; kf.xdim = xdim;
+	i = (ydim+gcompvsamp[0]-1)/gcompvsamp[0];
+	if (kpegthreads) runworkers(kpegrows,&kf,i,max(i/(getworkercount()*4),1));
+	else kpegrows(&kf,0,i);
 
 	free(dctbuf); return(0);
 }
@@ -3,6 +3,8 @@ extern void kpzload (const char *, long *, long *, long *, long *);
 	//Low-level PNG/JPG functions:
 extern void kpgetdim (const char *, long, long *, long *);
 extern long kprender (const char *, long, long, long, long, long, long, long);
+extern long kpngfast; //1:decode PNGs a scanline at a time (SSE2 filters), 0:old byte path
+extern long kpegfast; //1:SSE2 IDCT/colour conversion and threaded decode of big JPEGs, 0:old path
 
 	//ZIP functions:
 extern long kzaddstack (const char *);
@@ -14,6 +14,8 @@
 #include "hightile_priv.h"
 #include "polymosttex_priv.h"
 #include "mdsprite_priv.h"
+#include "cpufeat.h"
+#include "workers.h"
 
 #ifdef __POWERPC__
 #define SHIFTMOD32(a) ((a)&31)
@@ -37,8 +39,40 @@ static long nummodelsalloced = 0;
 long nextmodelid = 0;
 mdmodel **models = NULL;
 
-static long maxmodelverts = 0, allocmodelverts = 0;
-static point3d *vertlist = NULL; //temp array to store interpolated vertices for drawing
+	//Skinned-vertex cache
+	//
+	//Frame interpolation only depends on the model, the two frames and the
+	//blend between them, so it is done in model space (the per-sprite scaling
+	//and flipping is folded into the modelview matrix instead) and the result
+	//is kept for other sprites showing the same pose. The blend is rounded to
+	//1/MDVCACHEINTERP of a frame so that enemies idling in step share entries.
+#define MDVCACHESIZE 64 //must be a power of 2
+#define MDVCACHEINTERP 256
+typedef struct
+{
+	mdmodel *m;
+	long surf, cframe, nframe, interp;
+	long numverts, alloced;
+	point3d *verts;
+} mdvcache_t;
+static mdvcache_t mdvcache[MDVCACHESIZE];
+
+	//scratch vertex/index arrays the draw functions fill for glDrawArrays/glDrawElements
+static void *drawbuf = NULL;
+static long drawbufsiz = 0;
+
+static void *getdrawbuf (long siz)
+{
+	void *p;
+
+	if (siz > drawbufsiz)
+	{
+		p = realloc(drawbuf,siz);
+		if (!p) { initprintf("ERROR: Not enough memory for %d bytes of model geometry!\n",siz); return NULL; }
+		drawbuf = p; drawbufsiz = siz;
+	}
+	return drawbuf;
+}
 
 mdmodel *mdload (const char *);
 void mdfree (mdmodel *);
@@ -57,11 +91,14 @@ void freeallmodels ()
 
 	memset(tile2model,-1,sizeof(tile2model));
 
-	if (vertlist)
+	for(i=0;i<MDVCACHESIZE;i++)
+		if (mdvcache[i].verts) free(mdvcache[i].verts);
+	memset(mdvcache,0,sizeof(mdvcache));
+	if (drawbuf)
 	{
-		free(vertlist);
-		vertlist = NULL;
-		allocmodelverts = maxmodelverts = 0;
+		free(drawbuf);
+		drawbuf = NULL;
+		drawbufsiz = 0;
 	}
 }
 
@@ -609,18 +646,170 @@ static md2model *md2load (int fil, const char *filnam)
 	m->tex = (PTMHead **)calloc(m->numskins, sizeof(PTMHead *) * (HICEFFECTMASK+1));
 	if (!m->tex) { free(m->skinfn); free(m->basepath); free(m->glcmds); free(m->frames); free(m); return(0); }
 
-	maxmodelverts = max(maxmodelverts, m->numverts);
-
 	return(m);
 }
 
+	//Rounds the model's blend between cframe and nframe for the vertex cache.
+	//A blend that rounds to either end collapses to that single frame.
+static float mdvcache_key (md2model *m, long *cframe, long *nframe, long *interp)
+{
+	long i;
+
+	i = (long)(m->interpol*MDVCACHEINTERP + .5);
+	*cframe = m->cframe; *nframe = m->nframe;
+	if (i <= 0) { i = 0; *nframe = *cframe; }
+	else if (i >= MDVCACHEINTERP) { i = 0; *cframe = *nframe; }
+	*interp = i;
+	return ((float)i)/((float)MDVCACHEINTERP);
+}
+
+	//Returns the slot for a pose with room for numverts vertices, and sets
+	//*hit if it already holds them. Returns NULL when out of memory.
+static point3d *mdvcache_get (mdmodel *m, long surf, long cframe, long nframe, long interp, long numverts, int *hit)
+{
+	mdvcache_t *c;
+	unsigned long h;
+	point3d *p;
+
+	h = ((unsigned long)(size_t)m>>4) ^ (surf*31) ^ (cframe*131) ^ (nframe*7919) ^ (interp*17);
+	c = &mdvcache[(h ^ (h>>8)) & (MDVCACHESIZE-1)];
+
+	*hit = (c->m == m && c->surf == surf && c->cframe == cframe && c->nframe == nframe &&
+		c->interp == interp && c->numverts == numverts);
+	if (*hit) return c->verts;
+
+	if (numverts > c->alloced)
+	{
+		p = (point3d *)realloc(c->verts,sizeof(point3d)*numverts);
+		if (!p) { initprintf("ERROR: Not enough memory to allocate %d vertices!\n",numverts); return NULL; }
+		c->verts = p; c->alloced = numverts;
+	}
+	c->m = m; c->surf = surf; c->cframe = cframe; c->nframe = nframe;
+	c->interp = interp; c->numverts = numverts;
+	return c->verts;
+}
+
+	//Forgets the poses of one model, or of every model when m is NULL
+static void mdvcache_flush (mdmodel *m)
+{
+	long i;
+
+	for(i=0;i<MDVCACHESIZE;i++)
+		if (!m || mdvcache[i].m == m) { mdvcache[i].m = NULL; mdvcache[i].numverts = 0; }
+}
+
+	//Interpolation kernels: out = v0*w0 + v1*w1 per component, with the
+	//components reordered from the file's (x,y,z) to the (y,z,x) the draw
+	//matrix expects. MD2 weights carry each frame's own scale per axis.
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# define MD_SSE2 __attribute__((target("sse2")))
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+# define MD_SSE2
+#endif
+
+static void md2interp_c (point3d *out, const unsigned char *c0, const unsigned char *c1, const float *w0, const float *w1, long n)
+{
+	long i;
+
+	for(i=0;i<n;i++,c0+=4,c1+=4)
+	{
+		out[i].x = ((float)c0[1])*w0[1] + ((float)c1[1])*w1[1];
+		out[i].y = ((float)c0[2])*w0[2] + ((float)c1[2])*w1[2];
+		out[i].z = ((float)c0[0])*w0[0] + ((float)c1[0])*w1[0];
+	}
+}
+
+static void md3interp_c (point3d *out, const md3xyzn_t *v0, const md3xyzn_t *v1, float w0, float w1, long n)
+{
+	long i;
+
+	for(i=0;i<n;i++)
+	{
+		out[i].x = ((float)v0[i].y)*w0 + ((float)v1[i].y)*w1;
+		out[i].y = ((float)v0[i].z)*w0 + ((float)v1[i].z)*w1;
+		out[i].z = ((float)v0[i].x)*w0 + ((float)v1[i].x)*w1;
+	}
+}
+
+#ifdef MD_SSE2
+#include <emmintrin.h>
+
+	//The 4th lane (MD2 light normal index, MD3 packed normal) is computed
+	//along with the rest but never stored.
+static MD_SSE2 void md2interp_sse2 (point3d *out, const unsigned char *c0, const unsigned char *c1, const float *w0, const float *w1, long n)
+{
+	__m128 a, b, r, m0, m1;
+	__m128i z = _mm_setzero_si128();
+	long i;
+
+	m0 = _mm_setr_ps(w0[0],w0[1],w0[2],0.f);
+	m1 = _mm_setr_ps(w1[0],w1[1],w1[2],0.f);
+	for(i=0;i<n;i++,c0+=4,c1+=4)
+	{
+		a = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)c0),z),z));
+		b = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int *)c1),z),z));
+		r = _mm_add_ps(_mm_mul_ps(a,m0),_mm_mul_ps(b,m1));
+		r = _mm_shuffle_ps(r,r,_MM_SHUFFLE(3,0,2,1));
+		_mm_storel_pi((__m64 *)&out[i].x,r);
+		_mm_store_ss(&out[i].z,_mm_movehl_ps(r,r));
+	}
+}
+
+static MD_SSE2 void md3interp_sse2 (point3d *out, const md3xyzn_t *v0, const md3xyzn_t *v1, float w0, float w1, long n)
+{
+	__m128 a, b, r, m0, m1;
+	__m128i t;
+	long i;
+
+	m0 = _mm_set1_ps(w0);
+	m1 = _mm_set1_ps(w1);
+	for(i=0;i<n;i++)
+	{
+		t = _mm_loadl_epi64((const __m128i *)&v0[i]);
+		a = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(t,t),16));
+		t = _mm_loadl_epi64((const __m128i *)&v1[i]);
+		b = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(t,t),16));
+		r = _mm_add_ps(_mm_mul_ps(a,m0),_mm_mul_ps(b,m1));
+		r = _mm_shuffle_ps(r,r,_MM_SHUFFLE(3,0,2,1));
+		_mm_storel_pi((__m64 *)&out[i].x,r);
+		_mm_store_ss(&out[i].z,_mm_movehl_ps(r,r));
+	}
+}
+#endif
+
+static void md2interp (point3d *out, const unsigned char *c0, const unsigned char *c1, const float *w0, const float *w1, long n)
+{
+#ifdef MD_SSE2
+	if (getcpufeatures() & CPUFEAT_SSE2) { md2interp_sse2(out,c0,c1,w0,w1,n); return; }
+#endif
+	md2interp_c(out,c0,c1,w0,w1,n);
+}
+
+static void md3interp (point3d *out, const md3xyzn_t *v0, const md3xyzn_t *v1, float w0, float w1, long n)
+{
+#ifdef MD_SSE2
+	if (getcpufeatures() & CPUFEAT_SSE2) { md3interp_sse2(out,v0,v1,w0,w1,n); return; }
+#endif
+	md3interp_c(out,v0,v1,w0,w1,n);
+}
+
+	//copies one glcmds vertex (s,t,index) out as u,v,x,y,z
+static inline void md2vert (float *tv, long *cmd, point3d *vl)
+{
+	tv[0] = ((float *)cmd)[0];
+	tv[1] = ((float *)cmd)[1];
+	tv[2] = vl[cmd[2]].x;
+	tv[3] = vl[cmd[2]].y;
+	tv[4] = vl[cmd[2]].z;
+}
+
 static int md2draw (md2model *m, spritetype *tspr)
 {
-	point3d fp, m0, m1, a0, a1;
+	point3d sc, a0, *vl;
 	md2frame_t *f0, *f1;
-	unsigned char *c0, *c1;
-	long i, *lptr;
-	float f, g, k0, k1, k2, k3, k4, k5, k6, k7, mat[16], pc[4];
+	long i, j, n, *lptr, *cmd, cf, nf, qi;
+	float f, g, k0, k1, k2, k3, k4, k5, k6, k7, mat[16], pc[4], w0[3], w1[3], *tv;
+	int hit;
 	PTMHead *ptmh = 0;
 
 	updateanimation(m,tspr);
@@ -628,16 +817,22 @@ static int md2draw (md2model *m, spritetype *tspr)
 // -------- Unnecessarily clean (lol) code to generate translation/rotation matrix for MD2 ---------
 
 		//create current&next frame's vertex list from whole list
-	f0 = (md2frame_t *)&m->frames[m->cframe*m->framebytes];
-	f1 = (md2frame_t *)&m->frames[m->nframe*m->framebytes];
-	f = m->interpol; g = 1-f;
-	m0.x = f0->mul.x*m->scale*g; m1.x = f1->mul.x*m->scale*f;
-	m0.y = f0->mul.y*m->scale*g; m1.y = f1->mul.y*m->scale*f;
-	m0.z = f0->mul.z*m->scale*g; m1.z = f1->mul.z*m->scale*f;
+	f = mdvcache_key(m,&cf,&nf,&qi); g = 1-f;
+	f0 = (md2frame_t *)&m->frames[cf*m->framebytes];
+	f1 = (md2frame_t *)&m->frames[nf*m->framebytes];
+	vl = mdvcache_get((mdmodel *)m,0,cf,nf,qi,m->numverts,&hit);
+	if (!vl) return 0;
+	if (!hit)
+	{
+		w0[0] = f0->mul.x*g; w1[0] = f1->mul.x*f;
+		w0[1] = f0->mul.y*g; w1[1] = f1->mul.y*f;
+		w0[2] = f0->mul.z*g; w1[2] = f1->mul.z*f;
+		md2interp(vl,&f0->verts[0].v[0],&f1->verts[0].v[0],w0,w1,m->numverts);
+	}
+	sc.x = sc.y = sc.z = m->scale;
 	a0.x = f0->add.x*m->scale; a0.x = (f1->add.x*m->scale-a0.x)*f+a0.x;
 	a0.y = f0->add.y*m->scale; a0.y = (f1->add.y*m->scale-a0.y)*f+a0.y;
 	a0.z = f0->add.z*m->scale; a0.z = (f1->add.z*m->scale-a0.z)*f+a0.z + m->zadd*m->scale;
-	c0 = &f0->verts[0].v[0]; c1 = &f1->verts[0].v[0];
 
 	// Parkar: Moved up to be able to use k0 for the y-flipping code
 	k0 = tspr->z;
@@ -646,32 +841,32 @@ static int md2draw (md2model *m, spritetype *tspr)
 	// Parkar: Changed to use the same method as centeroriented sprites
 	if (globalorientation&8) //y-flipping
 	{
-		m0.z = -m0.z; m1.z = -m1.z; a0.z = -a0.z;
+		sc.z = -sc.z; a0.z = -a0.z;
 		k0 -= (float)((tilesizy[tspr->picnum]*tspr->yrepeat)<<2);
 	}
-	if (globalorientation&4) { m0.y = -m0.y; m1.y = -m1.y; a0.y = -a0.y; } //x-flipping
+	if (globalorientation&4) { sc.y = -sc.y; a0.y = -a0.y; } //x-flipping
 
 	f = ((float)tspr->xrepeat)/64*m->bscale;
-	m0.x *= f; m1.x *= f; a0.x *= f; f = -f;   // 20040610: backwards models aren't cool
-	m0.y *= f; m1.y *= f; a0.y *= f;
+	sc.x *= f; a0.x *= f; f = -f;   // 20040610: backwards models aren't cool
+	sc.y *= f; a0.y *= f;
 	f = ((float)tspr->yrepeat)/64*m->bscale;
-	m0.z *= f; m1.z *= f; a0.z *= f;
+	sc.z *= f; a0.z *= f;
 	
 	// floor aligned
 	k1 = tspr->y;
 	if((globalorientation&48)==32)
 	{
-		m0.z = -m0.z; m1.z = -m1.z; a0.z = -a0.z;
-		m0.y = -m0.y; m1.y = -m1.y; a0.y = -a0.y;
+		sc.z = -sc.z; a0.z = -a0.z;
+		sc.y = -sc.y; a0.y = -a0.y;
 		f = a0.x; a0.x = a0.z; a0.z = f;
 		k1 += (float)((tilesizy[tspr->picnum]*tspr->yrepeat)>>3);
 	}
 
 	f = (65536.0*512.0)/((float)xdimen*viewingrange);
 	g = 32.0/((float)xdimen*gxyaspect);
-	m0.y *= f; m1.y *= f; a0.y = (((float)(tspr->x-globalposx))/  1024.0 + a0.y)*f;
-	m0.x *=-f; m1.x *=-f; a0.x = (((float)(k1     -globalposy))/ -1024.0 + a0.x)*-f;
-	m0.z *= g; m1.z *= g; a0.z = (((float)(k0     -globalposz))/-16384.0 + a0.z)*g;
+	sc.y *= f; a0.y = (((float)(tspr->x-globalposx))/  1024.0 + a0.y)*f;
+	sc.x *=-f; a0.x = (((float)(k1     -globalposy))/ -1024.0 + a0.x)*-f;
+	sc.z *= g; a0.z = (((float)(k0     -globalposz))/-16384.0 + a0.z)*g;
 
 	k0 = ((float)(tspr->x-globalposx))*f/1024.0;
 	k1 = ((float)(tspr->y-globalposy))*f/1024.0;
@@ -705,26 +900,13 @@ static int md2draw (md2model *m, spritetype *tspr)
 
 // ------ Unnecessarily clean (lol) code to generate translation/rotation matrix for MD2 ends ------
 
-#if 0
-	for(i=m->numverts-1;i>=0;i--) //interpolate (for animation) & transform to Build coords
-	{
-		fp.z = ((float)c0[(i<<2)+0])*m0.x + ((float)c1[(i<<2)+0])*m1.x;
-		fp.y = ((float)c0[(i<<2)+2])*m0.z + ((float)c1[(i<<2)+2])*m1.z;
-		fp.x = ((float)c0[(i<<2)+1])*m0.y + ((float)c1[(i<<2)+1])*m1.y;
-		vertlist[i].x = fp.x*mat[0] + fp.y*mat[4] + fp.z*mat[ 8] + mat[12];
-		vertlist[i].y = fp.x*mat[1] + fp.y*mat[5] + fp.z*mat[ 9] + mat[13];
-		vertlist[i].z = fp.x*mat[2] + fp.y*mat[6] + fp.z*mat[10] + mat[14];
-	}
-#else
-	for(i=m->numverts-1;i>=0;i--) //interpolate (for animation) & transform to Build coords
-	{
-		vertlist[i].z = ((float)c0[(i<<2)+0])*m0.x + ((float)c1[(i<<2)+0])*m1.x;
-		vertlist[i].y = ((float)c0[(i<<2)+2])*m0.z + ((float)c1[(i<<2)+2])*m1.z;
-		vertlist[i].x = ((float)c0[(i<<2)+1])*m0.y + ((float)c1[(i<<2)+1])*m1.y;
-	}
+		//scale the cached model-space vertices to Build coords
+	mat[0] *= sc.y; mat[1] *= sc.y; mat[ 2] *= sc.y;
+	mat[4] *= sc.z; mat[5] *= sc.z; mat[ 6] *= sc.z;
+	mat[8] *= sc.x; mat[9] *= sc.x; mat[10] *= sc.x;
+
 	bglMatrixMode(GL_MODELVIEW); //Let OpenGL (and perhaps hardware :) handle the matrix rotation
 	mat[3] = mat[7] = mat[11] = 0.f; mat[15] = 1.f; bglLoadMatrixf(mat);
-#endif
 
 	ptmh = mdloadskin(m,tile2model[tspr->picnum].skinnum,globalpal,0);
 	if (!ptmh || !ptmh->glpic) return 0;
@@ -760,16 +942,31 @@ static int md2draw (md2model *m, spritetype *tspr)
 	}
 	bglColor4f(pc[0],pc[1],pc[2],pc[3]);
 
-	for(lptr=m->glcmds;(i=*lptr++);)
+		//unroll the strips and fans into one triangle list (u,v,x,y,z per vertex)
+		//so the whole model goes out in a single draw call
+	for(n=0,lptr=m->glcmds;(i=*lptr++);lptr+=labs(i)*3) n += labs(i)-2;
+	tv = (float *)getdrawbuf(n*3*5*sizeof(float));
+	if (tv)
 	{
-		if (i < 0) { bglBegin(GL_TRIANGLE_FAN); i = -i; }
-				else { bglBegin(GL_TRIANGLE_STRIP); }
-		for(;i>0;i--,lptr+=3)
-		{
-			bglTexCoord2f(((float *)lptr)[0],((float *)lptr)[1]);
-			bglVertex3fv((float *)&vertlist[lptr[2]]);
-		}
-		bglEnd();
+		for(n=0,lptr=m->glcmds;(i=*lptr++);lptr+=labs(i)*3)
+			for(j=2;j<labs(i);j++)
+			{
+				//fans pivot on the first vertex; strips flip every other
+				//triangle so they all keep the same winding for culling
+				if (i < 0) { cmd = &lptr[0]; md2vert(&tv[n],cmd,vl); cmd = &lptr[(j-1)*3]; md2vert(&tv[n+5],cmd,vl); }
+				else if (j&1) { cmd = &lptr[(j-1)*3]; md2vert(&tv[n],cmd,vl); cmd = &lptr[(j-2)*3]; md2vert(&tv[n+5],cmd,vl); }
+				else { cmd = &lptr[(j-2)*3]; md2vert(&tv[n],cmd,vl); cmd = &lptr[(j-1)*3]; md2vert(&tv[n+5],cmd,vl); }
+				cmd = &lptr[j*3]; md2vert(&tv[n+10],cmd,vl);
+				n += 15;
+			}
+
+		bglEnableClientState(GL_VERTEX_ARRAY);
+		bglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		bglTexCoordPointer(2,GL_FLOAT,5*sizeof(float),&tv[0]);
+		bglVertexPointer(3,GL_FLOAT,5*sizeof(float),&tv[2]);
+		bglDrawArrays(GL_TRIANGLES,0,n/5); polymost_drawcalls++;
+		bglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		bglDisableClientState(GL_VERTEX_ARRAY);
 	}
 
 	if (m->usesalpha) bglDisable(GL_ALPHA_TEST);
@@ -900,7 +1097,6 @@ static md3model *md3load (int fil)
 		}
 #endif
 
-		maxmodelverts = max(maxmodelverts, s->numverts);
 		ofsurf += s->ofsend;
 	}
 
@@ -909,10 +1105,11 @@ static md3model *md3load (int fil)
 
 static int md3draw (md3model *m, spritetype *tspr)
 {
-	point3d fp, m0, m1, a0, a1;
-	md3xyzn_t *v0, *v1;
-	long i, j, k, surfi, *lptr;
-	float f, g, k0, k1, k2, k3, k4, k5, k6, k7, mat[16], pc[4];
+	point3d sc, a0, *vl;
+	long i, j, k, surfi, cf, nf, qi;
+	float f, g, k0, k1, k2, k3, k4, k5, k6, k7, mat[16], pc[4], w0, w1;
+	int hit;
+	GLuint *ind;
 	md3surf_t *s;
 	PTMHead * ptmh = 0;
 
@@ -920,10 +1117,8 @@ static int md3draw (md3model *m, spritetype *tspr)
 
 		//create current&next frame's vertex list from whole list
 
-	f = m->interpol; g = 1-f;
-	m0.x = (1.0/64.0)*m->scale*g; m1.x = (1.0/64.0)*m->scale*f;
-	m0.y = (1.0/64.0)*m->scale*g; m1.y = (1.0/64.0)*m->scale*f;
-	m0.z = (1.0/64.0)*m->scale*g; m1.z = (1.0/64.0)*m->scale*f;
+	w1 = mdvcache_key((md2model *)m,&cf,&nf,&qi); w0 = 1-w1;
+	sc.x = sc.y = sc.z = (1.0/64.0)*m->scale;
 	a0.x = a0.y = 0; a0.z = m->zadd*m->scale;
 
     // Parkar: Moved up to be able to use k0 for the y-flipping code
@@ -933,32 +1128,32 @@ static int md3draw (md3model *m, spritetype *tspr)
     // Parkar: Changed to use the same method as centeroriented sprites
 	if (globalorientation&8) //y-flipping
 	{
-		m0.z = -m0.z; m1.z = -m1.z; a0.z = -a0.z;
+		sc.z = -sc.z; a0.z = -a0.z;
 		k0 -= (float)((tilesizy[tspr->picnum]*tspr->yrepeat)<<2);
 	}
-	if (globalorientation&4) { m0.y = -m0.y; m1.y = -m1.y; a0.y = -a0.y; } //x-flipping
+	if (globalorientation&4) { sc.y = -sc.y; a0.y = -a0.y; } //x-flipping
 
 	f = ((float)tspr->xrepeat)/64*m->bscale;
-	m0.x *= f; m1.x *= f; a0.x *= f; f = -f;   // 20040610: backwards models aren't cool
-	m0.y *= f; m1.y *= f; a0.y *= f;
+	sc.x *= f; a0.x *= f; f = -f;   // 20040610: backwards models aren't cool
+	sc.y *= f; a0.y *= f;
 	f = ((float)tspr->yrepeat)/64*m->bscale;
-	m0.z *= f; m1.z *= f; a0.z *= f;
+	sc.z *= f; a0.z *= f;
 	
 	// floor aligned
 	k1 = tspr->y;
 	if((globalorientation&48)==32)
 	{
-		m0.z = -m0.z; m1.z = -m1.z; a0.z = -a0.z;
-		m0.y = -m0.y; m1.y = -m1.y; a0.y = -a0.y;
+		sc.z = -sc.z; a0.z = -a0.z;
+		sc.y = -sc.y; a0.y = -a0.y;
 		f = a0.x; a0.x = a0.z; a0.z = f;
 		k1 += (float)((tilesizy[tspr->picnum]*tspr->yrepeat)>>3);
 	}
 
 	f = (65536.0*512.0)/((float)xdimen*viewingrange);
 	g = 32.0/((float)xdimen*gxyaspect);
-	m0.y *= f; m1.y *= f; a0.y = (((float)(tspr->x-globalposx))/  1024.0 + a0.y)*f;
-	m0.x *=-f; m1.x *=-f; a0.x = (((float)(k1     -globalposy))/ -1024.0 + a0.x)*-f;
-	m0.z *= g; m1.z *= g; a0.z = (((float)(k0     -globalposz))/-16384.0 + a0.z)*g;
+	sc.y *= f; a0.y = (((float)(tspr->x-globalposx))/  1024.0 + a0.y)*f;
+	sc.x *=-f; a0.x = (((float)(k1     -globalposy))/ -1024.0 + a0.x)*-f;
+	sc.z *= g; a0.z = (((float)(k0     -globalposz))/-16384.0 + a0.z)*g;
 
 	k0 = ((float)(tspr->x-globalposx))*f/1024.0;
 	k1 = ((float)(tspr->y-globalposy))*f/1024.0;
@@ -989,6 +1184,14 @@ static int md3draw (md3model *m, spritetype *tspr)
     
 	//Mirrors
 	if (grhalfxdown10x < 0) { mat[0] = -mat[0]; mat[4] = -mat[4]; mat[8] = -mat[8]; mat[12] = -mat[12]; }
+
+	//scale the cached model-space vertices to Build coords
+	mat[0] *= sc.y; mat[1] *= sc.y; mat[ 2] *= sc.y;
+	mat[4] *= sc.z; mat[5] *= sc.z; mat[ 6] *= sc.z;
+	mat[8] *= sc.x; mat[9] *= sc.x; mat[10] *= sc.x;
+
+	bglMatrixMode(GL_MODELVIEW); //Let OpenGL (and perhaps hardware :) handle the matrix rotation
+	mat[3] = mat[7] = mat[11] = 0.f; mat[15] = 1.f; bglLoadMatrixf(mat);
 	
 //------------
 	//bit 10 is an ugly hack in game.c\animatesprites telling MD2SPRITE
@@ -1025,28 +1228,9 @@ static int md3draw (md3model *m, spritetype *tspr)
 	for(surfi=0;surfi<m->head.numsurfs;surfi++)
 	{
 		s = &m->head.surfs[surfi];
-		v0 = &s->xyzn[m->cframe*s->numverts];
-		v1 = &s->xyzn[m->nframe*s->numverts];
-#if 0
-		for(i=s->numverts-1;i>=0;i--) //interpolate (for animation) & transform to Build coords
-		{
-			fp.z = ((float)v0[i].x)*m0.x + ((float)v1[i].x)*m1.x;
-			fp.y = ((float)v0[i].z)*m0.z + ((float)v1[i].z)*m1.z;
-			fp.x = ((float)v0[i].y)*m0.y + ((float)v1[i].y)*m1.y;
-			vertlist[i].x = fp.x*mat[0] + fp.y*mat[4] + fp.z*mat[ 8] + mat[12];
-			vertlist[i].y = fp.x*mat[1] + fp.y*mat[5] + fp.z*mat[ 9] + mat[13];
-			vertlist[i].z = fp.x*mat[2] + fp.y*mat[6] + fp.z*mat[10] + mat[14];
-		}
-#else
-		for(i=s->numverts-1;i>=0;i--) //interpolate (for animation) & transform to Build coords
-		{
-			vertlist[i].z = ((float)v0[i].x)*m0.x + ((float)v1[i].x)*m1.x;
-			vertlist[i].y = ((float)v0[i].z)*m0.z + ((float)v1[i].z)*m1.z;
-			vertlist[i].x = ((float)v0[i].y)*m0.y + ((float)v1[i].y)*m1.y;
-		}
-		bglMatrixMode(GL_MODELVIEW); //Let OpenGL (and perhaps hardware :) handle the matrix rotation
-		mat[3] = mat[7] = mat[11] = 0.f; mat[15] = 1.f; bglLoadMatrixf(mat);
-#endif
+		vl = mdvcache_get((mdmodel *)m,surfi,cf,nf,qi,s->numverts,&hit);
+		if (!vl) continue;
+		if (!hit) md3interp(vl,&s->xyzn[cf*s->numverts],&s->xyzn[nf*s->numverts],w0,w1,s->numverts);
 
 
 #if 0
@@ -1067,15 +1251,18 @@ static int md3draw (md3model *m, spritetype *tspr)
 		if (!ptmh || !ptmh->glpic) continue;
 		bglBindTexture(GL_TEXTURE_2D, ptmh->glpic);
 
-		bglBegin(GL_TRIANGLES);
-		for(i=s->numtris-1;i>=0;i--)
-			for(j=0;j<3;j++)
-			{
-				k = s->tris[i].i[j];
-				bglTexCoord2f(s->uv[k].u,s->uv[k].v);
-				bglVertex3fv((float *)&vertlist[k]);
-			}
-		bglEnd();
+		ind = (GLuint *)getdrawbuf(s->numtris*3*sizeof(GLuint));
+		if (!ind) continue;
+		for(i=s->numtris-1,k=0;i>=0;i--)
+			for(j=0;j<3;j++) ind[k++] = (GLuint)s->tris[i].i[j];
+
+		bglEnableClientState(GL_VERTEX_ARRAY);
+		bglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		bglTexCoordPointer(2,GL_FLOAT,sizeof(md3uv_t),&s->uv[0].u);
+		bglVertexPointer(3,GL_FLOAT,sizeof(point3d),&vl[0].x);
+		bglDrawElements(GL_TRIANGLES,k,GL_UNSIGNED_INT,ind); polymost_drawcalls++;
+		bglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		bglDisableClientState(GL_VERTEX_ARRAY);
 	}
 
 //------------
@@ -1133,17 +1320,50 @@ static void md3free (md3model *m)
 //---------------------------------------- MD3 LIBRARY ENDS ----------------------------------------
 //--------------------------------------- VOX LIBRARY BEGINS ---------------------------------------
 
-	//For loading/conversion only
-static long xsiz, ysiz, zsiz, yzsiz, *vbit = 0; //vbit: 1 bit per voxel: 0=air,1=solid
-static float xpiv, ypiv, zpiv; //Might want to use more complex/unique names!
-static long *vcolhashead = 0, vcolhashsizm1;
+	//For loading/conversion only. Each voxel being converted gets its own
+	//voxbuild_t, so several can be meshed at once on the worker threads.
 typedef struct { long p, c, n; } voxcol_t;
-static voxcol_t *vcol = 0; long vnum = 0, vmax = 0;
 typedef struct { short x, y; } spoint2d;
-static spoint2d *shp;
-static long *shcntmal, *shcnt = 0, shcntp;
-static long mytexo5, *zbit, gmaxx, gmaxy, garea, pow2m1[33];
-static voxmodel *gvox;
+typedef struct
+{
+	unsigned char *buf; long leng, pos; //the whole voxel file, read up front
+	unsigned long randseed;
+	long xsiz, ysiz, zsiz, yzsiz, *vbit; //vbit: 1 bit per voxel: 0=air,1=solid
+	float xpiv, ypiv, zpiv;
+	long *vcolhashead, vcolhashsizm1;
+	voxcol_t *vcol; long vnum, vmax;
+	spoint2d *shp;
+	long *shcntmal, *shcnt, shcntp;
+	long mytexo5, *zbit, gmaxx, gmaxy, garea;
+	voxmodel *gvox;
+} voxbuild_t;
+static long pow2m1[33];
+
+#define VOXTYPE_VOX 1
+#define VOXTYPE_KVX 2
+#define VOXTYPE_KV6 3
+
+static long vbread (voxbuild_t *vb, void *buf, long leng)
+{
+	if (leng > vb->leng-vb->pos) leng = vb->leng-vb->pos;
+	if (leng <= 0) return(0);
+	memcpy(buf,&vb->buf[vb->pos],leng); vb->pos += leng;
+	return(leng);
+}
+
+static void vbseek (voxbuild_t *vb, long offs, long whence)
+{
+	if (whence == SEEK_CUR) offs += vb->pos;
+	else if (whence == SEEK_END) offs += vb->leng;
+	vb->pos = min(max(offs,0),vb->leng);
+}
+
+	//Same sequence as the MSVC rand(), but private to each conversion
+static long vbrand (voxbuild_t *vb)
+{
+	vb->randseed = vb->randseed*214013+2531011;
+	return((long)((vb->randseed>>16)&32767));
+}
 
 	//pitch must equal xsiz*4
 unsigned gloadtex (long *picbuf, long xsiz, long ysiz, long is8bit, long dapal)
@@ -1187,25 +1407,25 @@ unsigned gloadtex (long *picbuf, long xsiz, long ysiz, long is8bit, long dapal)
 	return(rtexid);
 }
 
-static long getvox (long x, long y, long z)
+static long getvox (voxbuild_t *vb, long x, long y, long z)
 {
-	z += x*yzsiz + y*zsiz;
-	for(x=vcolhashead[(z*214013)&vcolhashsizm1];x>=0;x=vcol[x].n)
-		if (vcol[x].p == z) return(vcol[x].c);
+	z += x*vb->yzsiz + y*vb->zsiz;
+	for(x=vb->vcolhashead[(z*214013)&vb->vcolhashsizm1];x>=0;x=vb->vcol[x].n)
+		if (vb->vcol[x].p == z) return(vb->vcol[x].c);
 	return(0x808080);
 }
 
-static void putvox (long x, long y, long z, long col)
+static void putvox (voxbuild_t *vb, long x, long y, long z, long col)
 {
-	if (vnum >= vmax) { vmax = max(vmax<<1,4096); vcol = (voxcol_t *)realloc(vcol,vmax*sizeof(voxcol_t)); }
+	if (vb->vnum >= vb->vmax) { vb->vmax = max(vb->vmax<<1,4096); vb->vcol = (voxcol_t *)realloc(vb->vcol,vb->vmax*sizeof(voxcol_t)); }
 
-	z += x*yzsiz + y*zsiz;
-	vcol[vnum].p = z; z = ((z*214013)&vcolhashsizm1);
-	vcol[vnum].c = col;
-	vcol[vnum].n = vcolhashead[z]; vcolhashead[z] = vnum++;
+	z += x*vb->yzsiz + y*vb->zsiz;
+	vb->vcol[vb->vnum].p = z; z = ((z*214013)&vb->vcolhashsizm1);
+	vb->vcol[vb->vnum].c = col;
+	vb->vcol[vb->vnum].n = vb->vcolhashead[z]; vb->vcolhashead[z] = vb->vnum++;
 }
 
-	//Set all bits in vbit from (x,y,z0) to (x,y,z1-1) to 0's
+	//Set all bits in vb->vbit from (x,y,z0) to (x,y,z1-1) to 0's
 static void setzrange0 (long *lptr, long z0, long z1)
 {
 	long z, ze;
@@ -1215,7 +1435,7 @@ static void setzrange0 (long *lptr, long z0, long z1)
 	lptr[z] &= (-1<<SHIFTMOD32(z1));
 }
 
-	//Set all bits in vbit from (x,y,z0) to (x,y,z1-1) to 1's
+	//Set all bits in vb->vbit from (x,y,z0) to (x,y,z1-1) to 1's
 static void setzrange1 (long *lptr, long z0, long z1)
 {
 	long z, ze;
@@ -1225,70 +1445,70 @@ static void setzrange1 (long *lptr, long z0, long z1)
 	lptr[z] |=~(-1<<SHIFTMOD32(z1));
 }
 
-static long isrectfree (long x0, long y0, long dx, long dy)
+static long isrectfree (voxbuild_t *vb, long x0, long y0, long dx, long dy)
 {
 #if 0
 	long i, j, x;
-	i = y0*gvox->mytexx + x0;
-	for(dy=0;dy;dy--,i+=gvox->mytexx)
-		for(x=0;x<dx;x++) { j = i+x; if (zbit[j>>5]&(1<<SHIFTMOD32(j))) return(0); }
+	i = y0*vb->gvox->mytexx + x0;
+	for(dy=0;dy;dy--,i+=vb->gvox->mytexx)
+		for(x=0;x<dx;x++) { j = i+x; if (vb->zbit[j>>5]&(1<<SHIFTMOD32(j))) return(0); }
 #else
 	long i, c, m, m1, x;
 
-	i = y0*mytexo5 + (x0>>5); dx += x0-1; c = (dx>>5) - (x0>>5);
+	i = y0*vb->mytexo5 + (x0>>5); dx += x0-1; c = (dx>>5) - (x0>>5);
 	m = ~pow2m1[x0&31]; m1 = pow2m1[(dx&31)+1];
-	if (!c) { for(m&=m1;dy;dy--,i+=mytexo5) if (zbit[i]&m) return(0); }
+	if (!c) { for(m&=m1;dy;dy--,i+=vb->mytexo5) if (vb->zbit[i]&m) return(0); }
 	else
-	{  for(;dy;dy--,i+=mytexo5)
+	{  for(;dy;dy--,i+=vb->mytexo5)
 		{
-			if (zbit[i]&m) return(0);
-			for(x=1;x<c;x++) if (zbit[i+x]) return(0);
-			if (zbit[i+x]&m1) return(0);
+			if (vb->zbit[i]&m) return(0);
+			for(x=1;x<c;x++) if (vb->zbit[i+x]) return(0);
+			if (vb->zbit[i+x]&m1) return(0);
 		}
 	}
 #endif
 	return(1);
 }
 
-static void setrect (long x0, long y0, long dx, long dy)
+static void setrect (voxbuild_t *vb, long x0, long y0, long dx, long dy)
 {
 #if 0
 	long i, j, y;
-	i = y0*gvox->mytexx + x0;
-	for(y=0;y<dy;y++,i+=gvox->mytexx)
-		for(x=0;x<dx;x++) { j = i+x; zbit[j>>5] |= (1<<SHIFTMOD32(j)); }
+	i = y0*vb->gvox->mytexx + x0;
+	for(y=0;y<dy;y++,i+=vb->gvox->mytexx)
+		for(x=0;x<dx;x++) { j = i+x; vb->zbit[j>>5] |= (1<<SHIFTMOD32(j)); }
 #else
 	long i, c, m, m1, x;
 
-	i = y0*mytexo5 + (x0>>5); dx += x0-1; c = (dx>>5) - (x0>>5);
+	i = y0*vb->mytexo5 + (x0>>5); dx += x0-1; c = (dx>>5) - (x0>>5);
 	m = ~pow2m1[x0&31]; m1 = pow2m1[(dx&31)+1];
-	if (!c) { for(m&=m1;dy;dy--,i+=mytexo5) zbit[i] |= m; }
+	if (!c) { for(m&=m1;dy;dy--,i+=vb->mytexo5) vb->zbit[i] |= m; }
 	else
-	{  for(;dy;dy--,i+=mytexo5)
+	{  for(;dy;dy--,i+=vb->mytexo5)
 		{
-			zbit[i] |= m;
-			for(x=1;x<c;x++) zbit[i+x] = -1;
-			zbit[i+x] |= m1;
+			vb->zbit[i] |= m;
+			for(x=1;x<c;x++) vb->zbit[i+x] = -1;
+			vb->zbit[i+x] |= m1;
 		}
 	}
 #endif
 }
 
-static void cntquad (long x0, long y0, long z0, long UNUSED(x1), long UNUSED(y1), long UNUSED(z1), long x2, long y2, long z2, long UNUSED(face))
+static void cntquad (voxbuild_t *vb, long x0, long y0, long z0, long UNUSED(x1), long UNUSED(y1), long UNUSED(z1), long x2, long y2, long z2, long UNUSED(face))
 {
 	long x, y, z;
 
 	x = labs(x2-x0); y = labs(y2-y0); z = labs(z2-z0);
 	if (!x) x = z; else if (!y) y = z;
 	if (x < y) { z = x; x = y; y = z; }
-	shcnt[y*shcntp+x]++;
-	if (x > gmaxx) gmaxx = x;
-	if (y > gmaxy) gmaxy = y;
-	garea += (x+(VOXBORDWIDTH<<1))*(y+(VOXBORDWIDTH<<1));
-	gvox->qcnt++;
+	vb->shcnt[y*vb->shcntp+x]++;
+	if (x > vb->gmaxx) vb->gmaxx = x;
+	if (y > vb->gmaxy) vb->gmaxy = y;
+	vb->garea += (x+(VOXBORDWIDTH<<1))*(y+(VOXBORDWIDTH<<1));
+	vb->gvox->qcnt++;
 }
 
-static void addquad (long x0, long y0, long z0, long x1, long y1, long z1, long x2, long y2, long z2, long face)
+static void addquad (voxbuild_t *vb, long x0, long y0, long z0, long x1, long y1, long z1, long x2, long y2, long z2, long face)
 {
 	long i, j, x, y, z, xx, yy, nx = 0, ny = 0, nz = 0, *lptr;
 	voxrect_t *qptr;
@@ -1296,8 +1516,8 @@ static void addquad (long x0, long y0, long z0, long x1, long y1, long z1, long
 	x = labs(x2-x0); y = labs(y2-y0); z = labs(z2-z0);
 	if (!x) { x = y; y = z; i = 0; } else if (!y) { y = z; i = 1; } else i = 2;
 	if (x < y) { z = x; x = y; y = z; i += 3; }
-	z = shcnt[y*shcntp+x]++;
-	lptr = &gvox->mytex[(shp[z].y+VOXBORDWIDTH)*gvox->mytexx+(shp[z].x+VOXBORDWIDTH)];
+	z = vb->shcnt[y*vb->shcntp+x]++;
+	lptr = &vb->gvox->mytex[(vb->shp[z].y+VOXBORDWIDTH)*vb->gvox->mytexx+(vb->shp[z].x+VOXBORDWIDTH)];
 	switch(face)
 	{
 		case 0: ny = y1; x2 = x0; x0 = x1; x1 = x2; break;
@@ -1307,7 +1527,7 @@ static void addquad (long x0, long y0, long z0, long x1, long y1, long z1, long
 		case 4: nx = x1; y2 = y0; y0 = y1; y1 = y2; x0++; x1++; x2++; break;
 		case 5: nx = x0; break;
 	}
-	for(yy=0;yy<y;yy++,lptr+=gvox->mytexx)
+	for(yy=0;yy<y;yy++,lptr+=vb->gvox->mytexx)
 		for(xx=0;xx<x;xx++)
 		{
 			switch(face)
@@ -1325,32 +1545,32 @@ static void addquad (long x0, long y0, long z0, long x1, long y1, long z1, long
 				case 5: if (i < 3) { ny = y0+xx;     nz = z0+yy;   } //left
 								  else { ny = y0+yy;     nz = z0+xx;   } break;
 			}
-			lptr[xx] = getvox(nx,ny,nz);
+			lptr[xx] = getvox(vb,nx,ny,nz);
 		}
 
 		//Extend borders horizontally
 	for(yy=VOXBORDWIDTH;yy<y+VOXBORDWIDTH;yy++)
 		for(xx=0;xx<VOXBORDWIDTH;xx++)
 		{
-			lptr = &gvox->mytex[(shp[z].y+yy)*gvox->mytexx+shp[z].x];
+			lptr = &vb->gvox->mytex[(vb->shp[z].y+yy)*vb->gvox->mytexx+vb->shp[z].x];
 			lptr[xx] = lptr[VOXBORDWIDTH]; lptr[xx+x+VOXBORDWIDTH] = lptr[x-1+VOXBORDWIDTH];
 		}
 		//Extend borders vertically
 	for(yy=0;yy<VOXBORDWIDTH;yy++)
 	{
-		memcpy(&gvox->mytex[(shp[z].y+yy)*gvox->mytexx+shp[z].x],
-				 &gvox->mytex[(shp[z].y+VOXBORDWIDTH)*gvox->mytexx+shp[z].x],
+		memcpy(&vb->gvox->mytex[(vb->shp[z].y+yy)*vb->gvox->mytexx+vb->shp[z].x],
+				 &vb->gvox->mytex[(vb->shp[z].y+VOXBORDWIDTH)*vb->gvox->mytexx+vb->shp[z].x],
 				 (x+(VOXBORDWIDTH<<1))<<2);
-		memcpy(&gvox->mytex[(shp[z].y+y+yy+VOXBORDWIDTH)*gvox->mytexx+shp[z].x],
-				 &gvox->mytex[(shp[z].y+y-1+VOXBORDWIDTH)*gvox->mytexx+shp[z].x],
+		memcpy(&vb->gvox->mytex[(vb->shp[z].y+y+yy+VOXBORDWIDTH)*vb->gvox->mytexx+vb->shp[z].x],
+				 &vb->gvox->mytex[(vb->shp[z].y+y-1+VOXBORDWIDTH)*vb->gvox->mytexx+vb->shp[z].x],
 				 (x+(VOXBORDWIDTH<<1))<<2);
 	}
 
-	qptr = &gvox->quad[gvox->qcnt];
+	qptr = &vb->gvox->quad[vb->gvox->qcnt];
 	qptr->v[0].x = x0; qptr->v[0].y = y0; qptr->v[0].z = z0;
 	qptr->v[1].x = x1; qptr->v[1].y = y1; qptr->v[1].z = z1;
 	qptr->v[2].x = x2; qptr->v[2].y = y2; qptr->v[2].z = z2;
-	for(j=0;j<3;j++) { qptr->v[j].u = shp[z].x+VOXBORDWIDTH; qptr->v[j].v = shp[z].y+VOXBORDWIDTH; }
+	for(j=0;j<3;j++) { qptr->v[j].u = vb->shp[z].x+VOXBORDWIDTH; qptr->v[j].v = vb->shp[z].y+VOXBORDWIDTH; }
 	if (i < 3) qptr->v[1].u += x; else qptr->v[1].v += y;
 	qptr->v[2].u += x; qptr->v[2].v += y;
 
@@ -1359,370 +1579,364 @@ static void addquad (long x0, long y0, long z0, long x1, long y1, long z1, long
 	qptr->v[3].x = qptr->v[0].x - qptr->v[1].x + qptr->v[2].x;
 	qptr->v[3].y = qptr->v[0].y - qptr->v[1].y + qptr->v[2].y;
 	qptr->v[3].z = qptr->v[0].z - qptr->v[1].z + qptr->v[2].z;
-	if (gvox->qfacind[face] < 0) gvox->qfacind[face] = gvox->qcnt;
-	gvox->qcnt++;
+	if (vb->gvox->qfacind[face] < 0) vb->gvox->qfacind[face] = vb->gvox->qcnt;
+	vb->gvox->qcnt++;
 
 }
 
-static long isolid (long x, long y, long z)
+static long isolid (voxbuild_t *vb, long x, long y, long z)
 {
-	if ((unsigned long)x >= (unsigned long)xsiz) return(0);
-	if ((unsigned long)y >= (unsigned long)ysiz) return(0);
-	if ((unsigned long)z >= (unsigned long)zsiz) return(0);
-	z += x*yzsiz + y*zsiz; return(vbit[z>>5]&(1<<SHIFTMOD32(z)));
+	if ((unsigned long)x >= (unsigned long)vb->xsiz) return(0);
+	if ((unsigned long)y >= (unsigned long)vb->ysiz) return(0);
+	if ((unsigned long)z >= (unsigned long)vb->zsiz) return(0);
+	z += x*vb->yzsiz + y*vb->zsiz; return(vb->vbit[z>>5]&(1<<SHIFTMOD32(z)));
 }
 
-static voxmodel *vox2poly ()
+static voxmodel *vox2poly (voxbuild_t *vb)
 {
 	long i, j, x, y, z, v, ov, oz = 0, cnt, sc, x0, y0, dx, dy, i0, i1, *bx0, *by0;
-	void (*daquad)(long, long, long, long, long, long, long, long, long, long);
+	void (*daquad)(voxbuild_t *, long, long, long, long, long, long, long, long, long, long);
 	coltype *pic;
 	unsigned char *cptr, ch;
 
-	gvox = (voxmodel *)malloc(sizeof(voxmodel)); if (!gvox) return(0);
-	memset(gvox,0,sizeof(voxmodel));
+	vb->gvox = (voxmodel *)malloc(sizeof(voxmodel)); if (!vb->gvox) return(0);
+	memset(vb->gvox,0,sizeof(voxmodel));
 
 		//x is largest dimension, y is 2nd largest dimension
-	x = xsiz; y = ysiz; z = zsiz;
+	x = vb->xsiz; y = vb->ysiz; z = vb->zsiz;
 	if ((x < y) && (x < z)) x = z; else if (y < z) y = z;
 	if (x < y) { z = x; x = y; y = z; }
-	shcntp = x; i = x*y*sizeof(long);
-	shcntmal = (long *)malloc(i); if (!shcntmal) { free(gvox); return(0); }
-	memset(shcntmal,0,i); shcnt = &shcntmal[-shcntp-1];
-	gmaxx = gmaxy = garea = 0;
+	vb->shcntp = x; i = x*y*sizeof(long);
+	vb->shcntmal = (long *)malloc(i); if (!vb->shcntmal) { free(vb->gvox); return(0); }
+	memset(vb->shcntmal,0,i); vb->shcnt = &vb->shcntmal[-vb->shcntp-1];
+	vb->gmaxx = vb->gmaxy = vb->garea = 0;
 
-	if (pow2m1[32] != -1) { for(i=0;i<32;i++) pow2m1[i] = (1<<i)-1; pow2m1[32] = -1; }
-	for(i=0;i<7;i++) gvox->qfacind[i] = -1;
+	for(i=0;i<7;i++) vb->gvox->qfacind[i] = -1;
 
-	i = ((max(ysiz,zsiz)+1)<<2);
-	bx0 = (long *)malloc(i<<1); if (!bx0) { free(gvox); return(0); }
+	i = ((max(vb->ysiz,vb->zsiz)+1)<<2);
+	bx0 = (long *)malloc(i<<1); if (!bx0) { free(vb->gvox); return(0); }
 	by0 = (long *)(((long)bx0)+i);
 
 	for(cnt=0;cnt<2;cnt++)
 	{
 		if (!cnt) daquad = cntquad;
 			  else daquad = addquad;
-		gvox->qcnt = 0;
+		vb->gvox->qcnt = 0;
 
-		memset(by0,-1,(max(ysiz,zsiz)+1)<<2); v = 0;
+		memset(by0,-1,(max(vb->ysiz,vb->zsiz)+1)<<2); v = 0;
 
 		for(i=-1;i<=1;i+=2)
-			for(y=0;y<ysiz;y++)
-				for(x=0;x<=xsiz;x++)
-					for(z=0;z<=zsiz;z++)
+			for(y=0;y<vb->ysiz;y++)
+				for(x=0;x<=vb->xsiz;x++)
+					for(z=0;z<=vb->zsiz;z++)
 					{
-						ov = v; v = (isolid(x,y,z) && (!isolid(x,y+i,z)));
+						ov = v; v = (isolid(vb,x,y,z) && (!isolid(vb,x,y+i,z)));
 						if ((by0[z] >= 0) && ((by0[z] != oz) || (v >= ov)))
-							{ daquad(bx0[z],y,by0[z],x,y,by0[z],x,y,z,i>=0); by0[z] = -1; }
+							{ daquad(vb,bx0[z],y,by0[z],x,y,by0[z],x,y,z,i>=0); by0[z] = -1; }
 						if (v > ov) oz = z; else if ((v < ov) && (by0[z] != oz)) { bx0[z] = x; by0[z] = oz; }
 					}
 
 		for(i=-1;i<=1;i+=2)
-			for(z=0;z<zsiz;z++)
-				for(x=0;x<=xsiz;x++)
-					for(y=0;y<=ysiz;y++)
+			for(z=0;z<vb->zsiz;z++)
+				for(x=0;x<=vb->xsiz;x++)
+					for(y=0;y<=vb->ysiz;y++)
 					{
-						ov = v; v = (isolid(x,y,z) && (!isolid(x,y,z-i)));
+						ov = v; v = (isolid(vb,x,y,z) && (!isolid(vb,x,y,z-i)));
 						if ((by0[y] >= 0) && ((by0[y] != oz) || (v >= ov)))
-							{ daquad(bx0[y],by0[y],z,x,by0[y],z,x,y,z,(i>=0)+2); by0[y] = -1; }
+							{ daquad(vb,bx0[y],by0[y],z,x,by0[y],z,x,y,z,(i>=0)+2); by0[y] = -1; }
 						if (v > ov) oz = y; else if ((v < ov) && (by0[y] != oz)) { bx0[y] = x; by0[y] = oz; }
 					}
 
 		for(i=-1;i<=1;i+=2)
-			for(x=0;x<xsiz;x++)
-				for(y=0;y<=ysiz;y++)
-					for(z=0;z<=zsiz;z++)
+			for(x=0;x<vb->xsiz;x++)
+				for(y=0;y<=vb->ysiz;y++)
+					for(z=0;z<=vb->zsiz;z++)
 					{
-						ov = v; v = (isolid(x,y,z) && (!isolid(x-i,y,z)));
+						ov = v; v = (isolid(vb,x,y,z) && (!isolid(vb,x-i,y,z)));
 						if ((by0[z] >= 0) && ((by0[z] != oz) || (v >= ov)))
-							{ daquad(x,bx0[z],by0[z],x,y,by0[z],x,y,z,(i>=0)+4); by0[z] = -1; }
+							{ daquad(vb,x,bx0[z],by0[z],x,y,by0[z],x,y,z,(i>=0)+4); by0[z] = -1; }
 						if (v > ov) oz = z; else if ((v < ov) && (by0[z] != oz)) { bx0[z] = y; by0[z] = oz; }
 					}
 
 		if (!cnt)
 		{
-			shp = (spoint2d *)malloc(gvox->qcnt*sizeof(spoint2d));
-			if (!shp) { free(bx0); free(gvox); return(0); }
+			vb->shp = (spoint2d *)malloc(vb->gvox->qcnt*sizeof(spoint2d));
+			if (!vb->shp) { free(bx0); free(vb->gvox); return(0); }
 
 			sc = 0;
-			for(y=gmaxy;y;y--)
-				for(x=gmaxx;x>=y;x--)
+			for(y=vb->gmaxy;y;y--)
+				for(x=vb->gmaxx;x>=y;x--)
 				{
-					i = shcnt[y*shcntp+x]; shcnt[y*shcntp+x] = sc; //shcnt changes from counter to head index
-					for(;i>0;i--) { shp[sc].x = x; shp[sc].y = y; sc++; }
+					i = vb->shcnt[y*vb->shcntp+x]; vb->shcnt[y*vb->shcntp+x] = sc; //vb->shcnt changes from counter to head index
+					for(;i>0;i--) { vb->shp[sc].x = x; vb->shp[sc].y = y; sc++; }
 				}
 
-			for(gvox->mytexx=32;gvox->mytexx<(gmaxx+(VOXBORDWIDTH<<1));gvox->mytexx<<=1);
-			for(gvox->mytexy=32;gvox->mytexy<(gmaxy+(VOXBORDWIDTH<<1));gvox->mytexy<<=1);
-			while (gvox->mytexx*gvox->mytexy*8 < garea*9) //This should be sufficient to fit most skins...
+			for(vb->gvox->mytexx=32;vb->gvox->mytexx<(vb->gmaxx+(VOXBORDWIDTH<<1));vb->gvox->mytexx<<=1);
+			for(vb->gvox->mytexy=32;vb->gvox->mytexy<(vb->gmaxy+(VOXBORDWIDTH<<1));vb->gvox->mytexy<<=1);
+			while (vb->gvox->mytexx*vb->gvox->mytexy*8 < vb->garea*9) //This should be sufficient to fit most skins...
 			{
 skindidntfit:;
-				if (gvox->mytexx <= gvox->mytexy) gvox->mytexx <<= 1; else gvox->mytexy <<= 1;
+				if (vb->gvox->mytexx <= vb->gvox->mytexy) vb->gvox->mytexx <<= 1; else vb->gvox->mytexy <<= 1;
 			}
-			mytexo5 = (gvox->mytexx>>5);
+			vb->mytexo5 = (vb->gvox->mytexx>>5);
 
-			i = (((gvox->mytexx*gvox->mytexy+31)>>5)<<2);
-			zbit = (long *)malloc(i); if (!zbit) { free(bx0); free(gvox); free(shp); return(0); }
-			memset(zbit,0,i);
+			i = (((vb->gvox->mytexx*vb->gvox->mytexy+31)>>5)<<2);
+			vb->zbit = (long *)malloc(i); if (!vb->zbit) { free(bx0); free(vb->gvox); free(vb->shp); return(0); }
+			memset(vb->zbit,0,i);
 
-			v = gvox->mytexx*gvox->mytexy;
+			v = vb->gvox->mytexx*vb->gvox->mytexy;
 			for(z=0;z<sc;z++)
 			{
-				dx = shp[z].x+(VOXBORDWIDTH<<1); dy = shp[z].y+(VOXBORDWIDTH<<1); i = v;
+				dx = vb->shp[z].x+(VOXBORDWIDTH<<1); dy = vb->shp[z].y+(VOXBORDWIDTH<<1); i = v;
 				do
 				{
 #if (VOXUSECHAR != 0)
-					x0 = (((rand()&32767)*(min(gvox->mytexx,255)-dx))>>15);
-					y0 = (((rand()&32767)*(min(gvox->mytexy,255)-dy))>>15);
+					x0 = (((vbrand(vb)&32767)*(min(vb->gvox->mytexx,255)-dx))>>15);
+					y0 = (((vbrand(vb)&32767)*(min(vb->gvox->mytexy,255)-dy))>>15);
 #else
-					x0 = (((rand()&32767)*(gvox->mytexx+1-dx))>>15);
-					y0 = (((rand()&32767)*(gvox->mytexy+1-dy))>>15);
+					x0 = (((vbrand(vb)&32767)*(vb->gvox->mytexx+1-dx))>>15);
+					y0 = (((vbrand(vb)&32767)*(vb->gvox->mytexy+1-dy))>>15);
 #endif
 					i--;
 					if (i < 0) //Time-out! Very slow if this happens... but at least it still works :P
 					{
-						free(zbit);
+						free(vb->zbit);
 
-							//Re-generate shp[].x/y (box sizes) from shcnt (now head indices) for next pass :/
+							//Re-generate vb->shp[].x/y (box sizes) from vb->shcnt (now head indices) for next pass :/
 						j = 0;
-						for(y=gmaxy;y;y--)
-							for(x=gmaxx;x>=y;x--)
+						for(y=vb->gmaxy;y;y--)
+							for(x=vb->gmaxx;x>=y;x--)
 							{
-								i = shcnt[y*shcntp+x];
-								for(;j<i;j++) { shp[j].x = x0; shp[j].y = y0; }
+								i = vb->shcnt[y*vb->shcntp+x];
+								for(;j<i;j++) { vb->shp[j].x = x0; vb->shp[j].y = y0; }
 								x0 = x; y0 = y;
 							}
-						for(;j<sc;j++) { shp[j].x = x0; shp[j].y = y0; }
+						for(;j<sc;j++) { vb->shp[j].x = x0; vb->shp[j].y = y0; }
 
 						goto skindidntfit;
 					}
-				} while (!isrectfree(x0,y0,dx,dy));
-				while ((y0) && (isrectfree(x0,y0-1,dx,1))) y0--;
-				while ((x0) && (isrectfree(x0-1,y0,1,dy))) x0--;
-				setrect(x0,y0,dx,dy);
-				shp[z].x = x0; shp[z].y = y0; //Overwrite size with top-left location
+				} while (!isrectfree(vb,x0,y0,dx,dy));
+				while ((y0) && (isrectfree(vb,x0,y0-1,dx,1))) y0--;
+				while ((x0) && (isrectfree(vb,x0-1,y0,1,dy))) x0--;
+				setrect(vb,x0,y0,dx,dy);
+				vb->shp[z].x = x0; vb->shp[z].y = y0; //Overwrite size with top-left location
 			}
 
-			gvox->quad = (voxrect_t *)malloc(gvox->qcnt*sizeof(voxrect_t));
-			if (!gvox->quad) { free(zbit); free(shp); free(bx0); free(gvox); return(0); }
+			vb->gvox->quad = (voxrect_t *)malloc(vb->gvox->qcnt*sizeof(voxrect_t));
+			if (!vb->gvox->quad) { free(vb->zbit); free(vb->shp); free(bx0); free(vb->gvox); return(0); }
 
-			gvox->mytex = (long *)malloc(gvox->mytexx*gvox->mytexy*sizeof(long));
-			if (!gvox->mytex) { free(gvox->quad); free(zbit); free(shp); free(bx0); free(gvox); return(0); }
+			vb->gvox->mytex = (long *)malloc(vb->gvox->mytexx*vb->gvox->mytexy*sizeof(long));
+			if (!vb->gvox->mytex) { free(vb->gvox->quad); free(vb->zbit); free(vb->shp); free(bx0); free(vb->gvox); return(0); }
 		}
 	}
-	free(shp); free(zbit); free(bx0);
-	return(gvox);
+	free(vb->shp); free(vb->zbit); free(bx0);
+	return(vb->gvox);
 }
 
-static long loadvox (const char *filnam)
+static long loadvox (voxbuild_t *vb)
 {
-	long i, j, k, x, y, z, pal[256], fil;
+	long i, j, k, x, y, z, pal[256];
 	unsigned char c[3], *tbuf;
 
-	fil = kopen4load((char *)filnam,0); if (fil < 0) return(-1);
-	kread(fil,&xsiz,4); xsiz = B_LITTLE32(xsiz);
-	kread(fil,&ysiz,4); ysiz = B_LITTLE32(ysiz);
-	kread(fil,&zsiz,4); zsiz = B_LITTLE32(zsiz);
-	xpiv = ((float)xsiz)*.5;
-	ypiv = ((float)ysiz)*.5;
-	zpiv = ((float)zsiz)*.5;
-
-	klseek(fil,-768,SEEK_END);
+	vbread(vb,&vb->xsiz,4); vb->xsiz = B_LITTLE32(vb->xsiz);
+	vbread(vb,&vb->ysiz,4); vb->ysiz = B_LITTLE32(vb->ysiz);
+	vbread(vb,&vb->zsiz,4); vb->zsiz = B_LITTLE32(vb->zsiz);
+	vb->xpiv = ((float)vb->xsiz)*.5;
+	vb->ypiv = ((float)vb->ysiz)*.5;
+	vb->zpiv = ((float)vb->zsiz)*.5;
+
+	vbseek(vb,-768,SEEK_END);
 	for(i=0;i<256;i++)
-		{ kread(fil,c,3); pal[i] = (((long)c[0])<<18)+(((long)c[1])<<10)+(((long)c[2])<<2)+(i<<24); }
+		{ vbread(vb,c,3); pal[i] = (((long)c[0])<<18)+(((long)c[1])<<10)+(((long)c[2])<<2)+(i<<24); }
 	pal[255] = -1;
 
-	vcolhashsizm1 = 8192-1;
-	vcolhashead = (long *)malloc((vcolhashsizm1+1)*sizeof(long)); if (!vcolhashead) { kclose(fil); return(-1); }
-	memset(vcolhashead,-1,(vcolhashsizm1+1)*sizeof(long));
+	vb->vcolhashsizm1 = 8192-1;
+	vb->vcolhashead = (long *)malloc((vb->vcolhashsizm1+1)*sizeof(long)); if (!vb->vcolhashead) return(-1);
+	memset(vb->vcolhashead,-1,(vb->vcolhashsizm1+1)*sizeof(long));
 
-	yzsiz = ysiz*zsiz; i = ((xsiz*yzsiz+31)>>3);
-	vbit = (long *)malloc(i); if (!vbit) { kclose(fil); return(-1); }
-	memset(vbit,0,i);
+	vb->yzsiz = vb->ysiz*vb->zsiz; i = ((vb->xsiz*vb->yzsiz+31)>>3);
+	vb->vbit = (long *)malloc(i); if (!vb->vbit) return(-1);
+	memset(vb->vbit,0,i);
 
-	tbuf = (unsigned char *)malloc(zsiz*sizeof(char)); if (!tbuf) { kclose(fil); return(-1); }
+	tbuf = (unsigned char *)malloc(vb->zsiz*sizeof(char)); if (!tbuf) return(-1);
 
-	klseek(fil,12,SEEK_SET);
-	for(x=0;x<xsiz;x++)
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	vbseek(vb,12,SEEK_SET);
+	for(x=0;x<vb->xsiz;x++)
+		for(y=0,j=x*vb->yzsiz;y<vb->ysiz;y++,j+=vb->zsiz)
 		{
-			kread(fil,tbuf,zsiz);
-			for(z=zsiz-1;z>=0;z--)
-				{ if (tbuf[z] != 255) { i = j+z; vbit[i>>5] |= (1<<SHIFTMOD32(i)); } }
+			vbread(vb,tbuf,vb->zsiz);
+			for(z=vb->zsiz-1;z>=0;z--)
+				{ if (tbuf[z] != 255) { i = j+z; vb->vbit[i>>5] |= (1<<SHIFTMOD32(i)); } }
 		}
 
-	klseek(fil,12,SEEK_SET);
-	for(x=0;x<xsiz;x++)
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	vbseek(vb,12,SEEK_SET);
+	for(x=0;x<vb->xsiz;x++)
+		for(y=0,j=x*vb->yzsiz;y<vb->ysiz;y++,j+=vb->zsiz)
 		{
-			kread(fil,tbuf,zsiz);
-			for(z=0;z<zsiz;z++)
+			vbread(vb,tbuf,vb->zsiz);
+			for(z=0;z<vb->zsiz;z++)
 			{
 				if (tbuf[z] == 255) continue;
-				if ((!x) || (!y) || (!z) || (x == xsiz-1) || (y == ysiz-1) || (z == zsiz-1))
-					{ putvox(x,y,z,pal[tbuf[z]]); continue; }
+				if ((!x) || (!y) || (!z) || (x == vb->xsiz-1) || (y == vb->ysiz-1) || (z == vb->zsiz-1))
+					{ putvox(vb,x,y,z,pal[tbuf[z]]); continue; }
 				k = j+z;
-				if ((!(vbit[(k-yzsiz)>>5]&(1<<SHIFTMOD32(k-yzsiz)))) ||
-					 (!(vbit[(k+yzsiz)>>5]&(1<<SHIFTMOD32(k+yzsiz)))) ||
-					 (!(vbit[(k- zsiz)>>5]&(1<<SHIFTMOD32(k- zsiz)))) ||
-					 (!(vbit[(k+ zsiz)>>5]&(1<<SHIFTMOD32(k+ zsiz)))) ||
-					 (!(vbit[(k-    1)>>5]&(1<<SHIFTMOD32(k-    1)))) ||
-					 (!(vbit[(k+    1)>>5]&(1<<SHIFTMOD32(k+    1)))))
-					{ putvox(x,y,z,pal[tbuf[z]]); continue; }
+				if ((!(vb->vbit[(k-vb->yzsiz)>>5]&(1<<SHIFTMOD32(k-vb->yzsiz)))) ||
+					 (!(vb->vbit[(k+vb->yzsiz)>>5]&(1<<SHIFTMOD32(k+vb->yzsiz)))) ||
+					 (!(vb->vbit[(k- vb->zsiz)>>5]&(1<<SHIFTMOD32(k- vb->zsiz)))) ||
+					 (!(vb->vbit[(k+ vb->zsiz)>>5]&(1<<SHIFTMOD32(k+ vb->zsiz)))) ||
+					 (!(vb->vbit[(k-    1)>>5]&(1<<SHIFTMOD32(k-    1)))) ||
+					 (!(vb->vbit[(k+    1)>>5]&(1<<SHIFTMOD32(k+    1)))))
+					{ putvox(vb,x,y,z,pal[tbuf[z]]); continue; }
 			}
 		}
 
-	free(tbuf); kclose(fil); return(0);
+	free(tbuf); return(0);
 }
 
-static long loadkvx (const char *filnam)
+static long loadkvx (voxbuild_t *vb)
 {
-	long i, j, k, x, y, z, pal[256], z0, z1, mip1leng, ysizp1, fil;
+	long i, j, k, x, y, z, pal[256], z0, z1, mip1leng, ysizp1;
 	unsigned short *xyoffs;
 	unsigned char c[3], *tbuf, *cptr;
 
-	fil = kopen4load((char *)filnam,0); if (fil < 0) return(-1);
-	kread(fil,&mip1leng,4); mip1leng = B_LITTLE32(mip1leng);
-	kread(fil,&xsiz,4);     xsiz = B_LITTLE32(xsiz);
-	kread(fil,&ysiz,4);     ysiz = B_LITTLE32(ysiz);
-	kread(fil,&zsiz,4);     zsiz = B_LITTLE32(zsiz);
-	kread(fil,&i,4); xpiv = ((float)B_LITTLE32(i))/256.0;
-	kread(fil,&i,4); ypiv = ((float)B_LITTLE32(i))/256.0;
-	kread(fil,&i,4); zpiv = ((float)B_LITTLE32(i))/256.0;
-	klseek(fil,(xsiz+1)<<2,SEEK_CUR);
-	ysizp1 = ysiz+1;
-	i = xsiz*ysizp1*sizeof(short);
-	xyoffs = (unsigned short *)malloc(i); if (!xyoffs) { kclose(fil); return(-1); }
-	kread(fil,xyoffs,i); for (i=i/sizeof(short)-1; i>=0; i--) xyoffs[i] = B_LITTLE16(xyoffs[i]);
-
-	klseek(fil,-768,SEEK_END);
+	vbread(vb,&mip1leng,4); mip1leng = B_LITTLE32(mip1leng);
+	vbread(vb,&vb->xsiz,4);     vb->xsiz = B_LITTLE32(vb->xsiz);
+	vbread(vb,&vb->ysiz,4);     vb->ysiz = B_LITTLE32(vb->ysiz);
+	vbread(vb,&vb->zsiz,4);     vb->zsiz = B_LITTLE32(vb->zsiz);
+	vbread(vb,&i,4); vb->xpiv = ((float)B_LITTLE32(i))/256.0;
+	vbread(vb,&i,4); vb->ypiv = ((float)B_LITTLE32(i))/256.0;
+	vbread(vb,&i,4); vb->zpiv = ((float)B_LITTLE32(i))/256.0;
+	vbseek(vb,(vb->xsiz+1)<<2,SEEK_CUR);
+	ysizp1 = vb->ysiz+1;
+	i = vb->xsiz*ysizp1*sizeof(short);
+	xyoffs = (unsigned short *)malloc(i); if (!xyoffs) return(-1);
+	vbread(vb,xyoffs,i); for (i=i/sizeof(short)-1; i>=0; i--) xyoffs[i] = B_LITTLE16(xyoffs[i]);
+
+	vbseek(vb,-768,SEEK_END);
 	for(i=0;i<256;i++)
-		{ kread(fil,c,3); pal[i] = B_LITTLE32((((long)c[0])<<18)+(((long)c[1])<<10)+(((long)c[2])<<2)+(i<<24)); }
+		{ vbread(vb,c,3); pal[i] = B_LITTLE32((((long)c[0])<<18)+(((long)c[1])<<10)+(((long)c[2])<<2)+(i<<24)); }
 
-	yzsiz = ysiz*zsiz; i = ((xsiz*yzsiz+31)>>3);
-	vbit = (long *)malloc(i); if (!vbit) { free(xyoffs); kclose(fil); return(-1); }
-	memset(vbit,0,i);
+	vb->yzsiz = vb->ysiz*vb->zsiz; i = ((vb->xsiz*vb->yzsiz+31)>>3);
+	vb->vbit = (long *)malloc(i); if (!vb->vbit) { free(xyoffs); return(-1); }
+	memset(vb->vbit,0,i);
 
-	for(vcolhashsizm1=4096;vcolhashsizm1<(mip1leng>>1);vcolhashsizm1<<=1); vcolhashsizm1--; //approx to numvoxs!
-	vcolhashead = (long *)malloc((vcolhashsizm1+1)*sizeof(long)); if (!vcolhashead) { free(xyoffs); kclose(fil); return(-1); }
-	memset(vcolhashead,-1,(vcolhashsizm1+1)*sizeof(long));
+	for(vb->vcolhashsizm1=4096;vb->vcolhashsizm1<(mip1leng>>1);vb->vcolhashsizm1<<=1); vb->vcolhashsizm1--; //approx to numvoxs!
+	vb->vcolhashead = (long *)malloc((vb->vcolhashsizm1+1)*sizeof(long)); if (!vb->vcolhashead) { free(xyoffs); return(-1); }
+	memset(vb->vcolhashead,-1,(vb->vcolhashsizm1+1)*sizeof(long));
 
-	klseek(fil,28+((xsiz+1)<<2)+((ysizp1*xsiz)<<1),SEEK_SET);
+	vbseek(vb,28+((vb->xsiz+1)<<2)+((ysizp1*vb->xsiz)<<1),SEEK_SET);
 
-	i = kfilelength(fil)-ktell(fil);
-	tbuf = (unsigned char *)malloc(i); if (!tbuf) { free(xyoffs); kclose(fil); return(-1); }
-	kread(fil,tbuf,i); kclose(fil);
+	i = vb->leng-vb->pos;
+	tbuf = (unsigned char *)malloc(i); if (!tbuf) { free(xyoffs); return(-1); }
+	vbread(vb,tbuf,i);
 
 	cptr = tbuf;
-	for(x=0;x<xsiz;x++) //Set surface voxels to 1 else 0
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	for(x=0;x<vb->xsiz;x++) //Set surface voxels to 1 else 0
+		for(y=0,j=x*vb->yzsiz;y<vb->ysiz;y++,j+=vb->zsiz)
 		{
 			i = xyoffs[x*ysizp1+y+1] - xyoffs[x*ysizp1+y]; if (!i) continue;
 			z1 = 0;
 			while (i)
 			{
 				z0 = (long)cptr[0]; k = (long)cptr[1]; cptr += 3;
-				if (!(cptr[-1]&16)) setzrange1(vbit,j+z1,j+z0);
+				if (!(cptr[-1]&16)) setzrange1(vb->vbit,j+z1,j+z0);
 				i -= k+3; z1 = z0+k;
-				setzrange1(vbit,j+z0,j+z1);
-				for(z=z0;z<z1;z++) putvox(x,y,z,pal[*cptr++]);
+				setzrange1(vb->vbit,j+z0,j+z1);
+				for(z=z0;z<z1;z++) putvox(vb,x,y,z,pal[*cptr++]);
 			}
 		}
 
 	free(tbuf); free(xyoffs); return(0);
 }
 
-static long loadkv6 (const char *filnam)
+static long loadkv6 (voxbuild_t *vb)
 {
-	long i, j, x, y, z, numvoxs, z0, z1, fil;
+	long i, j, x, y, z, numvoxs, z0, z1;
 	unsigned short *ylen;
 	unsigned char c[8];
 
-	fil = kopen4load((char *)filnam,0); if (fil < 0) return(-1);
-	kread(fil,&i,4); if (B_LITTLE32(i) != 0x6c78764b) { kclose(fil); return(-1); } //Kvxl
-	kread(fil,&xsiz,4);    xsiz = B_LITTLE32(xsiz);
-	kread(fil,&ysiz,4);    ysiz = B_LITTLE32(ysiz);
-	kread(fil,&zsiz,4);    zsiz = B_LITTLE32(zsiz);
-	kread(fil,&i,4);       xpiv = (float)(B_LITTLE32(i));
-	kread(fil,&i,4);       ypiv = (float)(B_LITTLE32(i));
-	kread(fil,&i,4);       zpiv = (float)(B_LITTLE32(i));
-	kread(fil,&numvoxs,4); numvoxs = B_LITTLE32(numvoxs);
-
-	ylen = (unsigned short *)malloc(xsiz*ysiz*sizeof(short));
-	if (!ylen) { kclose(fil); return(-1); }
-
-	klseek(fil,32+(numvoxs<<3)+(xsiz<<2),SEEK_SET);
-	kread(fil,ylen,xsiz*ysiz*sizeof(short)); for (i=xsiz*ysiz-1; i>=0; i--) ylen[i] = B_LITTLE16(ylen[i]);
-	klseek(fil,32,SEEK_SET);
-
-	yzsiz = ysiz*zsiz; i = ((xsiz*yzsiz+31)>>3);
-	vbit = (long *)malloc(i); if (!vbit) { free(ylen); kclose(fil); return(-1); }
-	memset(vbit,0,i);
-
-	for(vcolhashsizm1=4096;vcolhashsizm1<numvoxs;vcolhashsizm1<<=1); vcolhashsizm1--;
-	vcolhashead = (long *)malloc((vcolhashsizm1+1)*sizeof(long)); if (!vcolhashead) { free(ylen); kclose(fil); return(-1); }
-	memset(vcolhashead,-1,(vcolhashsizm1+1)*sizeof(long));
-
-	for(x=0;x<xsiz;x++)
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	vbread(vb,&i,4); if (B_LITTLE32(i) != 0x6c78764b) return(-1); //Kvxl
+	vbread(vb,&vb->xsiz,4);    vb->xsiz = B_LITTLE32(vb->xsiz);
+	vbread(vb,&vb->ysiz,4);    vb->ysiz = B_LITTLE32(vb->ysiz);
+	vbread(vb,&vb->zsiz,4);    vb->zsiz = B_LITTLE32(vb->zsiz);
+	vbread(vb,&i,4);       vb->xpiv = (float)(B_LITTLE32(i));
+	vbread(vb,&i,4);       vb->ypiv = (float)(B_LITTLE32(i));
+	vbread(vb,&i,4);       vb->zpiv = (float)(B_LITTLE32(i));
+	vbread(vb,&numvoxs,4); numvoxs = B_LITTLE32(numvoxs);
+
+	ylen = (unsigned short *)malloc(vb->xsiz*vb->ysiz*sizeof(short));
+	if (!ylen) return(-1);
+
+	vbseek(vb,32+(numvoxs<<3)+(vb->xsiz<<2),SEEK_SET);
+	vbread(vb,ylen,vb->xsiz*vb->ysiz*sizeof(short)); for (i=vb->xsiz*vb->ysiz-1; i>=0; i--) ylen[i] = B_LITTLE16(ylen[i]);
+	vbseek(vb,32,SEEK_SET);
+
+	vb->yzsiz = vb->ysiz*vb->zsiz; i = ((vb->xsiz*vb->yzsiz+31)>>3);
+	vb->vbit = (long *)malloc(i); if (!vb->vbit) { free(ylen); return(-1); }
+	memset(vb->vbit,0,i);
+
+	for(vb->vcolhashsizm1=4096;vb->vcolhashsizm1<numvoxs;vb->vcolhashsizm1<<=1); vb->vcolhashsizm1--;
+	vb->vcolhashead = (long *)malloc((vb->vcolhashsizm1+1)*sizeof(long)); if (!vb->vcolhashead) { free(ylen); return(-1); }
+	memset(vb->vcolhashead,-1,(vb->vcolhashsizm1+1)*sizeof(long));
+
+	for(x=0;x<vb->xsiz;x++)
+		for(y=0,j=x*vb->yzsiz;y<vb->ysiz;y++,j+=vb->zsiz)
 		{
-			z1 = zsiz;
-			for(i=ylen[x*ysiz+y];i>0;i--)
+			z1 = vb->zsiz;
+			for(i=ylen[x*vb->ysiz+y];i>0;i--)
 			{
-				kread(fil,c,8); //b,g,r,a,z_lo,z_hi,vis,dir
+				vbread(vb,c,8); //b,g,r,a,z_lo,z_hi,vis,dir
 				z0 = B_LITTLE16(*(unsigned short *)&c[4]);
-				if (!(c[6]&16)) setzrange1(vbit,j+z1,j+z0);
-				vbit[(j+z0)>>5] |= (1<<SHIFTMOD32(j+z0));
-				putvox(x,y,z0,B_LITTLE32(*(long *)&c[0])&0xffffff);
+				if (!(c[6]&16)) setzrange1(vb->vbit,j+z1,j+z0);
+				vb->vbit[(j+z0)>>5] |= (1<<SHIFTMOD32(j+z0));
+				putvox(vb,x,y,z0,B_LITTLE32(*(long *)&c[0])&0xffffff);
 				z1 = z0+1;
 			}
 		}
-	free(ylen); kclose(fil); return(0);
+	free(ylen); return(0);
 }
 
 #if 0
 	//While this code works, it's way too slow and can only cause trouble.
-static long loadvxl (const char *filnam)
+static long loadvxl (voxbuild_t *vb)
 {
-	long i, j, x, y, z, fil;
+	long i, j, x, y, z;
 	unsigned char *v, *vbuf;
 
-	fil = kopen4load((char *)filnam,0); if (fil < 0) return(-1);
-	kread(fil,&i,4);
-	kread(fil,&xsiz,4);
-	kread(fil,&ysiz,4);
-	if ((i != 0x09072000) || (xsiz != 1024) || (ysiz != 1024)) { kclose(fil); return(-1); }
-	zsiz = 256;
-	klseek(fil,96,SEEK_CUR); //skip pos&orient
-	xpiv = ((float)xsiz)*.5;
-	ypiv = ((float)ysiz)*.5;
-	zpiv = ((float)zsiz)*.5;
-
-	yzsiz = ysiz*zsiz; i = ((xsiz*yzsiz+31)>>3);
-	vbit = (long *)malloc(i); if (!vbit) { kclose(fil); return(-1); }
-	memset(vbit,-1,i);
-
-	vcolhashsizm1 = 1048576-1;
-	vcolhashead = (long *)malloc((vcolhashsizm1+1)*sizeof(long)); if (!vcolhashead) { kclose(fil); return(-1); }
-	memset(vcolhashead,-1,(vcolhashsizm1+1)*sizeof(long));
+	vbread(vb,&i,4);
+	vbread(vb,&vb->xsiz,4);
+	vbread(vb,&vb->ysiz,4);
+	if ((i != 0x09072000) || (vb->xsiz != 1024) || (vb->ysiz != 1024)) return(-1);
+	vb->zsiz = 256;
+	vbseek(vb,96,SEEK_CUR); //skip pos&orient
+	vb->xpiv = ((float)vb->xsiz)*.5;
+	vb->ypiv = ((float)vb->ysiz)*.5;
+	vb->zpiv = ((float)vb->zsiz)*.5;
+
+	vb->yzsiz = vb->ysiz*vb->zsiz; i = ((vb->xsiz*vb->yzsiz+31)>>3);
+	vb->vbit = (long *)malloc(i); if (!vb->vbit) return(-1);
+	memset(vb->vbit,-1,i);
+
+	vb->vcolhashsizm1 = 1048576-1;
+	vb->vcolhashead = (long *)malloc((vb->vcolhashsizm1+1)*sizeof(long)); if (!vb->vcolhashead) return(-1);
+	memset(vb->vcolhashead,-1,(vb->vcolhashsizm1+1)*sizeof(long));
 
 		//Allocate huge buffer and load rest of file into it...
-	i = kfilelength(fil)-ktell(fil);
-	vbuf = (unsigned char *)malloc(i); if (!vbuf) { kclose(fil); return(-1); }
-	kread(fil,vbuf,i);
-	kclose(fil);
+	i = vb->leng-vb->pos;
+	vbuf = (unsigned char *)malloc(i); if (!vbuf) return(-1);
+	vbread(vb,vbuf,i);
 
 	v = vbuf;
-	for(y=0;y<ysiz;y++)
-		for(x=0,j=y*zsiz;x<xsiz;x++,j+=yzsiz)
+	for(y=0;y<vb->ysiz;y++)
+		for(x=0,j=y*vb->zsiz;x<vb->xsiz;x++,j+=vb->yzsiz)
 		{
 			z = 0;
 			while (1)
 			{
-				setzrange0(vbit,j+z,j+v[1]);
-				for(z=v[1];z<=v[2];z++) putvox(x,y,z,(*(long *)&v[(z-v[1]+1)<<2])&0xffffff);
+				setzrange0(vb->vbit,j+z,j+v[1]);
+				for(z=v[1];z<=v[2];z++) putvox(vb,x,y,z,(*(long *)&v[(z-v[1]+1)<<2])&0xffffff);
 				if (!v[0]) break; z = v[2]-v[1]-v[0]+2; v += v[0]*4;
-				for(z+=v[3];z<v[3];z++) putvox(x,y,z,(*(long *)&v[(z-v[3])<<2])&0xffffff);
+				for(z+=v[3];z<v[3];z++) putvox(vb,x,y,z,(*(long *)&v[(z-v[3])<<2])&0xffffff);
 			}
 			v += ((((long)v[2])-((long)v[1])+2)<<2);
 		}
@@ -1739,43 +1953,411 @@ void voxfree (voxmodel *m)
 	free(m);
 }
 
-voxmodel *voxload (const char *filnam)
+	//Converts the voxel file in vb->buf into a model. Only touches vb, so any
+	//number of these can run at once.
+static voxmodel *voxconvert (voxbuild_t *vb, long type)
 {
-	long i, is8bit, ret;
-	voxmodel *vm;
+	long ret;
+	voxmodel *vm = 0;
 
-	i = strlen(filnam)-4; if (i < 0) return(0);
-		  if (!Bstrcasecmp(&filnam[i],".vox")) { ret = loadvox(filnam); is8bit = 1; }
-	else if (!Bstrcasecmp(&filnam[i],".kvx")) { ret = loadkvx(filnam); is8bit = 1; }
-	else if (!Bstrcasecmp(&filnam[i],".kv6")) { ret = loadkv6(filnam); is8bit = 0; }
- //else if (!Bstrcasecmp(&filnam[i],".vxl")) { ret = loadvxl(filnam); is8bit = 0; }
-	else return(0);
-	if (ret >= 0) vm = vox2poly(); else vm = 0;
+	switch(type)
+	{
+		case VOXTYPE_VOX: ret = loadvox(vb); break;
+		case VOXTYPE_KVX: ret = loadkvx(vb); break;
+		case VOXTYPE_KV6: ret = loadkv6(vb); break;
+		default: ret = -1; break;
+	}
+	if (ret >= 0) vm = vox2poly(vb);
 	if (vm)
 	{
-		vm->mdnum = 1; //VOXel model id
-		vm->scale = vm->bscale = 1.0;
-		vm->xsiz = xsiz; vm->ysiz = ysiz; vm->zsiz = zsiz;
-		vm->xpiv = xpiv; vm->ypiv = ypiv; vm->zpiv = zpiv;
-		vm->is8bit = is8bit;
-
-		vm->texid = (unsigned int *)calloc(MAXPALOOKUPS,sizeof(unsigned int));
-		if (!vm->texid) { voxfree(vm); vm = 0; }
-	}
-	if (shcntmal) { free(shcntmal); shcntmal = 0; }
-	if (vbit) { free(vbit); vbit = 0; }
-	if (vcol) { free(vcol); vcol = 0; vnum = 0; vmax = 0; }
-	if (vcolhashead) { free(vcolhashead); vcolhashead = 0; }
+		vm->xsiz = vb->xsiz; vm->ysiz = vb->ysiz; vm->zsiz = vb->zsiz;
+		vm->xpiv = vb->xpiv; vm->ypiv = vb->ypiv; vm->zpiv = vb->zpiv;
+	}
+	if (vb->shcntmal) { free(vb->shcntmal); vb->shcntmal = 0; }
+	if (vb->vbit) { free(vb->vbit); vb->vbit = 0; }
+	if (vb->vcol) { free(vb->vcol); vb->vcol = 0; vb->vnum = 0; vb->vmax = 0; }
+	if (vb->vcolhashead) { free(vb->vcolhashead); vb->vcolhashead = 0; }
+	return(vm);
+}
+
+static long voxtype (const char *filnam)
+{
+	long i;
+
+	i = strlen(filnam)-4; if (i < 0) return(0);
+	if (!Bstrcasecmp(&filnam[i],".vox")) return(VOXTYPE_VOX);
+	if (!Bstrcasecmp(&filnam[i],".kvx")) return(VOXTYPE_KVX);
+	if (!Bstrcasecmp(&filnam[i],".kv6")) return(VOXTYPE_KV6);
+ //if (!Bstrcasecmp(&filnam[i],".vxl")) return(VOXTYPE_VXL);
+	return(0);
+}
+
+static long voxreadfile (voxbuild_t *vb, const char *filnam)
+{
+	long fil;
+
+	memset(vb,0,sizeof(voxbuild_t));
+	vb->randseed = 1;
+	if (pow2m1[32] != -1) { long i; for(i=0;i<32;i++) pow2m1[i] = (1<<i)-1; pow2m1[32] = -1; }
+
+	fil = kopen4load((char *)filnam,0); if (fil < 0) return(-1);
+	vb->leng = kfilelength(fil);
+	vb->buf = (unsigned char *)malloc(max(vb->leng,1)); if (!vb->buf) { kclose(fil); return(-1); }
+	vb->leng = kread(fil,vb->buf,vb->leng); if (vb->leng < 0) vb->leng = 0;
+	kclose(fil);
+	return(0);
+}
+
+	//Fills in what the renderer needs that the conversion (or cache) doesn't
+static voxmodel *voxfinish (voxmodel *vm, long type)
+{
+	vm->mdnum = 1; //VOXel model id
+	vm->scale = vm->bscale = 1.0;
+	vm->is8bit = (type != VOXTYPE_KV6);
+
+	vm->texid = (unsigned int *)calloc(MAXPALOOKUPS,sizeof(unsigned int));
+	if (!vm->texid) { voxfree(vm); vm = 0; }
+	return(vm);
+}
+
+//------------------------------------------ VOXEL CACHE -------------------------------------------
+/*
+ Converted models are kept in voxel.cache next to texture.cache, keyed on the
+ CRC-32, length and type of the voxel file, so an edited file simply misses.
+ New entries are appended; the index is rebuilt by walking the file the
+ first time a voxel is loaded.
+
+ STORAGE (voxel.cache):
+   signature  "PolymostVoxCach"
+   version    VOXCACHEVER
+   ENTRIES...
+     crc       int32		Key: CRC-32 of the voxel file
+     leng      int32		     its length
+     type      int32		     and VOXTYPE_*
+     size      int32		Bytes of entry data that follow
+     xsiz, ysiz, zsiz    int32
+     xpiv, ypiv, zpiv    float
+     qcnt, qfacind[7]    int32
+     mytexx, mytexy      int32
+     quads     uint16[qcnt*4*5]	x,y,z,u,v of each corner
+     texels    int32[mytexx*mytexy]
+
+ All multibyte values are little-endian.
+ */
+
+typedef struct voxcacheent_t
+{
+	unsigned long crc;
+	long leng, type, size, offset;
+	struct voxcacheent_t *next;
+} voxcacheent_t;
+#define VOXCACHEHASHSIZ 256
+static voxcacheent_t *voxcachehead[VOXCACHEHASHSIZ];
+static const char *VOXCACHEFILE = "voxel.cache";
+static const int VOXCACHEVER = 0;
+static int voxcacheloaded = 0, voxcachereplace = 0;
+
+static voxcacheent_t *voxcache_find (unsigned long crc, long leng, long type)
+{
+	voxcacheent_t *e;
+
+	for(e=voxcachehead[crc&(VOXCACHEHASHSIZ-1)];e;e=e->next)
+		if (e->crc == crc && e->leng == leng && e->type == type) return(e);
+	return(0);
+}
+
+static void voxcache_add (unsigned long crc, long leng, long type, long size, long offset)
+{
+	voxcacheent_t *e;
+
+	e = voxcache_find(crc,leng,type);
+	if (!e)
+	{
+		e = (voxcacheent_t *)malloc(sizeof(voxcacheent_t)); if (!e) return;
+		e->crc = crc; e->leng = leng; e->type = type;
+		e->next = voxcachehead[crc&(VOXCACHEHASHSIZ-1)];
+		voxcachehead[crc&(VOXCACHEHASHSIZ-1)] = e;
+	}
+	e->size = size; e->offset = offset;
+}
+
+static void voxcache_unload (void)
+{
+	voxcacheent_t *e, *ne;
+	long i;
+
+	for(i=0;i<VOXCACHEHASHSIZ;i++)
+	{
+		for(e=voxcachehead[i];e;e=ne) { ne = e->next; free(e); }
+		voxcachehead[i] = 0;
+	}
+	voxcacheloaded = voxcachereplace = 0;
+}
+
+static void voxcache_load (void)
+{
+	FILE *fh;
+	int8_t sig[16];
+	const int8_t voxsig[16] = { 'P','o','l','y','m','o','s','t','V','o','x','C','a','c','h',VOXCACHEVER };
+	int32_t hdr[4];
+	long offset, filelen;
+
+	if (voxcacheloaded) return;
+	voxcacheloaded = 1;
+
+	fh = fopen(VOXCACHEFILE, "rb");
+	if (!fh) { voxcachereplace = 1; return; }
+	if (fread(sig, 16, 1, fh) != 1 || memcmp(sig, voxsig, 16)) { fclose(fh); voxcachereplace = 1; return; }
+	fseek(fh, 0, SEEK_END); filelen = ftell(fh);
+
+	for(offset=16;offset<filelen;offset+=16+hdr[3])
+	{
+		if (fseek(fh, offset, SEEK_SET) || fread(hdr, 4, 4, fh) != 4) { voxcachereplace = 1; break; }
+		hdr[3] = B_LITTLE32(hdr[3]);
+		if (hdr[3] < 0 || hdr[3] > filelen-offset-16) { voxcachereplace = 1; break; } //truncated entry
+		voxcache_add((unsigned long)(uint32_t)B_LITTLE32(hdr[0]),B_LITTLE32(hdr[1]),B_LITTLE32(hdr[2]),hdr[3],offset+16);
+	}
+	fclose(fh);
+
+	if (voxcachereplace)
+	{
+		initprintf("Voxel cache: corrupt %s detected, cache will be replaced\n", VOXCACHEFILE);
+		voxcache_unload();
+		voxcacheloaded = voxcachereplace = 1;
+	}
+}
+
+static voxmodel *voxcache_get (unsigned long crc, long leng, long type)
+{
+	voxcacheent_t *e;
+	voxmodel *vm;
+	FILE *fh;
+	unsigned char *buf;
+	int32_t *ip;
+	uint16_t *sp;
+	long i, j, numquads, numtexels;
+
+	voxcache_load();
+	e = voxcache_find(crc,leng,type); if (!e || e->size < 16*4) return(0);
+
+	buf = (unsigned char *)malloc(e->size); if (!buf) return(0);
+	fh = fopen(VOXCACHEFILE, "rb");
+	if (!fh || fseek(fh, e->offset, SEEK_SET) || fread(buf, e->size, 1, fh) != 1)
+		{ if (fh) fclose(fh); free(buf); return(0); }
+	fclose(fh);
+
+	vm = (voxmodel *)calloc(1,sizeof(voxmodel));
+	if (!vm) { free(buf); return(0); }
+
+	ip = (int32_t *)buf;
+	for(i=0;i<16;i++) ip[i] = B_LITTLE32(ip[i]);
+	vm->xsiz = ip[0]; vm->ysiz = ip[1]; vm->zsiz = ip[2];
+	vm->xpiv = ((float *)ip)[3]; vm->ypiv = ((float *)ip)[4]; vm->zpiv = ((float *)ip)[5];
+	vm->qcnt = ip[6];
+	for(i=0;i<7;i++) vm->qfacind[i] = ip[7+i];
+	vm->mytexx = ip[14]; vm->mytexy = ip[15];
+
+	numquads = vm->qcnt; numtexels = vm->mytexx*vm->mytexy;
+	if (numquads < 0 || numtexels <= 0 || e->size != 16*4 + numquads*4*5*2 + numtexels*4)
+		{ free(buf); free(vm); return(0); }
+		//voxdraw indexes the quads by these, so a damaged entry gets converted afresh
+	for(i=0;i<7;i++)
+		if (vm->qfacind[i] < -1 || vm->qfacind[i] >= numquads) { free(buf); free(vm); return(0); }
+
+	vm->quad = (voxrect_t *)malloc(max(numquads,1)*sizeof(voxrect_t));
+	vm->mytex = (long *)malloc(numtexels*sizeof(long));
+	if (!vm->quad || !vm->mytex) { free(buf); voxfree(vm); return(0); }
+
+	sp = (uint16_t *)&ip[16];
+	for(i=0;i<numquads;i++)
+		for(j=0;j<4;j++,sp+=5)
+		{
+			vm->quad[i].v[j].x = B_LITTLE16(sp[0]); vm->quad[i].v[j].y = B_LITTLE16(sp[1]);
+			vm->quad[i].v[j].z = B_LITTLE16(sp[2]);
+			vm->quad[i].v[j].u = B_LITTLE16(sp[3]); vm->quad[i].v[j].v = B_LITTLE16(sp[4]);
+		}
+		//texels are stored as they sit in memory on a little-endian machine,
+		//which is how the loaders lay out their colours on every machine
+	ip = (int32_t *)sp;
+	for(i=0;i<numtexels;i++) vm->mytex[i] = (long)(uint32_t)ip[i];
+
+	free(buf);
 	return(vm);
 }
 
+static void voxcache_put (unsigned long crc, long leng, long type, voxmodel *vm)
+{
+	FILE *fh;
+	unsigned char *buf;
+	int32_t *ip;
+	uint16_t *sp;
+	long i, j, size, offset;
+	const int8_t voxsig[16] = { 'P','o','l','y','m','o','s','t','V','o','x','C','a','c','h',VOXCACHEVER };
+
+	voxcache_load();
+
+	size = 16*4 + vm->qcnt*4*5*2 + vm->mytexx*vm->mytexy*4;
+	buf = (unsigned char *)malloc(16+size); if (!buf) return;
+
+	ip = (int32_t *)buf;
+	ip[0] = (int32_t)crc; ip[1] = leng; ip[2] = type; ip[3] = size;
+	ip[4] = vm->xsiz; ip[5] = vm->ysiz; ip[6] = vm->zsiz;
+	((float *)ip)[7] = vm->xpiv; ((float *)ip)[8] = vm->ypiv; ((float *)ip)[9] = vm->zpiv;
+	ip[10] = vm->qcnt;
+	for(i=0;i<7;i++) ip[11+i] = vm->qfacind[i];
+	ip[18] = vm->mytexx; ip[19] = vm->mytexy;
+	for(i=0;i<20;i++) ip[i] = B_LITTLE32(ip[i]);
+
+	sp = (uint16_t *)&ip[20];
+	for(i=0;i<vm->qcnt;i++)
+		for(j=0;j<4;j++,sp+=5)
+		{
+			sp[0] = B_LITTLE16(vm->quad[i].v[j].x); sp[1] = B_LITTLE16(vm->quad[i].v[j].y);
+			sp[2] = B_LITTLE16(vm->quad[i].v[j].z);
+			sp[3] = B_LITTLE16(vm->quad[i].v[j].u); sp[4] = B_LITTLE16(vm->quad[i].v[j].v);
+		}
+	ip = (int32_t *)sp;
+	for(i=vm->mytexx*vm->mytexy-1;i>=0;i--) ip[i] = (int32_t)vm->mytex[i];
+
+	if (voxcachereplace)
+	{
+		fh = fopen(VOXCACHEFILE, "wb");
+		if (fh && fwrite(voxsig, 16, 1, fh) != 1) { fclose(fh); fh = 0; }
+		if (fh) voxcachereplace = 0;
+	}
+	else fh = fopen(VOXCACHEFILE, "ab");
+	if (!fh) { free(buf); return; }
+
+	fseek(fh, 0, SEEK_END);
+	offset = ftell(fh);
+	if (fwrite(buf, 16+size, 1, fh) == 1) voxcache_add(crc,leng,type,size,offset+16);
+	fclose(fh);
+	free(buf);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+voxmodel *voxload (const char *filnam)
+{
+	long type;
+	unsigned long crc;
+	voxbuild_t vb;
+	voxmodel *vm = 0;
+
+	type = voxtype(filnam); if (!type) return(0);
+	if (voxreadfile(&vb,filnam) < 0) { if (vb.buf) free(vb.buf); return(0); }
+
+	crc = crc32once(vb.buf,vb.leng);
+	if (glusevoxcache) vm = voxcache_get(crc,vb.leng,type);
+	if (!vm)
+	{
+		vm = voxconvert(&vb,type);
+		if (vm && glusevoxcache) voxcache_put(crc,vb.leng,type,vm);
+	}
+	free(vb.buf);
+
+	if (vm) vm = voxfinish(vm,type);
+	return(vm);
+}
+
+	//Voxels named by .def files are queued up by qloadkvx() and converted in
+	//one go once the file has been parsed, spread over the worker threads.
+typedef struct
+{
+	long voxindex, type, cached;
+	unsigned long crc;
+	voxbuild_t vb;
+	voxmodel *vm;
+} voxjob_t;
+static voxjob_t *voxjobs = 0;
+static long voxnumjobs = 0, voxmaxjobs = 0;
+
+void voxloadqueue (long voxindex, const char *filnam)
+{
+	voxjob_t *j;
+	long i, type;
+
+	if (voxmodels[voxindex]) { voxfree(voxmodels[voxindex]); voxmodels[voxindex] = NULL; }
+	for(i=0;i<voxnumjobs;i++) //a later definition replaces an earlier one
+		if (voxjobs[i].voxindex == voxindex) voxjobs[i].voxindex = -1;
+
+	type = voxtype(filnam); if (!type) return;
+
+	if (voxnumjobs >= voxmaxjobs)
+	{
+		i = max(voxmaxjobs<<1,64);
+		j = (voxjob_t *)realloc(voxjobs,i*sizeof(voxjob_t));
+		if (!j) { initprintf("ERROR: Not enough memory to queue voxel \"%s\"!\n",filnam); return; }
+		voxjobs = j; voxmaxjobs = i;
+	}
+
+	j = &voxjobs[voxnumjobs];
+	if (voxreadfile(&j->vb,filnam) < 0) { if (j->vb.buf) free(j->vb.buf); return; }
+	j->voxindex = voxindex; j->type = type; j->cached = 0; j->vm = 0;
+	j->crc = crc32once(j->vb.buf,j->vb.leng);
+	voxnumjobs++;
+}
+
+static void voxloadjobs (void *arg, long start, long end)
+{
+	voxjob_t *j;
+
+	for(;start<end;start++)
+	{
+		j = &voxjobs[start];
+		if (j->voxindex >= 0 && !j->vm) j->vm = voxconvert(&j->vb,j->type);
+	}
+}
+
+void voxloadflush (void)
+{
+	voxjob_t *j;
+	long i, numconverted = 0, numcached = 0, t;
+
+	if (!voxnumjobs) return;
+	t = getticks();
+
+	if (glusevoxcache)
+		for(i=0;i<voxnumjobs;i++)
+		{
+			j = &voxjobs[i]; if (j->voxindex < 0) continue;
+			j->vm = voxcache_get(j->crc,j->vb.leng,j->type);
+			if (j->vm) j->cached = 1;
+		}
+
+	runworkers(voxloadjobs,NULL,voxnumjobs,1);
+
+	for(i=0;i<voxnumjobs;i++)
+	{
+		j = &voxjobs[i];
+		if (j->voxindex >= 0)
+		{
+			if (!j->vm) initprintf("Failure converting voxel %d to polygons\n",j->voxindex);
+			else
+			{
+				if (j->cached) numcached++;
+				else { numconverted++; if (glusevoxcache) voxcache_put(j->crc,j->vb.leng,j->type,j->vm); }
+				voxmodels[j->voxindex] = voxfinish(j->vm,j->type);
+			}
+		}
+		else if (j->vm) voxfree(j->vm);
+		free(j->vb.buf);
+	}
+
+	initprintf("Loaded %d voxel models (%d from %s) in %dms\n",
+		numconverted+numcached, numcached, VOXCACHEFILE, getticks()-t);
+
+	free(voxjobs); voxjobs = 0;
+	voxnumjobs = voxmaxjobs = 0;
+}
+
 	//Draw voxel model as perfect cubes
 int voxdraw (voxmodel *m, spritetype *tspr)
 {
-	point3d fp, m0, a0;
+	point3d m0, a0;
 	long i, j, k, fi, *lptr, xx, yy, zz;
 	float ru, rv, uhack[2], vhack[2], phack[2], clut[6] = {1,1,1,1,1,1}; //1.02,1.02,0.94,1.06,0.98,0.98};
-	float f, g, k0, k1, k2, k3, k4, k5, k6, k7, mat[16], omat[16], pc[4];
+	float f, g, k0, k1, k2, k3, k4, k5, k6, k7, mat[16], omat[16], pc[4], col[4], *tv;
 	vert_t *vptr;
 
 	//updateanimation((md2model *)m,tspr);
@@ -1878,31 +2460,48 @@ int voxdraw (voxmodel *m, spritetype *tspr)
 
 	if (!m->texid[globalpal]) m->texid[globalpal] = gloadtex(m->mytex,m->mytexx,m->mytexy,m->is8bit,globalpal);
 					 else bglBindTexture(GL_TEXTURE_2D,m->texid[globalpal]);
-	bglBegin(GL_QUADS);
-	for(i=0,fi=0;i<m->qcnt;i++)
+		//u,v,r,g,b,a,x,y,z per vertex, drawn as one array of quads
+	tv = (float *)getdrawbuf(m->qcnt*4*9*sizeof(float));
+	if (tv)
 	{
-		if (i == m->qfacind[fi]) { f = clut[fi++]; bglColor4f(pc[0]*f,pc[1]*f,pc[2]*f,pc[3]*f); }
-		vptr = &m->quad[i].v[0];
+		col[0] = pc[0]; col[1] = pc[1]; col[2] = pc[2]; col[3] = pc[3];
+		for(i=0,fi=0,k=0;i<m->qcnt;i++)
+		{
+			if (i == m->qfacind[fi]) { f = clut[fi++]; col[0] = pc[0]*f; col[1] = pc[1]*f; col[2] = pc[2]*f; col[3] = pc[3]*f; }
+			vptr = &m->quad[i].v[0];
 
-		xx = vptr[0].x+vptr[2].x;
-		yy = vptr[0].y+vptr[2].y;
-		zz = vptr[0].z+vptr[2].z;
+			xx = vptr[0].x+vptr[2].x;
+			yy = vptr[0].y+vptr[2].y;
+			zz = vptr[0].z+vptr[2].z;
 
-		for(j=0;j<4;j++)
-		{
+			for(j=0;j<4;j++,k+=9)
+			{
 #if (VOXBORDWIDTH == 0)
-			bglTexCoord2f(((float)vptr[j].u)*ru+uhack[vptr[j].u!=vptr[0].u],
-							  ((float)vptr[j].v)*rv+vhack[vptr[j].v!=vptr[0].v]);
+				tv[k+0] = ((float)vptr[j].u)*ru+uhack[vptr[j].u!=vptr[0].u];
+				tv[k+1] = ((float)vptr[j].v)*rv+vhack[vptr[j].v!=vptr[0].v];
 #else
-			bglTexCoord2f(((float)vptr[j].u)*ru,((float)vptr[j].v)*rv);
+				tv[k+0] = ((float)vptr[j].u)*ru;
+				tv[k+1] = ((float)vptr[j].v)*rv;
 #endif
-			fp.x = ((float)vptr[j].x) - phack[xx>vptr[j].x*2] + phack[xx<vptr[j].x*2];
-			fp.y = ((float)vptr[j].y) - phack[yy>vptr[j].y*2] + phack[yy<vptr[j].y*2];
-			fp.z = ((float)vptr[j].z) - phack[zz>vptr[j].z*2] + phack[zz<vptr[j].z*2];
-			bglVertex3fv((float *)&fp);
+				tv[k+2] = col[0]; tv[k+3] = col[1]; tv[k+4] = col[2]; tv[k+5] = col[3];
+				tv[k+6] = ((float)vptr[j].x) - phack[xx>vptr[j].x*2] + phack[xx<vptr[j].x*2];
+				tv[k+7] = ((float)vptr[j].y) - phack[yy>vptr[j].y*2] + phack[yy<vptr[j].y*2];
+				tv[k+8] = ((float)vptr[j].z) - phack[zz>vptr[j].z*2] + phack[zz<vptr[j].z*2];
+			}
 		}
+
+		bglEnableClientState(GL_VERTEX_ARRAY);
+		bglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		bglEnableClientState(GL_COLOR_ARRAY);
+		bglTexCoordPointer(2,GL_FLOAT,9*sizeof(float),&tv[0]);
+		bglColorPointer(4,GL_FLOAT,9*sizeof(float),&tv[2]);
+		bglVertexPointer(3,GL_FLOAT,9*sizeof(float),&tv[6]);
+		bglDrawArrays(GL_QUADS,0,m->qcnt*4); polymost_drawcalls++;
+		bglDisableClientState(GL_COLOR_ARRAY);
+		bglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		bglDisableClientState(GL_VERTEX_ARRAY);
+		bglColor4f(col[0],col[1],col[2],col[3]);
 	}
-	bglEnd();
 
 //------------
 	bglDisable(GL_CULL_FACE);
@@ -1944,13 +2543,6 @@ int mddraw (spritetype *tspr)
 	mdanim_t *anim;
 	mdmodel *vm;
 
-	if (maxmodelverts > allocmodelverts)
-	{
-		point3d *vl = (point3d *)realloc(vertlist,sizeof(point3d)*maxmodelverts);
-		if (!vl) { initprintf("ERROR: Not enough memory to allocate %d vertices!\n",maxmodelverts); return 0; }
-		vertlist = vl; allocmodelverts = maxmodelverts;
-	}
-
 	vm = models[tile2model[tspr->picnum].modelid];
 	if (vm->mdnum == 1) { return voxdraw((voxmodel *)vm,tspr); }
 	if (vm->mdnum == 2) { return md2draw((md2model *)vm,tspr); }
@@ -1960,6 +2552,7 @@ int mddraw (spritetype *tspr)
 
 void mdfree (mdmodel *vm)
 {
+	mdvcache_flush(vm);
 	if (vm->mdnum == 1) { voxfree((voxmodel *)vm); return; }
 	if (vm->mdnum == 2) { md2free((md2model *)vm); return; }
 	if (vm->mdnum == 3) { md3free((md3model *)vm); return; }
@@ -178,6 +178,8 @@ void freeallmodels ();
 void clearskins ();
 void voxfree (voxmodel *m);
 voxmodel *voxload (const char *filnam);
+void voxloadqueue (long voxindex, const char *filnam);
+void voxloadflush (void);
 int voxdraw (voxmodel *m, spritetype *tspr);
 
 void mdinit ();
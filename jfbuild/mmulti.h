@@ -39,6 +39,7 @@ void checktimeout();
 void dosendpackets (long other, int timeout);
 
 void resettimeout();
+void keepalive(long other); // heard from other outside getpacket()
 
 void kickplayer(long other); // arrange fake quit packet
 
@@ -6,6 +6,7 @@
 #include "dnSnapshot.h"
 #include "dnMulti.h"
 #include "dnAPI.h"
+#include "dnTransport.h"
 
 #ifdef KSFORBUILD
 # include "baselayer.h"
@@ -86,6 +87,12 @@ void resettimeout(void) {
 	memset( lastreadtims, 0, sizeof( lastreadtims ) );
 }
 
+void keepalive(long other) {
+	if ( other >= 0 && other < MAXPLAYERS ) {
+		lastreadtims[other] = getticks();
+	}
+}
+
 void checktimeout(void) {
 	int i;
 	long now;
@@ -292,8 +299,82 @@ long initmultiplayers_steam(steam_id_t my_steam_id, int num_steam_players, steam
     return 0;
 }
 
+/*
+ Steam-less games over the UDP transport:
+    -net [-n0|-n1] [-pPORT] <player> <player> ...
+ Every machine lists the same players in the same order, host first, each as host[:port],
+ and writes its own slot as '*'. -p picks the local port, 23513 by default.
+ */
 long initmultiplayersparms(long argc, char **argv) {
-    return 0;
+    steam_id_t ids[MAXPLAYERS];
+    static lobby_info_t lobby;
+    long i, n = 0, me = -1, mode = 1;
+    
+    if (argc < 1) {
+        return 0;
+    }
+    
+    for (i = 0; i < argc; i++) {
+        if (argv[i][0] != '-' && argv[i][0] != '/') {
+            continue;
+        }
+        if (argv[i][1] == 'n' || argv[i][1] == 'N') {
+            mode = (argv[i][2] == '0') ? 0 : 1;
+        } else if (argv[i][1] == 'p' || argv[i][1] == 'P') {
+            dnNetSetUDPPort(atoi(&argv[i][2]));
+        }
+    }
+    
+    if (!dnNetSetTransport(NET_TRANSPORT_UDP)) {
+        printf("Could not open UDP port %d\n", dnNetGetUDPPort());
+        return 0;
+    }
+    
+    memset(&lobby, 0, sizeof(lobby));
+    for (i = 0; i < argc; i++) {
+        if (argv[i][0] == '-' || argv[i][0] == '/') {
+            continue;
+        }
+        if (n >= (long)(sizeof(lobby.players) / sizeof(lobby.players[0]))) {
+            printf("Too many players, ignoring %s\n", argv[i]);
+            continue;
+        }
+        if (!strcmp(argv[i], "*")) {
+            me = n;
+            ids[n] = dnNetMyID();
+        } else if (!(ids[n] = dnNetParseAddress(argv[i]))) {
+            printf("Can't resolve player address %s\n", argv[i]);
+            break;
+        }
+        n++;
+    }
+    
+    if (i < argc || me < 0 || n < 2) {
+        if (i >= argc) {
+            printf("-net needs at least two players, one of them '*'\n");
+        }
+        dnNetSetTransport(NET_TRANSPORT_STEAM);
+        return 0;
+    }
+    
+    lobby.version = MPVERSION;
+    lobby.session_token = 0x4e455430;
+    lobby.num_players = n;
+    for (i = 0; i < n; i++) {
+        lobby.players[i].id = ids[i];
+        sprintf(lobby.players[i].name, "Player %ld", i + 1);
+        printf("Player %ld: %s%s\n", i, dnNetFormatID(ids[i]), i == me ? " (me)" : "");
+    }
+    lobby.owner = &lobby.players[0];
+    lobby.players[0].owner = 1;
+    
+    initmultiplayers_steam(ids[me], n, ids, mode);
+    if (!dnEnterMultiMode(&lobby)) {
+        initmultiplayers_reset();
+        dnNetSetTransport(NET_TRANSPORT_STEAM);
+        return 0;
+    }
+    return 1;
 }
 
 long initmultiplayerscycle(void) {
@@ -436,12 +517,12 @@ void sendpacket (long other, char *bufptr, long messleng) {
 void netcleanup() {
     int i;
     
-    CSTEAM_DrainQueue();
+    dnNetDrain();
     
 #if 1
     for ( i = 0; i < MAXPLAYERS; i++ ) {
         if (otherid[i] != 0) {
-            CSTEAM_CloseP2P(otherid[i]);
+            dnNetClosePeer(otherid[i]);
             otherid[i] = 0;
         }
     }
@@ -143,6 +143,7 @@ long glusetexcompr = 1;
 long gltexcomprquality = 0;	// 0 = fast, 1 = slow and pretty, 2 = very slow and pretty
 long gltexfiltermode = 5;   // GL_LINEAR_MIPMAP_LINEAR
 long glusetexcache = 1;
+long glusevoxcache = 1;
 long glmultisample = 0, glnvmultisamplehint = 0;
 long gltexmaxsize = 0;      // 0 means autodetection on first run
 long gltexmiplevel = 0;		// discards this many mipmap levels
@@ -151,6 +152,11 @@ long glpolygonmode = 0;     // 0:GL_FILL,1:GL_LINE,2:GL_POINT //FUK
 static GLuint polymosttext = 0;
 // used for fogcalc
 float fogresult, fogresult2, fogcol[4], fogtable[4*MAXPALOOKUPS];
+typedef struct {
+	GLint mode;
+	float col[4], density, start, end;
+} fogstate;
+static fogstate curfog;	// what calc_and_apply_fog last gave GL
 #endif
 
 #if defined(USE_MSC_PRAGMAS)
@@ -346,7 +352,7 @@ void gltexapplyprops (void)
 	iter = PTIterNew();
 	while ((pth = PTIterNext(iter)) != 0) {
 		for (i = 0; i < PTHPIC_SIZE; i++) {
-			if (pth->pic[i] == 0 || pth->pic[i]->glpic == 0) {
+			if (pth->pic[i] == 0 || pth->pic[i]->glpic == 0 || pth->pic[i]->atlas) {
 				continue;
 			}
 			bglBindTexture(GL_TEXTURE_2D,pth->pic[i]->glpic);
@@ -370,6 +376,7 @@ void gltexapplyprops (void)
 		}
 	}
 	PTIterFree(iter);
+	PTAtlasApplyParameters();
     
 	{
 		int j;
@@ -443,6 +450,7 @@ void polymost_glinit()
     else
         bglHint(GL_FOG_HINT, GL_DONT_CARE);
     bglFogi(GL_FOG_MODE, GL_EXP2);
+    curfog.mode = GL_EXP2;
     
 	bglBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
@@ -463,6 +471,7 @@ static void fogcalc_old(int32_t shade, int32_t vis)
 {
     float f;
     bglFogi(GL_FOG_MODE, GL_EXP2);
+    curfog.mode = GL_EXP2;
     if (r_usenewshading==1)
     {
         f = 0.9f * shade;
@@ -501,6 +510,7 @@ static inline void fogcalc(int32_t tile, int32_t shade, int32_t vis, int32_t pal
     {
         float combvis = (float)globalvisibility * (uint8_t)(vis+16);
         bglFogi(GL_FOG_MODE, GL_LINEAR);
+        curfog.mode = GL_LINEAR;
         if (combvis == 0)
         {
             if (shade > 0)
@@ -527,13 +537,17 @@ void calc_and_apply_fog(int32_t tile, int32_t shade, int32_t vis, int32_t pal)
         return;
     fogcalc(tile, shade, vis, pal);
     bglFogfv(GL_FOG_COLOR, fogcol);
+    Bmemcpy(curfog.col, fogcol, sizeof(fogcol));
     if (r_usenewshading!=2)
     {
         bglFogf(GL_FOG_DENSITY, fogresult);
+        curfog.density = fogresult;
         return;
     }
     bglFogf(GL_FOG_START, fogresult);
     bglFogf(GL_FOG_END, fogresult2);
+    curfog.start = fogresult;
+    curfog.end = fogresult2;
 }
 void calc_and_apply_fog_factor(int32_t tile, int32_t shade, int32_t vis, int32_t pal, float factor)
 {
@@ -543,13 +557,226 @@ void calc_and_apply_fog_factor(int32_t tile, int32_t shade, int32_t vis, int32_t
     // unused.
     fogcalc(tile, shade, vis, pal);
     bglFogfv(GL_FOG_COLOR, fogcol);
+    Bmemcpy(curfog.col, fogcol, sizeof(fogcol));
     if (r_usenewshading!=2)
     {
         bglFogf(GL_FOG_DENSITY, fogresult*factor);
+        curfog.density = fogresult*factor;
         return;
     }
     bglFogf(GL_FOG_START, FULLVIS_BEGIN);
     bglFogf(GL_FOG_END, FULLVIS_END);
+    curfog.start = FULLVIS_BEGIN;
+    curfog.end = FULLVIS_END;
+}
+static void applyfog(const fogstate *f)
+{
+    if (nofog || !f->mode)
+        return;
+    bglFogi(GL_FOG_MODE, f->mode);
+    bglFogfv(GL_FOG_COLOR, f->col);
+    if (f->mode == GL_LINEAR)
+    {
+        bglFogf(GL_FOG_START, f->start);
+        bglFogf(GL_FOG_END, f->end);
+    }
+    else
+        bglFogf(GL_FOG_DENSITY, f->density);
+}
+////////////////////
+
+////////// POLYGON BATCHING //////////
+// drawpoly() queues its triangle fans here rather than sending them with
+// glBegin/glEnd, each tagged with the texture, blend and fog state it needs.
+// Outside of polymost_drawrooms() the queue is flushed at the end of every
+// drawpoly() call. While drawrooms is scanning it is held back until the
+// whole view is done, then sorted by layer, texture and fog so every run of
+// fans sharing a state goes out as one glDrawElements. Reordering is safe
+// there because the walls, floors and ceilings of one pass never overlap on
+// screen and are drawn with GL_ALWAYS depth testing; glow layers sort after
+// every base layer so they still blend over them.
+
+enum { BATCH_OPAQUE, BATCH_BLENDED, BATCH_GLOW };
+
+typedef struct {
+	GLuint glpic;
+	float alphacut;
+	fogstate fog;
+	unsigned char layer, blend, alphatest, depthmask;
+} batchstate;
+
+typedef struct {
+	float x, y, z, u, v;
+	float col[4];
+} batchvert;
+
+typedef struct {
+	long state, firstvert, numverts;
+} batchfan;
+
+long glbatch = 1;	// 0 = draw every fan by itself, in the order drawpoly made them
+long polymost_drawcalls = 0;
+static long batchpolys = 0, batchruns = 0;
+static long lastdrawcalls = 0, lastbatchpolys = 0, lastbatchruns = 0;
+
+static batchstate *batchstates = NULL;
+static batchvert *batchverts = NULL;
+static batchfan *batchfans = NULL;
+static long *batchorder = NULL;
+static GLuint *batchindices = NULL;
+static long numbatchstates = 0, numbatchverts = 0, numbatchfans = 0, numbatchindices = 0;
+static long maxbatchstates = 0, maxbatchverts = 0, maxbatchfans = 0, maxbatchorder = 0, maxbatchindices = 0;
+static long batchdeferred = 0;
+
+static int growbatch(void **buf, long *alloced, long need, long size)
+{
+	void *p;
+	long n;
+
+	if (need <= *alloced) return 0;
+	n = max(*alloced*2, max(need, 256));
+	p = realloc(*buf, n*size);
+	if (!p) return -1;
+	*buf = p;
+	*alloced = n;
+	return 0;
+}
+
+// Queues an n-vertex fan and returns its vertices with the colour filled in,
+// or NULL if the queue can't grow.
+static batchvert *batchfan_add(const batchstate *st, const float *col, long n)
+{
+	batchvert *v;
+	batchfan *f;
+	long i;
+
+	if (growbatch((void **)&batchfans, &maxbatchfans, numbatchfans+1, sizeof(batchfan)) ||
+	    growbatch((void **)&batchverts, &maxbatchverts, numbatchverts+n, sizeof(batchvert)))
+		return NULL;
+
+	if (!numbatchstates || memcmp(&batchstates[numbatchstates-1], st, sizeof(batchstate))) {
+		if (growbatch((void **)&batchstates, &maxbatchstates, numbatchstates+1, sizeof(batchstate)))
+			return NULL;
+		memcpy(&batchstates[numbatchstates++], st, sizeof(batchstate));
+	}
+
+	f = &batchfans[numbatchfans++];
+	f->state = numbatchstates-1;
+	f->firstvert = numbatchverts;
+	f->numverts = n;
+
+	v = &batchverts[numbatchverts];
+	numbatchverts += n;
+	for(i=0;i<n;i++) memcpy(v[i].col, col, sizeof(v[i].col));
+	batchpolys++;
+	return v;
+}
+
+static int batchcmp(const void *a, const void *b)
+{
+	const batchfan *fa = &batchfans[*(const long *)a], *fb = &batchfans[*(const long *)b];
+	const batchstate *sa = &batchstates[fa->state], *sb = &batchstates[fb->state];
+	int i;
+
+	if (sa->layer != sb->layer) return (int)sa->layer - (int)sb->layer;
+	if (sa->glpic != sb->glpic) return (sa->glpic < sb->glpic) ? -1 : 1;
+	if (fa->state != fb->state && (i = memcmp(sa, sb, sizeof(batchstate))) != 0) return i;
+	return (*(const long *)a < *(const long *)b) ? -1 : 1;	// keep submission order within a run
+}
+
+static void applybatchstate(const batchstate *st, const batchstate *last)
+{
+	if (!last || st->glpic != last->glpic) bglBindTexture(GL_TEXTURE_2D, st->glpic);
+	if (!last || st->blend != last->blend) {
+		if (st->blend) bglEnable(GL_BLEND); else bglDisable(GL_BLEND);
+	}
+	if (!last || st->alphatest != last->alphatest) {
+		if (st->alphatest) bglEnable(GL_ALPHA_TEST); else bglDisable(GL_ALPHA_TEST);
+	}
+	if (st->alphatest && (!last || !last->alphatest || st->alphacut != last->alphacut))
+		bglAlphaFunc(GL_GREATER, st->alphacut);
+	if (!last || st->depthmask != last->depthmask) bglDepthMask(st->depthmask ? GL_TRUE : GL_FALSE);
+
+	// glow layers are drawn unfogged
+	if (!nofog) {
+		if (st->layer == BATCH_GLOW && (!last || last->layer != BATCH_GLOW)) bglDisable(GL_FOG);
+		else if (st->layer != BATCH_GLOW && last && last->layer == BATCH_GLOW) bglEnable(GL_FOG);
+	}
+	// fog only needs setting here when fans from many walls have been held back
+	if (batchdeferred && st->layer != BATCH_GLOW &&
+	    (!last || memcmp(&st->fog, &last->fog, sizeof(fogstate))))
+		applyfog(&st->fog);
+}
+
+void polymost_flushbatch(void)
+{
+	const batchstate *st, *last = NULL;
+	batchfan *f;
+	long i, j, k, n;
+
+	if (!numbatchfans) return;
+
+	if (growbatch((void **)&batchorder, &maxbatchorder, numbatchfans, sizeof(long))) {
+		numbatchstates = numbatchverts = numbatchfans = 0;
+		return;
+	}
+	for(i=0;i<numbatchfans;i++) batchorder[i] = i;
+	if (glbatch && numbatchfans > 1) qsort(batchorder, numbatchfans, sizeof(long), batchcmp);
+
+	bglEnableClientState(GL_VERTEX_ARRAY);
+	bglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	bglEnableClientState(GL_COLOR_ARRAY);
+	bglVertexPointer(3, GL_FLOAT, sizeof(batchvert), &batchverts[0].x);
+	bglTexCoordPointer(2, GL_FLOAT, sizeof(batchvert), &batchverts[0].u);
+	bglColorPointer(4, GL_FLOAT, sizeof(batchvert), &batchverts[0].col[0]);
+
+	for(i=0;i<numbatchfans;i=j)
+	{
+		st = &batchstates[batchfans[batchorder[i]].state];
+
+		// gather the run of fans sharing this state as a triangle list
+		for(j=i,n=0;j<numbatchfans;j++)
+		{
+			f = &batchfans[batchorder[j]];
+			if (j > i && (!glbatch || (&batchstates[f->state] != st &&
+			    memcmp(&batchstates[f->state], st, sizeof(batchstate))))) break;
+			if (growbatch((void **)&batchindices, &maxbatchindices, n+(f->numverts-2)*3, sizeof(GLuint))) break;
+			for(k=2;k<f->numverts;k++)
+			{
+				batchindices[n++] = f->firstvert;
+				batchindices[n++] = f->firstvert+k-1;
+				batchindices[n++] = f->firstvert+k;
+			}
+		}
+		if (j == i) break;
+
+		applybatchstate(st, last);
+		bglDrawElements(GL_TRIANGLES, n, GL_UNSIGNED_INT, batchindices);
+		polymost_drawcalls++;
+		batchruns++;
+		last = st;
+	}
+
+	bglDisableClientState(GL_COLOR_ARRAY);
+	bglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	bglDisableClientState(GL_VERTEX_ARRAY);
+
+	// leave things the way the last fan would have with glBegin/glEnd
+	if (last && last->layer == BATCH_GLOW && !nofog) bglEnable(GL_FOG);
+	if (batchdeferred) applyfog(&curfog);
+	f = &batchfans[numbatchfans-1];
+	bglColor4f(batchverts[f->firstvert].col[0], batchverts[f->firstvert].col[1],
+		batchverts[f->firstvert].col[2], batchverts[f->firstvert].col[3]);
+
+	numbatchstates = numbatchverts = numbatchfans = 0;
+}
+
+void polymost_endframe(void)
+{
+	lastdrawcalls = polymost_drawcalls;
+	lastbatchpolys = batchpolys;
+	lastbatchruns = batchruns;
+	polymost_drawcalls = batchpolys = batchruns = 0;
 }
 ////////////////////
 
@@ -717,10 +944,12 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 #ifdef USE_OPENGL
 	if (rendmode == 3)
 	{
-		float hackscx, hackscy, alphac;
+		float hackscx, hackscy, alphac, pc[4], gc[4], au = 0.f, av = 0.f;
 		unsigned short ptflags = 0;
 		int drawlayers = 1 << PTHPIC_BASE, drawinglayer = PTHPIC_BASE, picidx = PTHPIC_BASE;
 		GLuint glpic = 0;
+		batchstate basest, glowst;
+		batchvert *bv;
 		
 		if (skyclamphack) method |= METH_CLAMPED;
 		
@@ -737,7 +966,10 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 				glpic = pth->pic[picidx]->glpic;
 			}
 		}
-		bglBindTexture(GL_TEXTURE_2D, glpic);
+		memset(&basest, 0, sizeof(basest));
+		basest.glpic = glpic;
+		basest.depthmask = 1;
+		memcpy(&basest.fog, &curfog, sizeof(fogstate));
 		
 		if ((method & METH_LAYERS) && pth && !drawingskybox) {
 			if (pth->pic[ PTHPIC_GLOW ]) {
@@ -755,8 +987,7 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 		oy2     = (double)1.0/(double)yy;
         
 		if (!(method & (METH_MASKED | METH_TRANS))) {
-			bglDisable(GL_BLEND);
-			bglDisable(GL_ALPHA_TEST);
+			basest.layer = BATCH_OPAQUE;
 		} else {
 			float al = 0.32;
 			if (pth && pth->repldef && pth->repldef->alphacut >= 0.0) {
@@ -764,9 +995,18 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 			}
 			if (usegoodalpha) al = 0.0;
 			if (!waloff[globalpicnum]) al = 0.0;	// invalid textures ignore the alpha cutoff settings
-			bglEnable(GL_BLEND);
-			bglEnable(GL_ALPHA_TEST);
-			bglAlphaFunc(GL_GREATER,al);
+			basest.layer = BATCH_BLENDED;
+			basest.blend = 1;
+			basest.alphatest = 1;
+			basest.alphacut = al;
+		}
+		
+		if (drawlayers & (1 << PTHPIC_GLOW)) {
+			memcpy(&glowst, &basest, sizeof(glowst));
+			glowst.layer = BATCH_GLOW;
+			glowst.glpic = pth->pic[PTHPIC_GLOW]->glpic;
+			glowst.blend = 1;	// blend with what's under us
+			glowst.depthmask = 0;	// don't update the Z buffer
 		}
         
 		if (!dorot)
@@ -780,7 +1020,6 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 		}
         
 		{
-			float pc[3];
 			pc[0] = pc[1] = pc[2] = getshadefactor(globalshade);
 			switch(method & (METH_MASKED | METH_TRANS))
 			{
@@ -797,7 +1036,8 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 				pc[1] *= (float)hictinting[globalpal].g / 255.0;
 				pc[2] *= (float)hictinting[globalpal].b / 255.0;
 			}
-			bglColor4f(pc[0],pc[1],pc[2],alphac);
+			pc[3] = alphac;
+			gc[0] = gc[1] = gc[2] = 1.f; gc[3] = alphac;
 		}
         
         //Hack for walls&masked walls which use textures that are not a power of 2
@@ -920,42 +1160,20 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 						continue;
 					}
 					
-					switch (drawinglayer) {
-						case PTHPIC_BASE:
-							bglDepthMask(GL_TRUE);
-							break;
-						case PTHPIC_GLOW:
-							bglColor4f(1.f,1.f,1.f,alphac);
-							if (!nofog) bglDisable(GL_FOG);
-							bglEnable(GL_BLEND);	// blend with what's under us
-							bglDepthMask(GL_FALSE);	// don't update the Z buffer
-							bglBindTexture(GL_TEXTURE_2D, pth->pic[PTHPIC_GLOW]->glpic);
-							break;
-						default:
-							break;
-					}
-                    
-					bglBegin(GL_TRIANGLE_FAN);
-					for(i=0;i<nn;i++)
+					if (drawinglayer == PTHPIC_GLOW) bv = batchfan_add(&glowst, gc, nn);
+					else bv = batchfan_add(&basest, pc, nn);
+					if (bv) for(i=0;i<nn;i++)
 					{
 						ox = uu[i]; oy = vv[i];
 						dp = ox*ngdx + oy*ngdy + ngdo;
 						up = ox*ngux + oy*nguy + nguo;
 						vp = ox*ngvx + oy*ngvy + ngvo;
 						r = 1.0/dp;
-						bglTexCoord2d((up*r-du0+uoffs)*ox2,vp*r*oy2);
-						bglVertex3d((ox-ghalfx)*r*grhalfxdown10x,(ghoriz-oy)*r*grhalfxdown10,r*(1.0/1024.0));
-					}
-					bglEnd();
-                    
-					switch (drawinglayer) {
-						case PTHPIC_BASE:
-							break;
-						case PTHPIC_GLOW:
-							if (!nofog) bglEnable(GL_FOG);
-							break;
-						default:
-							break;
+						bv[i].u = (up*r-du0+uoffs)*ox2;
+						bv[i].v = vp*r*oy2;
+						bv[i].x = (ox-ghalfx)*r*grhalfxdown10x;
+						bv[i].y = (ghoriz-oy)*r*grhalfxdown10;
+						bv[i].z = r*(1.0/1024.0);
 					}
 					
 					drawlayers &= ~(1 << drawinglayer);
@@ -966,6 +1184,12 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 		else
 		{
 			ox2 *= hackscx; oy2 *= hackscy;
+			if (pth->pic[picidx]->atlas) {
+				// the tile is one corner of a shared atlas page; atlas tiles
+				// never have glow maps, so this only affects the base layer
+				au = pth->pic[picidx]->atlasu; ox2 *= pth->pic[picidx]->atlasw;
+				av = pth->pic[picidx]->atlasv; oy2 *= pth->pic[picidx]->atlash;
+			}
             
 			do {
 				if ((drawlayers & (1 << drawinglayer)) == 0) {
@@ -977,38 +1201,16 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 					continue;
 				}
 				
-				switch (drawinglayer) {
-					case PTHPIC_BASE:
-						bglDepthMask(GL_TRUE);
-						break;
-					case PTHPIC_GLOW:
-						bglColor4f(1.f,1.f,1.f,alphac);
-						if (!nofog) bglDisable(GL_FOG);
-						bglEnable(GL_BLEND);	// blend with what's under us
-						bglDepthMask(GL_FALSE);	// don't update the Z buffer
-						bglBindTexture(GL_TEXTURE_2D, pth->pic[PTHPIC_GLOW]->glpic);
-						break;
-					default:
-						break;
-				}
-				
-				bglBegin(GL_TRIANGLE_FAN);
-				for(i=0;i<n;i++)
+				if (drawinglayer == PTHPIC_GLOW) bv = batchfan_add(&glowst, gc, n);
+				else bv = batchfan_add(&basest, pc, n);
+				if (bv) for(i=0;i<n;i++)
 				{
 					r = 1.0/dd[i];
-					bglTexCoord2d(uu[i]*r*ox2,vv[i]*r*oy2);
-					bglVertex3d((px[i]-ghalfx)*r*grhalfxdown10x,(ghoriz-py[i])*r*grhalfxdown10,r*(1.0/1024.0));
-				}
-				bglEnd();
-				
-				switch (drawinglayer) {
-					case PTHPIC_BASE:
-						break;
-					case PTHPIC_GLOW:
-						if (!nofog) bglEnable(GL_FOG);
-						break;
-					default:
-						break;
+					bv[i].u = uu[i]*r*ox2 + au;
+					bv[i].v = vv[i]*r*oy2 + av;
+					bv[i].x = (px[i]-ghalfx)*r*grhalfxdown10x;
+					bv[i].y = (ghoriz-py[i])*r*grhalfxdown10;
+					bv[i].z = r*(1.0/1024.0);
 				}
 				
 				drawlayers &= ~(1 << drawinglayer);
@@ -1016,6 +1218,7 @@ void drawpoly (double *dpx, double *dpy, long n, long method)
 			} while (drawlayers);
 		}
 		
+		if (!batchdeferred) polymost_flushbatch();
 		return;
 	}
 #endif
@@ -2901,6 +3104,10 @@ void polymost_drawrooms ()
     
 	polymost_scansector(globalcursectnum);
     
+#ifdef USE_OPENGL
+	if (rendmode == 3) batchdeferred = glbatch;
+#endif
+    
 	if (inpreparemirror)
 	{
 		grhalfxdown10x = -grhalfxdown10;
@@ -2941,6 +3148,9 @@ void polymost_drawrooms ()
 #ifdef USE_OPENGL
 	if (rendmode == 3)
 	{
+		polymost_flushbatch();
+		batchdeferred = 0;
+        
 		bglDepthFunc(GL_LEQUAL); //NEVER,LESS,(,L)EQUAL,GREATER,(NOT,G)EQUAL,ALWAYS
         
 		//bglPolygonOffset(0,0);
@@ -3143,6 +3353,7 @@ void polymost_drawsprite (long snum)
 			if (mddraw(tspr)) return;
 			break;	// else, render as flat sprite
 		}
+		voxloadflush();	// in case voxels were defined after the last .def finished
 		if (usevoxels && (tspr->cstat&48)!=48 && tiletovox[tspr->picnum] >= 0 && voxmodels[ tiletovox[tspr->picnum] ]) {
 			if (voxdraw(voxmodels[ tiletovox[tspr->picnum] ], tspr)) return;
 			break;	// else, render as flat sprite
@@ -3738,7 +3949,7 @@ static void drawtrap (float x0, float x1, float y0, float x2, float x3, float y1
 	else if (x2 == x3) { px[1] = x1; py[1] = y0; px[2] = x3; n = 3; }
 	else               { px[1] = x1; py[1] = y0; px[2] = x3; px[3] = x2; py[3] = y1; n = 4; }
     
-	bglBegin(GL_TRIANGLE_FAN);
+	bglBegin(GL_TRIANGLE_FAN); polymost_drawcalls++;
 	for(i=0;i<n;i++)
 	{
 		px[i] = min(max(px[i],trapextx[0]),trapextx[1]);
@@ -3790,7 +4001,7 @@ static void tessectrap (float *px, float *py, long *point2, long numpoints)
 	}
 	if (z != 3) //Simple polygon... early out
 	{
-		bglBegin(GL_TRIANGLE_FAN);
+		bglBegin(GL_TRIANGLE_FAN); polymost_drawcalls++;
 		for(i=0;i<npoints;i++)
 		{
 			j = slist[i];
@@ -3929,7 +4140,7 @@ void polymost_fillpolygon (long npoints)
 long polymost_drawtilescreen (long tilex, long tiley, long wallnum, long dimen)
 {
 #ifdef USE_OPENGL
-	float xdime, ydime, xdimepad, ydimepad, scx, scy;
+	float xdime, ydime, xdimepad, ydimepad, xdimeoff, ydimeoff, scx, scy;
 	long i;
 	PTHead *pth;
     
@@ -3959,7 +4170,13 @@ long polymost_drawtilescreen (long tilex, long tiley, long wallnum, long dimen)
 	
 	bglBindTexture(GL_TEXTURE_2D, pth->pic[PTHPIC_BASE]->glpic);
     
-	if (pth) {
+	xdimeoff = ydimeoff = 0.0;
+	if (pth && pth->pic[PTHPIC_BASE]->atlas) {
+		xdimeoff = pth->pic[PTHPIC_BASE]->atlasu;
+		ydimeoff = pth->pic[PTHPIC_BASE]->atlasv;
+		xdimepad = pth->pic[PTHPIC_BASE]->atlasw;
+		ydimepad = pth->pic[PTHPIC_BASE]->atlash;
+	} else if (pth) {
 		xdimepad = (float)pth->pic[PTHPIC_BASE]->tsizx / (float)pth->pic[PTHPIC_BASE]->sizx;
 		ydimepad = (float)pth->pic[PTHPIC_BASE]->tsizy / (float)pth->pic[PTHPIC_BASE]->sizy;
 	} else {
@@ -3971,7 +4188,7 @@ long polymost_drawtilescreen (long tilex, long tiley, long wallnum, long dimen)
     
 	if (!pth || (pth->pic[PTHPIC_BASE]->flags & PTH_HASALPHA)) {
 		bglDisable(GL_TEXTURE_2D);
-		bglBegin(GL_TRIANGLE_FAN);
+		bglBegin(GL_TRIANGLE_FAN); polymost_drawcalls++;
 		if (gammabrightness) {
 			bglColor4f((float)curpalette[255].r/255.0,
 					   (float)curpalette[255].g/255.0,
@@ -3993,11 +4210,11 @@ long polymost_drawtilescreen (long tilex, long tiley, long wallnum, long dimen)
 	bglColor4f(1,1,1,1);
 	bglEnable(GL_TEXTURE_2D);
 	bglEnable(GL_BLEND);
-	bglBegin(GL_TRIANGLE_FAN);
-	bglTexCoord2f(       0,       0); bglVertex2f((float)tilex    ,(float)tiley    );
-	bglTexCoord2f(xdimepad,       0); bglVertex2f((float)tilex+scx,(float)tiley    );
-	bglTexCoord2f(xdimepad,ydimepad); bglVertex2f((float)tilex+scx,(float)tiley+scy);
-	bglTexCoord2f(       0,ydimepad); bglVertex2f((float)tilex    ,(float)tiley+scy);
+	bglBegin(GL_TRIANGLE_FAN); polymost_drawcalls++;
+	bglTexCoord2f(xdimeoff         ,ydimeoff         ); bglVertex2f((float)tilex    ,(float)tiley    );
+	bglTexCoord2f(xdimeoff+xdimepad,ydimeoff         ); bglVertex2f((float)tilex+scx,(float)tiley    );
+	bglTexCoord2f(xdimeoff+xdimepad,ydimeoff+ydimepad); bglVertex2f((float)tilex+scx,(float)tiley+scy);
+	bglTexCoord2f(xdimeoff         ,ydimeoff+ydimepad); bglVertex2f((float)tilex    ,(float)tiley+scy);
 	bglEnd();
 	
 	return(0);
@@ -4086,7 +4303,7 @@ long polymost_printext256(long xpos, long ypos, short col, short backcol, char *
 		bglColor4ub(b.r,b.g,b.b,255);
 		c = Bstrlen(name);
 		
-		bglBegin(GL_QUADS);
+		bglBegin(GL_QUADS); polymost_drawcalls++;
 		bglVertex2i(xpos,ypos);
 		bglVertex2i(xpos,ypos+(fontsize?6:8));
 		bglVertex2i(xpos+(c<<(3-fontsize)),ypos+(fontsize?6:8));
@@ -4099,7 +4316,7 @@ long polymost_printext256(long xpos, long ypos, short col, short backcol, char *
 	bglColor4ub(p.r,p.g,p.b,255);
 	txc = fontsize ? (4.0/256.0) : (8.0/256.0);
 	tyc = fontsize ? (6.0/128.0) : (8.0/128.0);
-	bglBegin(GL_QUADS);
+	bglBegin(GL_QUADS); polymost_drawcalls++;
 	for (c=0; name[c]; c++) {
 		tx = (float)(name[c]%32)/32.0;
 		ty = (float)((name[c]/32) + (fontsize*8))/16.0;
@@ -4250,6 +4467,11 @@ static int osdcmd_polymostvars(const osdfuncparm_t *parm)
 		else glusetexcache = (val != 0);
 		return OSDCMD_OK;
 	}
+	else if (!Bstrcasecmp(parm->name, "glusevoxcache")) {
+		if (showval) { OSD_Printf("glusevoxcache is %d\n", glusevoxcache); }
+		else glusevoxcache = (val != 0);
+		return OSDCMD_OK;
+	}
 	else if (!Bstrcasecmp(parm->name, "glmultisample")) {
 		if (showval) { OSD_Printf("glmultisample is %d\n", glmultisample); }
 		else glmultisample = max(0,val);
@@ -4260,6 +4482,19 @@ static int osdcmd_polymostvars(const osdfuncparm_t *parm)
 		else glnvmultisamplehint = (val != 0);
 		return OSDCMD_OK;
 	}
+	else if (!Bstrcasecmp(parm->name, "glatlas")) {
+		if (showval) { OSD_Printf("glatlas is %d\n", polymosttexatlas); }
+		else if (polymosttexatlas != (val != 0)) {
+			polymosttexatlas = (val != 0);
+			polymost_texinvalidateall();	// tiles move in or out of the atlas as they reload
+		}
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "glbatch")) {
+		if (showval) { OSD_Printf("glbatch is %d\n", glbatch); }
+		else glbatch = (val != 0);
+		return OSDCMD_OK;
+	}
 	else if (!Bstrcasecmp(parm->name, "polymosttexverbosity")) {
 		if (showval) { OSD_Printf("polymosttexverbosity is %d\n", polymosttexverbosity); }
 		else {
@@ -4272,6 +4507,20 @@ static int osdcmd_polymostvars(const osdfuncparm_t *parm)
 	return OSDCMD_SHOWHELP;
 }
 
+#ifdef USE_OPENGL
+static int osdcmd_glbatchstats(const osdfuncparm_t *parm)
+{
+	int pages, tiles, freeslots;
+	
+	OSD_Printf("Last frame: %d draw calls, %d polygons in %d batches (glbatch %d)\n",
+		lastdrawcalls, lastbatchpolys, lastbatchruns, glbatch);
+	PTAtlasStats(&pages, &tiles, &freeslots);
+	OSD_Printf("Atlas: %d tiles on %d pages, %d free slots (glatlas %d)\n",
+		tiles, pages, freeslots, polymosttexatlas);
+	return OSDCMD_OK;
+}
+#endif
+
 #if 1
 // because I'm lazy
 static int dumptexturedefs(const osdfuncparm_t * UNUSED(parm))
@@ -4344,10 +4593,14 @@ void polymost_initosdfuncs(void)
 	OSD_RegisterFunction("usegoodalpha","usegoodalpha: enable/disable better looking OpenGL alpha hack",osdcmd_polymostvars);
 	OSD_RegisterFunction("glpolygonmode","glpolygonmode: debugging feature",osdcmd_polymostvars); //FUK
 	OSD_RegisterFunction("glusetexcache","glusetexcache: enable/disable OpenGL compressed texture cache",osdcmd_polymostvars);
+	OSD_RegisterFunction("glusevoxcache","glusevoxcache: enable/disable the cache of voxels converted to polygons",osdcmd_polymostvars);
 	OSD_RegisterFunction("glmultisample","glmultisample: sets the number of samples used for antialiasing (0 = off)",osdcmd_polymostvars);
 	OSD_RegisterFunction("glnvmultisamplehint","glnvmultisamplehint: enable/disable Nvidia multisampling hinting",osdcmd_polymostvars);
 	OSD_RegisterFunction("polymosttexverbosity","polymosttexverbosity: sets the level of chatter during texture loading. 0 = none, 1 = errors (default), 2 = all",osdcmd_polymostvars);
 	OSD_RegisterFunction("forcetexcacherebuild","forcetexcacherebuild: invalidates the compressed texture cache", osdcmd_forcetexcacherebuild);
+	OSD_RegisterFunction("glbatch","glbatch: enable/disable sorting polygons into batches by texture and fog",osdcmd_polymostvars);
+	OSD_RegisterFunction("glbatchstats","glbatchstats: shows the OpenGL draw calls made for the last frame and the texture atlas usage",osdcmd_glbatchstats);
+	OSD_RegisterFunction("glatlas","glatlas: enable/disable packing small ART tiles into shared textures",osdcmd_polymostvars);
 #endif
 	OSD_RegisterFunction("usemodels","usemodels: enable/disable model rendering in >8-bit mode",osdcmd_polymostvars);
 	OSD_RegisterFunction("usehightile","usehightile: enable/disable hightile texture rendering in >8-bit mode",osdcmd_polymostvars);
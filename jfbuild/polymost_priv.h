@@ -31,6 +31,8 @@ extern struct glfiltermodes glfiltermodes[numglfiltermodes];
 extern long gltexcomprquality;	// 0 = fast, 1 = slow and pretty, 2 = very slow and pretty
 extern long gltexmaxsize;	// 0 means autodetection on first run
 extern long gltexmiplevel;	// discards this many mipmap levels
+extern long glbatch;		// 0 = draw polygons in the order they come, 1 = batch by texture and fog
+extern long polymost_drawcalls;	// GL draw calls made so far this frame
 
 long polymost_texmayhavealpha (long dapicnum, long dapalnum);
 void polymost_texinvalidate (long dapicnum, long dapalnum, long dameth);
@@ -44,5 +46,7 @@ void polymost_dorotatesprite (long sx, long sy, long z, short a, short picnum,
 void polymost_fillpolygon (long npoints);
 long polymost_printext256(long xpos, long ypos, short col, short backcol, char *name, char fontsize);
 void polymost_initosdfuncs(void);
+void polymost_flushbatch(void);
+void polymost_endframe(void);
 
 #endif
@@ -71,6 +71,42 @@ static PTHash * pthashhead[PTHASHHEADSIZ];	// will be initialised 0 by .bss segm
 #define PTMHASHHEADSIZ 4096
 static PTMHash * ptmhashhead[PTMHASHHEADSIZ];	// will be initialised 0 by .bss segment
 
+/*
+ * Small clamped ART tiles (HUD digits and fonts, status bar pieces, most
+ * sprites) are packed into shared atlas pages rather than getting a texture
+ * each, so consecutive polygons using them can be drawn without a rebind.
+ * Pages are filled shelf by shelf. Each tile is surrounded by a copy of its
+ * edge pixels so bilinear filtering samples the same colours the clamped
+ * texture would have. Released slots are reused by tiles of the same size,
+ * which is what happens when an invalidated tile is reloaded.
+ */
+#define PTATLASSIZE 1024
+#define PTATLASMAXTILE 64	// largest tile dimension that goes into an atlas
+#define PTATLASMAXPAGES 8
+#define PTATLASMAXSHELVES 256
+
+struct PTAtlasPage_typ {
+	GLuint glpic;
+	int nexty;		// top of the unused space below the last shelf
+	int numshelves;
+	struct { short y, h, x; } shelf[PTATLASMAXSHELVES];
+};
+typedef struct PTAtlasPage_typ PTAtlasPage;
+
+struct PTAtlasSlot_typ {
+	int page;
+	int x, y, w, h;		// including the border
+	int inuse;
+};
+typedef struct PTAtlasSlot_typ PTAtlasSlot;
+
+int polymosttexatlas = 1;
+
+static PTAtlasPage atlaspage[PTATLASMAXPAGES];
+static int numatlaspages = 0;
+static PTAtlasSlot * atlasslot = 0;
+static int numatlasslots = 0, maxatlasslots = 0;
+
 
 static void ptm_fixtransparency(PTTexture * tex, int clamped);
 static void ptm_applyeffects(PTTexture * tex, int effects);
@@ -522,6 +558,243 @@ static PTHash * pt_findhash(int picnum, int palnum, int shade, unsigned short fl
 	return pth;
 }
 
+/**
+ * Sets the filtering and wrapping of the currently bound atlas page.
+ * Pages have no mipmaps since neighbouring tiles would bleed into each other.
+ */
+static void ptatlas_setparameters(void)
+{
+	GLint c = glinfo.clamptoedge ? GL_CLAMP_TO_EDGE : GL_CLAMP;
+	long filtermode = gltexfiltermode;
+	
+	if (filtermode < 0) {
+		filtermode = 0;
+	} else if (filtermode >= (long)numglfiltermodes) {
+		filtermode = numglfiltermodes-1;
+	}
+	bglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, glfiltermodes[filtermode].mag);
+	bglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, glfiltermodes[filtermode].mag);
+	bglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, c);
+	bglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, c);
+}
+
+/**
+ * Finds room for a w*h block in the atlas
+ * @return the slot index, or -1 if the atlas is full
+ */
+static int ptatlas_alloc(int w, int h)
+{
+	PTAtlasPage * pg;
+	PTAtlasSlot * sl;
+	int i, p, best, besth, x = 0, y = 0;
+	
+	// a released slot of exactly the right size is the cheapest option
+	for (i = 0; i < numatlasslots; i++) {
+		if (!atlasslot[i].inuse && atlasslot[i].w == w && atlasslot[i].h == h) {
+			atlasslot[i].inuse = 1;
+			return i;
+		}
+	}
+	
+	for (p = 0; p <= numatlaspages && p < PTATLASMAXPAGES; p++) {
+		pg = &atlaspage[p];
+		if (p == numatlaspages) {
+			// open a new page
+			memset(pg, 0, sizeof(PTAtlasPage));
+			bglGenTextures(1, &pg->glpic);
+			if (!pg->glpic) {
+				return -1;
+			}
+			bglBindTexture(GL_TEXTURE_2D, pg->glpic);
+			bglTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, PTATLASSIZE, PTATLASSIZE, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, 0);
+			ptatlas_setparameters();
+			numatlaspages++;
+		}
+		
+		// the shortest shelf the block fits on, without wasting much height
+		best = -1; besth = PTATLASSIZE+1;
+		for (i = 0; i < pg->numshelves; i++) {
+			if (pg->shelf[i].h >= h && pg->shelf[i].h <= h + (h>>1) + 4 &&
+			    pg->shelf[i].x + w <= PTATLASSIZE && pg->shelf[i].h < besth) {
+				best = i;
+				besth = pg->shelf[i].h;
+			}
+		}
+		if (best < 0 && pg->numshelves < PTATLASMAXSHELVES &&
+		    pg->nexty + h <= PTATLASSIZE) {
+			best = pg->numshelves++;
+			pg->shelf[best].y = pg->nexty;
+			pg->shelf[best].h = min((h + 7) & ~7, PTATLASSIZE - pg->nexty);
+			pg->shelf[best].x = 0;
+			pg->nexty += pg->shelf[best].h;
+		}
+		if (best < 0) {
+			continue;
+		}
+		
+		x = pg->shelf[best].x;
+		y = pg->shelf[best].y;
+		pg->shelf[best].x += w;
+		break;
+	}
+	if (p >= numatlaspages) {
+		return -1;
+	}
+	
+	if (numatlasslots >= maxatlasslots) {
+		i = maxatlasslots ? maxatlasslots*2 : 256;
+		sl = (PTAtlasSlot *) realloc(atlasslot, i * sizeof(PTAtlasSlot));
+		if (!sl) {
+			return -1;	// the space is lost until the next reset
+		}
+		atlasslot = sl;
+		maxatlasslots = i;
+	}
+	sl = &atlasslot[numatlasslots];
+	sl->page = p;
+	sl->x = x; sl->y = y;
+	sl->w = w; sl->h = h;
+	sl->inuse = 1;
+	return numatlasslots++;
+}
+
+/**
+ * Gives a texture's atlas slot back, leaving the texture unloaded
+ * @param ptm the texture
+ */
+static void ptatlas_release(PTMHead * ptm)
+{
+	if (!ptm->atlas) {
+		return;
+	}
+	if (ptm->atlas-1 < numatlasslots) {
+		atlasslot[ptm->atlas-1].inuse = 0;
+	}
+	ptm->atlas = 0;
+	ptm->glpic = 0;
+}
+
+/**
+ * Tries to place an ART tile into the atlas, replacing whatever texture
+ * the header had before
+ * @param ptm the texture management header
+ * @param tex the tile image
+ * @return !0 if the tile went into the atlas
+ */
+static int ptatlas_upload(PTMHead * ptm, PTTexture * tex)
+{
+	PTAtlasSlot * sl;
+	coltype * pic, * src, * dst;
+	int w = tex->tsizx + 2, h = tex->tsizy + 2;
+	int y, slot = -1;
+	
+	if (ptm->atlas) {
+		sl = &atlasslot[ptm->atlas-1];
+		if (sl->w == w && sl->h == h) {
+			slot = ptm->atlas-1;	// reloading in place
+		} else {
+			ptatlas_release(ptm);
+		}
+	}
+	if (slot < 0) {
+		slot = ptatlas_alloc(w, h);
+		if (slot < 0) {
+			return 0;
+		}
+	}
+	
+	pic = (coltype *) malloc(w * h * sizeof(coltype));
+	if (!pic) {
+		if (ptm->atlas) {
+			ptatlas_release(ptm);
+		} else {
+			atlasslot[slot].inuse = 0;
+		}
+		return 0;
+	}
+	
+	ptm_fixtransparency(tex, 1);
+	for (y = 0; y < h; y++) {
+		src = &tex->pic[ min(max(y-1, 0), tex->tsizy-1) * tex->sizx ];
+		dst = &pic[y * w];
+		dst[0] = src[0];
+		memcpy(&dst[1], src, tex->tsizx * sizeof(coltype));
+		dst[w-1] = src[tex->tsizx-1];
+	}
+	
+	if (ptm->glpic && !ptm->atlas) {
+		// the tile used to have a texture all of its own
+		bglDeleteTextures(1, &ptm->glpic);
+	}
+	
+	sl = &atlasslot[slot];
+	ptm->atlas = slot + 1;
+	ptm->glpic = atlaspage[sl->page].glpic;
+	bglBindTexture(GL_TEXTURE_2D, ptm->glpic);
+	bglTexSubImage2D(GL_TEXTURE_2D, 0, sl->x, sl->y, w, h,
+		GL_RGBA, GL_UNSIGNED_BYTE, (const GLvoid *) pic);
+	free(pic);
+	
+	ptm->atlasu = (float)(sl->x + 1) / (float)PTATLASSIZE;
+	ptm->atlasv = (float)(sl->y + 1) / (float)PTATLASSIZE;
+	ptm->atlasw = (float)tex->tsizx / (float)PTATLASSIZE;
+	ptm->atlash = (float)tex->tsizy / (float)PTATLASSIZE;
+	ptm->sizx = tex->tsizx;
+	ptm->sizy = tex->tsizy;
+	ptm->flags = (tex->hasalpha ? PTH_HASALPHA : 0);
+	
+	return 1;
+}
+
+/**
+ * Releases every atlas page and forgets all the tiles packed in them
+ */
+void PTAtlasReset(void)
+{
+	int i;
+	
+	for (i = 0; i < numatlaspages; i++) {
+		if (atlaspage[i].glpic) {
+			bglDeleteTextures(1, &atlaspage[i].glpic);
+		}
+	}
+	memset(atlaspage, 0, sizeof(atlaspage));
+	numatlaspages = 0;
+	numatlasslots = 0;
+}
+
+/**
+ * Applies the global texture filter setting to the atlas pages
+ */
+void PTAtlasApplyParameters(void)
+{
+	int i;
+	
+	for (i = 0; i < numatlaspages; i++) {
+		bglBindTexture(GL_TEXTURE_2D, atlaspage[i].glpic);
+		ptatlas_setparameters();
+	}
+}
+
+/**
+ * Reports how much of the atlas is in use
+ */
+void PTAtlasStats(int *pages, int *tiles, int *freeslots)
+{
+	int i;
+	
+	*pages = numatlaspages;
+	*tiles = *freeslots = 0;
+	for (i = 0; i < numatlasslots; i++) {
+		if (atlasslot[i].inuse) {
+			(*tiles)++;
+		} else {
+			(*freeslots)++;
+		}
+	}
+}
+
 /**
  * Unloads a texture from memory
  * @param pth pointer to the pthash of the loaded texture
@@ -530,7 +803,9 @@ static void pt_unload(PTHash * pth)
 {
 	int i;
 	for (i = PTHPIC_SIZE - 1; i>=0; i--) {
-		if (pth->head.pic[i] && pth->head.pic[i]->glpic) {
+		if (pth->head.pic[i] && pth->head.pic[i]->atlas) {
+			ptatlas_release(pth->head.pic[i]);
+		} else if (pth->head.pic[i] && pth->head.pic[i]->glpic) {
 			bglDeleteTextures(1, &pth->head.pic[i]->glpic);
 			pth->head.pic[i]->glpic = 0;
 		}
@@ -695,9 +970,15 @@ static int pt_load_art(PTHead * pth)
 	pth->pic[PTHPIC_BASE] = PTM_GetHead(&id);
 	pth->pic[PTHPIC_BASE]->tsizx = tex.tsizx;
 	pth->pic[PTHPIC_BASE]->tsizy = tex.tsizy;
-	pth->pic[PTHPIC_BASE]->sizx  = tex.sizx;
-	pth->pic[PTHPIC_BASE]->sizy  = tex.sizy;
-	ptm_uploadtexture(pth->pic[PTHPIC_BASE], pth->flags, &tex, 0);
+	
+	if (!(polymosttexatlas && (pth->flags & PTH_CLAMPED) && !hasfullbright &&
+	      tex.tsizx <= PTATLASMAXTILE && tex.tsizy <= PTATLASMAXTILE &&
+	      ptatlas_upload(pth->pic[PTHPIC_BASE], &tex))) {
+		ptatlas_release(pth->pic[PTHPIC_BASE]);
+		pth->pic[PTHPIC_BASE]->sizx  = tex.sizx;
+		pth->pic[PTHPIC_BASE]->sizy  = tex.sizy;
+		ptm_uploadtexture(pth->pic[PTHPIC_BASE], pth->flags, &tex, 0);
+	}
 	
 	if (hasfullbright) {
         id.layer = PTHPIC_GLOW;
@@ -823,7 +1104,7 @@ static void pt_load_applyparameters(PTHead * pth)
 	int i;
 	long filtermode, anisotropy;
 	for (i = 0; i < PTHPIC_SIZE; i++) {
-		if (pth->pic[i] == 0 || pth->pic[i]->glpic == 0) {
+		if (pth->pic[i] == 0 || pth->pic[i]->glpic == 0 || pth->pic[i]->atlas) {
 			continue;
 		}
 		
@@ -1392,6 +1673,7 @@ void PTReset()
 			pth = pth->next;
 		}
 	}
+	PTAtlasReset();
 }
 
 /**
@@ -1423,6 +1705,7 @@ void PTClear()
 		}
 		ptmhashhead[i] = 0;
 	}
+	PTAtlasReset();
 }
 
 extern int32_t r_usetileshades;
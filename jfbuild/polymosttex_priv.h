@@ -27,6 +27,10 @@ struct PTMHead_typ {
 	int flags;
 	int sizx, sizy;		// padded texture dimensions
 	int tsizx, tsizy;		// true texture dimensions
+	
+	int atlas;		// 1 + atlas slot when glpic is a shared atlas page, else 0
+	float atlasu, atlasv;	// where the tile starts within the atlas page
+	float atlasw, atlash;	// and how much of the page it covers
 };
 
 typedef struct PTMHead_typ PTMHead;
@@ -78,6 +82,7 @@ struct PTIter_typ;	// an opaque iterator type for walking the internal hash
 typedef struct PTIter_typ * PTIter;
 
 extern int polymosttexverbosity;	// 0 = none, 1 = errors (default), 2 = all
+extern int polymosttexatlas;		// 0 = every ART tile gets its own texture, 1 = pack small ones
 
 /**
  * Prepare for priming by sweeping through the textures and marking them as all unused
@@ -107,6 +112,24 @@ void PTReset();
  */
 void PTClear();
 
+/**
+ * Releases every atlas page and forgets all the tiles packed in them
+ */
+void PTAtlasReset(void);
+
+/**
+ * Applies the global texture filter setting to the atlas pages
+ */
+void PTAtlasApplyParameters(void);
+
+/**
+ * Reports how much of the atlas is in use
+ * @param pages receives the number of atlas pages allocated
+ * @param tiles receives the number of tiles currently packed
+ * @param freeslots receives the number of released slots awaiting reuse
+ */
+void PTAtlasStats(int *pages, int *tiles, int *freeslots);
+
 /**
  * Creates a new iterator for walking the header hash looking for particular
  * parameters that match.
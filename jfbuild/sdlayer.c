@@ -35,6 +35,8 @@
 #include "mmulti.h"
 #include "log.h"
 #include "crash.h"
+#include "workers.h"
+#include "cpufeat.h"
 
 #if 0
 static snapshot_t snapshot0 = { 0 };
@@ -70,6 +72,8 @@ char quitevent=0, appactive=1;
 
 static SDL_Surface *sdl_buffersurface=NULL;
 static SDL_Palette *sdl_palptr=NULL;
+static SDL_Renderer *sdl_renderer=NULL;
+static SDL_Texture *sdl_texture=NULL;
 // static SDL_Window *sdl_window=NULL;
 static SDL_GLContext sdl_context=NULL;
 long xres=-1, yres=-1, bpp=0, fullscreen=0, bytesperline, imageSize;
@@ -102,6 +106,9 @@ void (*joypresscallback)(long,long) = 0;
 
 static char keytranslation[SDL_NUM_SCANCODES];
 static int buildkeytranslationtable(void);
+static void initpalexpand(void);
+static int osdcmd_palbench(const osdfuncparm_t *parm);
+static int osdcmd_framestats(const osdfuncparm_t *parm);
 
 //static SDL_Surface * loadtarga(const char *fn);		// for loading the icon
 static SDL_Surface * loadappicon(void);
@@ -237,6 +244,7 @@ int main(int argc, char *argv[])
 //
 int initsystem(void)
 {
+	extern int dedicated;
 	SDL_version compiled;
 
     SDL_version linked_;
@@ -250,6 +258,12 @@ int initsystem(void)
 		linked->major, linked->minor, linked->patch,
 		compiled.major, compiled.minor, compiled.patch);
 
+	if (dedicated) {
+		// a headless host never opens a window or plays a sound
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+		SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER
 #ifdef NOSDLPARACHUTE
 			| SDL_INIT_NOPARACHUTE
@@ -262,11 +276,15 @@ int initsystem(void)
     grabmouse(1);
 	atexit(uninitsystem);
 
+	initpalexpand();
+	OSD_RegisterFunction("palbench","palbench [frames]: times 8-bit to 32-bit frame conversion at 1080p and 4K",osdcmd_palbench);
+	OSD_RegisterFunction("framestats","framestats [reset]: shows the spread of recent frame times, to check frame pacing",osdcmd_framestats);
+
 	frameplace = 0;
 	lockcount = 0;
 
 #ifdef USE_OPENGL
-	if (loadgldriver(getenv("BUILD_GLDRV"))) {
+	if (!dedicated && loadgldriver(getenv("BUILD_GLDRV"))) {
 //		initprintf("Failed loading OpenGL driver. GL modes will be unavailable.\n");
 //		nogl = 1;
         initprintf("Failed loading OpenGL driver. Exiting...\n");
@@ -1064,18 +1082,160 @@ int checkvideomode(int *x, int *y, int c, int fs, int forced)
 }
 
 static SDL_Color sdlayer_pal[256];
+static Uint32 sdlayer_pal32[256];	// sdlayer_pal as ARGB8888, for expanding 8-bit frames
 
 static void destroy_window_resources() {
+	if ( sdl_texture ) {
+		SDL_DestroyTexture( sdl_texture );
+	}
+	sdl_texture = NULL;
+	if ( sdl_renderer ) {
+		SDL_DestroyRenderer( sdl_renderer );
+	}
+	sdl_renderer = NULL;
 	if ( sdl_buffersurface ) {
 		SDL_FreeSurface( sdl_buffersurface );
 	}
 	sdl_buffersurface = NULL;
+	if ( sdl_context ) {
+		SDL_GL_DeleteContext( sdl_context );
+	}
+	sdl_context = NULL;
 	if ( sdl_window ) {
 		SDL_DestroyWindow( sdl_window );
 	}
 	sdl_window = NULL;
 }
 
+
+//
+// 8-bit frame presentation
+//
+// The classic renderer draws palette indices into sdl_buffersurface. To
+// present a frame the indices are expanded through the faded palette into
+// a 32-bit streaming texture, which any SDL renderer can show, including
+// the software one on machines without a usable GPU.
+//
+typedef void (*palexpandfunc)(const unsigned char *src, Uint32 *dst, long n, const Uint32 *pal);
+
+static void palexpand_c(const unsigned char *src, Uint32 *dst, long n, const Uint32 *pal)
+{
+	for (; n >= 8; n -= 8, src += 8, dst += 8) {
+		dst[0] = pal[src[0]]; dst[1] = pal[src[1]];
+		dst[2] = pal[src[2]]; dst[3] = pal[src[3]];
+		dst[4] = pal[src[4]]; dst[5] = pal[src[5]];
+		dst[6] = pal[src[6]]; dst[7] = pal[src[7]];
+	}
+	for (; n > 0; n--) *dst++ = pal[*src++];
+}
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# define PALEXPAND_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (_MSC_VER >= 1800) && (defined(_M_IX86) || defined(_M_X64))
+# define PALEXPAND_AVX2
+#endif
+
+#ifdef PALEXPAND_AVX2
+#include <immintrin.h>
+
+	// 16 pixels a step: widen the indices to dwords and gather the colours
+static PALEXPAND_AVX2 void palexpand_avx2(const unsigned char *src, Uint32 *dst, long n, const Uint32 *pal)
+{
+	__m128i idx;
+
+	for (; n >= 16; n -= 16, src += 16, dst += 16) {
+		idx = _mm_loadu_si128((const __m128i *)src);
+		_mm256_storeu_si256((__m256i *)dst,
+			_mm256_i32gather_epi32((const int *)pal, _mm256_cvtepu8_epi32(idx), 4));
+		_mm256_storeu_si256((__m256i *)(dst+8),
+			_mm256_i32gather_epi32((const int *)pal, _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8)), 4));
+	}
+	if (n > 0) palexpand_c(src, dst, n, pal);
+}
+#endif
+
+static palexpandfunc palexpand = NULL;
+
+static void initpalexpand(void)
+{
+	palexpand = palexpand_c;
+#ifdef PALEXPAND_AVX2
+	if (getcpufeatures() & CPUFEAT_AVX2) palexpand = palexpand_avx2;
+#endif
+}
+
+typedef struct {
+	palexpandfunc func;
+	const unsigned char *src;
+	long srcpitch;
+	unsigned char *dst;
+	long dstpitch, width;
+	const Uint32 *pal;
+} palexpandjob;
+
+static void palexpandrows(void *arg, long start, long end)
+{
+	palexpandjob *job = (palexpandjob *)arg;
+	long y;
+
+	for (y = start; y < end; y++)
+		job->func(job->src + y*job->srcpitch, (Uint32 *)(job->dst + y*job->dstpitch), job->width, job->pal);
+}
+
+static void expandframe(palexpandfunc func, const unsigned char *src, long srcpitch,
+		unsigned char *dst, long dstpitch, long width, long height)
+{
+	palexpandjob job;
+
+	job.func = func;
+	job.src = src; job.srcpitch = srcpitch;
+	job.dst = dst; job.dstpitch = dstpitch;
+	job.width = width;
+	job.pal = sdlayer_pal32;
+	runworkers(palexpandrows, &job, height, 64);
+}
+
+static int osdcmd_palbench(const osdfuncparm_t *parm)
+{
+	static const long sizes[2][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	struct { const char *name; palexpandfunc func; } kernels[2];
+	unsigned char *src, *dst;
+	long i, j, k, numkernels = 0, frames = 60;
+	double t;
+
+	kernels[numkernels].name = "c"; kernels[numkernels++].func = palexpand_c;
+#ifdef PALEXPAND_AVX2
+	if (getcpufeatures() & CPUFEAT_AVX2) { kernels[numkernels].name = "avx2"; kernels[numkernels++].func = palexpand_avx2; }
+#endif
+	if (parm->numparms > 0) frames = max(1, atol(parm->parms[0]));
+
+	src = (unsigned char *)Bmalloc(3840*2160);
+	dst = (unsigned char *)Bmalloc(3840*2160*4);
+	if (!src || !dst) {
+		if (src) Bfree(src);
+		if (dst) Bfree(dst);
+		OSD_Printf("palbench: out of memory\n");
+		return OSDCMD_OK;
+	}
+	for (i = 0; i < 3840*2160; i++) src[i] = (unsigned char)((i*2654435761u) >> 24);
+
+	for (k = 0; k < numkernels; k++) {
+		for (j = 0; j < 2; j++) {
+			t = Sys_GetTicks();
+			for (i = 0; i < frames; i++)
+				expandframe(kernels[k].func, src, sizes[j][0], dst, sizes[j][0]*4, sizes[j][0], sizes[j][1]);
+			t = (Sys_GetTicks() - t) / (double)frames;
+			OSD_Printf("palbench %-4s %ldx%ld: %.3f ms/frame, %.0f Mpixel/s (%d thread(s))\n",
+				kernels[k].name, sizes[j][0], sizes[j][1], t,
+				t > 0.0 ? (double)(sizes[j][0]*sizes[j][1]) / (t * 1000.0) : 0.0, getworkercount());
+		}
+	}
+
+	Bfree(dst);
+	Bfree(src);
+	return OSDCMD_OK;
+}
+
 //
 // setvideomode() -- set SDL video mode
 //
@@ -1197,6 +1357,7 @@ int setvideomode(int x, int y, int c, int fs, int force)
 		};
 
 		if (nogl) return -1;
+		if (sdl_renderer) destroy_window_resources();	// the 8-bit window has no GL context
 	initprintf("Setting video mode %dx%d (%d-bpp %s)\n",
 	
 				x,y,c, ((fs&1) ? "fullscreen" : "windowed"));
@@ -1247,6 +1408,7 @@ int setvideomode(int x, int y, int c, int fs, int force)
 				x,y,c, ((fs&1) ? "fullscreen" : "windowed"));
 
         // init
+        destroy_window_resources();
         sdl_window = SDL_CreateWindow("", SDL_WINDOWPOS_UNDEFINED,SDL_WINDOWPOS_UNDEFINED,
                                       x,y, ((fs&1)?SDL_WINDOW_FULLSCREEN:0));
         if (!sdl_window)
@@ -1256,6 +1418,20 @@ int setvideomode(int x, int y, int c, int fs, int force)
             return -1;
         }
 
+        sdl_renderer = SDL_CreateRenderer(sdl_window, -1, ud.vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+        if (!sdl_renderer)
+            sdl_renderer = SDL_CreateRenderer(sdl_window, -1, SDL_RENDERER_SOFTWARE);
+        if (sdl_renderer)
+            sdl_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                            SDL_TEXTUREACCESS_STREAMING, x, y);
+        if (!sdl_texture)
+        {
+            initprintf("Unable to set video mode: SDL_CreateTexture failed: %s\n",
+                       SDL_GetError());
+            destroy_window_resources();
+            return -1;
+        }
+
         sdl_buffersurface = SDL_CreateRGBSurface(0, x, y, c, 0, 0, 0, 0);
         if (!sdl_buffersurface)
         {
@@ -1378,6 +1554,20 @@ void begindrawing(void)
 		return;
 
 	if (offscreenrendering) return;	
+
+	if (!sdl_buffersurface) return;
+	if (SDL_MUSTLOCK(sdl_buffersurface)) SDL_LockSurface(sdl_buffersurface);
+	frameplace = (long)sdl_buffersurface->pixels;
+
+	if (sdl_buffersurface->pitch != bytesperline || modechange) {
+		bytesperline = sdl_buffersurface->pitch;
+		imageSize = bytesperline*yres;
+		setvlinebpl(bytesperline);
+
+		j = 0;
+		for(i=0;i<=ydim;i++) ylookup[i] = j, j += bytesperline;
+		modechange=0;
+	}
 }
 
 
@@ -1399,14 +1589,70 @@ void enddrawing(void)
 
 	if (offscreenrendering) return;
 
+	if (sdl_buffersurface && SDL_MUSTLOCK(sdl_buffersurface)) SDL_UnlockSurface(sdl_buffersurface);
 }
 
 int dnFPS = 0;
 
+// Recent frame-to-frame times in msec, for judging how even the pacing is
+#define FRAMESTATS 512
+static double frametimes[FRAMESTATS];
+static int numframetimes = 0, framestatpos = 0;
+static double lastframetime = 0.0;
+
+static int cmpframetime(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static int osdcmd_framestats(const osdfuncparm_t *parm)
+{
+	double sorted[FRAMESTATS], mean = 0.0, var = 0.0;
+	int i, n = numframetimes;
+
+	if (parm->numparms > 0 && !Bstrcasecmp(parm->parms[0], "reset")) {
+		numframetimes = framestatpos = 0;
+		lastframetime = 0.0;
+		return OSDCMD_OK;
+	}
+	if (n < 2) {
+		OSD_Printf("framestats: not enough frames yet\n");
+		return OSDCMD_OK;
+	}
+
+	for (i = 0; i < n; i++) {
+		sorted[i] = frametimes[i];
+		mean += frametimes[i];
+	}
+	mean /= n;
+	for (i = 0; i < n; i++) var += (frametimes[i]-mean) * (frametimes[i]-mean);
+	var /= n-1;
+	qsort(sorted, n, sizeof(double), cmpframetime);
+
+	OSD_Printf("framestats: last %d frames, target %s%.3f ms\n", n,
+		(!ud.vsync && ud.fps_max > 10) ? "" : "none, ", ud.fps_max > 0 ? 1000.0 / ud.fps_max : 0.0);
+	OSD_Printf("  mean %.3f ms (%.1f fps), std dev %.3f ms, variance %.4f ms^2\n",
+		mean, mean > 0.0 ? 1000.0 / mean : 0.0, sqrt(var), var);
+	OSD_Printf("  min %.3f  1%% %.3f  median %.3f  99%% %.3f  max %.3f ms\n",
+		sorted[0], sorted[n/100], sorted[n/2], sorted[n-1-n/100], sorted[n-1]);
+	return OSDCMD_OK;
+}
+
 void dnCalcFPS() {
 	static Uint32 prev_time = 0;
 	static Uint32 frame_counter = 0;
 	int current_time;
+	double t;
+
+	t = Sys_GetTicks();
+	if (lastframetime > 0.0) {
+		frametimes[framestatpos] = t - lastframetime;
+		framestatpos = (framestatpos + 1) % FRAMESTATS;
+		if (numframetimes < FRAMESTATS) numframetimes++;
+	}
+	lastframetime = t;
+
 	frame_counter++;
 	if (frame_counter == 50) {
 		frame_counter = 0;
@@ -1476,7 +1722,25 @@ void showframe(int w)
 		while (lockcount) enddrawing();
 	}
 
+	if (!sdl_texture || !sdl_buffersurface) return;
 
+	{
+		void *pixels;
+		int pitch;
+
+		if (SDL_LockTexture(sdl_texture, NULL, &pixels, &pitch) == 0) {
+			expandframe(palexpand, (const unsigned char *)sdl_buffersurface->pixels, sdl_buffersurface->pitch,
+				(unsigned char *)pixels, pitch, xres, yres);
+			SDL_UnlockTexture(sdl_texture);
+		}
+	}
+	SDL_RenderCopy(sdl_renderer, sdl_texture, NULL, NULL);
+	SDL_RenderPresent(sdl_renderer);
+
+	dnCalcFPS();
+	if (!ud.vsync && ud.fps_max > 10) {
+		Sys_ThrottleFPS(ud.fps_max);
+	}
 }
 
 
@@ -1498,6 +1762,11 @@ int setpalette(int start, int num, char *dapal)
 		dapal += 4;
 	}
 
+	for (i=0; i<256; i++)
+		sdlayer_pal32[i] = 0xff000000 | ((Uint32)sdlayer_pal[i].r << 16) |
+			((Uint32)sdlayer_pal[i].g << 8) | (Uint32)sdlayer_pal[i].b;
+
+	if (!sdl_palptr) return 0;
     return (SDL_SetPaletteColors(sdl_palptr, sdlayer_pal, 0, 256) != 0);
 }
 
@@ -0,0 +1,247 @@
+// Fork/join worker pool used by the engine and game for data-parallel loops
+
+#include "compat.h"
+#include "workers.h"
+
+#ifdef HAVE_SDL
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "SDL_atomic.h"
+
+#define MAXWORKERS 16
+
+static SDL_Thread *workthread[MAXWORKERS];
+static SDL_sem *workstart = NULL, *workdone = NULL;
+static SDL_mutex *worklock = NULL;
+static int numworkers = 0, workquit = 0;
+
+typedef struct bgjob {
+	backgroundfunc func;
+	void *arg;
+	struct bgjob *next;
+} bgjob;
+
+static SDL_Thread *bgthread = NULL;
+static SDL_mutex *bglock = NULL;
+static SDL_cond *bgcond = NULL;
+static bgjob *bghead = NULL, *bgtail = NULL;
+static int bgbusy = 0, bgquit = 0;
+
+static workerfunc jobfunc;
+static void *jobarg;
+static long jobcount, jobgrain;
+static SDL_atomic_t jobnext;
+
+static void dojobs(void)
+{
+	long s, e;
+
+	while ((s = (long)SDL_AtomicAdd(&jobnext, (int)jobgrain)) < jobcount) {
+		e = s + jobgrain;
+		if (e > jobcount) e = jobcount;
+		jobfunc(jobarg, s, e);
+	}
+}
+
+static int workerproc(void *unused)
+{
+	while (1) {
+		SDL_SemWait(workstart);
+		if (workquit) break;
+		dojobs();
+		SDL_SemPost(workdone);
+	}
+	return 0;
+}
+
+static int backgroundproc(void *unused)
+{
+	bgjob *job;
+
+	SDL_LockMutex(bglock);
+	while (1) {
+		while (!bghead && !bgquit) SDL_CondWait(bgcond, bglock);
+		if (!bghead) break;	// only quits once the queue is empty
+
+		job = bghead;
+		bghead = job->next;
+		if (!bghead) bgtail = NULL;
+		bgbusy = 1;
+		SDL_UnlockMutex(bglock);
+
+		job->func(job->arg);
+		free(job);
+
+		SDL_LockMutex(bglock);
+		bgbusy = 0;
+		SDL_CondBroadcast(bgcond);
+	}
+	SDL_UnlockMutex(bglock);
+	return 0;
+}
+
+static void uninitbackground(void)
+{
+	if (bgthread) {
+		SDL_LockMutex(bglock);
+		bgquit = 1;
+		SDL_CondBroadcast(bgcond);
+		SDL_UnlockMutex(bglock);
+		SDL_WaitThread(bgthread, NULL);
+		bgthread = NULL;
+	}
+	if (bgcond) SDL_DestroyCond(bgcond);
+	if (bglock) SDL_DestroyMutex(bglock);
+	bgcond = NULL;
+	bglock = NULL;
+	bgquit = 0;
+}
+
+int initworkers(int numthreads)
+{
+	int i;
+
+	if (numworkers > 0) return 0;
+
+	if (numthreads <= 0) numthreads = SDL_GetCPUCount() - 1;
+	if (numthreads > MAXWORKERS) numthreads = MAXWORKERS;
+	if (numthreads <= 0) return 0;
+
+	workstart = SDL_CreateSemaphore(0);
+	workdone = SDL_CreateSemaphore(0);
+	worklock = SDL_CreateMutex();
+	if (!workstart || !workdone || !worklock) {
+		uninitworkers();
+		return -1;
+	}
+
+	workquit = 0;
+	for (i = 0; i < numthreads; i++) {
+		workthread[i] = SDL_CreateThread(workerproc, "worker", NULL);
+		if (!workthread[i]) break;
+		numworkers++;
+	}
+
+	return 0;
+}
+
+void uninitworkers(void)
+{
+	int i;
+
+	workquit = 1;
+	for (i = 0; i < numworkers; i++) SDL_SemPost(workstart);
+	for (i = 0; i < numworkers; i++) SDL_WaitThread(workthread[i], NULL);
+	numworkers = 0;
+
+	uninitbackground();
+
+	if (workstart) SDL_DestroySemaphore(workstart);
+	if (workdone) SDL_DestroySemaphore(workdone);
+	if (worklock) SDL_DestroyMutex(worklock);
+	workstart = workdone = NULL;
+	worklock = NULL;
+}
+
+int getworkercount(void)
+{
+	return numworkers + 1;
+}
+
+void runworkers(workerfunc func, void *arg, long count, long grain)
+{
+	int i, n;
+
+	if (count <= 0) return;
+	if (grain < 1) grain = 1;
+
+	if (numworkers == 0 || count <= grain || SDL_TryLockMutex(worklock) != 0) {
+		func(arg, 0, count);
+		return;
+	}
+
+	jobfunc = func;
+	jobarg = arg;
+	jobcount = count;
+	jobgrain = grain;
+	SDL_AtomicSet(&jobnext, 0);
+
+	// don't wake more threads than there are chunks to hand out
+	n = (int)((count + grain - 1) / grain) - 1;
+	if (n > numworkers) n = numworkers;
+
+	for (i = 0; i < n; i++) SDL_SemPost(workstart);
+	dojobs();
+	for (i = 0; i < n; i++) SDL_SemWait(workdone);
+
+	SDL_UnlockMutex(worklock);
+}
+
+void runbackground(backgroundfunc func, void *arg)
+{
+	bgjob *job;
+
+	// started on first use, so single-CPU machines get the thread too
+	if (!bglock) {
+		bglock = SDL_CreateMutex();
+		bgcond = SDL_CreateCond();
+		if (bglock && bgcond) bgthread = SDL_CreateThread(backgroundproc, "background", NULL);
+	}
+
+	if (!bgthread || (job = (bgjob *)malloc(sizeof(bgjob))) == NULL) {
+		finishbackground();
+		func(arg);
+		return;
+	}
+	job->func = func;
+	job->arg = arg;
+	job->next = NULL;
+
+	SDL_LockMutex(bglock);
+	if (bgtail) bgtail->next = job;
+	else bghead = job;
+	bgtail = job;
+	SDL_CondBroadcast(bgcond);
+	SDL_UnlockMutex(bglock);
+}
+
+void finishbackground(void)
+{
+	if (!bgthread) return;
+
+	SDL_LockMutex(bglock);
+	while (bghead || bgbusy) SDL_CondWait(bgcond, bglock);
+	SDL_UnlockMutex(bglock);
+}
+
+#else	// HAVE_SDL
+
+int initworkers(int numthreads)
+{
+	return 0;
+}
+
+void uninitworkers(void)
+{
+}
+
+int getworkercount(void)
+{
+	return 1;
+}
+
+void runworkers(workerfunc func, void *arg, long count, long grain)
+{
+	if (count > 0) func(arg, 0, count);
+}
+
+void runbackground(backgroundfunc func, void *arg)
+{
+	func(arg);
+}
+
+void finishbackground(void)
+{
+}
+
+#endif
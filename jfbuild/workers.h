@@ -0,0 +1,37 @@
+#ifndef __workers_h__
+#define __workers_h__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Small fork/join pool for splitting an index range across threads.
+// The caller always takes part in the work, so with no threads available
+// runworkers() simply calls func over the whole range itself.
+
+typedef void (*workerfunc)(void *arg, long start, long end);
+
+int  initworkers(int numthreads);	// numthreads <= 0 picks one per extra CPU
+void uninitworkers(void);
+int  getworkercount(void);		// threads taking part, including the caller
+
+// Calls func(arg,start,end) over [0,count) in chunks of at most 'grain'
+// items and returns once every chunk has completed. Nested or concurrent
+// calls degrade to running serially on the calling thread.
+void runworkers(workerfunc func, void *arg, long count, long grain);
+
+// A single background thread runs queued jobs one at a time, in the order
+// they were queued, for work such as compressing and writing files that the
+// caller doesn't need to wait for. Without threads the job runs right away.
+// finishbackground() returns once everything queued so far has run.
+
+typedef void (*backgroundfunc)(void *arg);
+
+void runbackground(backgroundfunc func, void *arg);
+void finishbackground(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
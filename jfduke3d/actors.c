@@ -28,9 +28,66 @@ Modifications for JonoF's port by Jonathon Fowler (jf@jonof.id.au)
 #include "duke3d.h"
 #include "dnAchievement.h"
 #include "dnMulti.h"
+#include "workers.h"
 
 extern char numenvsnds,actor_tog;
 
+// Interpolated positions are looked up by pointer through a chained hash
+// so set/stop don't have to walk every active entry.
+#define INTERPHASHSIZE 4096		// power of two, >= 2*MAXINTERPOLATIONS
+
+static short interphead[INTERPHASHSIZE];
+static short interpnext[MAXINTERPOLATIONS];
+static long interpival[MAXINTERPOLATIONS];
+
+static inline long interphash(long *posptr)
+{
+	unsigned long p = (unsigned long)(intptr_t)posptr;
+
+	p >>= 2;
+	return (long)((p ^ (p>>11)) & (INTERPHASHSIZE-1));
+}
+
+static long findinterpolation(long *posptr)
+{
+	long i;
+
+	for(i=interphead[interphash(posptr)];i>=0;i=interpnext[i])
+		if (curipos[i] == posptr) return i;
+	return -1;
+}
+
+static void unlinkinterpolation(long i)
+{
+	long j, h;
+
+	h = interphash(curipos[i]);
+	if (interphead[h] == i) { interphead[h] = interpnext[i]; return; }
+	for(j=interphead[h];j>=0;j=interpnext[j])
+		if (interpnext[j] == i) { interpnext[j] = interpnext[i]; return; }
+}
+
+void clearinterpolations(void)
+{
+	numinterpolations = 0;
+	startofdynamicinterpolations = 0;
+	clearbufbyte(interphead,sizeof(interphead),0xffffffff);
+}
+
+// rebuilds the hash after curipos[] has been written directly
+void relinkinterpolations(void)
+{
+	long i, h;
+
+	clearbufbyte(interphead,sizeof(interphead),0xffffffff);
+	for(i=0;i<numinterpolations;i++)
+	{
+		h = interphash(curipos[i]);
+		interpnext[i] = interphead[h];
+		interphead[h] = (short)i;
+	}
+}
+
 void updateinterpolations()  //Stick at beginning of domovethings
 {
 	long i;
@@ -41,42 +98,50 @@ void updateinterpolations()  //Stick at beginning of domovethings
 
 void setinterpolation(long *posptr)
 {
-	long i;
+	long h;
 
 	if (numinterpolations >= MAXINTERPOLATIONS) return;
-	for(i=numinterpolations-1;i>=0;i--)
-		if (curipos[i] == posptr) return;
+	if (findinterpolation(posptr) >= 0) return;
+	h = interphash(posptr);
 	curipos[numinterpolations] = posptr;
 	oldipos[numinterpolations] = *posptr;
+	interpnext[numinterpolations] = interphead[h];
+	interphead[h] = (short)numinterpolations;
 	numinterpolations++;
 }
 
 void stopinterpolation(long *posptr)
 {
-	long i;
-
-	for(i=numinterpolations-1;i>=startofdynamicinterpolations;i--)
-		if (curipos[i] == posptr)
-		{
-			numinterpolations--;
-			oldipos[i] = oldipos[numinterpolations];
-			bakipos[i] = bakipos[numinterpolations];
-			curipos[i] = curipos[numinterpolations];
-		}
+	long i, h;
+
+	i = findinterpolation(posptr);
+	if (i < startofdynamicinterpolations) return;
+
+	unlinkinterpolation(i);
+	numinterpolations--;
+	if (i == numinterpolations) return;
+
+	// move the last entry into the freed slot and re-point its hash link
+	unlinkinterpolation(numinterpolations);
+	oldipos[i] = oldipos[numinterpolations];
+	bakipos[i] = bakipos[numinterpolations];
+	curipos[i] = curipos[numinterpolations];
+	h = interphash(curipos[i]);
+	interpnext[i] = interphead[h];
+	interphead[h] = (short)i;
 }
 
 void dointerpolations(long smoothratio)       //Stick at beginning of drawscreen
 {
-	long i, j, odelta, ndelta;
+	long i, n = numinterpolations;
 
-	ndelta = 0; j = 0;
-	for(i=numinterpolations-1;i>=0;i--)
-	{
-		bakipos[i] = *curipos[i];
-		odelta = ndelta; ndelta = (*curipos[i])-oldipos[i];
-		if (odelta != ndelta) j = mulscale16(ndelta,smoothratio);
-		*curipos[i] = oldipos[i]+j;
-	}
+	for(i=0;i<n;i++) bakipos[i] = *curipos[i];
+
+	// contiguous lerp pass; kept free of pointer chasing so it vectorises
+	for(i=0;i<n;i++)
+		interpival[i] = oldipos[i] + (long)(((int64)(bakipos[i]-oldipos[i])*smoothratio)>>16);
+
+	for(i=0;i<n;i++) *curipos[i] = interpival[i];
 }
 
 void restoreinterpolations()  //Stick at end of drawscreen
@@ -897,24 +962,58 @@ void ms(short i)
     }
 }
 
+// movefta() runs in three passes so the cansee() tests can be spread over
+// the worker pool: a serial pass that draws every TRAND in the original
+// order, a parallel pass of read-only visibility queries, and a serial
+// commit in statlist order. The result is identical to the serial loop.
+
+#define FTA_NONE	0	// nothing to test, only the shading applies
+#define FTA_SKIP	1	// bailed out before the test, leave the sprite alone
+#define FTA_TEST	2	// wants a cansee() test
+
+typedef struct {
+	long x1, y1, z1, x2, y2, z2;
+	short sect1, sect2;
+	short i;
+	char state, seen;
+} ftatest;
+
+static ftatest ftatests[MAXSPRITES];
+char parallelactors = 1;
+
+static void ftacansee(void *arg, long start, long end)
+{
+	ftatest *t = (ftatest *)arg;
+	long n;
+
+	for(n=start;n<end;n++)
+		if (t[n].state == FTA_TEST)
+			t[n].seen = (char)(cansee_r(t[n].x1,t[n].y1,t[n].z1,t[n].sect1,t[n].x2,t[n].y2,t[n].z2,t[n].sect2) != 0);
+}
+
 void movefta(void)
 {
-    long x, px, py, sx, sy;
-    short i, j, p, psect, ssect, nexti;
+    long x, px, py, sx, sy, n, numtests;
+    short i, p, psect, ssect;
     spritetype *s;
+    ftatest *t;
 
-    i = headspritestat[2];
-    while(i >= 0)
+    numtests = 0;
+    for(i=headspritestat[2];i>=0;i=nextspritestat[i])
     {
-        nexti = nextspritestat[i];
-
         s = &sprite[i];
         p = findplayer(s,&x);
 
+        t = &ftatests[numtests++];
+        t->i = i;
+        t->state = FTA_SKIP;
+        t->seen = 0;
+
         ssect = psect = s->sectnum;
 
         if(sprite[ps[p].i].extra > 0 )
         {
+            t->state = FTA_NONE;
             if( x < 30000 )
             {
                 hittype[i].timetosleep++;
@@ -927,7 +1026,7 @@ void movefta(void)
                         updatesector(px,py,&psect);
                         if(psect == -1)
                         {
-                            i = nexti;
+                            t->state = FTA_SKIP;
                             continue;
                         }
                         sx = s->x+64-(TRAND&127);
@@ -935,56 +1034,76 @@ void movefta(void)
                         updatesector(px,py,&ssect);
                         if(ssect == -1)
                         {
-                            i = nexti;
+                            t->state = FTA_SKIP;
                             continue;
                         }
-                        j = cansee(sx,sy,s->z-(TRAND%(52<<8)),s->sectnum,px,py,ps[p].oposz-(TRAND%(32<<8)),ps[p].cursectnum);
+                        t->x1 = sx; t->y1 = sy; t->z1 = s->z-(TRAND%(52<<8)); t->sect1 = s->sectnum;
+                        t->x2 = px; t->y2 = py; t->z2 = ps[p].oposz-(TRAND%(32<<8)); t->sect2 = ps[p].cursectnum;
                     }
                     else
-                        j = cansee(s->x,s->y,s->z-((TRAND&31)<<8),s->sectnum,ps[p].oposx,ps[p].oposy,ps[p].oposz-((TRAND&31)<<8),ps[p].cursectnum);
-
-       //             j = 1;
-
-                    if(j) switch(s->picnum)
-                    {
-                        case RUBBERCAN:
-                        case EXPLODINGBARREL:
-                        case WOODENHORSE:
-                        case HORSEONSIDE:
-                        case CANWITHSOMETHING:
-                        case CANWITHSOMETHING2:
-                        case CANWITHSOMETHING3:
-                        case CANWITHSOMETHING4:
-                        case FIREBARREL:
-                        case FIREVASE:
-                        case NUKEBARREL:
-                        case NUKEBARRELDENTED:
-                        case NUKEBARRELLEAKED:
-                        case TRIPBOMB:
-                            if (sector[s->sectnum].ceilingstat&1)
-                                s->shade = sector[s->sectnum].ceilingshade;
-                            else s->shade = sector[s->sectnum].floorshade;
-
-                            hittype[i].timetosleep = 0;
-                            changespritestat(i,6);
-                            break;
-                        default:
-                            hittype[i].timetosleep = 0;
-                            check_fta_sounds(i);
-                            changespritestat(i,1);
-                            break;
+                    {
+                        t->x1 = s->x; t->y1 = s->y; t->z1 = s->z-((TRAND&31)<<8); t->sect1 = s->sectnum;
+                        t->x2 = ps[p].oposx; t->y2 = ps[p].oposy; t->z2 = ps[p].oposz-((TRAND&31)<<8); t->sect2 = ps[p].cursectnum;
                     }
-                    else hittype[i].timetosleep = 0;
+                    t->state = FTA_TEST;
                 }
             }
-            if( badguy( s ) )
+        }
+    }
+
+    if (parallelactors)
+        runworkers(ftacansee,ftatests,numtests,64);
+    else
+        ftacansee(ftatests,0,numtests);
+
+    for(n=0;n<numtests;n++)
+    {
+        t = &ftatests[n];
+        if (t->state == FTA_SKIP) continue;
+
+        i = t->i;
+        s = &sprite[i];
+
+        if (t->state == FTA_TEST)
+        {
+            if(t->seen) switch(s->picnum)
             {
-                if (sector[s->sectnum].ceilingstat&1)
-                    s->shade = sector[s->sectnum].ceilingshade;
-                else s->shade = sector[s->sectnum].floorshade;
+                case RUBBERCAN:
+                case EXPLODINGBARREL:
+                case WOODENHORSE:
+                case HORSEONSIDE:
+                case CANWITHSOMETHING:
+                case CANWITHSOMETHING2:
+                case CANWITHSOMETHING3:
+                case CANWITHSOMETHING4:
+                case FIREBARREL:
+                case FIREVASE:
+                case NUKEBARREL:
+                case NUKEBARRELDENTED:
+                case NUKEBARRELLEAKED:
+                case TRIPBOMB:
+                    if (sector[s->sectnum].ceilingstat&1)
+                        s->shade = sector[s->sectnum].ceilingshade;
+                    else s->shade = sector[s->sectnum].floorshade;
+
+                    hittype[i].timetosleep = 0;
+                    changespritestat(i,6);
+                    break;
+                default:
+                    hittype[i].timetosleep = 0;
+                    check_fta_sounds(i);
+                    changespritestat(i,1);
+                    break;
             }
+            else hittype[i].timetosleep = 0;
+        }
+
+        if( badguy( s ) )
+        {
+            if (sector[s->sectnum].ceilingstat&1)
+                s->shade = sector[s->sectnum].ceilingshade;
+            else s->shade = sector[s->sectnum].floorshade;
         }
-        i = nexti;
     }
 }
 
@@ -1186,6 +1305,10 @@ void moveplayers(void) //Players
 
         s = &sprite[i];
         p = &ps[s->yvel];
+
+        // a dedicated host's player is left where resetpspritevars put it
+        if(s->owner >= 0 && dnIsDedicatedHost(s->yvel)) { i = nexti; continue; }
+
         if(s->owner >= 0)
         {
             if(p->newowner >= 0 ) //Looking thru the camera
@@ -2846,7 +2969,7 @@ void movetransports(void)
                                     spritesound(TELEPORTER,i);
                                 }
 
-                                dnIterPlayers(k)
+                                dnIterPlaying(k)
                                     if(ps[k].cursectnum == sprite[OW].sectnum)
                                 {
                                     ps[k].frag_ps = p;
@@ -5248,7 +5371,7 @@ void moveeffectors(void)   //STATNUM 3
                     if( (sc->floorz-sc->ceilingz) < (108<<8) )
                     {
                         if(ud.clipping == 0 && s->xvel >= 192)
-                            dnIterPlayers( p )
+                            dnIterPlaying( p )
                                 if(sprite[ps[p].i].extra > 0)
                         {
                             k = ps[p].cursectnum;
@@ -5330,7 +5453,7 @@ void moveeffectors(void)   //STATNUM 3
                     if( (sc->floorz-sc->ceilingz) < (108<<8) )
                     {
                         if(ud.clipping == 0 && s->xvel >= 192)
-                            dnIterPlayers( p )
+                            dnIterPlaying( p )
                                 if(sprite[ps[p].i].extra > 0)
                         {
                             k = ps[p].cursectnum;
@@ -5429,7 +5552,7 @@ void moveeffectors(void)   //STATNUM 3
 
                     if( (sc->floorz-sc->ceilingz) < (108<<8) )
                         if(ud.clipping == 0)
-                            dnIterPlayers( p )
+                            dnIterPlaying( p )
                                 if(sprite[ps[p].i].extra > 0)
                     {
                         k = ps[p].cursectnum;
@@ -5498,7 +5621,7 @@ void moveeffectors(void)   //STATNUM 3
                     if( (sc->floorz-sc->ceilingz) < (108<<8) )
                     {
                         if(ud.clipping == 0)
-                            dnIterPlayers( p )
+                            dnIterPlaying( p )
                                 if(sprite[ps[p].i].extra > 0)
                         {
                             k = ps[p].cursectnum;
@@ -5868,7 +5991,7 @@ void moveeffectors(void)   //STATNUM 3
                     j = 1;
 
                     if( (sc->lotag&0xff) != 27)
-                        dnIterPlayers( p )
+                        dnIterPlaying( p )
                             if( sc->lotag != 30 && sc->lotag != 31 && sc->lotag != 0 )
                                 if(s->sectnum == sprite[ps[p].i].sectnum)
                                     j = 0;
@@ -0,0 +1,377 @@
+// concheck: standalone CON compiler/validator
+//
+// Compiles one or more CON trees with the game's own parser (gamedef.c built
+// with CONCHECK defined, so none of the actor interpreter, engine or SDL is
+// pulled in) and writes, for every tree, the compiled script image, its label
+// map and the compiler log, plus a one-line summary with timing on stdout.
+//
+// The compiler keeps its state in globals, so trees are compiled in parallel
+// by forking one child process per tree (-j). On Windows they run in turn.
+//
+// Built by the concheck target in duke3d/concheck.vcxproj and the Xcode
+// project. Elsewhere:
+//   cc -DCONCHECK -DNOASM -Ijfbuild -Ijfmact -Ijfduke3d -Icode -Ithirdparty/include
+//      -idirafter jfaudiolib jfduke3d/concheck.c jfduke3d/gamedef.c jfduke3d/global.c jfbuild/pragmas.c -o concheck
+//
+// The exit status is 0 only when every tree compiled and all its output
+// files were written.
+//
+// Usage: concheck [-j jobs] [-o outdir] <tree|file.con>...
+//   A directory argument compiles GAME.CON inside it; a file compiles that
+//   file with includes resolved relative to its directory.
+
+#include "duke3d.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+# include <windows.h>
+# include <direct.h>
+# define chdir _chdir
+# define getcwd _getcwd
+#else
+# include <unistd.h>
+# include <sys/time.h>
+# include <sys/types.h>
+# include <sys/wait.h>
+# include <sys/stat.h>
+#endif
+
+#define CONCHECK_MAGIC "CONCHK01"
+#define MAXKFILES 16
+
+static FILE *logfile = NULL;
+static char outdir[1024] = ".";
+
+//
+// Stand-ins for the pieces of the game and engine the compiler calls
+//
+
+void initprintf(const char *f, ...)
+{
+	va_list va;
+
+	va_start(va, f);
+	vfprintf(logfile ? logfile : stderr, f, va);
+	va_end(va);
+}
+
+void gameexit(const char *t)
+{
+	initprintf("%s\n", t);
+	if (logfile) fclose(logfile);
+	exit(2);
+}
+
+static FILE *kfiles[MAXKFILES];
+
+long kopen4load(char *filename, char searchfirst)
+{
+	char name[BMAX_PATH];
+	FILE *fp;
+	long i, h;
+
+	for (h = 0; h < MAXKFILES; h++) if (!kfiles[h]) break;
+	if (h == MAXKFILES) return -1;
+
+	// CONs name their includes in whatever case DOS let them get away with
+	Bstrncpy(name, filename, sizeof(name)-1);
+	name[sizeof(name)-1] = 0;
+	fp = fopen(name, "rb");
+	if (!fp) { for (i = 0; name[i]; i++) name[i] = tolower(name[i]); fp = fopen(name, "rb"); }
+	if (!fp) { for (i = 0; name[i]; i++) name[i] = toupper(name[i]); fp = fopen(name, "rb"); }
+	if (!fp) return -1;
+
+	kfiles[h] = fp;
+	return h;
+}
+
+long kread(long handle, void *buffer, long leng)
+{
+	return (long)fread(buffer, 1, leng, kfiles[handle]);
+}
+
+long kfilelength(long handle)
+{
+	long pos, len;
+
+	pos = ftell(kfiles[handle]);
+	fseek(kfiles[handle], 0, SEEK_END);
+	len = ftell(kfiles[handle]);
+	fseek(kfiles[handle], pos, SEEK_SET);
+	return len;
+}
+
+void kclose(long handle)
+{
+	if (handle < 0 || handle >= MAXKFILES || !kfiles[handle]) return;
+	fclose(kfiles[handle]);
+	kfiles[handle] = NULL;
+}
+
+//
+// Timing
+//
+
+static double gettimems(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER f, c;
+	QueryPerformanceFrequency(&f);
+	QueryPerformanceCounter(&c);
+	return (double)c.QuadPart * 1000.0 / (double)f.QuadPart;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec * 1000.0 + (double)tv.tv_usec / 1000.0;
+#endif
+}
+
+//
+// Output
+//
+
+static void makeoutname(char *dest, int destlen, const char *tree, const char *ext)
+{
+	char base[256];
+	int i, j;
+
+	// flatten the tree path into a single file name
+	for (i = j = 0; tree[i] && j < (int)sizeof(base)-1; i++) {
+		if (isalnum((unsigned char)tree[i]) || tree[i] == '-' || tree[i] == '_' || tree[i] == '.')
+			base[j++] = tree[i];
+		else if (j > 0 && base[j-1] != '_')
+			base[j++] = '_';
+	}
+	base[j] = 0;
+
+	Bsnprintf(dest, destlen, "%s/%s.%s", outdir, base, ext);
+	dest[destlen-1] = 0;
+}
+
+static char *labeltypename(long type)
+{
+	if (type & 2) return "state";
+	if (type & 4) return "actor";
+	if (type & 8) return "action";
+	if (type & 16) return "ai";
+	if (type & 32) return "move";
+	return "define";
+}
+
+// Script words that point back into script[] are written relative to its
+// start, with a bit set in the relocation map so a loader can rebase them.
+static int writescript(const char *fn)
+{
+	FILE *fp;
+	long i, size, w;
+	unsigned char *reloc;
+	int ok;
+	long base = (long)&script[0], end = (long)&script[MAXSCRIPTSIZE];
+
+	size = (long)(scriptptr - script);
+	reloc = (unsigned char *)calloc((size+7)>>3, 1);
+	if (!reloc) return -1;
+
+	fp = fopen(fn, "wb");
+	if (!fp) { free(reloc); return -1; }
+
+	ok = fwrite(CONCHECK_MAGIC, 8, 1, fp) == 1;
+	w = size; ok &= fwrite(&w, sizeof(w), 1, fp) == 1;
+	for (i = 0; i < size; i++) {
+		w = script[i];
+		if (w >= base && w < end && ((w - base) % sizeof(long)) == 0) {
+			w = (w - base) / sizeof(long);
+			reloc[i>>3] |= 1<<(i&7);
+		}
+		ok &= fwrite(&w, sizeof(w), 1, fp) == 1;
+	}
+	if (size > 0) ok &= fwrite(reloc, (size+7)>>3, 1, fp) == 1;
+
+	ok &= fclose(fp) == 0;
+	free(reloc);
+	return ok ? 0 : -1;
+}
+
+static int writelabels(const char *fn)
+{
+	FILE *fp;
+	long i, code;
+	long base = (long)&script[0], end = (long)&script[MAXSCRIPTSIZE];
+	int ok = 1;
+
+	fp = fopen(fn, "w");
+	if (!fp) return -1;
+
+	for (i = 0; i < labelcnt; i++) {
+		code = labelcode[i];
+		if (!(labeltype[i] & 1) && code >= base && code < end)
+			ok &= fprintf(fp, "%s\t%s\t@%ld\n", label+(i<<6), labeltypename(labeltype[i]), (code - base) / (long)sizeof(long)) > 0;
+		else
+			ok &= fprintf(fp, "%s\t%s\t%ld\n", label+(i<<6), labeltypename(labeltype[i]), code) > 0;
+	}
+
+	ok &= fclose(fp) == 0;
+	return ok ? 0 : -1;
+}
+
+//
+// Compiling one tree
+//
+
+static int checktree(const char *tree)
+{
+	char root[BMAX_PATH], confile[BMAX_PATH], fn[BMAX_PATH], cwd[BMAX_PATH], *slash;
+	char *text;
+	long fil, len;
+	double t0, t1;
+	int rv = 0, compiled = 0, written = 1;
+	struct Bstat st;
+
+	// the tree is compiled from inside its root; the caller may go on to
+	// other trees given relative to where it started
+	if (!getcwd(cwd, sizeof(cwd))) {
+		printf("FAIL\t%s\tcannot get the current directory\n", tree);
+		fflush(stdout);
+		return 1;
+	}
+
+	Bstrncpy(root, tree, sizeof(root)-1);
+	root[sizeof(root)-1] = 0;
+
+	if (Bstat(root, &st) == 0 && (st.st_mode & S_IFDIR)) {
+		strcpy(confile, "GAME.CON");
+	} else {
+		slash = Bstrrchr(root, '/');
+		if (!slash) slash = Bstrrchr(root, '\\');
+		if (slash) { *slash = 0; strcpy(confile, slash+1); }
+		else { strcpy(confile, root); strcpy(root, "."); }
+	}
+
+	makeoutname(fn, sizeof(fn), tree, "log");
+	logfile = fopen(fn, "w");
+
+	if (chdir(root) != 0) {
+		initprintf("Cannot enter %s\n", root);
+		rv = 1;
+		goto done;
+	}
+
+	fil = kopen4load(confile, 0);
+	if (fil < 0) {
+		initprintf("CON file \"%s\" was not found.\n", confile);
+		rv = 1;
+		goto done;
+	}
+	len = kfilelength(fil);
+	text = (char *)Bmalloc(len+1);
+	if (!text) gameexit("Out of memory.");
+	kread(fil, text, len);
+	kclose(fil);
+	text[len] = 0;
+
+	initprintf("Compiling: %s (%ld bytes)\n", confile, len);
+
+	t0 = gettimems();
+	compileconbuffer(text, confile);
+	t1 = gettimems();
+	compiled = 1;
+
+	Bfree(text);
+
+	initprintf("Found %ld warning(s), %ld error(s).\n", (long)warning, (long)error);
+
+	if (!error) {
+		makeoutname(fn, sizeof(fn), tree, "conc");
+		if (writescript(fn)) { initprintf("Could not write %s\n", fn); written = 0; }
+		makeoutname(fn, sizeof(fn), tree, "labels");
+		if (writelabels(fn)) { initprintf("Could not write %s\n", fn); written = 0; }
+	}
+
+	printf("%s\t%s\terrors=%ld\twarnings=%ld\tcode=%ld\tlabels=%ld\tms=%.2f%s\n",
+		(error || !written) ? "FAIL" : "OK", tree, (long)error, (long)warning,
+		(long)((scriptptr-script)<<2)-4, labelcnt, t1 - t0, written ? "" : "\toutput not written, see log");
+	fflush(stdout);
+
+	rv = (error || !written) ? 1 : 0;
+
+done:
+	if (rv && !compiled) {
+		printf("FAIL\t%s\tnot compiled, see log\n", tree);
+		fflush(stdout);
+	}
+	if (logfile) fclose(logfile);
+	logfile = NULL;
+	if (chdir(cwd) != 0 && !rv) rv = 1;
+	return rv;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: concheck [-j jobs] [-o outdir] <tree|file.con>...\n"
+		"  -j jobs    compile this many trees at once (default 1)\n"
+		"  -o outdir  where .conc, .labels and .log files go (default .)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int i, jobs = 1, failed = 0, first;
+	char cwd[BMAX_PATH];
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-j") && i+1 < argc) jobs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i+1 < argc) {
+			Bstrncpy(outdir, argv[++i], sizeof(outdir)-1);
+		}
+		else usage();
+	}
+	if (i >= argc) usage();
+	first = i;
+	if (jobs < 1) jobs = 1;
+
+	// trees chdir into their root, so the output path has to be absolute
+	if (outdir[0] != '/' && outdir[0] != '\\' && !(outdir[0] && outdir[1] == ':')) {
+		if (!getcwd(cwd, sizeof(cwd))) return 1;
+		Bstrcat(cwd, "/");
+		Bstrncat(cwd, outdir, sizeof(cwd)-strlen(cwd)-1);
+		Bstrncpy(outdir, cwd, sizeof(outdir)-1);
+	}
+
+	label     = (char *)Bmalloc(MAXLABELS<<6);
+	labelcode = (long *)Bmalloc(MAXLABELS*sizeof(long));
+	labeltype = (long *)Bmalloc(MAXLABELS*sizeof(long));
+	if (!label || !labelcode || !labeltype) return 1;
+
+#ifdef _WIN32
+	for (i = first; i < argc; i++)
+		failed += checktree(argv[i]);
+#else
+	{
+		int running = 0, status;
+		pid_t pid;
+
+		for (i = first; i < argc || running > 0; ) {
+			if (i < argc && running < jobs) {
+				fflush(stdout);
+				pid = fork();
+				if (pid == 0) exit(checktree(argv[i]));
+				if (pid < 0) { failed += checktree(argv[i]); i++; continue; }
+				running++;
+				i++;
+				continue;
+			}
+			if (wait(&status) < 0) break;
+			running--;
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+		}
+	}
+#endif
+
+	return failed ? 1 : 0;
+}
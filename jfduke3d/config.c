@@ -38,6 +38,7 @@ Modifications for JonoF's port by Jonathon Fowler (jf@jonof.id.au)
 #include "_functio.h"
 #undef __SETUP__
 #include "dnAPI.h"
+#include "dnSaveFile.h"
 
 //
 // Sound variables
@@ -576,10 +577,10 @@ void CONFIG_SetupJoystick( void )
 
 void readsavenames(void)
 {
-    long dummy;
+    int32 dummy;
     short i;
     char fn[13];
-    BFILE *fil;
+    saveFile_t *fil;
 
 //        Bstrcpy(fn,"game_.sav");
         sprintf(fn, "game__%d.sav", dnGetAddonId());
@@ -587,13 +588,11 @@ void readsavenames(void)
     for (i=0;i<10;i++)
     {
         fn[4] = i+'0';
-        if ((fil = Bfopen(fn,"rb")) == NULL ) continue;
-        if (dfread(&dummy,4,1,fil) != 1) { Bfclose(fil); continue; }
-
-        if(dummy != BYTEVERSION) return;
-        if (dfread(&dummy,4,1,fil) != 1) { Bfclose(fil); continue; }
-		if (dfread(&ud.savegame[i][0],19,1,fil) != 1) { ud.savegame[i][0] = 0; }
-        Bfclose(fil);
+        if ((fil = dnSaveOpen(fn)) == NULL ) continue;
+        if (dnSaveRead(&dummy,4,1,fil) != 1 || dummy != BYTEVERSION) { dnSaveEnd(fil); continue; }
+        if (dnSaveRead(&dummy,4,1,fil) != 1) { dnSaveEnd(fil); continue; }
+		if (dnSaveRead(&ud.savegame[i][0],19,1,fil) != 1) { ud.savegame[i][0] = 0; }
+        dnSaveEnd(fil);
     }
 }
 
@@ -680,6 +679,7 @@ int32 CONFIG_ReadSetup( void )
 	SCRIPT_GetNumber( scripthandle, "Misc", "ShowLevelStats",&ud.levelstats);
 	SCRIPT_GetNumber( scripthandle, "Misc", "ShowOpponentWeapons",&ShowOpponentWeapons);
 	dummy = useprecache; SCRIPT_GetNumber( scripthandle, "Misc", "UsePrecache",&dummy); useprecache = dummy != 0;
+	dummy = parallelactors; SCRIPT_GetNumber( scripthandle, "Misc", "ParallelActors",&dummy); parallelactors = dummy != 0;
 	// weapon choices are defaulted in checkcommandline, which may override them
 	if (!CommandWeaponChoice) for(i=0;i<10;i++)
 	{
@@ -828,6 +828,7 @@ void CONFIG_WriteSetup( void )
 	SCRIPT_PutNumber( scripthandle, "Misc", "StatusBarScale",ud.statusbarscale,false,false);
 	SCRIPT_PutNumber( scripthandle, "Misc", "ShowOpponentWeapons",ShowOpponentWeapons,false,false);
 	SCRIPT_PutNumber( scripthandle, "Misc", "UsePrecache",useprecache,false,false);
+	SCRIPT_PutNumber( scripthandle, "Misc", "ParallelActors",parallelactors,false,false);
 
 	SCRIPT_PutNumber( scripthandle, "Controls","UseJoystick",UseJoystick,false,false);
 	SCRIPT_PutNumber( scripthandle, "Controls","UseMouse",UseMouse,false,false);
@@ -441,6 +441,8 @@ extern char sounds[NUM_SOUNDS][14];
 	// JBF 20040531: adding 16 extra to the script so we have some leeway
 	// to (hopefully) safely abort when hitting the limit
 extern long script[MAXSCRIPTSIZE+16],*scriptptr,*insptr,*labelcode,labelcnt,*labeltype;
+	// compilecons() keeps the label names in sprite[], 64 bytes each
+#define MAXLABELS ((long)(sizeof(sprite)/64))
 extern char *label,*textptr,error,warning,killit_flag;
 extern long *actorscrptr[MAXTILES],*parsing_actor;
 extern char actortype[MAXTILES];
@@ -597,6 +599,7 @@ int loadpheader(char spot,struct savehead *saveh);
 #define TILE_VIEWSCR  (MAXTILES-5)
 
 extern char useprecache;
+extern char parallelactors;
 
 #define NAM_GRENADE_LIFETIME	120
 #define NAM_GRENADE_LIFETIME_VAR	30
@@ -166,6 +166,7 @@ extern long transword(void );
 extern long transnum(long type);
 extern char parsecommand(void );
 extern void passone(void );
+extern void compileconbuffer(char *text,char *filenam);
 extern void loadefs(char *fn);
 extern char dodge(spritetype *s);
 extern short furthestangle(short i,short angs);
@@ -211,7 +212,7 @@ extern void operatefta(void);
 extern void FTA(short q,struct player_struct *p);
 extern void showtwoscreens(void );
 extern void binscreen(void );
-extern void gameexit(char *t);
+extern void gameexit(const char *t);
 extern int exittotitle; /* ME: modifies behaviour of gameexit() function. */
 extern short strget(short x,short y,char *t,short dalen,short c);
 extern void displayrest(long smoothratio);
@@ -243,8 +244,10 @@ extern void closedemowrite(void );
 extern long playback(void );
 extern char moveloop(void);
 extern void fakedomovethingscorrect(void);
+extern void fakedomovethingsresync(void);
 extern void fakedomovethings(void );
 extern char domovethings(void );
+extern void incrementEndLevelsVars(void);
 extern void displaybonuspics(short x,short y,short p);
 extern void doorders(void );
 extern void dobonus(char bonusonly);
@@ -277,7 +280,9 @@ extern void loadpage(uint16 pagenumber,uint16 *pagepointer);
 extern void CPlayRunSkipDump(char *srcP,char *dstP);
 extern void renderframe(uint16 framenumber,uint16 *pagepointer);
 extern void drawframe(uint16 framenumber);
+extern void clearinterpolations(void);
 extern void updateinterpolations(void);
+extern void relinkinterpolations(void);
 extern void setinterpolation(long *posptr);
 extern void stopinterpolation(long *posptr);
 extern void dointerpolations(long smoothratio);
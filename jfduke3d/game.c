@@ -53,6 +53,14 @@ Modifications for JonoF's port by Jonathon Fowler(jf@jonof.id.au)
 #include "dnAPI.h"
 #include "dnMulti.h"
 #include "dnSnapshot.h"
+#include "dnRollback.h"
+#include "dnNetInput.h"
+#include "dnTelemetry.h"
+#include "dnDedicated.h"
+#include "dnDemo.h"
+#include "dnSaveFile.h"
+#include "dnRewind.h"
+#include "workers.h"
 
 #include "_control.h"
 
@@ -116,6 +124,8 @@ int noanim = 0;
 int nogamepad = 0;
 int delete_saves = 0;
 int norawmouse = 0;
+int dedicated = 0;
+int dedicatedhost = 0;
 
 int addon = 0;
 typedef struct  {
@@ -650,6 +660,8 @@ void getpackets(void)
     }
 
 	checktimeout();
+	dnInputGetPackets();
+	dnTelemetryUpdate();
 	
     while ((packbufleng = getpacket(&other,packbuf)) > 0)
     {
@@ -657,6 +669,7 @@ void getpackets(void)
 			Sys_DPrintf( "[DUKEMP] Warning: gave packet from unknown user index: %d\n", other );
 			continue;
 		}
+		if (dedicated) dnDedicatedNotePacket(other, packbufleng);
         switch(packbuf[0])
         {
             case 126:
@@ -819,6 +832,7 @@ void getpackets(void)
                 ud.m_coop = packbuf[8];
                 ud.m_marker = ud.marker = packbuf[9];
                 ud.m_ffire = ud.ffire = packbuf[10];
+                if (packbufleng > 11 && packbuf[11]) dedicatedhost = 1;
 
                 dnIterPlayers(i)
                 {
@@ -892,8 +906,11 @@ void getpackets(void)
                 ud.m_marker = ud.marker = packbuf[9];
                 ud.m_ffire = ud.ffire = packbuf[10];
 
-                copybufbyte(packbuf+10,boardfilename,packbufleng-11);
-                boardfilename[packbufleng-11] = 0;
+                for(i=10,j=0;i<packbufleng && packbuf[i] && j<(long)sizeof(boardfilename)-1;i++,j++)
+                    boardfilename[j] = packbuf[i];
+                boardfilename[j] = 0;
+                // a dedicated host puts a byte after the map name
+                if (i+1 < packbufleng && packbuf[i+1]) dedicatedhost = 1;
 
                 dnIterPlayers(i)
                 {
@@ -1002,7 +1019,8 @@ void faketimerhandler()
         if (i != myconnectindex)
             if (movefifoend[i] < movefifoend[myconnectindex]-200) return;
 
-     getinput(myconnectindex);
+     if (dedicated) clearbufbyte(&loc,sizeof(input),0L);
+     else getinput(myconnectindex);
 
      avgfvel += loc.fvel;
      avgsvel += loc.svel;
@@ -1143,6 +1161,12 @@ void faketimerhandler()
                 myminlag[i] = 0x7fffffff;
         }
 
+        if (dnInputActive())
+        {
+            dnInputSendMoves();
+            return;
+        }
+
         packbuf[0] = 1; packbuf[1] = 0; j = 2;
 
         osyn = (input *)&inputfifo[(movefifoend[myconnectindex]-2)&(MOVEFIFOSIZ-1)][myconnectindex];
@@ -1195,6 +1219,33 @@ void faketimerhandler()
             return;
         }
 
+    if (dnInputActive())   //Master, redundant input packets
+    {
+        while (1)
+        {
+            dnIterPlayers(i)
+                if (playerquitflag[i] && (movefifoend[i] <= movefifosendplc)) break;
+            if (i >= 0) break;
+
+            nsyn = (input *)&inputfifo[(movefifosendplc)&(MOVEFIFOSIZ-1)][0];
+
+                //Fix timers and buffer/jitter value
+            dnInputRecordTic(movefifosendplc,(movefifosendplc&(TIMERUPDATESIZ-1)) == 0);
+            if ((movefifosendplc&(TIMERUPDATESIZ-1)) == 0)
+                dnIterPlayers(i)
+                    myminlag[i] = 0x7fffffff;
+
+            dnIterClients(i)
+                if (playerquitflag[i] && (nsyn[i].bits&(1<<26)))
+                    playerquitflag[i] = 0;
+
+            movefifosendplc += movesperpacket;
+        }
+
+        dnInputSendTics();
+        return;
+    }
+
     while (1)  //Master
     {
         dnIterPlayers(i)
@@ -1341,7 +1392,7 @@ void checksync(void)
 #else
 	
 	if ( syncstat || syncstate ) {
-		printext256( 4L, 130L, 31, 0, "Sync...", 0 );
+		if ( !dedicated ) printext256( 4L, 130L, 31, 0, "Sync...", 0 );
 //		dnWaitForEverybody( BLOCK_SNAPSHOT );
 		dnNotifyPlayer( 0, NOTIFICATION_OUT_OF_SYNC );
 	}
@@ -1882,12 +1933,13 @@ void displayinventory(struct player_struct *p)
 
 void displayfragbar(void)
 {
-    short i, j;
+    short i, j, k;
     char nickname[1024];
     j = 0;
 
-    dnIterPlayers(i)
-        if(i > j) j = i;
+        // a dedicated host has no box, everybody else moves up a place
+    dnIterPlaying(i)
+        if(i-dedicatedhost > j) j = i-dedicatedhost;
 
     if (megatondef) {
         rotatesprite((320 - tilesizx[FRAGBAR_MEGATON]) << 15,0,65536L,0,FRAGBAR_MEGATON,0,0,10+16+128,0,0,xdim-1,ydim-1);
@@ -1902,15 +1954,16 @@ void displayfragbar(void)
         if(j >= 12) rotatesprite(319,(24)<<16,65600L,0,FRAGBAR,0,0,10+16+64+128,0,0,xdim-1,ydim-1);
     }
 
-    dnIterPlayers(i)
+    dnIterPlaying(i)
     {
+        k = i-dedicatedhost;
         strcpy(nickname, &ud.user_name[i][0]);
         if (strlen(&nickname[0]) > 10) {
             nickname[10] = '\0';
         }
-        minitext(21+(73*(i&3)),2+((i&28)<<1),&nickname[0],sprite[ps[i].i].pal,2+8+16+128);
+        minitext(21+(73*(k&3)),2+((k&28)<<1),&nickname[0],sprite[ps[i].i].pal,2+8+16+128);
         sprintf(tempbuf,"%2d",ps[i].frag-ps[i].fraggedself);
-        minitext(17+50+(73*(i&3)),2+((i&28)<<1),tempbuf,sprite[ps[i].i].pal,2+8+16+128);
+        minitext(17+50+(73*(k&3)),2+((k&28)<<1),tempbuf,sprite[ps[i].i].pal,2+8+16+128);
     }
 }
 
@@ -2233,8 +2286,8 @@ void operatefta(void)
      if (ud.coop != 1 && ud.screen_size > 0 && ud.multimode > 1)
      {
          j = 0; k = 8;
-         dnIterPlayers(i)
-             if (i > j) j = i;
+         dnIterPlaying(i)
+             if (i-dedicatedhost > j) j = i-dedicatedhost;
 
          if (j >= 4 && j <= 8) k += 8;
          else if (j > 8 && j <= 12) k += 16;
@@ -2330,7 +2383,7 @@ void showtwoscreens(void)
 
 int exittotitle = 0;
 
-void gameexit(char *t) {
+void gameexit(const char *t) {
 
 	static int inside_gameexit = 0;
 	
@@ -2381,7 +2434,9 @@ void gameexit(char *t) {
      }
      */
     
-    if( *t != 0 && *(t+1) != 'V' && *(t+1) != 'Y') {
+    if (dedicated) {
+        if (*t != 0 && *t != ' ') initprintf("%s\n", t);
+    } else if( *t != 0 && *(t+1) != 'V' && *(t+1) != 'Y') {
         showtwoscreens();
     }
     
@@ -2836,6 +2891,7 @@ void displayrest(long smoothratio)
         coords(screenpeek);
     if(ud.tickrate)
         tics();
+    dnTelemetryDraw();
 
     // JBF 20040124: display level stats in screen corner
 #if CLASSIC_MENU
@@ -2847,8 +2903,8 @@ void displayrest(long smoothratio)
             
             //TODO: fix this
             if (ud.multimode > 1 && ud.coop != 1  && ud.screen_size >=4) {
-                dnIterPlayers(i)
-                    if(i > j) j = i;
+                dnIterPlaying(i)
+                    if(i-dedicatedhost > j) j = i-dedicatedhost;
                 minitext_y += 8;
                 
                 if (j >= 4) minitext_y += 8;
@@ -6789,6 +6845,14 @@ void fn_gamefuncs(void){
                 dnLoadGame(lastsavedpos);
             BUTTONCLEAR(gamefunc_Quick_Load);
         }
+
+        if (dnRewindGetKey() && KB_KeyPressed(dnRewindGetKey()) && !(ps[myconnectindex].gm&(MODE_MENU|MODE_TYPE))) {
+            KB_ClearKeyDown(dnRewindGetKey());
+            if (dnRewind(REWIND_KEYSECONDS)) {
+                strcpy(fta_quotes[122],"REWOUND");
+                FTA(122,&ps[myconnectindex]);
+            }
+        }
         
         if (BUTTON(gamefunc_Quit_Game)) {
             BUTTONCLEAR(gamefunc_Quit_Game);
@@ -6855,6 +6919,7 @@ void nonsharedkeys(void)
         CONTROL_ClearButton( gamefunc_See_Coop_View );
         screenpeek = dnGetNextPlayer(screenpeek);
         if(screenpeek == -1) screenpeek = connecthead;
+        if(dnIsDedicatedHost(screenpeek)) screenpeek = dnGetNextPlayer(screenpeek);
         restorepalette = 1;
     }
 
@@ -7309,6 +7374,7 @@ void comlinehelp(char **argv)
 		"-map FILE\tUse a map FILE\n"
 		"-name NAME\tFoward NAME\n"
 		"-net\t\tNet mode game\n"
+		"--dedicated\tHost the -net game without a window, sound or GUI (must come before -net; Steam lobby games are not supported)\n"
 		"-nam\t\tActivates NAM compatibility mode (sets CON to NAM.CON and GRP to NAM.GRP)\n"
 		"-setup\t\ttDisplays the configuration dialogue box\n"
 		;
@@ -7465,6 +7531,13 @@ void checkcommandline(int argc,char **argv)
                     i++;
                     continue;
                 }
+
+                if ( !Bstrcasecmp( c + 1, "dedicated" ) || !Bstrcasecmp( c + 1, "-dedicated" ) ) {
+                    initprintf( "Dedicated host\n" );
+                    dedicated = 1;
+                    i++;
+                    continue;
+                }
             }
 
 			if (firstnet > 0) {
@@ -7959,13 +8032,20 @@ void loadtmb(void)
 
 void Shutdown( void )
 {
-    CONFIG_WriteSetup();
-	dnPushCloudFiles();
+	dnSaveFlush();
+	if (!dedicated) {
+		// a dedicated host never started the rest, and leaves the player's setup alone
+		CONFIG_WriteSetup();
+		dnPushCloudFiles();
+	}
 	CSTEAM_Shutdown();
-	GUI_Shutdown();
-    MusicShutdown();
-    SoundShutdown();
+	if (!dedicated) {
+		GUI_Shutdown();
+		MusicShutdown();
+		SoundShutdown();
+	}
     uninittimer();
+    uninitworkers();
     uninitengine();
     CONTROL_Shutdown();
     KB_Shutdown();
@@ -7996,7 +8076,7 @@ void compilecons(void)
        loadefs(confilename);
    }
 
-   if ((unsigned long)labelcnt > sizeof(sprite)/64 )	// see the arithmetic above for why
+   if (labelcnt > MAXLABELS)	// see the arithmetic above for why
 	   gameexit("Error: too many labels defined!");
    else {
 	   char *newlabel;
@@ -8035,6 +8115,8 @@ void Startup(void)
 	   exit(1);
 	}
 
+	initworkers(0);
+
 	compilecons();
 
 #ifdef AUSTRALIA
@@ -8353,7 +8435,7 @@ void app_main(int argc,char **argv)
 
 
 #if defined RENDERTYPEWIN || (defined RENDERTYPESDL && (defined __APPLE__ || defined HAVE_GTK2))
-	if (i < 0 || ForceSetup || CommandSetup) {
+	if (!dedicated && (i < 0 || ForceSetup || CommandSetup)) {
 		if (quitevent || !startwin_run()) {
 			uninitengine();
 			exit(0);
@@ -8499,6 +8581,11 @@ if (!NAM && VOLUMEALL) {
 
         initprintf("Loading palette/lookups.\n");
 
+    if (dedicated) {
+        dnDedicatedRun();
+        return;
+    }
+
     dnDetectVideoMode();
     if( setgamemode(ScreenMode,ScreenWidth,ScreenHeight,ScreenBPP,0) < 0 )
     {
@@ -8705,6 +8792,7 @@ char opendemoread(char which_demo) // 0 = mine
 {
     char d[13];
     char ver;
+    int32 magic;
     short i;
 
     strcpy(d, "demo_.dmo");
@@ -8715,6 +8803,7 @@ char opendemoread(char which_demo) // 0 = mine
         d[4] = '0' + which_demo;
 
     ud.reccnt = 0;
+    finishbackground();     // in case it is the demo just recorded
 
      if(which_demo == 1 && firstdemofile[0] != 0)
      {
@@ -8723,7 +8812,17 @@ char opendemoread(char which_demo) // 0 = mine
      else
        if ((recfilep = kopen4load(d,loadfromgrouponly)) == -1) return(0);
 
-     if (kread(recfilep,&ud.reccnt,sizeof(long)) != sizeof(long)) goto corrupt;
+     if (kread(recfilep,&magic,sizeof(int32)) != sizeof(int32)) goto corrupt;
+     if (magic == DEMO_MAGIC)
+     {
+         if (!dnDemoReadHeader(recfilep,&ud.reccnt)) goto corrupt;
+     }
+     else
+     {
+         ud.reccnt = magic;
+         dedicatedhost = 0;
+         dnDemoEndRead();
+     }
      if (kread(recfilep,&ver,sizeof(char)) != sizeof(char)) goto corrupt;
      if( (ver != BYTEVERSION) ) // || (ud.reccnt < 512) )
      {
@@ -8761,6 +8860,7 @@ char opendemoread(char which_demo) // 0 = mine
 	   if (kread(recfilep,(int32 *)&ps[i].auto_aim,sizeof(int32)) != sizeof(int32)) goto corrupt;	// JBF 20031126
 	   if (kread(recfilep,(int32 *)&ps[i].weaponswitch,sizeof(int32)) != sizeof(int32)) goto corrupt;
 	}
+     dnDemoBeginRead(recfilep,&ud.reccnt);
 
      ud.god = ud.cashman = ud.eog = ud.showallmap = 0;
      ud.clipping = ud.scrollmode = ud.overhead_on = 0;
@@ -8779,7 +8879,6 @@ corrupt:
 void opendemowrite(void)
 {
     char *d = "demo1.dmo";
-    long dummylong = 0;
     char ver;
     short i;
 
@@ -8787,8 +8886,9 @@ void opendemowrite(void)
 
     ver = BYTEVERSION;
 
+    finishbackground();     // the last demo may still be being written
     if ((frecfilep = fopen(d,"wb")) == NULL) return;
-    fwrite(&dummylong,4,1,frecfilep);
+    dnDemoWriteHeader(frecfilep);
     fwrite(&ver,sizeof(char),1,frecfilep);
     fwrite((char *)&ud.volume_number,sizeof(char),1,frecfilep);
     fwrite((char *)&ud.level_number,sizeof(char),1,frecfilep);
@@ -8826,7 +8926,7 @@ void record(void)
                  totalreccnt++;
                  if (ud.reccnt >= RECSYNCBUFSIZ)
                  {
-              dfwrite(recsync,sizeof(input)*ud.multimode,ud.reccnt/ud.multimode,frecfilep);
+              dnDemoWriteInputs(frecfilep,recsync,ud.reccnt/ud.multimode,sizeof(input)*ud.multimode);
                           ud.reccnt = 0;
                  }
          }
@@ -8837,14 +8937,10 @@ void closedemowrite(void)
     if (ud.recstat == 1)
     {
         if (ud.reccnt > 0)
-        {
-            dfwrite(recsync,sizeof(input)*ud.multimode,ud.reccnt/ud.multimode,frecfilep);
-
-            fseek(frecfilep,SEEK_SET,0L);
-            fwrite(&totalreccnt,sizeof(long),1,frecfilep);
-            ud.recstat = ud.m_recstat = 0;
-        }
-        fclose(frecfilep);
+            dnDemoWriteInputs(frecfilep,recsync,ud.reccnt/ud.multimode,sizeof(input)*ud.multimode);
+        dnDemoFinishWrite(frecfilep,totalreccnt);
+        frecfilep = NULL;
+        ud.recstat = ud.m_recstat = 0;
     }
 }
 
@@ -8913,13 +9009,30 @@ long playback(void)
 
     while (ud.reccnt > 0 || foundemo == 0)
     {
-        if(foundemo) while ( totalclock >= (lockclock+TICSPERFRAME) )
+        if (foundemo && dnDemoSeekPending())
         {
-            if ((i == 0) || (i >= RECSYNCBUFSIZ))
+            FX_StopAllSounds();
+            clearsoundlocks();
+            if (dnDemoPerformSeek(recfilep)) i = 0;
+        }
+
+        if(foundemo) while ( ud.reccnt > 0 && (totalclock >= (lockclock+TICSPERFRAME) || dnDemoFastForwarding()) )
+        {
+            if ((i == 0) || (i >= l))
             {
                 i = 0;
-                l = min(ud.reccnt,RECSYNCBUFSIZ);
-                if (kdfread(recsync,sizeof(input)*ud.multimode,l/ud.multimode,recfilep) != l/ud.multimode) {
+                if (dnDemoSeekable())
+                {
+                    l = dnDemoReadInputs(recfilep,recsync,RECSYNCBUFSIZ/ud.multimode,sizeof(input)*ud.multimode);
+                    t = l;
+                    l *= ud.multimode;
+                }
+                else
+                {
+                    l = min(ud.reccnt,RECSYNCBUFSIZ);
+                    t = kdfread(recsync,sizeof(input)*ud.multimode,l/ud.multimode,recfilep);
+                }
+                if (t <= 0 || t != l/ud.multimode) {
 					OSD_Printf("Demo %d is corrupt.\n", which_demo-1);
 					foundemo = 0;
 					ud.reccnt = 0;
@@ -9129,7 +9242,10 @@ char moveloop()
 {
     long i;
 
-    if (numplayers > 1)
+    if (dnRollbackActive())
+        return dnRollbackMoveLoop();
+
+    if (numplayers > 1 && !dedicated)
         while (fakemovefifoplc < movefifoend[myconnectindex]) fakedomovethings();
 
     getpackets();
@@ -9155,7 +9271,7 @@ void fakedomovethingscorrect(void)
      long i;
      struct player_struct *p;
 
-     if (numplayers < 2) return;
+     if (numplayers < 2 || dnRollbackActive() || dedicated) return;
 
      i = ((movefifoplc-1)&(MOVEFIFOSIZ-1));
      p = &ps[myconnectindex];
@@ -9163,6 +9279,15 @@ void fakedomovethingscorrect(void)
      if (p->posx == myxbak[i] && p->posy == myybak[i] && p->posz == myzbak[i]
           && p->horiz == myhorizbak[i] && p->ang == myangbak[i]) return;
 
+     fakedomovethingsresync();
+}
+
+void fakedomovethingsresync(void)
+{
+     struct player_struct *p;
+
+     p = &ps[myconnectindex];
+
      myx = p->posx; omyx = p->oposx; myxvel = p->posxv;
      myy = p->posy; omyy = p->oposy; myyvel = p->posyv;
      myz = p->posz; omyz = p->oposz; myzvel = p->poszv;
@@ -9632,6 +9757,15 @@ char domovethings(void)
 
 	
 	dnResyncIfNeeded();
+
+    if (ud.recstat == 1 && dnDemoKeyframeDue(totalreccnt/ud.multimode))
+    {
+        if (ud.reccnt > 0)
+            dnDemoWriteInputs(frecfilep,recsync,ud.reccnt/ud.multimode,sizeof(input)*ud.multimode);
+        ud.reccnt = 0;
+        dnDemoWriteKeyframe(frecfilep,totalreccnt/ud.multimode);
+    }
+    dnRewindCapture();
 	
 #if 0 // network save/load isnt supported in megaton
     dnIterPlayers(i)
@@ -9736,6 +9870,7 @@ char domovethings(void)
           {
                 screenpeek = dnGetNextPlayer(i);
                 if (screenpeek < 0) screenpeek = connecthead;
+                if (dnIsDedicatedHost(screenpeek)) screenpeek = myconnectindex;
           }
 
          if (i == connecthead) {
@@ -9780,8 +9915,11 @@ char domovethings(void)
             ch = (char)(randomseed&255);
             dnIterPlayers(i)
                  ch += ((ps[i].posx+ps[i].posy+ps[i].posz+ps[i].ang+ps[i].horiz)&255);
-            syncval[myconnectindex][syncvalhead[myconnectindex]&(MOVEFIFOSIZ-1)] = ch;
-            syncvalhead[myconnectindex]++;
+            if (!dnRollbackDeferSyncVal(ch))
+            {
+                syncval[myconnectindex][syncvalhead[myconnectindex]&(MOVEFIFOSIZ-1)] = ch;
+                syncvalhead[myconnectindex]++;
+            }
       }
 
     if(ud.recstat == 1) record();
@@ -9792,7 +9930,7 @@ char domovethings(void)
         movedummyplayers();//ST 13
     }
 
-    dnIterPlayers(i)
+    dnIterPlaying(i)
     {
         cheatkeys(i);
 
@@ -9881,7 +10019,7 @@ void doorders(void)
 void dobonus(char bonusonly)
 {
     short t, r, tinc,gfx_offset;
-    long i, y,xfragtotal,yfragtotal;
+    long i, y,xfragtotal,yfragtotal,first;
     short bonuscnt;
 	int clockpad = 2;
 	char *lastmapname;
@@ -10195,17 +10333,18 @@ void dobonus(char bonusonly)
 
 
         t = 0;
+        first = dedicatedhost;      // a dedicated host has no row or column
         minitext(23,80,"   NAME                                           KILLS",8,2+8+16+128);
-        for(i=0;i<playerswhenstarted;i++)
+        for(i=first;i<playerswhenstarted;i++)
         {
-            sprintf(tempbuf,"%-4ld",i+1);
-            minitext(92+(i*23),80,tempbuf,3,2+8+16+128);
+            sprintf(tempbuf,"%-4ld",i+1-first);
+            minitext(92+((i-first)*23),80,tempbuf,3,2+8+16+128);
         }
 
-        for(i=0;i<playerswhenstarted;i++)
+        for(i=first;i<playerswhenstarted;i++)
         {
             xfragtotal = 0;
-            sprintf(tempbuf,"%ld",i+1);
+            sprintf(tempbuf,"%ld",i+1-first);
             
             strcpy(nickname, &ud.user_name[i][0]);
             if (strlen(&nickname[0]) > 10) {
@@ -10216,18 +10355,18 @@ void dobonus(char bonusonly)
             minitext(30,90+t,tempbuf,0,2+8+16+128);
             minitext(38,90+t,&nickname[0],ps[i].palookup,2+8+16+128);
 
-            for(y=0;y<playerswhenstarted;y++)
+            for(y=first;y<playerswhenstarted;y++)
             {
                 if(i == y)
                 {
                     sprintf(tempbuf,"%-4d",ps[y].fraggedself);
-                    minitext(92+(y*23),90+t,tempbuf,2,2+8+16+128);
+                    minitext(92+((y-first)*23),90+t,tempbuf,2,2+8+16+128);
                     xfragtotal -= ps[y].fraggedself;
                 }
                 else
                 {
                     sprintf(tempbuf,"%-4d",frags[i][y]);
-                    minitext(92+(y*23),90+t,tempbuf,0,2+8+16+128);
+                    minitext(92+((y-first)*23),90+t,tempbuf,0,2+8+16+128);
                     xfragtotal += frags[i][y];
                 }
 
@@ -10244,17 +10383,17 @@ void dobonus(char bonusonly)
             t += 7;
         }
 
-        for(y=0;y<playerswhenstarted;y++)
+        for(y=first;y<playerswhenstarted;y++)
         {
             yfragtotal = 0;
-            for(i=0;i<playerswhenstarted;i++)
+            for(i=first;i<playerswhenstarted;i++)
             {
                 if(i == y)
                     yfragtotal += ps[i].fraggedself;
                 yfragtotal += frags[i][y];
             }
             sprintf(tempbuf,"%-4ld",yfragtotal);
-            minitext(92+(y*23),96+(8*7),tempbuf,2,2+8+16+128);
+            minitext(92+((y-first)*23),96+(8*7),tempbuf,2,2+8+16+128);
         }
 
         minitext(45,96+(8*7),"DEATHS",8,2+8+16+128);
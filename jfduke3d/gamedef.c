@@ -36,10 +36,12 @@ static short total_lines,line_number;
 static char checking_ifelse,parsing_state;
 static short num_squigilly_brackets;
 
+#ifndef CONCHECK
 static short g_i,g_p;
 static long g_x;
 static long *g_t;
 static spritetype *g_sp;
+#endif
 
 static char compilefile[255] = "(none)";	// file we're currently compiling
 
@@ -232,6 +234,7 @@ char isaltok(char c)
     return ( isalnum(c) || c == '{' || c == '}' || c == '/' || c == '*' || c == '-' || c == '_' || c == '.');
 }
 
+#ifndef CONCHECK
 void getglobalz(short i)
 {
     long hz,lz,zr;
@@ -317,8 +320,28 @@ void makeitfall(short i)
         s->zvel = 0;
     }
 }
+#endif // CONCHECK
 
 
+static char labelsfull;
+
+// the slot at labelcnt is where getlabel() reads the next name to, so the
+// last one is never handed out
+static void nextlabel(void)
+{
+    if (labelcnt < MAXLABELS-1)
+    {
+        labelcnt++;
+        return;
+    }
+    if (!labelsfull)
+    {
+        initprintf("  * ERROR!(L%ld %s) Too many labels defined.\n",line_number,compilefile);
+        error++;
+        labelsfull = 1;
+    }
+}
+
 void getlabel(void)
 {
     long i;
@@ -333,7 +356,10 @@ void getlabel(void)
 
     i = 0;
     while( ispecial(*textptr) == 0 )
-        label[(labelcnt<<6)+i++] = *(textptr++);
+    {
+        if (i < 63) label[(labelcnt<<6)+i++] = *textptr;
+        textptr++;
+    }
 
     label[(labelcnt<<6)+i] = 0;
 }
@@ -529,7 +555,7 @@ char parsecommand(void)
                 scriptptr--;
                 labelcode[labelcnt] = (long) scriptptr;
 		labeltype[labelcnt] = LABEL_STATE;
-                labelcnt++;
+                nextlabel();
 
                 parsing_state = 1;
 
@@ -629,7 +655,7 @@ char parsecommand(void)
             if(i == labelcnt) {
                 labelcode[labelcnt] = *(scriptptr-1);
 		labeltype[labelcnt] = LABEL_DEFINE;
-		labelcnt++;
+		nextlabel();
 	    }
             scriptptr -= 2;
             return 0;
@@ -689,7 +715,7 @@ char parsecommand(void)
                 if(i == labelcnt) {
 		    labeltype[labelcnt] = LABEL_MOVE;
                     labelcode[labelcnt] = (long) scriptptr;
-		    labelcnt++;
+		    nextlabel();
 		}
                 for(j=0;j<2;j++)
                 {
@@ -859,7 +885,7 @@ char parsecommand(void)
                 if(i == labelcnt) {
 		    labeltype[labelcnt] = LABEL_AI;
                     labelcode[labelcnt] = (long) scriptptr;
-		    labelcnt++;
+		    nextlabel();
 		}
 
                 for(j=0;j<3;j++)
@@ -918,7 +944,7 @@ char parsecommand(void)
                 if(i == labelcnt) {
 		    labeltype[labelcnt] = LABEL_ACTION;
                     labelcode[labelcnt] = (long) scriptptr;
-		    labelcnt++;
+		    nextlabel();
 		}
 
                 for(j=0;j<5;j++)
@@ -1583,6 +1609,30 @@ void passone(void)
 
 }
 
+// Compiles the NUL-terminated CON text into script[] from scratch.
+// Counts end up in error/warning; used by loadefs() and the concheck tool.
+void compileconbuffer(char *text, char *filenam)
+{
+    textptr = text;
+
+    clearbuf(actorscrptr,MAXTILES,0L);	// JBF 20040531: MAXSPRITES? I think Todd meant MAXTILES...
+    clearbufbyte(actortype,MAXTILES,0L);
+    clearbufbyte(script,sizeof(script),0l);	// JBF 20040531: yes? no?
+
+    labelcnt = 0;
+    labelsfull = 0;
+    scriptptr = script+1;
+    warning = 0;
+    error = 0;
+    line_number = 1;
+    total_lines = 0;
+
+    strcpy(compilefile, filenam);	// JBF 20031130: Store currently compiling file name
+    passone(); //Tokenize
+    *script = (long) scriptptr;
+}
+
+#ifndef CONCHECK
 char *defaultcons[3] =
 {
      "GAME.CON",
@@ -1661,20 +1711,7 @@ void loadefs(char *filenam)
 
     //textptr[fs - 2] = 0;
 
-    clearbuf(actorscrptr,MAXTILES,0L);	// JBF 20040531: MAXSPRITES? I think Todd meant MAXTILES...
-    clearbufbyte(actortype,MAXTILES,0L);
-    clearbufbyte(script,sizeof(script),0l);	// JBF 20040531: yes? no?
-
-    labelcnt = 0;
-    scriptptr = script+1;
-    warning = 0;
-    error = 0;
-    line_number = 1;
-    total_lines = 0;
-
-    strcpy(compilefile, filenam);	// JBF 20031130: Store currently compiling file name
-    passone(); //Tokenize
-    *script = (long) scriptptr;
+    compileconbuffer(mptr, filenam);
 
     Bfree(mptr);
 
@@ -3394,3 +3431,4 @@ void execute(short i,short p,long x)
 // 97.5 KPIG! - Wanker County
 // "Fauna" - Native Indiginouns Animal Life
 
+#endif // CONCHECK
@@ -36,6 +36,7 @@ Modifications for JonoF's port by Jonathon Fowler (jf@jonof.id.au)
 #include "dnAPI.h"
 #include "dnMulti.h"
 #include "dnSnapshot.h"
+#include "dnSaveFile.h"
 #include "glbuild.h"
 
 #include "hightile_priv.h"
@@ -123,7 +124,7 @@ void getangplayers(short snum)
 int loadpheader(char spot,struct savehead *saveh)
 {
 	char fn[13];
-	long fil;
+	saveFile_t *fil;
 	long bv;
 
 //    strcpy(fn, "game0.sav");
@@ -131,35 +132,35 @@ int loadpheader(char spot,struct savehead *saveh)
     
     fn[4] = spot+'0';
 
-	if ((fil = kopen4load(fn,0)) == -1) return(-1);
+	if ((fil = dnSaveOpen(fn)) == NULL) return(-1);
 
 	walock[TILE_LOADSHOT] = 255;
 
-	if (kdfread(&bv,4,1,fil) != 1) goto corrupt;
+	if (dnSaveRead(&bv,4,1,fil) != 1) goto corrupt;
 	if(bv != BYTEVERSION) {
 		FTA(114,&ps[myconnectindex]);
-		kclose(fil);
+		dnSaveEnd(fil);
 		return 1;
 	}
 
-	if (kdfread(&saveh->numplr,sizeof(int32),1,fil) != 1) goto corrupt;
+	if (dnSaveRead(&saveh->numplr,sizeof(int32),1,fil) != 1) goto corrupt;
 
-	if (kdfread(saveh->name,19,1,fil) != 1) goto corrupt;
-	if (kdfread(&saveh->volnum,sizeof(int32),1,fil) != 1) goto corrupt;
-	if (kdfread(&saveh->levnum,sizeof(int32),1,fil) != 1) goto corrupt;
-	if (kdfread(&saveh->plrskl,sizeof(int32),1,fil) != 1) goto corrupt;
-	if (kdfread(saveh->boardfn,BMAX_PATH,1,fil) != 1) goto corrupt;
+	if (dnSaveRead(saveh->name,19,1,fil) != 1) goto corrupt;
+	if (dnSaveRead(&saveh->volnum,sizeof(int32),1,fil) != 1) goto corrupt;
+	if (dnSaveRead(&saveh->levnum,sizeof(int32),1,fil) != 1) goto corrupt;
+	if (dnSaveRead(&saveh->plrskl,sizeof(int32),1,fil) != 1) goto corrupt;
+	if (dnSaveRead(saveh->boardfn,BMAX_PATH,1,fil) != 1) goto corrupt;
 
 	if (waloff[TILE_LOADSHOT] == 0) allocache(&waloff[TILE_LOADSHOT],320*200,&walock[TILE_LOADSHOT]);
 	tilesizx[TILE_LOADSHOT] = 200; tilesizy[TILE_LOADSHOT] = 320;
-	if (kdfread((char *)waloff[TILE_LOADSHOT],320,200,fil) != 200) goto corrupt;
+	if (dnSaveRead((char *)waloff[TILE_LOADSHOT],320,200,fil) != 200) goto corrupt;
 	invalidatetile(TILE_LOADSHOT,0,255);
 
-	kclose(fil);
+	dnSaveEnd(fil);
 
 	return(0);
 corrupt:
-	kclose(fil);
+	dnSaveEnd(fil);
 	return 1;
 }
 
@@ -170,7 +171,8 @@ int loadplayer(signed char spot)
      char fn[13];
      char mpfn[13];
      char *fnptr, scriptptrs[MAXSCRIPTSIZE];
-     long fil, bv, i, j, x;
+     saveFile_t *fil;
+     long bv, i, j, x;
      int32 nump;
 
 //     strcpy(fn, "game0.sav");
@@ -203,24 +205,24 @@ int loadplayer(signed char spot)
         fn[4] = spot + '0';
      }
 
-     if ((fil = kopen4load(fnptr,0)) == -1) return(-1);
+     if ((fil = dnSaveOpen(fnptr)) == NULL) return(-1);
 
      ready2send = 0;
 
-     if (kdfread(&bv,4,1,fil) != 1) return -1;
+     if (dnSaveRead(&bv,4,1,fil) != 1) return -1;
      if(bv != BYTEVERSION)
      {
         FTA(114,&ps[myconnectindex]);
-        kclose(fil);
+        dnSaveEnd(fil);
         ototalclock = totalclock;
         ready2send = 1;
         return 1;
      }
 
-     if (kdfread(&nump,sizeof(nump),1,fil) != 1) return -1;
+     if (dnSaveRead(&nump,sizeof(nump),1,fil) != 1) return -1;
      if(nump != numplayers)
      {
-        kclose(fil);
+        dnSaveEnd(fil);
         ototalclock = totalclock;
         ready2send = 1;
         FTA(124,&ps[myconnectindex]);
@@ -244,17 +246,17 @@ int loadplayer(signed char spot)
          stopmusic();
 
      if(numplayers > 1) {
-         if (kdfread(&buf,19,1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&buf,19,1,fil) != 1) goto corrupt;
 	 } else {
-         if (kdfread(&ud.savegame[spot][0],19,1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&ud.savegame[spot][0],19,1,fil) != 1) goto corrupt;
 	 }
 
 //     music_changed = (music_select != (ud.volume_number*11) + ud.level_number);
 
-         if (kdfread(&ud.volume_number,sizeof(ud.volume_number),1,fil) != 1) goto corrupt;
-         if (kdfread(&ud.level_number,sizeof(ud.level_number),1,fil) != 1) goto corrupt;
-         if (kdfread(&ud.player_skill,sizeof(ud.player_skill),1,fil) != 1) goto corrupt;
-     if (kdfread(&boardfilename[0],BMAX_PATH,1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&ud.volume_number,sizeof(ud.volume_number),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&ud.level_number,sizeof(ud.level_number),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&ud.player_skill,sizeof(ud.player_skill),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&boardfilename[0],BMAX_PATH,1,fil) != 1) goto corrupt;
 
          ud.m_level_number = ud.level_number;
          ud.m_volume_number = ud.volume_number;
@@ -264,45 +266,45 @@ int loadplayer(signed char spot)
      walock[TILE_LOADSHOT] = 1;
      if (waloff[TILE_LOADSHOT] == 0) allocache(&waloff[TILE_LOADSHOT],320*200,&walock[TILE_LOADSHOT]);
      tilesizx[TILE_LOADSHOT] = 200; tilesizy[TILE_LOADSHOT] = 320;
-     if (kdfread((char *)waloff[TILE_LOADSHOT],320,200,fil) != 200) goto corrupt;
+     if (dnSaveRead((char *)waloff[TILE_LOADSHOT],320,200,fil) != 200) goto corrupt;
 	 invalidatetile(TILE_LOADSHOT,0,255);
 
-         if (kdfread(&numwalls,2,1,fil) != 1) goto corrupt;
-     if (kdfread(&wall[0],sizeof(walltype),MAXWALLS,fil) != MAXWALLS) goto corrupt;
-         if (kdfread(&numsectors,2,1,fil) != 1) goto corrupt;
-     if (kdfread(&sector[0],sizeof(sectortype),MAXSECTORS,fil) != MAXSECTORS) goto corrupt;
-         if (kdfread(&sprite[0],sizeof(spritetype),MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
-		 if (kdfread(&spriteext[0],sizeof(spriteexttype),MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
-         if (kdfread(&headspritesect[0],2,MAXSECTORS+1,fil) != MAXSECTORS+1) goto corrupt;
-         if (kdfread(&prevspritesect[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
-         if (kdfread(&nextspritesect[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
-         if (kdfread(&headspritestat[0],2,MAXSTATUS+1,fil) != MAXSTATUS+1) goto corrupt;
-         if (kdfread(&prevspritestat[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
-         if (kdfread(&nextspritestat[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
-         if (kdfread(&numcyclers,sizeof(numcyclers),1,fil) != 1) goto corrupt;
-         if (kdfread(&cyclers[0][0],12,MAXCYCLERS,fil) != MAXCYCLERS) goto corrupt;
-     if (kdfread(ps,sizeof(ps),1,fil) != 1) goto corrupt;
-     if (kdfread(po,sizeof(po),1,fil) != 1) goto corrupt;
-         if (kdfread(&numanimwalls,sizeof(numanimwalls),1,fil) != 1) goto corrupt;
-         if (kdfread(&animwall,sizeof(animwall),1,fil) != 1) goto corrupt;
-         if (kdfread(&msx[0],sizeof(long),sizeof(msx)/sizeof(long),fil) != sizeof(msx)/sizeof(long)) goto corrupt;
-         if (kdfread(&msy[0],sizeof(long),sizeof(msy)/sizeof(long),fil) != sizeof(msy)/sizeof(long)) goto corrupt;
-     if (kdfread((short *)&spriteqloc,sizeof(short),1,fil) != 1) goto corrupt;
-     if (kdfread((short *)&spriteqamount,sizeof(short),1,fil) != 1) goto corrupt;
-     if (kdfread((short *)&spriteq[0],sizeof(short),spriteqamount,fil) != spriteqamount) goto corrupt;
-         if (kdfread(&mirrorcnt,sizeof(short),1,fil) != 1) goto corrupt;
-         if (kdfread(&mirrorwall[0],sizeof(short),64,fil) != 64) goto corrupt;
-     if (kdfread(&mirrorsector[0],sizeof(short),64,fil) != 64) goto corrupt;
-     if (kdfread(&show2dsector[0],sizeof(char),MAXSECTORS>>3,fil) != (MAXSECTORS>>3)) goto corrupt;
-     if (kdfread(&actortype[0],sizeof(char),MAXTILES-VIRTUALTILES,fil) != MAXTILES-VIRTUALTILES) goto corrupt;
-
-     if (kdfread(&numclouds,sizeof(numclouds),1,fil) != 1) goto corrupt;
-     if (kdfread(&clouds[0],sizeof(short)<<7,1,fil) != 1) goto corrupt;
-     if (kdfread(&cloudx[0],sizeof(short)<<7,1,fil) != 1) goto corrupt;
-     if (kdfread(&cloudy[0],sizeof(short)<<7,1,fil) != 1) goto corrupt;
-
-     if (kdfread(&scriptptrs[0],1,MAXSCRIPTSIZE,fil) != MAXSCRIPTSIZE) goto corrupt;
-     if (kdfread(&script[0],4,MAXSCRIPTSIZE,fil) != MAXSCRIPTSIZE) goto corrupt;
+         if (dnSaveRead(&numwalls,2,1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&wall[0],sizeof(walltype),MAXWALLS,fil) != MAXWALLS) goto corrupt;
+         if (dnSaveRead(&numsectors,2,1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&sector[0],sizeof(sectortype),MAXSECTORS,fil) != MAXSECTORS) goto corrupt;
+         if (dnSaveRead(&sprite[0],sizeof(spritetype),MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+		 if (dnSaveRead(&spriteext[0],sizeof(spriteexttype),MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+         if (dnSaveRead(&headspritesect[0],2,MAXSECTORS+1,fil) != MAXSECTORS+1) goto corrupt;
+         if (dnSaveRead(&prevspritesect[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+         if (dnSaveRead(&nextspritesect[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+         if (dnSaveRead(&headspritestat[0],2,MAXSTATUS+1,fil) != MAXSTATUS+1) goto corrupt;
+         if (dnSaveRead(&prevspritestat[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+         if (dnSaveRead(&nextspritestat[0],2,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+         if (dnSaveRead(&numcyclers,sizeof(numcyclers),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&cyclers[0][0],12,MAXCYCLERS,fil) != MAXCYCLERS) goto corrupt;
+     if (dnSaveRead(ps,sizeof(ps),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(po,sizeof(po),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&numanimwalls,sizeof(numanimwalls),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&animwall,sizeof(animwall),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&msx[0],sizeof(long),sizeof(msx)/sizeof(long),fil) != sizeof(msx)/sizeof(long)) goto corrupt;
+         if (dnSaveRead(&msy[0],sizeof(long),sizeof(msy)/sizeof(long),fil) != sizeof(msy)/sizeof(long)) goto corrupt;
+     if (dnSaveRead((short *)&spriteqloc,sizeof(short),1,fil) != 1) goto corrupt;
+     if (dnSaveRead((short *)&spriteqamount,sizeof(short),1,fil) != 1) goto corrupt;
+     if (dnSaveRead((short *)&spriteq[0],sizeof(short),spriteqamount,fil) != spriteqamount) goto corrupt;
+         if (dnSaveRead(&mirrorcnt,sizeof(short),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&mirrorwall[0],sizeof(short),64,fil) != 64) goto corrupt;
+     if (dnSaveRead(&mirrorsector[0],sizeof(short),64,fil) != 64) goto corrupt;
+     if (dnSaveRead(&show2dsector[0],sizeof(char),MAXSECTORS>>3,fil) != (MAXSECTORS>>3)) goto corrupt;
+     if (dnSaveRead(&actortype[0],sizeof(char),MAXTILES-VIRTUALTILES,fil) != MAXTILES-VIRTUALTILES) goto corrupt;
+
+     if (dnSaveRead(&numclouds,sizeof(numclouds),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&clouds[0],sizeof(short)<<7,1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&cloudx[0],sizeof(short)<<7,1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&cloudy[0],sizeof(short)<<7,1,fil) != 1) goto corrupt;
+
+     if (dnSaveRead(&scriptptrs[0],1,MAXSCRIPTSIZE,fil) != MAXSCRIPTSIZE) goto corrupt;
+     if (dnSaveRead(&script[0],4,MAXSCRIPTSIZE,fil) != MAXSCRIPTSIZE) goto corrupt;
      for(i=0;i<MAXSCRIPTSIZE;i++)
         if( scriptptrs[i] )
      {
@@ -310,7 +312,7 @@ int loadplayer(signed char spot)
          script[i] = j;
      }
 
-     if (kdfread(&actorscrptr[0],4,MAXTILES-VIRTUALTILES,fil) != MAXTILES-VIRTUALTILES) goto corrupt;
+     if (dnSaveRead(&actorscrptr[0],4,MAXTILES-VIRTUALTILES,fil) != MAXTILES-VIRTUALTILES) goto corrupt;
      for(i=0;i<MAXTILES-VIRTUALTILES;i++)
          if(actorscrptr[i])
      {
@@ -318,8 +320,8 @@ int loadplayer(signed char spot)
         actorscrptr[i] = (long *)j;
      }
 
-     if (kdfread(&scriptptrs[0],1,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
-     if (kdfread(&hittype[0],sizeof(struct weaponhit),MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+     if (dnSaveRead(&scriptptrs[0],1,MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
+     if (dnSaveRead(&hittype[0],sizeof(struct weaponhit),MAXSPRITES,fil) != MAXSPRITES) goto corrupt;
 
      for(i=0;i<MAXSPRITES;i++)
      {
@@ -329,53 +331,53 @@ int loadplayer(signed char spot)
         if( scriptptrs[i]&4 ) T6 += j;
      }
 
-         if (kdfread(&lockclock,sizeof(lockclock),1,fil) != 1) goto corrupt;
-     if (kdfread(&pskybits,sizeof(pskybits),1,fil) != 1) goto corrupt;
-     if (kdfread(&pskyoff[0],sizeof(pskyoff[0]),MAXPSKYTILES,fil) != MAXPSKYTILES) goto corrupt;
+         if (dnSaveRead(&lockclock,sizeof(lockclock),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&pskybits,sizeof(pskybits),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&pskyoff[0],sizeof(pskyoff[0]),MAXPSKYTILES,fil) != MAXPSKYTILES) goto corrupt;
 
-         if (kdfread(&animatecnt,sizeof(animatecnt),1,fil) != 1) goto corrupt;
-         if (kdfread(&animatesect[0],2,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
-         if (kdfread(&animateptr[0],4,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
+         if (dnSaveRead(&animatecnt,sizeof(animatecnt),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&animatesect[0],2,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
+         if (dnSaveRead(&animateptr[0],4,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
      for(i = animatecnt-1;i>=0;i--) animateptr[i] = (long *)((long)animateptr[i]+(long)(&sector[0]));
-         if (kdfread(&animategoal[0],4,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
-         if (kdfread(&animatevel[0],4,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
+         if (dnSaveRead(&animategoal[0],4,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
+         if (dnSaveRead(&animatevel[0],4,MAXANIMATES,fil) != MAXANIMATES) goto corrupt;
 
-         if (kdfread(&earthquaketime,sizeof(earthquaketime),1,fil) != 1) goto corrupt;
-     if (kdfread(&ud.from_bonus,sizeof(ud.from_bonus),1,fil) != 1) goto corrupt;
-     if (kdfread(&ud.secretlevel,sizeof(ud.secretlevel),1,fil) != 1) goto corrupt;
-     if (kdfread(&ud.respawn_monsters,sizeof(ud.respawn_monsters),1,fil) != 1) goto corrupt;
+         if (dnSaveRead(&earthquaketime,sizeof(earthquaketime),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.from_bonus,sizeof(ud.from_bonus),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.secretlevel,sizeof(ud.secretlevel),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.respawn_monsters,sizeof(ud.respawn_monsters),1,fil) != 1) goto corrupt;
      ud.m_respawn_monsters = ud.respawn_monsters;
-     if (kdfread(&ud.respawn_items,sizeof(ud.respawn_items),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.respawn_items,sizeof(ud.respawn_items),1,fil) != 1) goto corrupt;
      ud.m_respawn_items = ud.respawn_items;
-     if (kdfread(&ud.respawn_inventory,sizeof(ud.respawn_inventory),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.respawn_inventory,sizeof(ud.respawn_inventory),1,fil) != 1) goto corrupt;
      ud.m_respawn_inventory = ud.respawn_inventory;
 
-     if (kdfread(&ud.god,sizeof(ud.god),1,fil) != 1) goto corrupt;
-     if (kdfread(&ud.auto_run,sizeof(ud.auto_run),1,fil) != 1) goto corrupt;
-     if (kdfread(&ud.crosshair,sizeof(ud.crosshair),1,fil) != 1) goto corrupt;
-     if (kdfread(&ud.monsters_off,sizeof(ud.monsters_off),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.god,sizeof(ud.god),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.auto_run,sizeof(ud.auto_run),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.crosshair,sizeof(ud.crosshair),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.monsters_off,sizeof(ud.monsters_off),1,fil) != 1) goto corrupt;
      ud.m_monsters_off = ud.monsters_off;
-     if (kdfread(&ud.last_level,sizeof(ud.last_level),1,fil) != 1) goto corrupt;
-     if (kdfread(&ud.eog,sizeof(ud.eog),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.last_level,sizeof(ud.last_level),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.eog,sizeof(ud.eog),1,fil) != 1) goto corrupt;
 
-     if (kdfread(&ud.coop,sizeof(ud.coop),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.coop,sizeof(ud.coop),1,fil) != 1) goto corrupt;
      ud.m_coop = ud.coop;
-     if (kdfread(&ud.marker,sizeof(ud.marker),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.marker,sizeof(ud.marker),1,fil) != 1) goto corrupt;
      ud.m_marker = ud.marker;
-     if (kdfread(&ud.ffire,sizeof(ud.ffire),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&ud.ffire,sizeof(ud.ffire),1,fil) != 1) goto corrupt;
      ud.m_ffire = ud.ffire;
 
-     if (kdfread(&camsprite,sizeof(camsprite),1,fil) != 1) goto corrupt;
-     if (kdfread(&connecthead,sizeof(connecthead),1,fil) != 1) goto corrupt;
-     if (kdfread(connectpoint2,sizeof(connectpoint2),1,fil) != 1) goto corrupt;
-     if (kdfread(&numplayersprites,sizeof(numplayersprites),1,fil) != 1) goto corrupt;
-     if (kdfread((short *)&frags[0][0],sizeof(frags),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&camsprite,sizeof(camsprite),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&connecthead,sizeof(connecthead),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(connectpoint2,sizeof(connectpoint2),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&numplayersprites,sizeof(numplayersprites),1,fil) != 1) goto corrupt;
+     if (dnSaveRead((short *)&frags[0][0],sizeof(frags),1,fil) != 1) goto corrupt;
 
-     if (kdfread(&randomseed,sizeof(randomseed),1,fil) != 1) goto corrupt;
-     if (kdfread(&global_random,sizeof(global_random),1,fil) != 1) goto corrupt;
-     if (kdfread(&parallaxyscale,sizeof(parallaxyscale),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&randomseed,sizeof(randomseed),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&global_random,sizeof(global_random),1,fil) != 1) goto corrupt;
+     if (dnSaveRead(&parallaxyscale,sizeof(parallaxyscale),1,fil) != 1) goto corrupt;
 
-     kclose(fil);
+     dnSaveEnd(fil);
 
      if(ps[myconnectindex].over_shoulder_on != 0)
      {
@@ -426,8 +428,7 @@ int loadplayer(signed char spot)
          }
      }
 
-     numinterpolations = 0;
-     startofdynamicinterpolations = 0;
+     clearinterpolations();
 
      k = headspritestat[3];
      while(k >= 0)
@@ -496,7 +497,7 @@ int saveplayer(signed char spot)
      char fn[13];
      char mpfn[13];
      char *fnptr,scriptptrs[MAXSCRIPTSIZE];
-         FILE *fil;
+     saveFile_t *fil;
      long bv = BYTEVERSION;
 
 //     strcpy(fn, "game0.sav");
@@ -531,18 +532,18 @@ int saveplayer(signed char spot)
         fn[4] = spot + '0';
      }
 
-     if ((fil = fopen(fnptr,"wb")) == 0) return(-1);
+     if ((fil = dnSaveCreate(fnptr,fnptr == fn)) == NULL) return(-1);
 
      ready2send = 0;
 
-     dfwrite(&bv,4,1,fil);
-     dfwrite(&ud.multimode,sizeof(ud.multimode),1,fil);
+     dnSaveWrite(&bv,4,1,fil);
+     dnSaveWrite(&ud.multimode,sizeof(ud.multimode),1,fil);
 
-         dfwrite(&ud.savegame[spot][0],19,1,fil);
-         dfwrite(&ud.volume_number,sizeof(ud.volume_number),1,fil);
-     dfwrite(&ud.level_number,sizeof(ud.level_number),1,fil);
-         dfwrite(&ud.player_skill,sizeof(ud.player_skill),1,fil);
-     dfwrite(&boardfilename[0],BMAX_PATH,1,fil);
+         dnSaveWrite(&ud.savegame[spot][0],19,1,fil);
+         dnSaveWrite(&ud.volume_number,sizeof(ud.volume_number),1,fil);
+     dnSaveWrite(&ud.level_number,sizeof(ud.level_number),1,fil);
+         dnSaveWrite(&ud.player_skill,sizeof(ud.player_skill),1,fil);
+     dnSaveWrite(&boardfilename[0],BMAX_PATH,1,fil);
 	 
 	 if (!waloff[TILE_SAVESHOT]) {
 		 walock[TILE_SAVESHOT] = 254;
@@ -550,41 +551,41 @@ int saveplayer(signed char spot)
 		 clearbuf((void*)waloff[TILE_SAVESHOT],(200*320)/4,0);
 		 walock[TILE_SAVESHOT] = 1;
 	 }
-     dfwrite((char *)waloff[TILE_SAVESHOT],320,200,fil);
-
-         dfwrite(&numwalls,2,1,fil);
-     dfwrite(&wall[0],sizeof(walltype),MAXWALLS,fil);
-         dfwrite(&numsectors,2,1,fil);
-     dfwrite(&sector[0],sizeof(sectortype),MAXSECTORS,fil);
-         dfwrite(&sprite[0],sizeof(spritetype),MAXSPRITES,fil);
-		 dfwrite(&spriteext[0],sizeof(spriteexttype),MAXSPRITES,fil);
-         dfwrite(&headspritesect[0],2,MAXSECTORS+1,fil);
-         dfwrite(&prevspritesect[0],2,MAXSPRITES,fil);
-         dfwrite(&nextspritesect[0],2,MAXSPRITES,fil);
-         dfwrite(&headspritestat[0],2,MAXSTATUS+1,fil);
-         dfwrite(&prevspritestat[0],2,MAXSPRITES,fil);
-         dfwrite(&nextspritestat[0],2,MAXSPRITES,fil);
-         dfwrite(&numcyclers,sizeof(numcyclers),1,fil);
-         dfwrite(&cyclers[0][0],12,MAXCYCLERS,fil);
-     dfwrite(ps,sizeof(ps),1,fil);
-     dfwrite(po,sizeof(po),1,fil);
-         dfwrite(&numanimwalls,sizeof(numanimwalls),1,fil);
-         dfwrite(&animwall,sizeof(animwall),1,fil);
-         dfwrite(&msx[0],sizeof(long),sizeof(msx)/sizeof(long),fil);
-         dfwrite(&msy[0],sizeof(long),sizeof(msy)/sizeof(long),fil);
-     dfwrite(&spriteqloc,sizeof(short),1,fil);
-     dfwrite(&spriteqamount,sizeof(short),1,fil);
-     dfwrite(&spriteq[0],sizeof(short),spriteqamount,fil);
-         dfwrite(&mirrorcnt,sizeof(short),1,fil);
-         dfwrite(&mirrorwall[0],sizeof(short),64,fil);
-         dfwrite(&mirrorsector[0],sizeof(short),64,fil);
-     dfwrite(&show2dsector[0],sizeof(char),MAXSECTORS>>3,fil);
-     dfwrite(&actortype[0],sizeof(char),MAXTILES-VIRTUALTILES,fil);
-
-     dfwrite(&numclouds,sizeof(numclouds),1,fil);
-     dfwrite(&clouds[0],sizeof(short)<<7,1,fil);
-     dfwrite(&cloudx[0],sizeof(short)<<7,1,fil);
-     dfwrite(&cloudy[0],sizeof(short)<<7,1,fil);
+     dnSaveWrite((char *)waloff[TILE_SAVESHOT],320,200,fil);
+
+         dnSaveWrite(&numwalls,2,1,fil);
+     dnSaveWrite(&wall[0],sizeof(walltype),MAXWALLS,fil);
+         dnSaveWrite(&numsectors,2,1,fil);
+     dnSaveWrite(&sector[0],sizeof(sectortype),MAXSECTORS,fil);
+         dnSaveWrite(&sprite[0],sizeof(spritetype),MAXSPRITES,fil);
+		 dnSaveWrite(&spriteext[0],sizeof(spriteexttype),MAXSPRITES,fil);
+         dnSaveWrite(&headspritesect[0],2,MAXSECTORS+1,fil);
+         dnSaveWrite(&prevspritesect[0],2,MAXSPRITES,fil);
+         dnSaveWrite(&nextspritesect[0],2,MAXSPRITES,fil);
+         dnSaveWrite(&headspritestat[0],2,MAXSTATUS+1,fil);
+         dnSaveWrite(&prevspritestat[0],2,MAXSPRITES,fil);
+         dnSaveWrite(&nextspritestat[0],2,MAXSPRITES,fil);
+         dnSaveWrite(&numcyclers,sizeof(numcyclers),1,fil);
+         dnSaveWrite(&cyclers[0][0],12,MAXCYCLERS,fil);
+     dnSaveWrite(ps,sizeof(ps),1,fil);
+     dnSaveWrite(po,sizeof(po),1,fil);
+         dnSaveWrite(&numanimwalls,sizeof(numanimwalls),1,fil);
+         dnSaveWrite(&animwall,sizeof(animwall),1,fil);
+         dnSaveWrite(&msx[0],sizeof(long),sizeof(msx)/sizeof(long),fil);
+         dnSaveWrite(&msy[0],sizeof(long),sizeof(msy)/sizeof(long),fil);
+     dnSaveWrite(&spriteqloc,sizeof(short),1,fil);
+     dnSaveWrite(&spriteqamount,sizeof(short),1,fil);
+     dnSaveWrite(&spriteq[0],sizeof(short),spriteqamount,fil);
+         dnSaveWrite(&mirrorcnt,sizeof(short),1,fil);
+         dnSaveWrite(&mirrorwall[0],sizeof(short),64,fil);
+         dnSaveWrite(&mirrorsector[0],sizeof(short),64,fil);
+     dnSaveWrite(&show2dsector[0],sizeof(char),MAXSECTORS>>3,fil);
+     dnSaveWrite(&actortype[0],sizeof(char),MAXTILES-VIRTUALTILES,fil);
+
+     dnSaveWrite(&numclouds,sizeof(numclouds),1,fil);
+     dnSaveWrite(&clouds[0],sizeof(short)<<7,1,fil);
+     dnSaveWrite(&cloudx[0],sizeof(short)<<7,1,fil);
+     dnSaveWrite(&cloudy[0],sizeof(short)<<7,1,fil);
 
      for(i=0;i<MAXSCRIPTSIZE;i++)
      {
@@ -597,8 +598,8 @@ int saveplayer(signed char spot)
           else scriptptrs[i] = 0;
      }
 
-     dfwrite(&scriptptrs[0],1,MAXSCRIPTSIZE,fil);
-     dfwrite(&script[0],4,MAXSCRIPTSIZE,fil);
+     dnSaveWrite(&scriptptrs[0],1,MAXSCRIPTSIZE,fil);
+     dnSaveWrite(&script[0],4,MAXSCRIPTSIZE,fil);
 
      for(i=0;i<MAXSCRIPTSIZE;i++)
         if( scriptptrs[i] )
@@ -613,7 +614,7 @@ int saveplayer(signed char spot)
         j = (long)actorscrptr[i]-(long)&script[0];
         actorscrptr[i] = (long *)j;
      }
-     dfwrite(&actorscrptr[0],4,MAXTILES-VIRTUALTILES,fil);
+     dnSaveWrite(&actorscrptr[0],4,MAXTILES-VIRTUALTILES,fil);
      for(i=0;i<MAXTILES-VIRTUALTILES;i++)
          if(actorscrptr[i])
      {
@@ -646,8 +647,8 @@ int saveplayer(signed char spot)
         }
     }
 
-    dfwrite(&scriptptrs[0],1,MAXSPRITES,fil);
-    dfwrite(&hittype[0],sizeof(struct weaponhit),MAXSPRITES,fil);
+    dnSaveWrite(&scriptptrs[0],1,MAXSPRITES,fil);
+    dnSaveWrite(&hittype[0],sizeof(struct weaponhit),MAXSPRITES,fil);
 
     for(i=0;i<MAXSPRITES;i++)
     {
@@ -662,43 +663,43 @@ int saveplayer(signed char spot)
             T6 += j;
     }
 
-         dfwrite(&lockclock,sizeof(lockclock),1,fil);
-     dfwrite(&pskybits,sizeof(pskybits),1,fil);
-     dfwrite(&pskyoff[0],sizeof(pskyoff[0]),MAXPSKYTILES,fil);
-         dfwrite(&animatecnt,sizeof(animatecnt),1,fil);
-         dfwrite(&animatesect[0],2,MAXANIMATES,fil);
+         dnSaveWrite(&lockclock,sizeof(lockclock),1,fil);
+     dnSaveWrite(&pskybits,sizeof(pskybits),1,fil);
+     dnSaveWrite(&pskyoff[0],sizeof(pskyoff[0]),MAXPSKYTILES,fil);
+         dnSaveWrite(&animatecnt,sizeof(animatecnt),1,fil);
+         dnSaveWrite(&animatesect[0],2,MAXANIMATES,fil);
          for(i = animatecnt-1;i>=0;i--) animateptr[i] = (long *)((long)animateptr[i]-(long)(&sector[0]));
-         dfwrite(&animateptr[0],4,MAXANIMATES,fil);
+         dnSaveWrite(&animateptr[0],4,MAXANIMATES,fil);
          for(i = animatecnt-1;i>=0;i--) animateptr[i] = (long *)((long)animateptr[i]+(long)(&sector[0]));
-         dfwrite(&animategoal[0],4,MAXANIMATES,fil);
-         dfwrite(&animatevel[0],4,MAXANIMATES,fil);
-
-         dfwrite(&earthquaketime,sizeof(earthquaketime),1,fil);
-         dfwrite(&ud.from_bonus,sizeof(ud.from_bonus),1,fil);
-     dfwrite(&ud.secretlevel,sizeof(ud.secretlevel),1,fil);
-     dfwrite(&ud.respawn_monsters,sizeof(ud.respawn_monsters),1,fil);
-     dfwrite(&ud.respawn_items,sizeof(ud.respawn_items),1,fil);
-     dfwrite(&ud.respawn_inventory,sizeof(ud.respawn_inventory),1,fil);
-     dfwrite(&ud.god,sizeof(ud.god),1,fil);
-     dfwrite(&ud.auto_run,sizeof(ud.auto_run),1,fil);
-     dfwrite(&ud.crosshair,sizeof(ud.crosshair),1,fil);
-     dfwrite(&ud.monsters_off,sizeof(ud.monsters_off),1,fil);
-     dfwrite(&ud.last_level,sizeof(ud.last_level),1,fil);
-     dfwrite(&ud.eog,sizeof(ud.eog),1,fil);
-     dfwrite(&ud.coop,sizeof(ud.coop),1,fil);
-     dfwrite(&ud.marker,sizeof(ud.marker),1,fil);
-     dfwrite(&ud.ffire,sizeof(ud.ffire),1,fil);
-     dfwrite(&camsprite,sizeof(camsprite),1,fil);
-     dfwrite(&connecthead,sizeof(connecthead),1,fil);
-     dfwrite(connectpoint2,sizeof(connectpoint2),1,fil);
-     dfwrite(&numplayersprites,sizeof(numplayersprites),1,fil);
-     dfwrite((short *)&frags[0][0],sizeof(frags),1,fil);
-
-     dfwrite(&randomseed,sizeof(randomseed),1,fil);
-     dfwrite(&global_random,sizeof(global_random),1,fil);
-     dfwrite(&parallaxyscale,sizeof(parallaxyscale),1,fil);
-
-         fclose(fil);
+         dnSaveWrite(&animategoal[0],4,MAXANIMATES,fil);
+         dnSaveWrite(&animatevel[0],4,MAXANIMATES,fil);
+
+         dnSaveWrite(&earthquaketime,sizeof(earthquaketime),1,fil);
+         dnSaveWrite(&ud.from_bonus,sizeof(ud.from_bonus),1,fil);
+     dnSaveWrite(&ud.secretlevel,sizeof(ud.secretlevel),1,fil);
+     dnSaveWrite(&ud.respawn_monsters,sizeof(ud.respawn_monsters),1,fil);
+     dnSaveWrite(&ud.respawn_items,sizeof(ud.respawn_items),1,fil);
+     dnSaveWrite(&ud.respawn_inventory,sizeof(ud.respawn_inventory),1,fil);
+     dnSaveWrite(&ud.god,sizeof(ud.god),1,fil);
+     dnSaveWrite(&ud.auto_run,sizeof(ud.auto_run),1,fil);
+     dnSaveWrite(&ud.crosshair,sizeof(ud.crosshair),1,fil);
+     dnSaveWrite(&ud.monsters_off,sizeof(ud.monsters_off),1,fil);
+     dnSaveWrite(&ud.last_level,sizeof(ud.last_level),1,fil);
+     dnSaveWrite(&ud.eog,sizeof(ud.eog),1,fil);
+     dnSaveWrite(&ud.coop,sizeof(ud.coop),1,fil);
+     dnSaveWrite(&ud.marker,sizeof(ud.marker),1,fil);
+     dnSaveWrite(&ud.ffire,sizeof(ud.ffire),1,fil);
+     dnSaveWrite(&camsprite,sizeof(camsprite),1,fil);
+     dnSaveWrite(&connecthead,sizeof(connecthead),1,fil);
+     dnSaveWrite(connectpoint2,sizeof(connectpoint2),1,fil);
+     dnSaveWrite(&numplayersprites,sizeof(numplayersprites),1,fil);
+     dnSaveWrite((short *)&frags[0][0],sizeof(frags),1,fil);
+
+     dnSaveWrite(&randomseed,sizeof(randomseed),1,fil);
+     dnSaveWrite(&global_random,sizeof(global_random),1,fil);
+     dnSaveWrite(&parallaxyscale,sizeof(parallaxyscale),1,fil);
+
+         dnSaveClose(fil);
 
      if(ud.multimode < 2)
      {
@@ -706,8 +707,6 @@ int saveplayer(signed char spot)
          FTA(122,&ps[myconnectindex]);
      }
 
-    CSTEAM_UploadFile(fn);
-    
      ready2send = 1;
 
      waitforeverybody();
@@ -4949,7 +4948,7 @@ void drawoverheadmap(long cposx, long cposy, long czoom, short cang)
                 }
         }
 
-         dnIterPlayers(p)
+         dnIterPlaying(p)
          {
           if(ud.scrollmode && p == screenpeek) continue;
 
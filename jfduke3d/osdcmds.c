@@ -3,6 +3,14 @@
 #include "baselayer.h"
 #include "duke3d.h"
 #include "crc32.h"
+#include "workers.h"
+#include "dnMulti.h"
+#include "dnTransport.h"
+#include "dnRollback.h"
+#include "dnNetInput.h"
+#include "dnTelemetry.h"
+#include "dnDemo.h"
+#include "dnRewind.h"
 
 #include <ctype.h>
 
@@ -373,6 +381,11 @@ static int osdcmd_vars(const osdfuncparm_t *parm)
 		else useprecache = (atoi(parm->parms[0]) != 0);
 		return OSDCMD_OK;
 	}
+	else if (!Bstrcasecmp(parm->name, "parallelactors")) {
+		if (showval) { OSD_Printf("parallelactors is %d (%d threads)\n", parallelactors, getworkercount()); }
+		else parallelactors = (atoi(parm->parms[0]) != 0);
+		return OSDCMD_OK;
+	}
 	return OSDCMD_SHOWHELP;
 }
 
@@ -417,6 +430,166 @@ int osdcmd_usemousejoy(const osdfuncparm_t *parm)
 	return OSDCMD_SHOWHELP;
 }
 
+static int osdcmd_net(const osdfuncparm_t *parm)
+{
+	int showval = (parm->numparms < 1);
+	netSimParams_t sim;
+
+	if (!Bstrcasecmp(parm->name, "net_transport")) {
+		int kind;
+		if (showval) { OSD_Printf("net_transport is %s\n", dnNetTransportName(dnNetGetTransport())); return OSDCMD_OK; }
+		kind = dnNetFindTransport(parm->parms[0]);
+		if (kind < 0) return OSDCMD_SHOWHELP;
+		if (dnIsInMultiMode()) { OSD_Printf("net_transport: can't switch during a multiplayer game\n"); return OSDCMD_OK; }
+		if (!dnNetSetTransport((netTransportKind_t)kind)) OSD_Printf("net_transport: %s failed to start\n", parm->parms[0]);
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_udpport")) {
+		if (showval) { OSD_Printf("net_udpport is %d\n", dnNetGetUDPPort()); }
+		else dnNetSetUDPPort(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_loopback")) {
+		if (showval) { OSD_Printf("net_loopback is %d\n", dnNetLoopbackCurrent()); }
+		else dnNetLoopbackSelect(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_sim")) {
+		dnNetGetSimParams(&sim);
+		if (showval) {
+			OSD_Printf("net_sim: latency %dms, jitter %dms, loss %d/1000, bandwidth %d B/s, seed %u, %d held back\n",
+				sim.latency, sim.jitter, sim.loss, sim.bandwidth, sim.seed, dnNetSimPending());
+			return OSDCMD_OK;
+		}
+		if (!Bstrcasecmp(parm->parms[0], "off")) {
+			memset(&sim, 0, sizeof(sim));
+		} else {
+			if (parm->numparms < 4) return OSDCMD_SHOWHELP;
+			sim.latency = atoi(parm->parms[0]);
+			sim.jitter = atoi(parm->parms[1]);
+			sim.loss = atoi(parm->parms[2]);
+			sim.bandwidth = atoi(parm->parms[3]);
+			if (parm->numparms > 4) sim.seed = (unsigned)atol(parm->parms[4]);
+		}
+		dnNetSetSimParams(&sim);
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_rollback")) {
+		rollbackStats_t stats;
+		if (showval) {
+			dnRollbackGetStats(&stats);
+			OSD_Printf("net_rollback is %d: %d rollbacks, %d tics resimulated, deepest %d, %d stalls\n",
+				dnRollbackEnabled(), stats.rollbacks, stats.resimulated, stats.maxdepth, stats.stalls);
+		}
+		else dnRollbackSetEnabled(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_rollbackbudget")) {
+		if (showval) { OSD_Printf("net_rollbackbudget is %d\n", dnRollbackGetBudget()); }
+		else dnRollbackSetBudget(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_inputcodec")) {
+		inputStats_t stats;
+		if (showval) {
+			dnInputGetStats(&stats);
+			OSD_Printf("net_inputcodec is %d%s: %d packets (%d bytes) sent, %d (%d bytes) received, "
+				"%d tics applied, %d repeated, %d gaps, %d dropped\n",
+				dnInputEnabled(), dnInputActive() ? ", in use" : "",
+				stats.packetsSent, stats.bytesSent, stats.packetsReceived, stats.bytesReceived,
+				stats.movesApplied, stats.movesRepeated, stats.gaps, stats.dropped);
+		}
+		else {
+			dnInputSetEnabled(atoi(parm->parms[0]));
+			OSD_Printf("net_inputcodec will be %d from the next level\n", dnInputEnabled());
+		}
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_stats")) {
+		if (showval) { OSD_Printf("net_stats is %d\n", dnTelemetryOverlay()); }
+		else dnTelemetrySetOverlay(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_statslog")) {
+		if (showval) {
+			if (dnTelemetryLogName()) OSD_Printf("net_statslog is writing to %s\n", dnTelemetryLogName());
+			else OSD_Printf("net_statslog is off\n");
+		}
+		else if (!Bstrcasecmp(parm->parms[0], "off")) dnTelemetryCloseLog();
+		else if (!dnTelemetryOpenLog(parm->parms[0])) OSD_Printf("net_statslog: can't create %s\n", parm->parms[0]);
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "net_inputredundancy")) {
+		if (showval) { OSD_Printf("net_inputredundancy is %d\n", dnInputGetMaxMoves()); }
+		else dnInputSetMaxMoves(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	return OSDCMD_SHOWHELP;
+}
+
+static int osdcmd_demo(const osdfuncparm_t *parm)
+{
+	int showval = (parm->numparms < 1);
+
+	if (!Bstrcasecmp(parm->name, "demo_keyframes")) {
+		if (showval) { OSD_Printf("demo_keyframes is %d\n", dnDemoGetKeyframeInterval()); }
+		else dnDemoSetKeyframeInterval(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "demo_verify")) {
+		if (showval) { OSD_Printf("demo_verify is %d\n", dnDemoGetVerify()); }
+		else dnDemoSetVerify(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+
+	if (ud.recstat != 2) { OSD_Printf("%s: no demo is playing\n", parm->name); return OSDCMD_OK; }
+	if (!Bstrcasecmp(parm->name, "demo_seek")) {
+		if (showval) dnDemoPrintStatus();
+		else dnDemoRequestSeek(atol(parm->parms[0]), 0);
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "demo_skip")) {
+		if (showval) return OSDCMD_SHOWHELP;
+		dnDemoRequestSeek(atol(parm->parms[0]), 1);
+		return OSDCMD_OK;
+	}
+	return OSDCMD_SHOWHELP;
+}
+
+static int osdcmd_rewind(const osdfuncparm_t *parm)
+{
+	int showval = (parm->numparms < 1);
+	rewindStats_t stats;
+
+	if (!Bstrcasecmp(parm->name, "rewind")) {
+		if (showval) {
+			dnRewindGetStats(&stats);
+			OSD_Printf("rewind: %d states over the last %ld seconds in %ld bytes, %d restores\n",
+				stats.entries, stats.seconds, stats.bytes, stats.restores);
+		}
+		else if (!dnRewind(atol(parm->parms[0]))) OSD_Printf("rewind: nothing to go back to\n");
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "rewind_history")) {
+		if (showval) { OSD_Printf("rewind_history is %d\n", dnRewindGetHistory()); }
+		else dnRewindSetHistory(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "rewind_interval")) {
+		if (showval) { OSD_Printf("rewind_interval is %d\n", dnRewindGetInterval()); }
+		else dnRewindSetInterval(atoi(parm->parms[0]));
+		return OSDCMD_OK;
+	}
+	else if (!Bstrcasecmp(parm->name, "rewind_key")) {
+		if (showval) { OSD_Printf("rewind_key is %s\n", dnRewindGetKey() ? KB_ScanCodeToString(dnRewindGetKey()) : "none"); }
+		else if (!Bstrcasecmp(parm->parms[0], "none")) dnRewindSetKey(0);
+		else if (KB_StringToScanCode(parm->parms[0])) dnRewindSetKey(KB_StringToScanCode(parm->parms[0]));
+		else OSD_Printf("rewind_key: no key is called %s\n", parm->parms[0]);
+		return OSDCMD_OK;
+	}
+	return OSDCMD_SHOWHELP;
+}
+
 int registerosdcommands(void)
 {
 	osdcmd_cheatsinfo_stat.cheatnum = -1;
@@ -442,6 +615,28 @@ if (VOLUMEONE) {
 	OSD_RegisterFunction("showfps","showfps: show the frame rate counter", osdcmd_vars);
 	OSD_RegisterFunction("showcoords","showcoords: show your position in the game world", osdcmd_vars);
 	OSD_RegisterFunction("useprecache","useprecache: enable/disable the pre-level caching routine", osdcmd_vars);
+	OSD_RegisterFunction("parallelactors","parallelactors: spread actor visibility tests over worker threads", osdcmd_vars);
+
+	OSD_RegisterFunction("net_transport","net_transport [steam|udp|loopback]: selects how multiplayer packets are carried", osdcmd_net);
+	OSD_RegisterFunction("net_udpport","net_udpport [port]: local port for the udp transport", osdcmd_net);
+	OSD_RegisterFunction("net_loopback","net_loopback [endpoint]: which loopback endpoint this game speaks as", osdcmd_net);
+	OSD_RegisterFunction("net_rollback","net_rollback [0|1]: run ahead on predicted remote input and rewind when it was wrong", osdcmd_net);
+	OSD_RegisterFunction("net_inputcodec","net_inputcodec [0|1]: send input as redundant bit-packed packets instead of the legacy ones", osdcmd_net);
+	OSD_RegisterFunction("net_inputredundancy","net_inputredundancy [tics]: most unacknowledged tics repeated in each input packet", osdcmd_net);
+	OSD_RegisterFunction("net_rollbackbudget","net_rollbackbudget [tics]: most tics re-simulated per frame after a rewind", osdcmd_net);
+	OSD_RegisterFunction("net_stats","net_stats [0|1]: show round trip, jitter, loss, traffic and fifo lag for every peer", osdcmd_net);
+	OSD_RegisterFunction("net_statslog","net_statslog [file.csv|file.json|off]: write the same figures to a file once a second", osdcmd_net);
+	OSD_RegisterFunction("net_sim","net_sim [latency jitter loss bandwidth [seed] | off]: simulate a bad link (ms, ms, per 1000, bytes/s)", osdcmd_net);
+
+	OSD_RegisterFunction("demo_seek","demo_seek [ms]: jump to a time in the demo that is playing, or show where it is", osdcmd_demo);
+	OSD_RegisterFunction("demo_skip","demo_skip <ms>: jump forward or, when negative, back in the demo that is playing", osdcmd_demo);
+	OSD_RegisterFunction("demo_keyframes","demo_keyframes [seconds]: how often recorded demos keep a snapshot to seek to, 0 for never", osdcmd_demo);
+	OSD_RegisterFunction("demo_verify","demo_verify [0|1]: check demo playback against the recorded snapshots and report desyncs", osdcmd_demo);
+
+	OSD_RegisterFunction("rewind","rewind [seconds]: go back in a single player game, or show what is kept", osdcmd_rewind);
+	OSD_RegisterFunction("rewind_history","rewind_history [seconds]: how far back rewind can go, 0 to keep nothing", osdcmd_rewind);
+	OSD_RegisterFunction("rewind_interval","rewind_interval [tics]: how often a state is kept to rewind to", osdcmd_rewind);
+	OSD_RegisterFunction("rewind_key","rewind_key [key|none]: the key that rewinds a few seconds", osdcmd_rewind);
 
 	OSD_RegisterFunction("restartvid","restartvid: reinitialised the video mode",osdcmd_restartvid);
 	OSD_RegisterFunction("vidmode","vidmode [xdim ydim] [bpp] [fullscreen]: immediately change the video mode",osdcmd_vidmode);
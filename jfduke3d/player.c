@@ -4206,7 +4206,7 @@ void computergetinput(long snum, input *syn)
     if ((goalplayer[snum] == snum) || (ps[goalplayer[snum]].dead_flag != 0))
     {
         j = 0x7fffffff;
-        dnIterPlayers(i)
+        dnIterPlaying(i)
             if (i != snum)
             {
                 dist = ksqrt((sprite[ps[i].i].x-x1)*(sprite[ps[i].i].x-x1)+(sprite[ps[i].i].y-y1)*(sprite[ps[i].i].y-y1));
@@ -30,6 +30,10 @@ Modifications for JonoF's port by Jonathon Fowler (jf@jonof.id.au)
 #include "dnAchievement.h"
 #include "dnAPI.h"
 #include "dnMulti.h"
+#include "dnRollback.h"
+#include "dnNetInput.h"
+#include "dnDedicated.h"
+#include "dnRewind.h"
 
 #ifndef min
 # define min(a,b) ( ((a) < (b)) ? (a) : (b) )
@@ -402,6 +406,8 @@ void vscrn(void)
 {
      long i, j, ss, x1, x2, y1, y2;
 
+     if (dedicated) return;	// no video mode to fit a view into
+
 	 if(ud.screen_size < 0) ud.screen_size = 0;
 	 else if(ud.screen_size > 63) ud.screen_size = 64;
 
@@ -416,8 +422,8 @@ void vscrn(void)
      if ( ud.screen_size > 0 && ud.coop != 1 && ud.multimode > 1)
 	 {
          j = 0;
-         dnIterPlayers(i)
-             if(i > j) j = i;
+         dnIterPlaying(i)
+             if(i-dedicatedhost > j) j = i-dedicatedhost;
 
          if (j >= 1) y1 += 8;
          if (j >= 4) y1 += 8;
@@ -652,8 +658,7 @@ void resetprestat(short snum,char g)
     camsprite               =-1;
     earthquaketime          = 0;
 
-    numinterpolations = 0;
-    startofdynamicinterpolations = 0;
+    clearinterpolations();
 
     if( ( (g&MODE_EOL) != MODE_EOL && numplayers < 2) || (ud.coop != 1 && numplayers > 1) )
     {
@@ -1031,11 +1036,13 @@ void newgame(char vn,char ln,char sk)
 			getpackets();
 		}
     globalskillsound = -1;
+
+    if (ud.multimode < 2) dedicatedhost = 0;   // left over from a dedicated game's demo
     
 //    waitforeverybody(); // commented out by serge
     ready2send = 0;
 
-    if( ud.m_recstat != 2 && ud.last_level >= 0 && ud.multimode > 1 && ud.coop != 1)
+    if( ud.m_recstat != 2 && ud.last_level >= 0 && ud.multimode > 1 && ud.coop != 1 && !dedicated)
         dobonus(1);
 
     if( ln == 0 && vn == 3 && ud.multimode < 2 && ud.lockout == 0 && dnGetAddonId() == 0)
@@ -1205,6 +1212,7 @@ void resetpspritevars(char g)
 
     which_palookup = 9;
     j = connecthead;
+    if (dedicatedhost) j = dnGetNextPlayer(j);     // a dedicated host takes no spawn point
     i = headspritestat[10];
     while(i >= 0)
     {
@@ -1271,6 +1279,32 @@ void resetpspritevars(char g)
         else deletesprite(i);
         i = nexti;
     }
+
+    if (dedicatedhost)
+    {
+        // give the host a hidden sprite of its own so ps[].i stays valid,
+        // but nothing can see, touch, hurt or target it
+        j = connecthead;
+        i = EGS(ps[j].cursectnum,ps[j].posx,ps[j].posy,ps[j].posz,
+            APLAYER,0,0,0,ps[j].ang,0,0,0,10);
+        s = &sprite[i];
+
+        s->owner = i;
+        s->cstat = 32768;
+        s->xrepeat = s->yrepeat = 0;
+        s->clipdist = 0;
+        s->extra = ps[j].last_extra = max_player_health;
+        s->yvel = j;
+
+        ps[j].i = i;
+        ps[j].frag_ps = j;
+        hittype[i].owner = i;
+
+        hittype[i].bposx = ps[j].bobposx = ps[j].oposx = s->x;
+        hittype[i].bposy = ps[j].bobposy = ps[j].oposy = s->y;
+        hittype[i].bposz = ps[j].oposz = s->z;
+        ps[j].oang = s->ang;
+    }
 }
 
 void clearfrags(void)
@@ -1419,6 +1453,7 @@ void dofrontscreens(const char *statustext)
 {
     extern int megatondef;
     long i=0;
+    if (dedicated) return;
     if(ud.recstat != 2)
     {
 	if (!statustext) {
@@ -1500,6 +1535,10 @@ void clearfifo(void)
     clearbuf(syncvalhead,MAXPLAYERS,0L);
     clearbuf(myminlag,MAXPLAYERS,0L);
 
+    dnRollbackReset();
+    dnInputReset();
+    dnRewindReset();
+
 //    clearbufbyte(playerquitflag,MAXPLAYERS,0x01);
 }
 
@@ -1523,8 +1562,7 @@ void resetmys(void)
 void resetinterpolations( void ) {
 	int k, i;
 	
-	numinterpolations = 0;
-	startofdynamicinterpolations = 0;
+	clearinterpolations();
 	
 	k = headspritestat[3];
 	while(k >= 0)
@@ -1661,7 +1699,7 @@ if (!VOLUMEONE) {
 
     if(ud.recstat != 2) stopmusic();
 
-    cacheit();
+    if (!dedicated) cacheit();
 
     if(ud.recstat != 2)
     {
@@ -1707,10 +1745,12 @@ if (VOLUMEONE) {
 
      //ps[myconnectindex].palette = palette;
      //palto(0,0,0,0);
-     setgamepalette(&ps[myconnectindex], palette, 0);	// JBF 20040308
+     if (!dedicated) {
+         setgamepalette(&ps[myconnectindex], palette, 0);	// JBF 20040308
 
-     setpal(&ps[myconnectindex]);
-     flushperms();
+         setpal(&ps[myconnectindex]);
+         flushperms();
+     }
 
      everyothertime = 0;
      global_random = 0;
@@ -1726,11 +1766,13 @@ if (VOLUMEONE) {
      flushpackets();
      waitforeverybody();
 
-     palto(0,0,0,0);
-     vscrn();
-     clearview(0L);
-     drawbackground();
-     displayrooms(myconnectindex,65536);
+     if (!dedicated) {
+         palto(0,0,0,0);
+         vscrn();
+         clearview(0L);
+         drawbackground();
+         displayrooms(myconnectindex,65536);
+     }
 
      clearbufbyte(playerquitflag,MAXPLAYERS,0x01010101);
      ps[myconnectindex].over_shoulder_on = 0;
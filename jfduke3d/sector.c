@@ -199,7 +199,7 @@ char isanearoperator(short lotag)
 short checkcursectnums(short sect)
 {
     short i;
-    dnIterPlayers(i)
+    dnIterPlaying(i)
         if( sprite[ps[i].i].sectnum == sect ) return i;
     return -1;
 }
@@ -234,8 +234,9 @@ short findplayer(spritetype *s,long *d)
 
     closest = 0x7fffffff;
     closest_player = 0;
+    if (dedicatedhost && dnGetNextPlayer(0) >= 0) closest_player = dnGetNextPlayer(0);
 
-    dnIterPlayers(j)
+    dnIterPlaying(j)
     {
         x = klabs(ps[j].oposx-s->x) + klabs(ps[j].oposy-s->y) + ((klabs(ps[j].oposz-s->z+(28<<8)))>>4);
         if( x < closest && sprite[ps[j].i].extra > 0 )
@@ -257,7 +258,7 @@ short findotherplayer(short p,long *d)
     closest = 0x7fffffff;
     closest_player = p;
 
-    dnIterPlayers(j)
+    dnIterPlaying(j)
         if(p != j && sprite[ps[j].i].extra > 0)
     {
         x = klabs(ps[j].oposx-ps[p].posx) + klabs(ps[j].oposy-ps[p].posy) + (klabs(ps[j].oposz-ps[p].posz)>>4);
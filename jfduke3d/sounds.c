@@ -34,6 +34,8 @@ Modifications for JonoF's port by Jonathon Fowler (jf@jonof.id.au)
 #include "duke3d.h"
 #include "util_lib.h"
 #include "dnAchievement.h"
+#include "dnRollback.h"
+#include "dnDemo.h"
 #include "cd.h"
 
 #define LOUDESTVOLUME 150
@@ -409,6 +411,8 @@ int xyzsound(short num,short i,long x,long y,long z)
 //    if(num != 358) return 0;
 
     if( num >= NUM_SOUNDS ||
+        dnRollbackFilterSound(num,i) ||
+        dnDemoFilterSound() ||
         FXDevice < 0 ||
         ( (soundm[num]&8) && ud.lockout ) ||
         SoundToggle == 0 ||
@@ -542,6 +546,7 @@ void sound(short num)
 
     if (FXDevice < 0) return;
     if(SoundToggle==0) return;
+    if(dnRollbackFilterSound(num,-1) || dnDemoFilterSound()) return;
     if(VoiceToggle==0 && (soundm[num]&4) ) return;
     if( (soundm[num]&8) && ud.lockout ) return;
     if(FX_VoiceAvailable(soundpr[num]) == 0) return;